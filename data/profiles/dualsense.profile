@@ -72,6 +72,14 @@ StickFiltering  = true
 #   Values:  true, false (recommended: true)
 TrackpadFiltering  = true
 
+# Axis Merge
+# How inputs bound to the same absolute axis are combined, for example when 
+# two buttons or the two halves of another axis drive a single stick axis.  
+# 'Priority' uses the first non-zero input and ignores the rest.  'Sum' adds 
+# them together, so opposite directions cancel each other out.
+#   Values:  Priority, Sum (default: Priority)
+AxisMerge  = Priority
+
 
 [DeviceInfo]
 # This section allows you to set the name and USB identity of the individual 
@@ -101,6 +109,34 @@ Motion      = 0x054C 0x0CE6 0x8100 "Wireless Controller Motion Sensors"
 Mouse       = 0x054C 0x0CE6 0x8100 "Wireless Controller Touchpad"
 
 
+[OutputRate]
+# This section controls how often each input device created by the gamepad 
+# driver writes events.  By default every device writes at the controller's 
+# report rate, which can be more than games and the compositor need.  A motion
+# device read once per game frame, for example, can be slowed down to reduce 
+# the number of events they have to process.
+#
+# These are optional and will use 'Native' if undefined.
+#
+# Format:
+#   <device> = <Native | OnChange | rate>
+#
+#   device:    Which device to set.  Can be:  <Gamepad | Motion | Mouse>
+#   Native:    Write every report.
+#   OnChange:  Only write when a button, key or axis changes, or when there is
+#              relative motion.
+#   rate:      Write at most this many times per second (10 - 1000).  Button 
+#              changes are still written immediately, axes use their latest 
+#              value and relative motion is added up until the next write.
+#
+# Examples:
+#   Motion = 120
+#   Mouse = OnChange
+Gamepad     = Native
+Motion      = Native
+Mouse       = Native
+
+
 [Deadzones]
 # Axis deadzones
 # Values are floating point and represent the percentage of the total range to
@@ -197,6 +233,19 @@ ABS_RZ          = -2097152  2097152     16      1024
 #     The above line will bind the up direction on the physical dpad to the negative 
 #     (up/left) direction of an absolute axis on the gamepad device.
 #
+#     Relative axis (REL_*) bindings may optionally specify a direction and a
+#     gain multiplier.  The gain defaults to 1.0.  Without a direction, 
+#     buttons and axes move in the - direction and trackpad motion (*RelX, 
+#     *RelY) is passed through as is.
+#     Fractional movement is carried over between frames so slow motion is
+#     never lost.  REL_WHEEL and REL_HWHEEL also emit high-resolution scroll
+#     events.
+#
+#       Input = <Gamepad | Motion | Mouse> <REL_*> [ + | - ] [gain]
+#
+#     Example:
+#       RPadRelY = Mouse REL_Y - 1.5
+#
 #     There are also some standard meanings for these with regard to device 
 #     types and it is possible to configure this section which can cause very
 #     strange behaviour.
@@ -234,8 +283,65 @@ ABS_RZ          = -2097152  2097152     16      1024
 #     Example:
 #       L5 = Profile left_hand_mouse.profile
 #       
+#   Layer Bindings:
+#     Layers are alternate sets of bindings defined in the same profile, in
+#     sections named [Layer_<layer_name>].  A layer starts out with all the
+#     bindings from this section and replaces the ones it lists.  Use 'None' in
+#     a layer to unbind an input.  Switching layers is instant and doesn't
+#     reload the profile.  Up to 8 layers can be defined.
+#
+#     Format:
+#       Input = Layer <Hold | Toggle> <layer_name>
+#
+#     Hold: The layer is active while the input is held.
+#
+#     Toggle: Each press switches between the layer and these bindings.
+#
+#     Layers keep the binding that switched to them unless they replace it, so
+#     the same input can release or toggle the layer off again.
+#
+#     Example:
+#       L4 = Layer Hold Fn
+#
+#       [Layer_Fn]
+#       A = Mouse BTN_LEFT
+#
+#   Turbo, Toggle and Macro Bindings:
+#     These are run inside the driver with millisecond timing, without starting
+#     any processes.  Relative axes (REL_*) can't be used.
+#
+#     Format:
+#       Input = Turbo <rate_hz> <Gamepad | Motion | Mouse> <input_event_code> [ + | - ]
+#       Input = Toggle <Gamepad | Motion | Mouse> <input_event_code> [ + | - ]
+#       Input = Macro <macro_name>
+#
+#     Turbo: Presses and releases the event rate_hz times per second while the
+#     input is held.
+#
+#     Toggle: Each press turns the event on or off.
+#
+#     Macro: Plays the steps in the [Macro_<macro_name>] section once per press.
+#     Each step needs its own key name and steps run in the order they are
+#     listed.  Anything still pressed is released when the macro ends.
+#
+#       Press <Gamepad | Motion | Mouse> <input_event_code> [ + | - ]
+#       Release <Gamepad | Motion | Mouse> <input_event_code> [ + | - ]
+#       Tap <ms> <Gamepad | Motion | Mouse> <input_event_code> [ + | - ]
+#       Wait <ms>
+#
+#     Example:
+#       R5 = Turbo 15 Gamepad BTN_SOUTH
+#       L5 = Macro Dodge
+#
+#       [Macro_Dodge]
+#       Step1 = Press Gamepad BTN_TL
+#       Step2 = Tap 30 Gamepad BTN_EAST
+#       Step3 = Wait 20
+#       Step4 = Release Gamepad BTN_TL
+#
 #
-#   Valid binding types are:  Gamepad, Mouse, Motion, Command, Profile
+#   Valid binding types are:  Gamepad, Mouse, Motion, Command, Profile, Layer,
+#   Turbo, Toggle, Macro
 #
 #
 # Input             BindType    Mapping     +/-
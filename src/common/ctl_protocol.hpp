@@ -0,0 +1,119 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//  OpenSD
+//  An open-source userspace driver for Valve's Steam Deck hardware
+//
+//  Copyright 2022 seek
+//  https://gitlab.com/open-sd/opensd
+//  Licensed under the GNU GPLv3+
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the 
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of 
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; 
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. 
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with this program. 
+//  If not, see <https://www.gnu.org/licenses/>.             
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#ifndef __CTL_PROTOCOL_HPP__
+#define __CTL_PROTOCOL_HPP__
+
+// C++
+#include <cstdint>
+
+
+// Wire format for the daemon control socket.  Every message is a FrameHeader 
+// followed by 'size' bytes of payload.  Fields use native byte order since the
+// socket is only reachable from the local machine.
+namespace Ctl
+{
+    const uint8_t           PROTOCOL_VERSION    = 1;
+    
+    // Largest payload the daemon will accept in a single frame
+    const uint16_t          MAX_PAYLOAD_SIZE    = 512;
+    
+    enum MsgId : uint8_t
+    {
+        // Requests, answered with RESULT or STATS
+        SWITCH_PROFILE      = 0x01,     // uint8_t gamepad, followed by the profile file name
+        SET_DEADZONE        = 0x02,     // SetDeadzoneReq
+        GET_STATS           = 0x03,     // uint8_t gamepad
+        SUBSCRIBE           = 0x04,     // uint32_t mask of EventType, 0 to unsubscribe
+        
+        // Replies
+        RESULT              = 0x80,     // Result
+        STATS               = 0x81,     // Stats
+        
+        // Sent unprompted to subscribed clients
+        EVENT               = 0xc0,     // Event, followed by the profile name for PROFILE_CHANGED
+    };
+    
+    enum EventType : uint32_t
+    {
+        PROFILE_CHANGED     = (1 << 0),
+        DEVICE_ATTACHED     = (1 << 1),
+        DEVICE_DETACHED     = (1 << 2),
+        CONFIG_RELOADED     = (1 << 3),
+    };
+    
+    // Same order as Drivers::Gamepad::AxisEnum
+    enum Axis : uint8_t
+    {
+        L_STICK,
+        R_STICK,
+        L_PAD,
+        R_PAD,
+        L_TRIGG,
+        R_TRIGG
+    };
+    
+    struct FrameHeader
+    {
+        uint16_t            size;       // Payload size in bytes
+        uint8_t             id;         // MsgId
+        uint8_t             seq;        // Copied from a request to its reply, 0 for events
+    };
+    
+    struct SetDeadzoneReq
+    {
+        uint8_t             gamepad;
+        uint8_t             axis;       // Axis
+        uint8_t             reserved[2];
+        float               deadzone;   // 0.0 - 0.9
+    };
+    
+    struct Result
+    {
+        int32_t             code;       // Err:: code, Err::OK on success
+    };
+    
+    struct Stats
+    {
+        uint8_t             gamepad;
+        uint8_t             attached;
+        uint8_t             reserved[6];
+        uint64_t            reports;    // Input reports received
+        uint64_t            skipped;    // Reports skipped because nothing changed
+        uint64_t            busy_ns;    // Total time spent processing reports
+        uint64_t            max_ns;     // Longest time spent processing one report
+        uint64_t            dropped;    // Driver messages lost
+    };
+    
+    struct Event
+    {
+        uint32_t            type;       // EventType
+        uint8_t             gamepad;
+        uint8_t             reserved[3];
+    };
+    
+    static_assert( sizeof(FrameHeader) == 4, "Unexpected control frame header size" );
+    static_assert( sizeof(SetDeadzoneReq) == 8, "Unexpected control message size" );
+    static_assert( sizeof(Stats) == 48, "Unexpected control message size" );
+    static_assert( sizeof(Event) == 8, "Unexpected control message size" );
+
+} // namespace Ctl
+
+
+#endif // __CTL_PROTOCOL_HPP__
@@ -0,0 +1,58 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//  OpenSD
+//  An open-source userspace driver for Valve's Steam Deck hardware
+//
+//  Copyright 2022 seek
+//  https://gitlab.com/open-sd/opensd
+//  Licensed under the GNU GPLv3+
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the 
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of 
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; 
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. 
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with this program. 
+//  If not, see <https://www.gnu.org/licenses/>.             
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#ifndef __TRACE_HPP__
+#define __TRACE_HPP__
+
+// Static tracepoints (USDT) for perf, bpftrace and systemtap.  Built with 
+// the OPT_USDT cmake option when <sys/sdt.h> is available, otherwise they 
+// compile to nothing.  An unattached probe is a single nop, but its 
+// arguments are still evaluated, so keep them cheap.
+//
+// Probes, all under the "opensdd" provider:
+//   report_received     gamepad, frame                  Input report about to be handled
+//   state_updated       gamepad, frame                  UpdateState() finished
+//   trans_event         bind type, ev_type, ev_code,    One TransEvent() dispatch.  State is
+//                       state * 1000                    scaled since probe args are integers.
+//   uinput_flush_start  fd, event count                 Before a uinput frame is written
+//   uinput_flush_done   fd, result                      After the write, or its completion with io_uring
+//   hid_write           fd, length, result              Output report written to hidraw
+//   hid_set_feature     fd, length, result              Feature report sent to hidraw
+//   profile_set         gamepad                         Driver switched to a new profile
+//   profile_load        gamepad, file name              Daemon loaded a profile for a gamepad
+//
+// Example, uinput writes per device fd:
+//   bpftrace -e 'usdt:/usr/bin/opensdd:opensdd:uinput_flush_done { @[arg0] = count(); }'
+#if defined(OPT_USDT) && __has_include(<sys/sdt.h>)
+    #include <sys/sdt.h>
+    #define TRACE_PROBE( name )                         DTRACE_PROBE( opensdd, name )
+    #define TRACE_PROBE1( name, a )                     DTRACE_PROBE1( opensdd, name, a )
+    #define TRACE_PROBE2( name, a, b )                  DTRACE_PROBE2( opensdd, name, a, b )
+    #define TRACE_PROBE3( name, a, b, c )               DTRACE_PROBE3( opensdd, name, a, b, c )
+    #define TRACE_PROBE4( name, a, b, c, d )            DTRACE_PROBE4( opensdd, name, a, b, c, d )
+#else
+    #define TRACE_PROBE( name )                         do {} while (0)
+    #define TRACE_PROBE1( name, a )                     do {} while (0)
+    #define TRACE_PROBE2( name, a, b )                  do {} while (0)
+    #define TRACE_PROBE3( name, a, b, c )               do {} while (0)
+    #define TRACE_PROBE4( name, a, b, c, d )            do {} while (0)
+#endif
+
+
+#endif // __TRACE_HPP__
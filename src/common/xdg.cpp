@@ -21,6 +21,8 @@
 #include "log.hpp"
 // C++
 #include <cstdlib>
+// Linux
+#include <unistd.h>
 
 
 std::filesystem::path Xdg::UserHome()
@@ -155,6 +157,28 @@ std::filesystem::path Xdg::StateHome()
 
 
 
+std::filesystem::path Xdg::RuntimeDir()
+{
+    std::string     dir;
+
+    if (getenv( "XDG_RUNTIME_DIR" ))
+        dir = getenv( "XDG_RUNTIME_DIR" );
+    
+    if (!dir.empty())
+    {
+        gLog.Write( Log::DEBUG, FUNC_NAME, "XDG_RUNTIME_DIR is set to '" + dir + "'" );
+        return dir + "/";
+    }
+    
+    // There is no default in the spec, so use what systemd-logind would
+    dir = "/run/user/" + std::to_string( getuid() ) + "/";
+    gLog.Write( Log::DEBUG, FUNC_NAME, "XDG_RUNTIME_DIR is not set, using '" + dir + "'");
+    
+    return dir;
+}
+
+
+
 std::filesystem::path Xdg::SysConfigDir()
 {
     return "/etc/";
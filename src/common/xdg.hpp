@@ -33,6 +33,7 @@ namespace Xdg
     std::filesystem::path       CacheHome();
     std::filesystem::path       DataHome();
     std::filesystem::path       StateHome();
+    std::filesystem::path       RuntimeDir();
     std::filesystem::path       SysConfigDir();
     std::filesystem::path       SysDataDir();
 }
\ No newline at end of file
@@ -19,6 +19,8 @@
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 #include "config.hpp"
 #include "../common/log.hpp"
+// Linux
+#include <sched.h>
 
 
 int Config::Load( std::filesystem::path configFile )
@@ -87,7 +89,95 @@ int Config::Load( std::filesystem::path configFile )
     }
     else
         mPort = val.Int();
-
+    
+    // Driver thread scheduling.  These are all optional.
+    mThread = Drivers::ThreadConfig();
+    val = mIni.GetVal( "Daemon", "SchedPolicy" );
+    if (val.Count())
+    {
+        std::string     policy = val.String();
+        
+        if ((policy == "fifo") || (policy == "FIFO"))
+            mThread.policy = Drivers::SchedPolicy::FIFO;
+        else if ((policy == "rr") || (policy == "RR"))
+            mThread.policy = Drivers::SchedPolicy::RR;
+        else if ((policy != "other") && (policy != "OTHER"))
+            gLog.Write( Log::WARN, "Invalid 'SchedPolicy' value '" + policy + "'.  Using default value 'other'." );
+    }
+    
+    val = mIni.GetVal( "Daemon", "SchedPriority" );
+    mThread.priority = val.Count() ? val.Int() : 10;
+    if ((mThread.priority < 1) || (mThread.priority > 99))
+    {
+        gLog.Write( Log::WARN, "'SchedPriority' must be between 1 and 99.  Using default value of '10'." );
+        mThread.priority = 10;
+    }
+    
+    val = mIni.GetVal( "Daemon", "Nice" );
+    if (val.Count())
+    {
+        mThread.nice = val.Int();
+        if ((mThread.nice < -20) || (mThread.nice > 19))
+        {
+            gLog.Write( Log::WARN, "'Nice' must be between -20 and 19.  Using default value of '0'." );
+            mThread.nice = 0;
+        }
+    }
+    
+    val = mIni.GetVal( "Daemon", "CpuAffinity" );
+    for (unsigned int i = 0; i < val.Count(); ++i)
+    {
+        int     cpu = val.Int(i);
+        
+        if ((cpu < 0) || (cpu >= CPU_SETSIZE))
+        {
+            gLog.Write( Log::WARN, "Ignoring invalid 'CpuAffinity' value '" + val.String(i) + "'." );
+            continue;
+        }
+        mThread.cpus.push_back( cpu );
+    }
+    
+    val = mIni.GetVal( "Daemon", "LockMemory" );
+    mLockMemory = val.Count() ? val.Bool() : false;
+    
+    // Multiple gamepads.  These are optional, too.
+    val = mIni.GetVal( "Daemon", "MaxGamepads" );
+    if (val.Count() && (val.Int() >= 1))
+        mMaxGamepads = val.Int();
+    else
+        mMaxGamepads = 4;
+    
+    mGamepadProfiles.clear();
+    val = mIni.GetVal( "Daemon", "GamepadProfiles" );
+    for (unsigned int i = 0; i < val.Count(); ++i)
+        mGamepadProfiles.push_back( val.String(i) );
+    
+    mGamepadCpus.clear();
+    val = mIni.GetVal( "Daemon", "GamepadCpus" );
+    for (unsigned int i = 0; i < val.Count(); ++i)
+    {
+        int     cpu = val.Int(i);
+        
+        if ((cpu < 0) || (cpu >= CPU_SETSIZE))
+        {
+            gLog.Write( Log::WARN, "Invalid 'GamepadCpus' value '" + val.String(i) + "'.  Gamepads from " + std::to_string(i) + " on will not be pinned." );
+            break;
+        }
+        mGamepadCpus.push_back( cpu );
+    }
+    
+    // Flight recorder, also optional
+    val = mIni.GetVal( "Daemon", "FlightRecorder" );
+    mFlightRecorder = val.Count() ? val.Bool() : true;
+    
+    val = mIni.GetVal( "Daemon", "RecorderThreshold" );
+    if (val.Count() && (val.Int() >= 0))
+        mRecorderThreshold = val.Int();
+    else
+        mRecorderThreshold = 20;
+    
+    val = mIni.GetVal( "Daemon", "KeepDevices" );
+    mKeepDevices = val.Count() ? val.Bool() : true;
     
     return Err::OK;
 }
@@ -145,6 +235,11 @@ Config::Config()
 {
     mAllowClients   = false;
     mPort           = 0;
+    mLockMemory     = false;
+    mMaxGamepads    = 4;
+    mFlightRecorder = true;
+    mRecorderThreshold = 20;
+    mKeepDevices    = true;
 }
 
 
@@ -22,8 +22,10 @@
 
 #include "../common/ini.hpp"
 #include "../common/errors.hpp"
+#include "drivers/thread_config.hpp"
 #include <cstdint>
 #include <string>
+#include <vector>
 #include <filesystem>
 
 
@@ -36,6 +38,14 @@ public:
     bool                mAllowClients;
     uint16_t            mPort;
     std::string         mProfileName;
+    Drivers::ThreadConfig mThread;
+    bool                mLockMemory;            // Lock the daemon's pages in RAM
+    unsigned int        mMaxGamepads;
+    std::vector<std::string> mGamepadProfiles;     // Profile for each gamepad, by index
+    std::vector<int>    mGamepadCpus;           // CPU each gamepad driver thread is pinned to, by index
+    bool                mFlightRecorder;
+    unsigned int        mRecorderThreshold;     // In milliseconds, 0 disables automatic dumps
+    bool                mKeepDevices;           // Park the virtual devices in the systemd fd store on exit
 
     int                 Load( std::filesystem::path configFile );
     int                 Save( std::filesystem::path configFile );
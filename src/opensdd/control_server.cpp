@@ -0,0 +1,440 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//  OpenSD
+//  An open-source userspace driver for Valve's Steam Deck hardware
+//
+//  Copyright 2022 seek
+//  https://gitlab.com/open-sd/opensd
+//  Licensed under the GNU GPLv3+
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the 
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of 
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; 
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. 
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with this program. 
+//  If not, see <https://www.gnu.org/licenses/>.             
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#include "control_server.hpp"
+#include "../common/log.hpp"
+#include "../common/errors.hpp"
+// Linux
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+// C++
+#include <algorithm>
+#include <cstring>
+
+
+const unsigned int      CTL_MAX_CLIENTS     = 16;
+// Clients that stop reading are dropped once this much is queued for them
+const size_t            CTL_MAX_BACKLOG     = 64 * 1024;
+
+
+
+int ControlServer::Listen( int domain, const void* pAddr, unsigned int addrLen )
+{
+    epoll_event     ev = {};
+    int             fd;
+    int             on = 1;
+    
+    fd = socket( domain, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+    if (fd < 0)
+    {
+        int e = errno;
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to create control socket: " + Err::GetErrnoString(e) );
+        return -1;
+    }
+    
+    if (domain == AF_INET)
+        setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on) );
+    
+    if ((bind( fd, (const sockaddr*)pAddr, addrLen ) < 0) || (listen( fd, 8 ) < 0))
+    {
+        int e = errno;
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to listen on control socket: " + Err::GetErrnoString(e) );
+        close( fd );
+        return -1;
+    }
+    
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    if (epoll_ctl( mEpollFd, EPOLL_CTL_ADD, fd, &ev ) < 0)
+    {
+        int e = errno;
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to watch control socket: " + Err::GetErrnoString(e) );
+        close( fd );
+        return -1;
+    }
+    
+    return fd;
+}
+
+
+
+void ControlServer::Accept( int listenFd )
+{
+    while (true)
+    {
+        epoll_event     ev = {};
+        int             fd;
+        int             on = 1;
+        
+        fd = accept4( listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC );
+        if (fd < 0)
+        {
+            int e = errno;
+            if ((e != EAGAIN) && (e != EWOULDBLOCK) && (e != EINTR))
+                gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to accept control client: " + Err::GetErrnoString(e) );
+            return;
+        }
+        
+        if (mClients.size() >= CTL_MAX_CLIENTS)
+        {
+            gLog.Write( Log::WARN, "Too many control clients.  Refusing connection." );
+            close( fd );
+            continue;
+        }
+        
+        // Replies are small and latency matters more than throughput
+        if (listenFd == mTcpFd)
+            setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on) );
+        
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        ev.data.fd = fd;
+        if (epoll_ctl( mEpollFd, EPOLL_CTL_ADD, fd, &ev ) < 0)
+        {
+            int e = errno;
+            gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to watch control client: " + Err::GetErrnoString(e) );
+            close( fd );
+            continue;
+        }
+        
+        mClients.push_back( { .fd = fd, .events = 0, .rx = {}, .tx = {}, .writing = false } );
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Control client connected on fd " + std::to_string(fd) + "." );
+    }
+}
+
+
+
+ControlServer::Client* ControlServer::FindClient( int fd )
+{
+    for (auto& i : mClients)
+        if (i.fd == fd)
+            return &i;
+    
+    return nullptr;
+}
+
+
+
+void ControlServer::Drop( int fd )
+{
+    for (auto i = mClients.begin(); i != mClients.end(); ++i)
+    {
+        if (i->fd != fd)
+            continue;
+        
+        epoll_ctl( mEpollFd, EPOLL_CTL_DEL, fd, nullptr );
+        close( fd );
+        mClients.erase( i );
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Control client on fd " + std::to_string(fd) + " disconnected." );
+        return;
+    }
+}
+
+
+
+int ControlServer::Flush( Client& rClient )
+{
+    size_t          sent = 0;
+    bool            writing;
+    
+    while (sent < rClient.tx.size())
+    {
+        ssize_t     result;
+        
+        result = send( rClient.fd, rClient.tx.data() + sent, rClient.tx.size() - sent, MSG_DONTWAIT | MSG_NOSIGNAL );
+        if (result < 0)
+        {
+            int e = errno;
+            if (e == EINTR)
+                continue;
+            if ((e == EAGAIN) || (e == EWOULDBLOCK))
+                break;
+            gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to write to control client: " + Err::GetErrnoString(e) );
+            return Err::WRITE_FAILED;
+        }
+        sent += result;
+    }
+    rClient.tx.erase( rClient.tx.begin(), rClient.tx.begin() + sent );
+    
+    // Only wait for the socket to become writable while there's a backlog
+    writing = !rClient.tx.empty();
+    if (writing != rClient.writing)
+    {
+        epoll_event     ev = {};
+        
+        ev.events = EPOLLIN | EPOLLRDHUP | (writing ? (uint32_t)EPOLLOUT : 0);
+        ev.data.fd = rClient.fd;
+        epoll_ctl( mEpollFd, EPOLL_CTL_MOD, rClient.fd, &ev );
+        rClient.writing = writing;
+    }
+    
+    return Err::OK;
+}
+
+
+
+void ControlServer::Receive( Client& rClient, std::vector<Request>& rRequests )
+{
+    int             fd = rClient.fd;
+    uint8_t         buff[1024];
+    
+    while (true)
+    {
+        Ctl::FrameHeader    hdr;
+        size_t              offset = 0;
+        ssize_t             result;
+        
+        result = recv( fd, buff, sizeof(buff), MSG_DONTWAIT );
+        if (result < 0)
+        {
+            int e = errno;
+            if (e == EINTR)
+                continue;
+            if ((e == EAGAIN) || (e == EWOULDBLOCK))
+                return;
+            gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to read from control client: " + Err::GetErrnoString(e) );
+            Drop( fd );
+            return;
+        }
+        if (result == 0)
+        {
+            Drop( fd );
+            return;
+        }
+        rClient.rx.insert( rClient.rx.end(), buff, buff + result );
+        
+        // Split off complete frames
+        while (rClient.rx.size() - offset >= sizeof(hdr))
+        {
+            memcpy( &hdr, rClient.rx.data() + offset, sizeof(hdr) );
+            if (hdr.size > Ctl::MAX_PAYLOAD_SIZE)
+            {
+                gLog.Write( Log::WARN, "Control client sent an oversized message.  Disconnecting." );
+                Drop( fd );
+                return;
+            }
+            if (rClient.rx.size() - offset < sizeof(hdr) + hdr.size)
+                break;
+            
+            offset += sizeof(hdr);
+            rRequests.push_back( { .client = fd, .id = hdr.id, .seq = hdr.seq, 
+                                   .payload = std::vector<uint8_t>( rClient.rx.begin() + offset, rClient.rx.begin() + offset + hdr.size ) } );
+            offset += hdr.size;
+        }
+        rClient.rx.erase( rClient.rx.begin(), rClient.rx.begin() + offset );
+    }
+}
+
+
+
+int ControlServer::Open( int epollFd, std::filesystem::path unixPath, uint16_t tcpPort )
+{
+    sockaddr_un     unaddr = {};
+    sockaddr_in     inaddr = {};
+    std::error_code ec;
+    
+    Close();
+    mEpollFd = epollFd;
+    
+    if (unixPath.string().size() < sizeof(unaddr.sun_path))
+    {
+        // Remove a stale socket left by a previous run
+        std::filesystem::remove( unixPath, ec );
+        
+        unaddr.sun_family = AF_UNIX;
+        strncpy( unaddr.sun_path, unixPath.c_str(), sizeof(unaddr.sun_path) - 1 );
+        mUnixFd = Listen( AF_UNIX, &unaddr, sizeof(unaddr) );
+        if (mUnixFd >= 0)
+        {
+            mUnixPath = unixPath;
+            gLog.Write( Log::INFO, "Accepting control clients on '" + unixPath.string() + "'." );
+        }
+        else
+            gLog.Write( Log::WARN, "Failed to open control socket '" + unixPath.string() + "'." );
+    }
+    else
+        gLog.Write( Log::WARN, "Control socket path '" + unixPath.string() + "' is too long." );
+    
+    // Only ever reachable from this machine
+    if (tcpPort)
+    {
+        inaddr.sin_family = AF_INET;
+        inaddr.sin_port = htons( tcpPort );
+        inaddr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+        mTcpFd = Listen( AF_INET, &inaddr, sizeof(inaddr) );
+        if (mTcpFd >= 0)
+            gLog.Write( Log::INFO, "Accepting control clients on localhost port " + std::to_string(tcpPort) + "." );
+        else
+            gLog.Write( Log::WARN, "Failed to listen on localhost port " + std::to_string(tcpPort) + "." );
+    }
+    
+    if ((mUnixFd < 0) && (mTcpFd < 0))
+        return Err::CANNOT_OPEN;
+    
+    return Err::OK;
+}
+
+
+
+void ControlServer::Close()
+{
+    std::error_code     ec;
+    
+    while (!mClients.empty())
+        Drop( mClients.back().fd );
+    
+    if (mUnixFd >= 0)
+    {
+        close( mUnixFd );
+        std::filesystem::remove( mUnixPath, ec );
+    }
+    if (mTcpFd >= 0)
+        close( mTcpFd );
+    
+    mUnixFd = mTcpFd = -1;
+    mUnixPath.clear();
+}
+
+
+
+bool ControlServer::OwnsFd( int fd )
+{
+    if (fd < 0)
+        return false;
+    if ((fd == mUnixFd) || (fd == mTcpFd))
+        return true;
+    
+    return (FindClient( fd ) != nullptr);
+}
+
+
+
+void ControlServer::HandleEvent( int fd, uint32_t events, std::vector<Request>& rRequests )
+{
+    Client*         pclient;
+    
+    if ((fd == mUnixFd) || (fd == mTcpFd))
+    {
+        Accept( fd );
+        return;
+    }
+    
+    pclient = FindClient( fd );
+    if (pclient == nullptr)
+        return;
+    
+    // Read whatever is left before noticing the hangup
+    if (events & EPOLLIN)
+    {
+        Receive( *pclient, rRequests );
+        pclient = FindClient( fd );
+        if (pclient == nullptr)
+            return;
+    }
+    
+    if (events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP))
+    {
+        Drop( fd );
+        return;
+    }
+    
+    if (events & EPOLLOUT)
+        if (Flush( *pclient ) != Err::OK)
+            Drop( fd );
+}
+
+
+
+void ControlServer::Send( int client, uint8_t id, uint8_t seq, const void* pPayload, uint16_t size, const std::string& rExtra )
+{
+    Ctl::FrameHeader    hdr;
+    Client*             pclient;
+    size_t              extra;
+    
+    pclient = FindClient( client );
+    if (pclient == nullptr)
+        return;
+    
+    extra = std::min<size_t>( rExtra.size(), Ctl::MAX_PAYLOAD_SIZE - size );
+    hdr.size = size + extra;
+    hdr.id = id;
+    hdr.seq = seq;
+    
+    pclient->tx.insert( pclient->tx.end(), (const uint8_t*)&hdr, (const uint8_t*)&hdr + sizeof(hdr) );
+    pclient->tx.insert( pclient->tx.end(), (const uint8_t*)pPayload, (const uint8_t*)pPayload + size );
+    pclient->tx.insert( pclient->tx.end(), rExtra.begin(), rExtra.begin() + extra );
+    
+    if (Flush( *pclient ) != Err::OK)
+    {
+        Drop( client );
+        return;
+    }
+    
+    if (pclient->tx.size() > CTL_MAX_BACKLOG)
+    {
+        gLog.Write( Log::WARN, "Control client is not reading its messages.  Disconnecting." );
+        Drop( client );
+    }
+}
+
+
+
+void ControlServer::SetSubscription( int client, uint32_t events )
+{
+    Client*         pclient = FindClient( client );
+    
+    if (pclient != nullptr)
+        pclient->events = events;
+}
+
+
+
+void ControlServer::Broadcast( uint32_t type, uint8_t gamepad, const std::string& rExtra )
+{
+    Ctl::Event          ev = { .type = type, .gamepad = gamepad, .reserved = {} };
+    std::vector<int>    fds;
+    
+    // Send() may drop clients, so don't walk the list while sending
+    for (auto& i : mClients)
+        if (i.events & type)
+            fds.push_back( i.fd );
+    
+    for (auto& i : fds)
+        Send( i, Ctl::EVENT, 0, &ev, sizeof(ev), rExtra );
+}
+
+
+
+ControlServer::ControlServer()
+{
+    mEpollFd    = -1;
+    mUnixFd     = -1;
+    mTcpFd      = -1;
+}
+
+
+
+ControlServer::~ControlServer()
+{
+    Close();
+}
@@ -0,0 +1,87 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//  OpenSD
+//  An open-source userspace driver for Valve's Steam Deck hardware
+//
+//  Copyright 2022 seek
+//  https://gitlab.com/open-sd/opensd
+//  Licensed under the GNU GPLv3+
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the 
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of 
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; 
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. 
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with this program. 
+//  If not, see <https://www.gnu.org/licenses/>.             
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#ifndef __CONTROL_SERVER_HPP__
+#define __CONTROL_SERVER_HPP__
+
+#include "../common/ctl_protocol.hpp"
+// C++
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+
+// Accepts control clients on a Unix socket and optionally on a localhost TCP
+// port.  All sockets are non-blocking and are watched by the caller's epoll
+// set, so requests are read and answered on the daemon thread.
+class ControlServer
+{
+public:
+    // A complete request frame read from a client
+    struct Request
+    {
+        int                         client;     // Client fd, used to reply
+        uint8_t                     id;         // Ctl::MsgId
+        uint8_t                     seq;
+        std::vector<uint8_t>        payload;
+    };
+    
+private:
+    struct Client
+    {
+        int                         fd;
+        uint32_t                    events;     // Subscribed Ctl::EventType mask
+        std::vector<uint8_t>        rx;         // Partial frames
+        std::vector<uint8_t>        tx;         // Data the socket wasn't ready for
+        bool                        writing;    // Waiting for EPOLLOUT
+    };
+    
+    int                             mEpollFd;
+    int                             mUnixFd;
+    int                             mTcpFd;
+    std::filesystem::path           mUnixPath;
+    std::vector<Client>             mClients;
+    
+    int                             Listen( int domain, const void* pAddr, unsigned int addrLen );
+    void                            Accept( int listenFd );
+    Client*                         FindClient( int fd );
+    void                            Drop( int fd );
+    int                             Flush( Client& rClient );
+    void                            Receive( Client& rClient, std::vector<Request>& rRequests );
+    
+public:
+    // tcpPort 0 disables the TCP listener
+    int                             Open( int epollFd, std::filesystem::path unixPath, uint16_t tcpPort );
+    void                            Close();
+    bool                            OwnsFd( int fd );
+    // Handles epoll events for one of our fds and appends any complete requests
+    void                            HandleEvent( int fd, uint32_t events, std::vector<Request>& rRequests );
+    void                            Send( int client, uint8_t id, uint8_t seq, const void* pPayload, uint16_t size, 
+                                          const std::string& rExtra = "" );
+    void                            SetSubscription( int client, uint32_t events );
+    // Sends an event to every client subscribed to it
+    void                            Broadcast( uint32_t type, uint8_t gamepad, const std::string& rExtra = "" );
+    
+    ControlServer();
+    ~ControlServer();
+};
+
+
+#endif // __CONTROL_SERVER_HPP__
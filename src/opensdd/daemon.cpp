@@ -21,47 +21,41 @@
 #include "profile_ini.hpp"
 #include "../common/log.hpp"
 #include "../common/errors.hpp"
+#include "../common/xdg.hpp"
+#include "../common/trace.hpp"
 // Linux
 #include <signal.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+// C++
+#include <cstring>
 
 
-// Global flag to stop daemon
-bool gDaemonRunning = true;
-
-
-void sig_handler( int sig )
-{
-    switch (sig)
-    {
-        case SIGINT:
-        case SIGTERM:
-        case SIGKILL:
-            gDaemonRunning = false;
-        break;
-        
-        default:
-            // no other handlers
-        break;
-    }
-}
+const int           DAEMON_MAX_EVENTS = 8;
+// How long --takeover waits for the running daemon to stop its drivers, in seconds
+const int           DAEMON_HANDOFF_TIMEOUT = 5;
 
 
 
-int Daemon::LoadProfile( std::string fileName )
+int Daemon::LoadProfile( Drivers::Gamepad::Driver* pDrv, std::string fileName )
 {
     namespace       fs = std::filesystem;
     fs::path        path;
     int             result;
     
     // Make sure we have a gamepad object first
-    if (mpGpDrv == nullptr)
+    if (pDrv == nullptr)
     {
         gLog.Write( Log::DEBUG, FUNC_NAME, "Gamepad driver object does not exist." );
         gLog.Write( Log::ERROR, "Failed to load profile: Initialization error." );
         return Err::NOT_INITIALIZED;
     }
     
-    gLog.Write( Log::INFO, "Loading gamepad profile '" + fileName + "'..." );
+    gLog.Write( Log::INFO, "Loading gamepad profile '" + fileName + "' for gamepad " + std::to_string(pDrv->GetIndex()) + "..." );
 
     // Get the full file path for the profile
     path = mFileMgr.GetProfileFilePath( fileName );
@@ -81,21 +75,649 @@ int Daemon::LoadProfile( std::string fileName )
         gLog.Write( Log::ERROR, "Failed to load gamepad profile." );
         return Err::NOT_INITIALIZED;
     }
-    mpGpDrv->SetProfile( profile );
+    pDrv->SetProfile( profile );
+    for (auto& i : mGamepads)
+        if (i.pDrv == pDrv)
+            i.profile = fileName;
+    TRACE_PROBE2( profile_load, pDrv->GetIndex(), fileName.c_str() );
+    mControl.Broadcast( Ctl::PROFILE_CHANGED, pDrv->GetIndex(), fileName );
+    
+    return Err::OK;
+}
+
+
+
+std::string Daemon::GetProfileName( unsigned int index )
+{
+    // Per-gamepad profiles fall back to the main one
+    if ((index < mConfig.mGamepadProfiles.size()) && (!mConfig.mGamepadProfiles[index].empty()))
+        return mConfig.mGamepadProfiles[index];
+    
+    return mConfig.mProfileName;
+}
+
+
+
+int Daemon::AddGamepads()
+{
+    unsigned int    count;
+    epoll_event     ev = {};
+    
+    // One driver instance per compatible interface, but always at least one
+    // so a controller that shows up later is picked up
+    count = Drivers::Gamepad::Driver::CountDevices();
+    if (count < 1)
+        count = 1;
+    if (count > mConfig.mMaxGamepads)
+        count = mConfig.mMaxGamepads;
+    
+    while (mGamepads.size() < count)
+    {
+        Gamepad                     gp = { .pDrv = nullptr, .msg_dropped = 0, .profile = "" };
+        unsigned int                index = mGamepads.size();
+        Drivers::ThreadConfig       thread_cfg = mConfig.mThread;
+        std::string                 prefix = "gp" + std::to_string(index) + ".";
+        
+        // Keep a profile switched to at runtime across a restart, unless the
+        // config now asks for a different one
+        gp.profile = GetProfileName( index );
+        if ((!mHandoff.GetValue( prefix + "profile" ).empty()) && (mHandoff.GetValue( prefix + "configured" ) == gp.profile))
+            gp.profile = mHandoff.GetValue( prefix + "profile" );
+        
+        gLog.Write( Log::INFO, "Creating gamepad driver object " + std::to_string(index) + "..." );
+        try 
+        {
+            gp.pDrv = new Drivers::Gamepad::Driver( index, &mHandoff );
+        }
+        catch (...)
+        {
+            gLog.Write( Log::ERROR, "Failed to create gamepad driver object." );
+            return Err::CANNOT_CREATE;
+        }
+        
+        // Wake up when the driver has a message for us
+        ev.events = EPOLLIN;
+        ev.data.fd = gp.pDrv->GetMessageFd();
+        if (epoll_ctl( mEpollFd, EPOLL_CTL_ADD, ev.data.fd, &ev ) < 0)
+        {
+            int e = errno;
+            gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to watch gamepad driver messages: " + Err::GetErrnoString(e) );
+            gLog.Write( Log::ERROR, "Failed to initialize daemon event loop." );
+            delete gp.pDrv;
+            return Err::INIT_FAILED;
+        }
+        
+        // Load gamepad driver profile
+        if (LoadProfile( gp.pDrv, gp.profile ) != Err::OK)
+        {
+            epoll_ctl( mEpollFd, EPOLL_CTL_DEL, ev.data.fd, nullptr );
+            delete gp.pDrv;
+            return Err::CANNOT_OPEN;
+        }
+        
+        // Pin each gamepad to its own CPU if asked to
+        if (index < mConfig.mGamepadCpus.size())
+            thread_cfg.cpus = { mConfig.mGamepadCpus[index] };
+        
+        // Publish live state for clients
+        if (mConfig.mAllowClients)
+            gp.pDrv->EnableSharedState();
+        
+        if (mConfig.mFlightRecorder)
+            gp.pDrv->EnableRecorder( mConfig.mRecorderThreshold );
+        
+        // Start threaded driver
+        gLog.Write( Log::INFO, "Starting gamepad driver " + std::to_string(index) + "..." );
+        gp.pDrv->SetThreadConfig( thread_cfg );
+        gp.pDrv->Start();
+        mGamepads.push_back( gp );
+    }
+    
+    return Err::OK;
+}
+
+
+
+std::filesystem::path Daemon::GetRuntimeDir()
+{
+    namespace       fs = std::filesystem;
+    fs::path        dir;
+    std::error_code ec;
+    
+    // Only the user running the daemon can get at the directory
+    dir = Xdg::RuntimeDir() / "opensdd";
+    fs::create_directories( dir, ec );
+    fs::permissions( dir, fs::perms::owner_all, ec );
+    
+    return dir;
+}
+
+
+
+int Daemon::OpenStateSocket()
+{
+    namespace       fs = std::filesystem;
+    sockaddr_un     addr = {};
+    epoll_event     ev = {};
+    std::error_code ec;
+    
+    mStateSockPath = GetRuntimeDir() / "state.sock";
+    if (mStateSockPath.string().size() >= sizeof(addr.sun_path))
+    {
+        gLog.Write( Log::ERROR, "State socket path '" + mStateSockPath.string() + "' is too long." );
+        return Err::INVALID_PARAMETER;
+    }
+    
+    // Remove a stale socket left by a previous run
+    fs::remove( mStateSockPath, ec );
+    
+    mStateSockFd = socket( AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+    if (mStateSockFd < 0)
+    {
+        int e = errno;
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to create state socket: " + Err::GetErrnoString(e) );
+        return Err::CANNOT_CREATE;
+    }
+    
+    addr.sun_family = AF_UNIX;
+    strncpy( addr.sun_path, mStateSockPath.c_str(), sizeof(addr.sun_path) - 1 );
+    if ((bind( mStateSockFd, (sockaddr*)&addr, sizeof(addr) ) < 0) || (listen( mStateSockFd, 8 ) < 0))
+    {
+        int e = errno;
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to listen on '" + mStateSockPath.string() + "': " + Err::GetErrnoString(e) );
+        CloseStateSocket();
+        return Err::CANNOT_OPEN;
+    }
+    
+    ev.events = EPOLLIN;
+    ev.data.fd = mStateSockFd;
+    epoll_ctl( mEpollFd, EPOLL_CTL_ADD, mStateSockFd, &ev );
+    gLog.Write( Log::INFO, "Publishing gamepad state on '" + mStateSockPath.string() + "'." );
+    
+    return Err::OK;
+}
+
+
+
+void Daemon::CloseStateSocket()
+{
+    std::error_code     ec;
+    
+    if (mStateSockFd < 0)
+        return;
+    
+    close( mStateSockFd );
+    mStateSockFd = -1;
+    std::filesystem::remove( mStateSockPath, ec );
+}
+
+
+
+void Daemon::HandleStateClients()
+{
+    using namespace Drivers::Gamepad;
+    
+    while (true)
+    {
+        SharedStateHandoff      hdr = { .magic = SHARED_STATE_MAGIC, .version = SHARED_STATE_VERSION, .count = 0 };
+        int                     fds[SHARED_STATE_MAX_FDS];
+        char                    cbuff[CMSG_SPACE(sizeof(fds))] = {};
+        iovec                   iov = { .iov_base = &hdr, .iov_len = sizeof(hdr) };
+        msghdr                  msg = {};
+        cmsghdr*                pcmsg;
+        int                     client;
+        
+        client = accept4( mStateSockFd, nullptr, nullptr, SOCK_CLOEXEC );
+        if (client < 0)
+        {
+            int e = errno;
+            if ((e != EAGAIN) && (e != EWOULDBLOCK) && (e != EINTR))
+                gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to accept state client: " + Err::GetErrnoString(e) );
+            return;
+        }
+        
+        for (auto& i : mGamepads)
+            if ((i.pDrv->GetSharedStateFd() >= 0) && (hdr.count < SHARED_STATE_MAX_FDS))
+                fds[hdr.count++] = i.pDrv->GetSharedStateFd();
+        
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        if (hdr.count)
+        {
+            msg.msg_control = cbuff;
+            msg.msg_controllen = CMSG_SPACE(sizeof(int) * hdr.count);
+            pcmsg = CMSG_FIRSTHDR( &msg );
+            pcmsg->cmsg_level = SOL_SOCKET;
+            pcmsg->cmsg_type = SCM_RIGHTS;
+            pcmsg->cmsg_len = CMSG_LEN(sizeof(int) * hdr.count);
+            memcpy( CMSG_DATA(pcmsg), fds, sizeof(int) * hdr.count );
+        }
+        
+        if (sendmsg( client, &msg, MSG_DONTWAIT | MSG_NOSIGNAL ) < 0)
+        {
+            int e = errno;
+            gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to send shared state to client: " + Err::GetErrnoString(e) );
+        }
+        else
+            gLog.Write( Log::VERB, FUNC_NAME, "Sent " + std::to_string(hdr.count) + " shared state segment(s) to client." );
+        
+        close( client );
+    }
+}
+
+
+
+int Daemon::ReceiveHandoff()
+{
+    sockaddr_un     addr = {};
+    timeval         timeout = { .tv_sec = DAEMON_HANDOFF_TIMEOUT, .tv_usec = 0 };
+    std::string     path = (GetRuntimeDir() / "handoff.sock").string();
+    int             sock;
+    int             result;
+    
+    
+    if (path.size() >= sizeof(addr.sun_path))
+    {
+        gLog.Write( Log::ERROR, "Handoff socket path '" + path + "' is too long." );
+        return Err::INVALID_PARAMETER;
+    }
+    
+    sock = socket( AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0 );
+    if (sock < 0)
+    {
+        int e = errno;
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to create handoff socket: " + Err::GetErrnoString(e) );
+        return Err::CANNOT_CREATE;
+    }
+    
+    // The running daemon stops its drivers before it answers
+    setsockopt( sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout) );
+    addr.sun_family = AF_UNIX;
+    strncpy( addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1 );
+    gLog.Write( Log::INFO, "Taking over from the running daemon..." );
+    if (connect( sock, (sockaddr*)&addr, sizeof(addr) ) < 0)
+    {
+        int e = errno;
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to connect to '" + path + "': " + Err::GetErrnoString(e) );
+        gLog.Write( Log::WARN, "No running daemon to take over from.  Starting normally." );
+        close( sock );
+        return Err::NOT_FOUND;
+    }
+    
+    result = mHandoff.Receive( sock );
+    close( sock );
+    if (result != Err::OK)
+        gLog.Write( Log::WARN, "Failed to take over from the running daemon.  Starting normally." );
+    
+    return result;
+}
+
+
+
+int Daemon::OpenHandoffSocket()
+{
+    namespace       fs = std::filesystem;
+    sockaddr_un     addr = {};
+    epoll_event     ev = {};
+    std::error_code ec;
+    
+    mHandoffSockPath = GetRuntimeDir() / "handoff.sock";
+    if (mHandoffSockPath.string().size() >= sizeof(addr.sun_path))
+    {
+        gLog.Write( Log::ERROR, "Handoff socket path '" + mHandoffSockPath.string() + "' is too long." );
+        return Err::INVALID_PARAMETER;
+    }
+    
+    // Remove a stale socket left by a previous run
+    fs::remove( mHandoffSockPath, ec );
+    
+    mHandoffSockFd = socket( AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+    if (mHandoffSockFd < 0)
+    {
+        int e = errno;
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to create handoff socket: " + Err::GetErrnoString(e) );
+        return Err::CANNOT_CREATE;
+    }
+    
+    addr.sun_family = AF_UNIX;
+    strncpy( addr.sun_path, mHandoffSockPath.c_str(), sizeof(addr.sun_path) - 1 );
+    if ((bind( mHandoffSockFd, (sockaddr*)&addr, sizeof(addr) ) < 0) || (listen( mHandoffSockFd, 1 ) < 0))
+    {
+        int e = errno;
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to listen on '" + mHandoffSockPath.string() + "': " + Err::GetErrnoString(e) );
+        CloseHandoffSocket();
+        return Err::CANNOT_OPEN;
+    }
+    
+    ev.events = EPOLLIN;
+    ev.data.fd = mHandoffSockFd;
+    epoll_ctl( mEpollFd, EPOLL_CTL_ADD, mHandoffSockFd, &ev );
     
     return Err::OK;
 }
 
 
 
+void Daemon::CloseHandoffSocket()
+{
+    std::error_code     ec;
+    
+    if (mHandoffSockFd < 0)
+        return;
+    
+    close( mHandoffSockFd );
+    mHandoffSockFd = -1;
+    std::filesystem::remove( mHandoffSockPath, ec );
+}
+
+
+
+void Daemon::HandleHandoff()
+{
+    ucred           cred = {};
+    socklen_t       len = sizeof(cred);
+    int             client;
+    
+    
+    client = accept4( mHandoffSockFd, nullptr, nullptr, SOCK_CLOEXEC );
+    if (client < 0)
+    {
+        int e = errno;
+        if ((e != EAGAIN) && (e != EWOULDBLOCK) && (e != EINTR))
+            gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to accept handoff client: " + Err::GetErrnoString(e) );
+        return;
+    }
+    
+    // The runtime directory is private already, but be sure
+    if ((getsockopt( client, SOL_SOCKET, SO_PEERCRED, &cred, &len ) < 0) || (cred.uid != getuid()))
+    {
+        gLog.Write( Log::WARN, "Refused to hand devices over to another user." );
+        close( client );
+        return;
+    }
+    
+    gLog.Write( Log::INFO, "Handing devices over to the new daemon (pid " + std::to_string(cred.pid) + ")..." );
+    ReleaseDevices( mHandoff, false );
+    
+    // Get out of the new daemon's way before it opens its own sockets
+    CloseStateSocket();
+    mControl.Close();
+    CloseHandoffSocket();
+    
+    if (mHandoff.Send( client ) != Err::OK)
+        gLog.Write( Log::ERROR, "Failed to hand devices over to the new daemon." );
+    close( client );
+    
+    mRunning = false;
+}
+
+
+
+void Daemon::ReleaseDevices( Handoff& rOut, bool restoreLizard )
+{
+    // Nothing may touch the devices while they change hands
+    for (auto& i : mGamepads)
+        i.pDrv->Stop();
+    
+    for (auto& i : mGamepads)
+    {
+        std::string     prefix = "gp" + std::to_string(i.pDrv->GetIndex()) + ".";
+        
+        i.pDrv->Release( rOut, restoreLizard );
+        rOut.SetValue( prefix + "profile", i.profile );
+        rOut.SetValue( prefix + "configured", GetProfileName( i.pDrv->GetIndex() ) );
+    }
+    
+    mHandedOff = true;
+}
+
+
+
+int Daemon::Reload()
+{
+    int             result;
+    
+    gLog.Write( Log::INFO, "Reloading config file..." );
+    result = mConfig.Load( mFileMgr.GetConfigFilePath() );
+    if (result != Err::OK)
+    {
+        gLog.Write( Log::ERROR, "Failed to reload config file." );
+        return result;
+    }
+    
+    for (auto& i : mGamepads)
+        LoadProfile( i.pDrv, GetProfileName( i.pDrv->GetIndex() ) );
+    
+    // Pick up any controllers that were added since
+    result = AddGamepads();
+    mControl.Broadcast( Ctl::CONFIG_RELOADED, 0 );
+    
+    return result;
+}
+
+
+
+void Daemon::HandleControlRequest( const ControlServer::Request& rReq )
+{
+    Ctl::Result                 res = { .code = Err::OK };
+    Drivers::Gamepad::Driver*   pdrv = nullptr;
+    
+    // Every request starts with the gamepad number, except SUBSCRIBE
+    if ((rReq.id != Ctl::SUBSCRIBE) && (rReq.payload.size()))
+        for (auto& i : mGamepads)
+            if (i.pDrv->GetIndex() == rReq.payload[0])
+                pdrv = i.pDrv;
+    
+    switch (rReq.id)
+    {
+        case Ctl::SWITCH_PROFILE:
+        {
+            std::string     name( rReq.payload.begin() + (rReq.payload.size() ? 1 : 0), rReq.payload.end() );
+            
+            // Only plain file names from the profile directories
+            if (name.empty() || (name.find( '/' ) != std::string::npos))
+                res.code = Err::INVALID_PARAMETER;
+            else if (pdrv == nullptr)
+                res.code = Err::NOT_FOUND;
+            else
+            {
+                gLog.Write( Log::DEBUG, FUNC_NAME, "Control client requested profile '" + name + "'." );
+                res.code = LoadProfile( pdrv, name );
+            }
+        }
+        break;
+        
+        case Ctl::SET_DEADZONE:
+        {
+            Ctl::SetDeadzoneReq     req;
+            
+            if (rReq.payload.size() != sizeof(req))
+                res.code = Err::INVALID_FORMAT;
+            else if (pdrv == nullptr)
+                res.code = Err::NOT_FOUND;
+            else
+            {
+                memcpy( &req, rReq.payload.data(), sizeof(req) );
+                if (req.axis > Ctl::R_TRIGG)
+                    res.code = Err::INVALID_PARAMETER;
+                else
+                    res.code = pdrv->QueueDeadzone( (Drivers::Gamepad::AxisEnum)req.axis, req.deadzone );
+            }
+        }
+        break;
+        
+        case Ctl::GET_STATS:
+            if (rReq.payload.size() != 1)
+                res.code = Err::INVALID_FORMAT;
+            else if (pdrv == nullptr)
+                res.code = Err::NOT_FOUND;
+            else
+            {
+                Drivers::Gamepad::DriverStats   stats = pdrv->GetStats();
+                Ctl::Stats                      reply = {};
+                
+                reply.gamepad   = pdrv->GetIndex();
+                reply.attached  = pdrv->IsAttached();
+                reply.reports   = stats.reports;
+                reply.skipped   = stats.skipped;
+                reply.busy_ns   = stats.busy_ns;
+                reply.max_ns    = stats.max_ns;
+                reply.dropped   = pdrv->GetDroppedMessages();
+                mControl.Send( rReq.client, Ctl::STATS, rReq.seq, &reply, sizeof(reply) );
+                return;
+            }
+        break;
+        
+        case Ctl::SUBSCRIBE:
+            if (rReq.payload.size() != sizeof(uint32_t))
+                res.code = Err::INVALID_FORMAT;
+            else
+            {
+                uint32_t    mask;
+                
+                memcpy( &mask, rReq.payload.data(), sizeof(mask) );
+                mControl.SetSubscription( rReq.client, mask );
+            }
+        break;
+        
+        default:
+            gLog.Write( Log::DEBUG, FUNC_NAME, "Received unknown control request " + std::to_string(rReq.id) + "." );
+            res.code = Err::UNSUPPORTED;
+        break;
+    }
+    
+    mControl.Send( rReq.client, Ctl::RESULT, rReq.seq, &res, sizeof(res) );
+}
+
+
+
+void Daemon::HandleSignal()
+{
+    signalfd_siginfo    info;
+    
+    while (read( mSignalFd, &info, sizeof(info) ) == sizeof(info))
+    {
+        switch (info.ssi_signo)
+        {
+            case SIGINT:
+            case SIGTERM:
+                gLog.Write( Log::DEBUG, FUNC_NAME, "Received termination signal." );
+                mRunning = false;
+            break;
+            
+            case SIGHUP:
+                gLog.Write( Log::DEBUG, FUNC_NAME, "Received hangup signal." );
+                Reload();
+            break;
+            
+            case SIGUSR2:
+                gLog.Write( Log::INFO, "Writing flight recorder dumps to '" + (Xdg::StateHome() / "opensdd").string() + "'." );
+                Drivers::Gamepad::FlightRecorder::DumpAll( "signal" );
+            break;
+            
+            default:
+                // no other handlers
+            break;
+        }
+    }
+}
+
+
+
+void Daemon::HandleDriverMessages( Gamepad& rGp )
+{
+    uint64_t        dropped;
+    
+    while (rGp.pDrv->HasMessage())
+        HandleDriverMessage( rGp.pDrv, rGp.pDrv->PopMessage() );
+    
+    dropped = rGp.pDrv->GetDroppedMessages();
+    if (dropped != rGp.msg_dropped)
+    {
+        gLog.Write( Log::WARN, "Gamepad driver " + std::to_string(rGp.pDrv->GetIndex()) + " dropped " + 
+                    std::to_string(dropped - rGp.msg_dropped) + " message(s)." );
+        rGp.msg_dropped = dropped;
+    }
+}
+
+
+
+void Daemon::HandleDriverMessage( Drivers::Gamepad::Driver* pDrv, const Drivers::Message& rMsg )
+{
+    switch (rMsg.type)
+    {
+        case Drivers::MsgType::NONE:
+            // Nada, shouldn't happen
+        break;
+        
+        case Drivers::MsgType::ATTACHED:
+            mControl.Broadcast( Ctl::DEVICE_ATTACHED, pDrv->GetIndex() );
+        break;
+        
+        case Drivers::MsgType::DETACHED:
+            mControl.Broadcast( Ctl::DEVICE_DETACHED, pDrv->GetIndex() );
+        break;
+        
+        case Drivers::MsgType::RECORDER:
+            gLog.Write( Log::WARN, "Gamepad " + std::to_string(pDrv->GetIndex()) + " input was delayed by " + std::to_string((uint64_t)rMsg.val) + 
+                        "us.  Writing flight recorder dump to '" + (Xdg::StateHome() / "opensdd").string() + "'." );
+            if (pDrv->DumpRecorder( "latency" ) != Err::OK)
+                gLog.Write( Log::WARN, "Failed to write flight recorder dump." );
+        break;
+        
+        case Drivers::MsgType::PROFILE:
+            // Request profile switch via binding
+            {
+                std::string     name = Drivers::gMsgStrings.Get( rMsg.id );
+                if (!name.empty())
+                {
+                    gLog.Write( Log::DEBUG, FUNC_NAME, "Received message from gamepad driver: Switch profile." );
+                    LoadProfile( pDrv, name );
+                }
+            }
+        break;
+        
+        default:
+            // Shouldn't happen since we're using an enum class switch, but lets be thorough
+            gLog.Write( Log::DEBUG, FUNC_NAME, "Received unknown message type from gamepad driver." );
+        break;
+    }
+}
+
+
+
 int Daemon::Startup()
 {
     int             result;
+    sigset_t        sigs;
+    epoll_event     ev = {};
+    
+    // Signals are received through a signalfd instead of a handler.  They have
+    // to be blocked before any driver threads are created so the threads
+    // inherit the mask and the signals are only ever picked up here.
+    sigemptyset( &sigs );
+    sigaddset( &sigs, SIGINT );
+    sigaddset( &sigs, SIGTERM );
+    sigaddset( &sigs, SIGHUP );
+    sigaddset( &sigs, SIGUSR2 );
+    pthread_sigmask( SIG_BLOCK, &sigs, nullptr );
     
-    // Set up signal handlers
-    signal( SIGINT,  sig_handler );
-    signal( SIGTERM, sig_handler );
-    signal( SIGKILL, sig_handler );
+    mSignalFd = signalfd( -1, &sigs, SFD_NONBLOCK | SFD_CLOEXEC );
+    mWakeFd   = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+    mEpollFd  = epoll_create1( EPOLL_CLOEXEC );
+    if ((mSignalFd < 0) || (mWakeFd < 0) || (mEpollFd < 0))
+    {
+        int e = errno;
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to create event descriptors: " + Err::GetErrnoString(e) );
+        gLog.Write( Log::ERROR, "Failed to initialize daemon event loop." );
+        return Err::INIT_FAILED;
+    }
+    
+    ev.events = EPOLLIN;
+    ev.data.fd = mSignalFd;
+    epoll_ctl( mEpollFd, EPOLL_CTL_ADD, mSignalFd, &ev );
+    ev.data.fd = mWakeFd;
+    epoll_ctl( mEpollFd, EPOLL_CTL_ADD, mWakeFd, &ev );
 
     // Initialize file manager
     gLog.Write( Log::INFO, "Initializing file manager..." );
@@ -109,32 +731,36 @@ int Daemon::Startup()
     if (result != Err::OK)
         return Err::INIT_FAILED;
     
-    // Create gamepad driver object
-    gLog.Write( Log::INFO, "Creating gamepad driver object..." );
-    if (mpGpDrv != nullptr)
-    {
-        gLog.Write( Log::ERROR, "Gamepad driver object already exists." );
-        return Err::INIT_FAILED;
-    }
+    // Process wide, so it's done here once rather than per driver thread
+    if (mConfig.mLockMemory)
+        Drivers::LockMemory();
     
-    try 
-    {
-        mpGpDrv = new Drivers::Gamepad::Driver;
-    }
-    catch (...)
-    {
-        gLog.Write( Log::ERROR, "Failed to create gamepad driver object." );
-        return Err::CANNOT_CREATE;
-    }
+    // Pick up the devices of the daemon we're replacing
+    if (mTakeover)
+        ReceiveHandoff();
+    else
+        mHandoff.Restore();
+    
+    // Create gamepad driver objects
+    result = AddGamepads();
     
-    // Load gamepad driver profile
-    result = LoadProfile( mConfig.mProfileName );
+    // Whatever wasn't taken over goes away
+    mHandoff.Unstore();
+    mHandoff.Clear();
     if (result != Err::OK)
-        return Err::CANNOT_OPEN;
- 
-    // Start threaded drivers
-    gLog.Write( Log::INFO, "Starting gamepad driver..." );
-    mpGpDrv->Start();
+        return result;
+    
+    if (mConfig.mFlightRecorder)
+        Drivers::Gamepad::FlightRecorder::InstallCrashHandler();
+    
+    // Clients are optional, so the daemon still runs if these fail
+    if (mConfig.mAllowClients)
+    {
+        OpenStateSocket();
+        mControl.Open( mEpollFd, GetRuntimeDir() / "control.sock", mConfig.mPort );
+    }
+    if (OpenHandoffSocket() != Err::OK)
+        gLog.Write( Log::WARN, "Failed to open handoff socket.  'opensdd --takeover' won't be able to replace this daemon." );
    
     return Err::OK;
 }
@@ -143,15 +769,36 @@ int Daemon::Startup()
 
 void Daemon::Shutdown()
 {
-    // Stop gamepad driver thread
-    if (mpGpDrv != nullptr)
-        mpGpDrv->Stop();
+    // Stop gamepad driver threads
+    for (auto& i : mGamepads)
+        i.pDrv->Stop();
     
-    if (mpGpDrv != nullptr)
-        delete mpGpDrv;
+    for (auto& i : mGamepads)
+    {
+        Drivers::Gamepad::DriverStats   stats = i.pDrv->GetStats();
+        uint64_t                        processed = stats.reports - stats.skipped;
+        
+        gLog.Write( Log::INFO, "Gamepad " + std::to_string(i.pDrv->GetIndex()) + ": " + std::to_string(stats.reports) + " reports, " + 
+                    std::to_string(stats.skipped) + " skipped, " + 
+                    std::to_string(processed ? stats.busy_ns / processed / 1000.0 : 0.0) + "us average, " + 
+                    std::to_string(stats.max_ns / 1000.0) + "us max." );
+        delete i.pDrv;
+    }
         
-    mpGpDrv         = nullptr;
-    gDaemonRunning  = false;
+    mGamepads.clear();
+    mRunning        = false;
+    
+    CloseStateSocket();
+    mControl.Close();
+    CloseHandoffSocket();
+    
+    if (mEpollFd >= 0)
+        close( mEpollFd );
+    if (mSignalFd >= 0)
+        close( mSignalFd );
+    if (mWakeFd >= 0)
+        close( mWakeFd );
+    mEpollFd = mSignalFd = mWakeFd = -1;
 }
 
 
@@ -168,40 +815,90 @@ int Daemon::Run()
         return result;
     }
 
-    // Loop until interrupt signal
-    while (gDaemonRunning)
+    // Sleep until there's a signal, a driver message or a stop request
+    while (mRunning)
     {
-        // ZzZzZzzz...
-        usleep( 100000 );
+        epoll_event     events[DAEMON_MAX_EVENTS];
+        int             count;
+        
+        count = epoll_wait( mEpollFd, events, DAEMON_MAX_EVENTS, -1 );
+        if (count < 0)
+        {
+            int e = errno;
+            if (e == EINTR)
+                continue;
+            gLog.Write( Log::DEBUG, FUNC_NAME, "epoll_wait failed: " + Err::GetErrnoString(e) );
+            gLog.Write( Log::ERROR, "Daemon event loop failed." );
+            break;
+        }
         
-        // Handle gamepad driver messages
-        if (mpGpDrv->HasMessage())
+        for (int i = 0; i < count; ++i)
         {
-            Drivers::Message    msg = mpGpDrv->PopMessage();
-            switch (msg.type)
+            int         fd = events[i].data.fd;
+            uint64_t    val;
+            
+            if (fd == mSignalFd)
             {
-                case Drivers::MsgType::NONE:
-                    // Nada, shouldn't happen
-                break;
-                
-                case Drivers::MsgType::PROFILE:
-                    // Request profile switch via binding
-                    if (!msg.msg.empty())
-                    {
-                        gLog.Write( Log::DEBUG, FUNC_NAME, "Received message from gamepad driver: Switch profile." );
-                        LoadProfile( msg.msg );
-                    }
-                break;
+                HandleSignal();
+                continue;
+            }
+            
+            if (fd == mWakeFd)
+            {
+                if (read( mWakeFd, &val, sizeof(val) ) < 0)
+                    gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to read wake event." );
+                continue;
+            }
+            
+            if (fd == mStateSockFd)
+            {
+                HandleStateClients();
+                continue;
+            }
+            
+            if (fd == mHandoffSockFd)
+            {
+                HandleHandoff();
+                continue;
+            }
+            
+            // Control requests are answered right here
+            if (mControl.OwnsFd( fd ))
+            {
+                std::vector<ControlServer::Request>     requests;
                 
-                default:
-                    // Shouldn't happen since we're using an enum class switch, but lets be thorough
-                    gLog.Write( Log::DEBUG, FUNC_NAME, "Received unknown message type from gamepad driver." );
+                mControl.HandleEvent( fd, events[i].events, requests );
+                for (auto& r : requests)
+                    HandleControlRequest( r );
+                continue;
+            }
+            
+            // Handle gamepad driver messages
+            for (auto& gp : mGamepads)
+            {
+                if (fd != gp.pDrv->GetMessageFd())
+                    continue;
+                if (read( fd, &val, sizeof(val) ) < 0)
+                    gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to read driver message event." );
+                HandleDriverMessages( gp );
                 break;
             }
         }
     }
 
     gLog.Write( Log::INFO, "Shutting down..." );
+    
+    // Under systemd the devices are parked in the fd store, in case this is
+    // a restart.  Otherwise systemd closes them once the service has stopped.
+    if ((!mHandedOff) && mConfig.mKeepDevices && Handoff::HasFdStore())
+    {
+        ReleaseDevices( mHandoff, true );
+        if (mHandoff.Store() == Err::OK)
+            gLog.Write( Log::INFO, "Kept virtual devices in the systemd fd store." );
+        else
+            gLog.Write( Log::WARN, "Failed to keep virtual devices in the systemd fd store." );
+    }
+    
     Shutdown();
     
     // Done
@@ -210,17 +907,35 @@ int Daemon::Run()
 
 
 
+void Daemon::SetTakeover( bool enabled )
+{
+    mTakeover = enabled;
+}
+
+
+
 void Daemon::Stop()
 {
-    gDaemonRunning  = false;
+    uint64_t        val = 1;
+    
+    mRunning = false;
+    if (mWakeFd >= 0)
+        if (write( mWakeFd, &val, sizeof(val) ) < 0)
+            gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to wake daemon." );
 }
 
 
 
 Daemon::Daemon()
 {
-    mpGpDrv         = nullptr;
-    gDaemonRunning  = true;
+    mRunning        = true;
+    mEpollFd        = -1;
+    mSignalFd       = -1;
+    mWakeFd         = -1;
+    mStateSockFd    = -1;
+    mHandoffSockFd  = -1;
+    mTakeover       = false;
+    mHandedOff      = false;
 }
 
 
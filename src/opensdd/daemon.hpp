@@ -22,17 +22,59 @@
 
 #include "filemgr.hpp"
 #include "config.hpp"
+#include "control_server.hpp"
+#include "handoff.hpp"
 #include "drivers/gamepad/driver.hpp"
+// C++
+#include <atomic>
+#include <filesystem>
+#include <vector>
 
 
 class Daemon
 {
 private:
+    // One per controller
+    struct Gamepad
+    {
+        Drivers::Gamepad::Driver*   pDrv;
+        uint64_t                    msg_dropped;    // Last reported driver message drop count
+        std::string                 profile;        // File name of the loaded profile
+    };
+    
     FileMgr                         mFileMgr;
     Config                          mConfig;
-    Drivers::Gamepad::Driver*       mpGpDrv;
+    std::vector<Gamepad>            mGamepads;
+    std::atomic<bool>               mRunning;
+    int                             mEpollFd;
+    int                             mSignalFd;      // SIGINT, SIGTERM, SIGHUP and SIGUSR2
+    int                             mWakeFd;        // Signaled by Stop()
+    int                             mStateSockFd;   // Hands shared state memfds to clients
+    std::filesystem::path           mStateSockPath;
+    ControlServer                   mControl;
+    Handoff                         mHandoff;       // Devices taken over from or handed to another daemon
+    int                             mHandoffSockFd; // Hands the devices to a daemon started with --takeover
+    std::filesystem::path           mHandoffSockPath;
+    bool                            mTakeover;
+    bool                            mHandedOff;
     
-    int                             LoadProfile( std::string fileName );
+    int                             LoadProfile( Drivers::Gamepad::Driver* pDrv, std::string fileName );
+    std::string                     GetProfileName( unsigned int index );
+    int                             AddGamepads();
+    int                             Reload();
+    std::filesystem::path           GetRuntimeDir();
+    int                             OpenStateSocket();
+    void                            CloseStateSocket();
+    void                            HandleStateClients();
+    int                             ReceiveHandoff();
+    int                             OpenHandoffSocket();
+    void                            CloseHandoffSocket();
+    void                            HandleHandoff();
+    void                            ReleaseDevices( Handoff& rOut, bool restoreLizard );
+    void                            HandleControlRequest( const ControlServer::Request& rReq );
+    void                            HandleSignal();
+    void                            HandleDriverMessages( Gamepad& rGp );
+    void                            HandleDriverMessage( Drivers::Gamepad::Driver* pDrv, const Drivers::Message& rMsg );
 
     int                             Startup();
     void                            Shutdown();
@@ -40,6 +82,8 @@ private:
 public:
     int                             Run();
     void                            Stop();
+    // Take the devices over from a running daemon on startup, which then exits
+    void                            SetTakeover( bool enabled );
     
     Daemon();
     ~Daemon();
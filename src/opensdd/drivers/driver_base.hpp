@@ -22,27 +22,40 @@
 
 // Needed for error codes
 #include "../../common/errors.hpp"
+#include "msg_ring.hpp"
+#include "msg_strings.hpp"
+#include "thread_config.hpp"
+// Linux
+#include <sys/eventfd.h>
+#include <unistd.h>
 // C++
 #include <atomic>
+#include <cstdint>
 #include <thread>
-#include <string>
-#include <queue>
 
 
 namespace Drivers
 {
-    constexpr unsigned int                  MAX_DRIVER_MESSAGES = 20;
+    // Must be a power of two
+    constexpr unsigned int                  MAX_DRIVER_MESSAGES = 32;
     
     enum class MsgType
     {
         NONE,
-        PROFILE
+        PROFILE,        // Driver requests a profile switch, id is the profile name
+        ATTACHED,       // Driver found its device again
+        DETACHED,       // Driver lost its device
+        DEADZONE,       // Daemon sets a deadzone, id is the axis and val the deadzone
+        RECORDER        // Driver saw slow input and wants its flight recorder dumped, id is the
+                        // Gamepad::RecMark and val the delay in microseconds
     };
     
+    // Plain data so it can be passed through the lock-free ring.  Strings are
+    // referenced by their gMsgStrings id.
     struct Message
     {
         MsgType                             type;
-        std::string                         msg;
+        uint32_t                            id;
         double                              val;
     };
     
@@ -51,31 +64,57 @@ namespace Drivers
     {
     private:
         std::thread                         mThread;
-        std::queue<Message>                 mMsgQueue;
-        std::mutex                          mMsgMutex;
+        ThreadConfig                        mThreadCfg;
+        MsgRing<Message, MAX_DRIVER_MESSAGES> mMsgRing;
+        std::atomic<uint64_t>               mMsgDropped;    // Messages lost because the ring was full
+        int                                 mMsgFd;         // eventfd signaled when a message is pushed
+
+        void                                ThreadEntry()
+        {
+            ApplyThreadConfig( mThreadCfg, "driver thread" );
+            PrefaultStack();
+            Run();
+        }
 
     protected:
         std::atomic<bool>                   mRunning;
         virtual void                        Run(){ mRunning = false; };
+        // Only call from the driver thread.  Never locks or allocates.
         void                                PushMessage( const Message& msg )
         {
-            std::lock_guard<std::mutex>     lock( mMsgMutex );
-            if (mMsgQueue.size() >= MAX_DRIVER_MESSAGES)
+            if (!mMsgRing.Push( msg ))
+            {
+                mMsgDropped.fetch_add( 1, std::memory_order_relaxed );
                 return;
-            mMsgQueue.push( msg );
+            }
+            
+            // Wake up whoever is waiting on messages
+            if (mMsgFd >= 0)
+            {
+                uint64_t        val = 1;
+                if (write( mMsgFd, &val, sizeof(val) ) < 0)
+                    return;
+            }
         }
 
     public:
         // Public driver functions
+        // Must be called before Start()
+        void                                SetThreadConfig( const ThreadConfig& rCfg )
+        {
+            mThreadCfg = rCfg;
+        }
+
         void                                Start()
         {
-            mThread = std::thread( &DrvBase::Run, this );
+            mThread = std::thread( &DrvBase::ThreadEntry, this );
         }
 
         void                                Stop()
         {
             mRunning = false;
-            mThread.join();
+            if (mThread.joinable())
+                mThread.join();
         }
 
         bool                                IsRunning()
@@ -83,30 +122,43 @@ namespace Drivers
             return mRunning;
         }
         
+        // Readable whenever there are messages waiting.  Read it to reset.
+        int                                 GetMessageFd()
+        {
+            return mMsgFd;
+        }
+        
+        // Only call from a single consumer thread
         bool                                HasMessage()
         {
-            std::lock_guard<std::mutex>     lock( mMsgMutex );
-            return !mMsgQueue.empty();
+            return !mMsgRing.IsEmpty();
         }
         
         Message                             PopMessage()
         {
-            std::lock_guard<std::mutex> lock( mMsgMutex );
-            Message         msg = { .type = MsgType::NONE, .msg = "", .val = 0 };
-            if (mMsgQueue.empty())
-                return msg;
-            msg = mMsgQueue.front();
-            mMsgQueue.pop();
+            Message         msg = { .type = MsgType::NONE, .id = 0, .val = 0 };
+            mMsgRing.Pop( msg );
             return msg;
         }
         
+        // Total number of messages dropped because the consumer fell behind
+        uint64_t                            GetDroppedMessages()
+        {
+            return mMsgDropped.load( std::memory_order_relaxed );
+        }
+        
         // Non-virtual constructor
-        DrvBase(): mThread(), mRunning(false) {};
+        DrvBase(): mThread(), mThreadCfg(), mMsgRing(), mMsgDropped(0), mRunning(false)
+        {
+            mMsgFd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+        };
 
         // Destructor
         virtual ~DrvBase()
         {
             try { Stop(); } catch(...) { /*??*/ };
+            if (mMsgFd >= 0)
+                close( mMsgFd );
         }
     };
 
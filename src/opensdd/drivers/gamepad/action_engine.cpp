@@ -0,0 +1,364 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//  OpenSD
+//  An open-source userspace driver for Valve's Steam Deck hardware
+//
+//  Copyright 2022 seek
+//  https://gitlab.com/open-sd/opensd
+//  Licensed under the GNU GPLv3+
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the 
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of 
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; 
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. 
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with this program. 
+//  If not, see <https://www.gnu.org/licenses/>.             
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#include "action_engine.hpp"
+// C++
+#include <algorithm>
+
+
+
+static bool IsSameOutput( const Drivers::Gamepad::Binding& rA, const Drivers::Gamepad::Binding& rB )
+{
+    return (rA.type == rB.type) && (rA.ev_type == rB.ev_type) && (rA.ev_code == rB.ev_code) && (rA.dir == rB.dir);
+}
+
+
+
+void Drivers::Gamepad::ActionEngine::Schedule( unsigned int index, uint32_t delay )
+{
+    State&          st = mStates[index];
+    unsigned int    slot;
+    
+    if (st.armed)
+        Cancel( index );
+    
+    // Anything shorter would never be emitted before it's undone
+    st.due = mTick + std::max<uint32_t>( delay, 1 );
+    slot = st.due & (ACTION_WHEEL_SLOTS - 1);
+    st.next = mWheel[slot];
+    mWheel[slot] = index;
+    st.armed = true;
+    ++mPending;
+}
+
+
+
+void Drivers::Gamepad::ActionEngine::Cancel( unsigned int index )
+{
+    State&          st = mStates[index];
+    int*            plink;
+    
+    if (!st.armed)
+        return;
+    
+    plink = &mWheel[st.due & (ACTION_WHEEL_SLOTS - 1)];
+    while (*plink >= 0)
+    {
+        if (*plink == (int)index)
+        {
+            *plink = st.next;
+            break;
+        }
+        plink = &mStates[*plink].next;
+    }
+    
+    st.armed = false;
+    st.next = -1;
+    --mPending;
+}
+
+
+
+void Drivers::Gamepad::ActionEngine::Fire( unsigned int index )
+{
+    State&          st = mStates[index];
+    
+    switch (mActions[index].type)
+    {
+        case ActionType::TURBO:
+            if (st.pressed)
+            {
+                st.on = !st.on;
+                Schedule( index, mActions[index].ms );
+            }
+            else
+                st.on = false;
+            mDirty = true;
+        break;
+        
+        case ActionType::MACRO:
+            RunMacro( index );
+        break;
+        
+        default:
+            // Toggles don't use timers
+        break;
+    }
+}
+
+
+
+void Drivers::Gamepad::ActionEngine::RunMacro( unsigned int index )
+{
+    State&                          st = mStates[index];
+    const std::vector<ActionStep>&  steps = mActions[index].steps;
+    
+    mDirty = true;
+    
+    // A tap has run its course
+    if (st.on)
+    {
+        st.held &= ~(1u << st.step);
+        st.on = false;
+        ++st.step;
+    }
+    
+    // Run steps until one has to wait
+    while (st.step < steps.size())
+    {
+        const ActionStep&   step = steps[st.step];
+        
+        switch (step.type)
+        {
+            case StepType::PRESS:
+                st.held |= (1u << st.step);
+                ++st.step;
+            break;
+            
+            case StepType::RELEASE:
+                for (unsigned int i = 0; i < st.step; ++i)
+                    if (IsSameOutput( steps[i].out, step.out ))
+                        st.held &= ~(1u << i);
+                ++st.step;
+            break;
+            
+            case StepType::TAP:
+                st.held |= (1u << st.step);
+                st.on = true;
+                Schedule( index, step.ms );
+                return;
+            break;
+            
+            case StepType::WAIT:
+                ++st.step;
+                Schedule( index, step.ms );
+                return;
+            break;
+        }
+    }
+    
+    // Done, and nothing stays held after a macro
+    st.running = false;
+    st.held = 0;
+}
+
+
+
+void Drivers::Gamepad::ActionEngine::Rebuild()
+{
+    mOutputs.clear();
+    
+    for (unsigned int i = 0; i < mActions.size(); ++i)
+    {
+        if (mActions[i].type == ActionType::MACRO)
+        {
+            for (unsigned int j = 0; j < mActions[i].steps.size(); ++j)
+                if (mStates[i].held & (1u << j))
+                    mOutputs.push_back( &mActions[i].steps[j].out );
+        }
+        else
+            if (mStates[i].on)
+                mOutputs.push_back( &mActions[i].out );
+    }
+    
+    mDirty = false;
+}
+
+
+
+void Drivers::Gamepad::ActionEngine::Load( const std::vector<Action>& rActions, uint64_t now )
+{
+    size_t          max_outputs = 0;
+    
+    mActions = rActions;
+    if (mActions.size() > MAX_ACTIONS)
+        mActions.resize( MAX_ACTIONS );
+    for (auto& i : mActions)
+    {
+        if (i.steps.size() > MAX_MACRO_STEPS)
+            i.steps.resize( MAX_MACRO_STEPS );
+        max_outputs += std::max<size_t>( i.steps.size(), 1 );
+    }
+    
+    // Sized up front so the driver thread never allocates
+    mStates.assign( mActions.size(), {} );
+    mOutputs.clear();
+    mOutputs.reserve( max_outputs );
+    Reset();
+    mTick = now;
+}
+
+
+
+void Drivers::Gamepad::ActionEngine::Reset()
+{
+    for (auto& i : mStates)
+        i = { .pressed = false, .seen = false, .on = false, .running = false, .step = 0, .held = 0, .armed = false, .due = 0, .next = -1 };
+    
+    std::fill( std::begin(mWheel), std::end(mWheel), -1 );
+    mPending = 0;
+    mDirty = true;
+}
+
+
+
+void Drivers::Gamepad::ActionEngine::Trigger( unsigned int index, bool pressed )
+{
+    State*          pst;
+    
+    if (index >= mStates.size())
+        return;
+    
+    pst = &mStates[index];
+    pst->seen = true;
+    if (pst->pressed == pressed)
+        return;
+    pst->pressed = pressed;
+    
+    switch (mActions[index].type)
+    {
+        case ActionType::TURBO:
+            // Starts with the output on so a tap always registers
+            pst->on = pressed;
+            if (pressed)
+                Schedule( index, mActions[index].ms );
+            else
+                Cancel( index );
+        break;
+        
+        case ActionType::TOGGLE:
+            if (pressed)
+                pst->on = !pst->on;
+        break;
+        
+        case ActionType::MACRO:
+            // Presses while a macro is playing are ignored
+            if (pressed && !pst->running)
+            {
+                pst->running = true;
+                pst->step = 0;
+                pst->held = 0;
+                pst->on = false;
+                RunMacro( index );
+            }
+        break;
+    }
+    
+    mDirty = true;
+}
+
+
+
+void Drivers::Gamepad::ActionEngine::BeginFrame()
+{
+    for (auto& i : mStates)
+        i.seen = false;
+}
+
+
+
+void Drivers::Gamepad::ActionEngine::EndFrame()
+{
+    for (unsigned int i = 0; i < mStates.size(); ++i)
+        if (mStates[i].pressed && !mStates[i].seen)
+            Trigger( i, false );
+}
+
+
+
+void Drivers::Gamepad::ActionEngine::Advance( uint64_t now )
+{
+    while (mPending && (mTick < now))
+    {
+        unsigned int    slot;
+        int             i;
+        
+        ++mTick;
+        slot = mTick & (ACTION_WHEEL_SLOTS - 1);
+        
+        // Take the whole slot, then put back whatever is due on a later turn
+        i = mWheel[slot];
+        mWheel[slot] = -1;
+        while (i >= 0)
+        {
+            State&      st = mStates[i];
+            int         next = st.next;
+            
+            if (st.due <= mTick)
+            {
+                st.armed = false;
+                st.next = -1;
+                --mPending;
+                Fire( i );
+            }
+            else
+            {
+                st.next = mWheel[slot];
+                mWheel[slot] = i;
+            }
+            i = next;
+        }
+    }
+    
+    if (mTick < now)
+        mTick = now;
+}
+
+
+
+bool Drivers::Gamepad::ActionEngine::IsBusy()
+{
+    return mPending;
+}
+
+
+
+int Drivers::Gamepad::ActionEngine::GetTimeout( uint64_t now )
+{
+    uint64_t        due = UINT64_MAX;
+    
+    if (!mPending)
+        return -1;
+    
+    for (auto& i : mStates)
+        if (i.armed && (i.due < due))
+            due = i.due;
+    
+    return (due > now) ? (int)std::min<uint64_t>( due - now, INT32_MAX ) : 1;
+}
+
+
+
+const std::vector<Drivers::Gamepad::Binding*>& Drivers::Gamepad::ActionEngine::GetOutputs()
+{
+    if (mDirty)
+        Rebuild();
+    
+    return mOutputs;
+}
+
+
+
+Drivers::Gamepad::ActionEngine::ActionEngine()
+{
+    std::fill( std::begin(mWheel), std::end(mWheel), -1 );
+    mTick       = 0;
+    mPending    = 0;
+    mDirty      = false;
+}
@@ -0,0 +1,97 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//  OpenSD
+//  An open-source userspace driver for Valve's Steam Deck hardware
+//
+//  Copyright 2022 seek
+//  https://gitlab.com/open-sd/opensd
+//  Licensed under the GNU GPLv3+
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the 
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of 
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; 
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. 
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with this program. 
+//  If not, see <https://www.gnu.org/licenses/>.             
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#ifndef __GAMEPAD__ACTION_ENGINE_HPP__
+#define __GAMEPAD__ACTION_ENGINE_HPP__
+
+#include "bindings.hpp"
+// C++
+#include <cstdint>
+#include <vector>
+
+
+namespace Drivers::Gamepad
+{
+    // Most actions a profile can define
+    const unsigned int      MAX_ACTIONS             = 64;
+    // Most steps in a single macro
+    const unsigned int      MAX_MACRO_STEPS         = 32;
+    // Timer wheel size, one slot per millisecond.  Must be a power of two.
+    const unsigned int      ACTION_WHEEL_SLOTS      = 256;
+    
+    // Runs turbo, toggle and macro actions on the driver thread.  Timers sit on
+    // a hashed wheel with one slot per millisecond, and each action has at most
+    // one timer, so nothing is allocated after Load().  The outputs that are
+    // currently held are re-emitted by the driver on every frame, the same way
+    // as ordinary bindings.
+    class ActionEngine
+    {
+    private:
+        struct State
+        {
+            bool                        pressed;    // Input state, for edge detection
+            bool                        seen;       // Triggered in the current frame
+            bool                        on;         // TURBO / TOGGLE output, or a MACRO tap in progress
+            bool                        running;    // MACRO is playing
+            unsigned int                step;       // Current MACRO step
+            uint32_t                    held;       // MACRO steps whose output is held, one bit per step
+            bool                        armed;      // Timer is on the wheel
+            uint64_t                    due;        // Timer expiry in ms
+            int                         next;       // Next action in the same wheel slot, or -1
+        };
+        
+        std::vector<Action>             mActions;
+        std::vector<State>              mStates;
+        std::vector<Binding*>           mOutputs;   // Outputs currently held
+        int                             mWheel[ACTION_WHEEL_SLOTS];
+        uint64_t                        mTick;      // Last millisecond processed
+        unsigned int                    mPending;   // Timers on the wheel
+        bool                            mDirty;     // mOutputs needs rebuilding
+        
+        void                            Schedule( unsigned int index, uint32_t delay );
+        void                            Cancel( unsigned int index );
+        void                            Fire( unsigned int index );
+        void                            RunMacro( unsigned int index );
+        void                            Rebuild();
+        
+    public:
+        void                            Load( const std::vector<Action>& rActions, uint64_t now );
+        // Stops every action and releases its outputs
+        void                            Reset();
+        void                            Trigger( unsigned int index, bool pressed );
+        // Trigger() calls between these make up one frame.  Actions that are
+        // still pressed but weren't triggered, i.e. because a layer change 
+        // unbound their input, are released by EndFrame().
+        void                            BeginFrame();
+        void                            EndFrame();
+        // Runs every timer that expired up to 'now', in ms
+        void                            Advance( uint64_t now );
+        // Timers are pending, so the driver has to keep running frames
+        bool                            IsBusy();
+        // Milliseconds until the next timer, at least 1
+        int                             GetTimeout( uint64_t now );
+        const std::vector<Binding*>&    GetOutputs();
+        
+        ActionEngine();
+    };
+
+} // namespace Drivers::Gamepad
+
+
+#endif // __GAMEPAD__ACTION_ENGINE_HPP__
@@ -25,10 +25,14 @@
 // C++ 
 #include <cstdint>
 #include <string>
+#include <vector>
 
 
 namespace Drivers::Gamepad
 {
+    // Most alternate binding layers a profile can define
+    const unsigned int          MAX_BIND_LAYERS = 8;
+    
     // Shorthand enums
     enum class BindType
     {
@@ -38,7 +42,9 @@ namespace Drivers::Gamepad
         MOTION,
         MOUSE,
         COMMAND,
-        PROFILE
+        PROFILE,
+        LAYER,
+        ACTION
     };
 
     // Input binding
@@ -48,20 +54,71 @@ namespace Drivers::Gamepad
         uint16_t                ev_type;        // Input event type
         uint16_t                ev_code;        // Input event code
         bool                    dir;            // Axis direction.  true = Axis+, false = Axis-
+                                                // If dev is LAYER, true = toggle, false = hold
+        bool                    dir_set;        // REL bindings only:  dir was given in the profile.  Otherwise
+                                                // relative inputs pass their motion through unchanged.
         std::string             str;            // If dev is COMMAND, this string will be executed in a shell environment
                                                 // If dev is PROFILE, this holds the filename of the profile ini to load
+                                                // If dev is LAYER, this holds the layer name
         uint32_t                id;             // Unique binding ID for commands, or zero to disable wait_for_exit
+                                                // If dev is PROFILE, the gMsgStrings id of the profile filename
+                                                // If dev is LAYER, the layer number
+                                                // If dev is ACTION, the index into the profile's action list
+                                                // If ev_type is EV_ABS, the driver's combined axis slot + 1, set
+                                                // when the profile is loaded
         uint64_t                delay;          // Minimum delay between repeated commands
         uint64_t                timestamp;      // Timestamp of binding execution in ms
+        double                  gain;           // Multiplier applied to relative axis output
+        double                  rem;            // Fractional relative counts carried over to the next frame
         
         Binding():
-            type(BindType::NONE), ev_type(0), ev_code(0), dir(false), str(""), id(0), delay(0), timestamp(0) {};
+            type(BindType::NONE), ev_type(0), ev_code(0), dir(false), dir_set(false), str(""), id(0), delay(0), timestamp(0), gain(1.0), rem(0) {};
             
         Binding( BindType bindType, uint16_t eventType, uint16_t eventCode, bool direction ):
-            type(bindType), ev_type(eventType), ev_code(eventCode), dir(direction), str(""), id(0), delay(0), timestamp(0) {};
+            type(bindType), ev_type(eventType), ev_code(eventCode), dir(direction), dir_set(false), str(""), id(0), delay(0), timestamp(0), gain(1.0), rem(0) {};
             
         Binding( std::string commandStr, uint32_t uniqueId, uint64_t repeatDelay ): 
-            type(BindType::COMMAND), ev_type(0), ev_code(0), str(commandStr), id(uniqueId), delay(repeatDelay), timestamp(0) {};
+            type(BindType::COMMAND), ev_type(0), ev_code(0), dir(false), dir_set(false), str(commandStr), id(uniqueId), delay(repeatDelay), timestamp(0), gain(1.0), rem(0) {};
+    };
+
+    // How bindings to the same absolute axis are combined, e.g. both halves
+    // of a split axis
+    enum class AxisMerge
+    {
+        PRIORITY,                               // First non-zero value wins, in the order bindings are handled
+        SUM                                     // Values are added up and clamped
+    };
+
+    // Turbo, toggle and macro bindings are run by the driver's action engine
+    enum class ActionType
+    {
+        TURBO,                                  // Pulses the output while held
+        TOGGLE,                                 // Each press latches the output on or off
+        MACRO                                   // Plays a sequence of steps once per press
+    };
+    
+    enum class StepType
+    {
+        PRESS,                                  // Hold the output until a matching RELEASE or the end of the macro
+        RELEASE,
+        TAP,                                    // Hold the output for 'ms'
+        WAIT                                    // Do nothing for 'ms'
+    };
+    
+    struct ActionStep
+    {
+        StepType                type;
+        Binding                 out;
+        uint32_t                ms;
+    };
+    
+    struct Action
+    {
+        ActionType              type;
+        std::string             name;           // Macro name
+        Binding                 out;            // Output for TURBO and TOGGLE
+        uint32_t                ms;             // TURBO on / off time
+        std::vector<ActionStep> steps;          // MACRO steps
     };
 
     // List of all gamepad input bindings are defined here
@@ -188,6 +245,18 @@ namespace Drivers::Gamepad
             Binding             yaw_minus;
         } att;
     };
+    
+    // BindMap holds nothing but Bindings, so it can be walked like an array
+    static_assert( sizeof(BindMap) % sizeof(Binding) == 0, "BindMap must only contain Bindings" );
+    
+    template <typename Func>
+    void ForEachBinding( BindMap& rMap, Func func )
+    {
+        Binding*        bind = (Binding*)&rMap;
+        
+        for (size_t i = 0; i < sizeof(BindMap) / sizeof(Binding); ++i)
+            func( bind[i] );
+    }
 
 } // namespace Drivers::Gamepad
 
@@ -20,6 +20,7 @@
 #ifndef __GAMEPAD__DEVICE_STATE_HPP__
 #define __GAMEPAD__DEVICE_STATE_HPP__
 
+#include <cstdint>
 
 namespace Drivers::Gamepad
 {
@@ -28,6 +29,11 @@ namespace Drivers::Gamepad
     // This struct is populated from the input report.
     struct DeviceState
     {
+        // Report timing
+        uint32_t            frame;          // Hardware frame counter
+        uint64_t            timestamp;      // Monotonic arrival time in microseconds
+        double              dt;             // Seconds elapsed since the previous report
+
         struct _dpad
         {
             bool            up;
@@ -102,6 +108,8 @@ namespace Drivers::Gamepad
             double          sy;
             double          dx;
             double          dy;
+            double          vx;             // Velocity in sx/sy units per second
+            double          vy;
             bool            touch;
             bool            press;
             double          force;
@@ -22,47 +22,379 @@
 #include "filter_axes.hpp"
 #include "../../../common/log.hpp"
 #include "../../../common/string_funcs.hpp"
+#include "../../../common/trace.hpp"
+#include "../../../common/xdg.hpp"
 #include "../../runner.hpp"
 // Linux
+#include <fcntl.h>
+#include <poll.h>
 #include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
 // C++
 #include <bit>
 #include <bitset>
 #include <cmath>
+#include <cstring>
+#include <mutex>
 #include <iostream>
 #include <chrono>
+#include <stdexcept>
+
+
+// hidraw nodes currently owned by a driver instance, so each controller is
+// only ever handled by one of them
+static std::mutex               gClaimMutex;
+static std::vector<std::string> gClaimedNodes;
+
+// Handoff names of mpGamepad, mpMotion and mpMouse, after "gp<index>."
+static const char*              gHandoffNames[Drivers::Gamepad::HANDOFF_DEVICES] = { "gamepad", "motion", "mouse" };
+
+
+
+static bool ClaimNode( const std::string& rPath )
+{
+    std::lock_guard<std::mutex>     lock( gClaimMutex );
+    
+    for (auto& i : gClaimedNodes)
+        if (i == rPath)
+            return false;
+    gClaimedNodes.push_back( rPath );
+    return true;
+}
+
+
+
+static void ReleaseNode( const std::string& rPath )
+{
+    std::lock_guard<std::mutex>     lock( gClaimMutex );
+    
+    std::erase( gClaimedNodes, rPath );
+}
+
+
+
+// Whether a binding's input counts as pressed for layer and action bindings
+static bool IsBindPressed( double state, Drivers::Gamepad::BindMode mode )
+{
+    switch (mode)
+    {
+        case Drivers::Gamepad::BindMode::AXIS_MINUS:    return (state < 0);
+        case Drivers::Gamepad::BindMode::RELATIVE:      return (state != 0);
+        default:                                        return (state > 0);
+    }
+}
+
+
+
+unsigned int Drivers::Gamepad::Driver::CountDevices()
+{
+    unsigned int        count = 0;
+    
+    for (auto&& i : KNOWN_DEVICES)
+        count += Hidraw::FindDevNodes( i.vid, i.pid, i.ifacenum ).size();
+    
+    return count;
+}
+
 
 
 int Drivers::Gamepad::Driver::OpenHid()
 {
     int                 result;
+    int                 err = Err::NOT_FOUND;
     std::string         path;
     
 
-    // Loop throught known gamepad device list and break on first one found
+    // Loop throught known gamepad device list and take the first one that
+    // no other driver instance owns
     for (auto&& i : KNOWN_DEVICES)
     {
-        path = mHid.FindDevNode( i.vid, i.pid, i.ifacenum );
-        if (!path.empty())
+        for (auto&& node : Hidraw::FindDevNodes( i.vid, i.pid, i.ifacenum ))
         {
+            path = node.string();
+            if (!ClaimNode( path ))
+            {
+                gLog.Write( Log::VERB, FUNC_NAME, "Skipping '" + path + "' since it belongs to another gamepad." );
+                continue;
+            }
+            
             gLog.Write( Log::DEBUG, FUNC_NAME, "Found hidraw device on '" + path + "'." );
             result = mHid.Open( path );
             if (result != Err::OK)
             {
+                // Callers decide how loud this is since it's expected while
+                // waiting for a device to settle
                 gLog.Write( Log::DEBUG, FUNC_NAME, "Error opening hidraw device on '" + path + "'." );
-                gLog.Write( Log::ERROR, "Failed to open gamepad hidraw device." );
-                return Err::CANNOT_OPEN;
-            }
-            else
-            {
-                gLog.Write( Log::INFO, "Successfully opened Steam Deck gamepad device." );
-                return Err::OK;
+                ReleaseNode( path );
+                err = Err::CANNOT_OPEN;
+                continue;
             }
+            
+            mClaimedNode = path;
+            mAttached = true;
+            // Falls back to Hidraw::Read() and Uinput::Device::Flush() if it fails
+            mFrameIo.Start( mHid );
+            gLog.Write( Log::INFO, "Successfully opened Steam Deck gamepad device for gamepad " + std::to_string(mIndex) + "." );
+            return Err::OK;
+        }
+    }
+    
+    gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to find any available compatible gamepad devices." );
+    return err;
+}
+
+
+
+int Drivers::Gamepad::Driver::AdoptHid( Handoff& rHandoff )
+{
+    std::string         name = "gp" + std::to_string(mIndex) + ".hidraw";
+    std::string         path = rHandoff.GetValue( name );
+    int                 fd = rHandoff.Take( name );
+    
+    
+    if (fd < 0)
+        return Err::NOT_FOUND;
+    
+    if (path.empty() || !ClaimNode( path ))
+    {
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Handed off hidraw device '" + path + "' can't be claimed." );
+        close( fd );
+        return Err::INVALID_PARAMETER;
+    }
+    
+    if (mHid.Adopt( fd, path ) != Err::OK)
+    {
+        ReleaseNode( path );
+        return Err::CANNOT_OPEN;
+    }
+    
+    mClaimedNode = path;
+    mAttached = true;
+    mFrameIo.Start( mHid );
+    gLog.Write( Log::INFO, "Took over Steam Deck gamepad device for gamepad " + std::to_string(mIndex) + "." );
+    
+    return Err::OK;
+}
+
+
+
+void Drivers::Gamepad::Driver::CloseHid()
+{
+    mFrameIo.Stop();
+    mHid.Close();
+    mAttached = false;
+    if (!mClaimedNode.empty())
+        ReleaseNode( mClaimedNode );
+    mClaimedNode.clear();
+}
+
+
+
+Drivers::Gamepad::DriverStats Drivers::Gamepad::Driver::GetStats()
+{
+    DriverStats         stats;
+    
+    stats.reports   = mStatReports.load( std::memory_order_relaxed );
+    stats.skipped   = mStatSkipped.load( std::memory_order_relaxed );
+    stats.busy_ns   = mStatBusyNs.load( std::memory_order_relaxed );
+    stats.max_ns    = mStatMaxNs.load( std::memory_order_relaxed );
+    
+    return stats;
+}
+
+
+
+bool Drivers::Gamepad::Driver::IsAttached()
+{
+    return mAttached;
+}
+
+
+
+int Drivers::Gamepad::Driver::EnableSharedState()
+{
+    int             result;
+    
+    if (mShared.IsCreated())
+        return Err::OK;
+    
+    result = mShared.Create( mIndex );
+    if (result != Err::OK)
+        gLog.Write( Log::WARN, "Failed to create shared state for gamepad " + std::to_string(mIndex) + "." );
+    
+    return result;
+}
+
+
+
+int Drivers::Gamepad::Driver::EnableRecorder( unsigned int thresholdMs )
+{
+    int             result;
+    
+    result = mRecorder.Enable( mIndex, Xdg::StateHome() / "opensdd" );
+    if (result != Err::OK)
+    {
+        gLog.Write( Log::WARN, "Failed to enable flight recorder for gamepad " + std::to_string(mIndex) + "." );
+        return result;
+    }
+    mRecorderThreshold = (uint64_t)thresholdMs * 1000000;
+    
+    return Err::OK;
+}
+
+
+
+int Drivers::Gamepad::Driver::DumpRecorder( const char* pReason )
+{
+    return mRecorder.Dump( pReason );
+}
+
+
+
+void Drivers::Gamepad::Driver::ReportSlowInput( RecMark mark, uint64_t delayNs, uint64_t now )
+{
+    mRecorder.RecordMark( mark, (delayNs / 1000 > INT32_MAX) ? INT32_MAX : delayNs / 1000, now );
+    
+    // Don't flood the disk if the system stays slow
+    if (mLastDumpNs && (now - mLastDumpNs < RECORDER_DUMP_INTERVAL))
+        return;
+    mLastDumpNs = now;
+    
+    // The daemon writes the dump so this thread can carry on
+    PushMessage( { .type = Drivers::MsgType::RECORDER, .id = (uint32_t)mark, .val = (double)(delayNs / 1000) } );
+}
+
+
+
+int Drivers::Gamepad::Driver::GetSharedStateFd()
+{
+    return mShared.GetFd();
+}
+
+
+
+unsigned int Drivers::Gamepad::Driver::GetIndex()
+{
+    return mIndex;
+}
+
+
+
+int Drivers::Gamepad::Driver::Release( Handoff& rOut, bool restoreLizard )
+{
+    std::string         prefix = "gp" + std::to_string(mIndex) + ".";
+    Uinput::Device*     devs[HANDOFF_DEVICES] = { mpGamepad, mpMotion, mpMouse };
+    int                 fd;
+    
+    
+    std::lock_guard<std::mutex>     lock( mPollMutex );
+    std::lock_guard<std::mutex>     ff_lock( mFFMutex );
+    
+    if (mHid.IsOpen())
+    {
+        fd = mHid.Dup();
+        if (fd >= 0)
+        {
+            rOut.Add( prefix + "hidraw", fd );
+            rOut.SetValue( prefix + "hidraw", mClaimedNode );
+        }
+    }
+    
+    for (unsigned int i = 0; i < HANDOFF_DEVICES; ++i)
+    {
+        if (devs[i] == nullptr)
+            continue;
+        
+        // A device that can't be handed off is destroyed as usual
+        fd = fcntl( devs[i]->GetFd(), F_DUPFD_CLOEXEC, 0 );
+        if (fd < 0)
+        {
+            int e = errno;
+            gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to duplicate uinput fd: " + Err::GetErrnoString(e) );
+            continue;
         }
+        
+        rOut.Add( prefix + gHandoffNames[i], fd );
+        rOut.SetValue( prefix + gHandoffNames[i], std::to_string(devs[i]->GetConfigHash()) );
+        devs[i]->Release();
+    }
+    
+    // The next daemon carries on from here
+    mHandedOff = !restoreLizard;
+    
+    return Err::OK;
+}
+
+
+
+void Drivers::Gamepad::Driver::ReleaseInputs()
+{
+    v100::PackedInputDataReport     ir = {};
+    
+    // Run a neutral report through the normal path so every bound button,
+    // axis and key is released on the uinput devices, and stop any trackpad
+    // inertia.
+    mState.pad.l.vx = mState.pad.l.vy = 0;
+    mState.pad.r.vx = mState.pad.r.vy = 0;
+    mActions.Reset();
+    ir.frame = mState.frame;
+    UpdateState( &ir );
+    Translate();
+    // Don't leave a released axis waiting on a device's output rate
+    Flush( true );
+    
+    // Restart timing when the device comes back
+    mState.timestamp = 0;
+    mLastReportValid = false;
+}
+
+
+
+void Drivers::Gamepad::Driver::Detach()
+{
+    std::lock_guard<std::mutex>     lock( mPollMutex );
+    
+    // Keep the uinput devices so games don't lose the controller
+    ReleaseInputs();
+    mOutQueue.Clear();
+    CloseHid();
+    mRecorder.RecordMark( RecMark::DETACHED, 0, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count() );
+    mLastReportNs = 0;
+    PushMessage( { .type = Drivers::MsgType::DETACHED, .id = 0, .val = 0 } );
+    gLog.Write( Log::WARN, "Gamepad " + std::to_string(mIndex) + " disconnected.  Waiting for it to come back..." );
+}
+
+
+
+int Drivers::Gamepad::Driver::Attach()
+{
+    int             result;
+    
+    result = OpenHid();
+    if (result != Err::OK)
+        return result;
+    
+    mHotplug.Attached();
+    mMotion.Reset();
+    SetLizardMode( false );
+    {
+        std::lock_guard<std::mutex>     lock( mPollMutex );
+        mRecorder.RecordMark( RecMark::ATTACHED, 0, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count() );
     }
+    PushMessage( { .type = Drivers::MsgType::ATTACHED, .id = 0, .val = 0 } );
+    gLog.Write( Log::INFO, "Gamepad " + std::to_string(mIndex) + " reconnected." );
     
-    gLog.Write( Log::ERROR, "Failed to find any compatible gamepad devices." );
-    return Err::NOT_FOUND;
+    return Err::OK;
+}
+
+
+
+void Drivers::Gamepad::Driver::WaitForDevice()
+{
+    if (mHotplug.Wait() && mRunning)
+        Attach();
 }
 
 
@@ -82,7 +414,7 @@ int Drivers::Gamepad::Driver::ReadRegister( uint8_t reg, uint16_t& rValue )
 
 int Drivers::Gamepad::Driver::WriteRegister( uint8_t reg, uint16_t value )
 {
-    std::vector<uint8_t>    buff;
+    uint8_t                 buff[OUTPUT_REPORT_SIZE] = {};
     uint8_t                 length = 3;  // Function writes fixed nuber of bytes
     int                     result;
     
@@ -96,19 +428,17 @@ int Drivers::Gamepad::Driver::WriteRegister( uint8_t reg, uint16_t value )
     
     
     // Set the first byte of the report to the write register command
-    buff.push_back( ReportType::WRITE_REGISTER );
+    buff[0] = ReportType::WRITE_REGISTER;
     // Second byte is the number of bytes for registers and values
-    buff.push_back( length );
+    buff[1] = length;
     // Register is 8 bits
-    buff.push_back( reg );
+    buff[2] = reg;
     // Value is 16 bits, with the low bits first
-    buff.push_back( value & 0xff );
-    buff.push_back( value >> 8 );
+    buff[3] = value & 0xff;
+    buff[4] = value >> 8;
 
-    // Fix buffer size at 64 bytes
-    buff.resize(64);
-    
-    result = mHid.Write( buff );
+    // Only the latest write or clear of a register needs to be sent
+    result = QueueOutput( OutPriority::CONTROL, OutputKey( ReportType::WRITE_REGISTER, reg ), buff );
     if (result != Err::OK)
     {
         gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to write register on gamepad device. " );
@@ -144,12 +474,55 @@ int Drivers::Gamepad::Driver::HandleInputReport( const std::vector<uint8_t>& rRe
                 {
                     // Cast input report vector into packed report struct
                     v100::PackedInputDataReport* pir = (v100::PackedInputDataReport*)rReport.data();
+                    
+                    auto                        start = std::chrono::steady_clock::now();
+                    uint64_t                    start_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(start.time_since_epoch()).count();
+                    uint64_t                    stages[STAGE_COUNT];
+                    uint64_t                    busy;
+                    
+                    mStatReports.fetch_add( 1, std::memory_order_relaxed );
+                    TRACE_PROBE2( report_received, mIndex, pir->frame );
+                    
+                    // Reports normally arrive every few milliseconds, even when idle
+                    if (mRecorderThreshold && mLastReportNs && (start_ns - mLastReportNs > mRecorderThreshold))
+                        ReportSlowInput( RecMark::LATE_REPORT, start_ns - mLastReportNs, start_ns );
+                    mLastReportNs = start_ns;
+                    
+                    // Nothing would change, so only keep the timing current
+                    if (IsIdleRepeat( rReport ))
+                    {
+                        mState.frame        = pir->frame;
+                        mState.timestamp    = std::chrono::duration_cast<std::chrono::microseconds>(start.time_since_epoch()).count();
+                        mStatSkipped.fetch_add( 1, std::memory_order_relaxed );
+                        mShared.Publish( mState );
+                        break;
+                    }
+                    memcpy( mLastReport, rReport.data(), sizeof(mLastReport) );
+                    mLastReportValid = true;
+                    mRecorder.RecordReport( rReport.data(), pir->frame, start_ns );
+                    
                     // Update internal gamepad state
                     UpdateState( pir );
+                    TRACE_PROBE2( state_updated, mIndex, pir->frame );
+                    stages[STAGE_UPDATE] = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
                     // Translate gamepad state into mapped events
                     Translate();
+                    stages[STAGE_TRANSLATE] = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
                     // Write out event buffer to uinput
                     Flush();
+                    stages[STAGE_FLUSH] = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+                    // Let clients see the new state
+                    mShared.Publish( mState );
+                    stages[STAGE_PUBLISH] = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+                    mRecorder.RecordStages( pir->frame, start_ns, stages );
+                    
+                    // Only this thread writes the stats
+                    busy = stages[STAGE_PUBLISH] - start_ns;
+                    mStatBusyNs.fetch_add( busy, std::memory_order_relaxed );
+                    if (busy > mStatMaxNs.load( std::memory_order_relaxed ))
+                        mStatMaxNs.store( busy, std::memory_order_relaxed );
+                    if (mRecorderThreshold && (busy > mRecorderThreshold))
+                        ReportSlowInput( RecMark::SLOW_REPORT, busy, stages[STAGE_PUBLISH] );
                 }
                 break;
                 
@@ -173,9 +546,37 @@ int Drivers::Gamepad::Driver::HandleInputReport( const std::vector<uint8_t>& rRe
 
 
 
+bool Drivers::Gamepad::Driver::IsIdleRepeat( const std::vector<uint8_t>& rReport )
+{
+    using namespace v100;
+    
+    if (!mLastReportValid)
+        return false;
+    
+    // Anything that keeps producing output without new input has to run
+    if (mRelActive || mActions.IsBusy())
+        return false;
+    // Output held back by a device's rate limit is written on a later frame
+    if (((mpGamepad != nullptr) && mpGamepad->IsPending()) ||
+        ((mpMotion != nullptr) && mpMotion->IsPending()) ||
+        ((mpMouse != nullptr) && mpMouse->IsPending()))
+        return false;
+    if (mState.pad.l.vx || mState.pad.l.vy || mState.pad.r.vx || mState.pad.r.vy)
+        return false;
+    
+    // Compare everything except the frame counter
+    if (memcmp( rReport.data(), mLastReport, REPORT_FRAME_OFFSET ))
+        return false;
+    return !memcmp( rReport.data() + REPORT_FRAME_OFFSET + REPORT_FRAME_SIZE, 
+                    mLastReport + REPORT_FRAME_OFFSET + REPORT_FRAME_SIZE, 
+                    sizeof(mLastReport) - REPORT_FRAME_OFFSET - REPORT_FRAME_SIZE );
+}
+
+
+
 int Drivers::Gamepad::Driver::ClearRegister( uint8_t reg )
 {
-    std::vector<uint8_t>    buff;
+    uint8_t                 buff[OUTPUT_REPORT_SIZE] = {};
     uint8_t                 length = 2;  // Function writes fixed nuber of bytes
     int                     result;
     
@@ -189,16 +590,14 @@ int Drivers::Gamepad::Driver::ClearRegister( uint8_t reg )
     
     
     // Set the first byte of the report to the write register command
-    buff.push_back( ReportType::CLEAR_REGISTER );
+    buff[0] = ReportType::CLEAR_REGISTER;
     // Second byte is the number of bytes for registers and values
-    buff.push_back( length );
+    buff[1] = length;
     // Register is 8 bits
-    buff.push_back( reg );
+    buff[2] = reg;
     
-    // Fix buffer size at 64 bytes
-    buff.resize(64);
-    
-    result = mHid.Write( buff );
+    // Shares the key with WriteRegister so the last operation wins
+    result = QueueOutput( OutPriority::CONTROL, OutputKey( ReportType::WRITE_REGISTER, reg ), buff );
     if (result != Err::OK)
     {
         gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to clear register on gamepad device. " );
@@ -212,6 +611,10 @@ int Drivers::Gamepad::Driver::ClearRegister( uint8_t reg )
 
 void Drivers::Gamepad::Driver::DestroyUinputDevs()
 {
+    // Slots point into the devices
+    mAxisSlots.clear();
+    mSetSlots.clear();
+    
     if (mpGamepad != nullptr)
     {
         gLog.Write( Log::DEBUG, FUNC_NAME, "Destroying gamepad uinput object." );
@@ -236,10 +639,184 @@ void Drivers::Gamepad::Driver::DestroyUinputDevs()
 
 
 
+void Drivers::Gamepad::Driver::CompileAxis( Binding& rBind )
+{
+    Uinput::Device*     device = nullptr;
+    Uinput::EventInfo*  info;
+    
+    
+    if (rBind.ev_type != EV_ABS)
+        return;
+    
+    switch (rBind.type)
+    {
+        case BindType::GAME:
+            device = mpGamepad;
+        break;
+        
+        case BindType::MOTION:
+            device = mpMotion;
+        break;
+        
+        case BindType::MOUSE:
+            device = mpMouse;
+        break;
+        
+        default:
+            return;
+        break;
+    }
+    
+    // Unresolved bindings are ignored by UpdateAxis()
+    rBind.id = 0;
+    if (device == nullptr)
+        return;
+    
+    info = device->GetAbsInfo( rBind.ev_code );
+    if (info == nullptr)
+    {
+        gLog.Write( Log::WARN, "Binding to absolute axis " + std::to_string(rBind.ev_code) + " is not enabled on its device and will be ignored." );
+        return;
+    }
+    
+    // Every binding to the same axis shares one slot
+    for (size_t i = 0; i < mAxisSlots.size(); ++i)
+    {
+        if (mAxisSlots[i].pInfo == info)
+        {
+            rBind.id = i + 1;
+            return;
+        }
+    }
+    
+    mAxisSlots.push_back( { .pDevice = device, .pInfo = info, .value = 0, .set = false } );
+    rBind.id = mAxisSlots.size();
+}
+
+
+
+void Drivers::Gamepad::Driver::CompileAxes( std::vector<Action>& rActions )
+{
+    mAxisSlots.clear();
+    mSetSlots.clear();
+    
+    for (auto& layer : mLayers)
+        ForEachBinding( layer, [this]( Binding& rBind ) { CompileAxis( rBind ); } );
+    
+    for (auto& action : rActions)
+    {
+        CompileAxis( action.out );
+        for (auto& step : action.steps)
+            CompileAxis( step.out );
+    }
+    
+    // Slots never move from here on, so they can be listed by pointer
+    mSetSlots.reserve( mAxisSlots.size() );
+    
+    gLog.Write( Log::DEBUG, FUNC_NAME, "Resolved absolute axis bindings to " + std::to_string(mAxisSlots.size()) + " output axes." );
+}
+
+
+
+void Drivers::Gamepad::Driver::UpdateAxis( const Binding& bind, double value )
+{
+    AxisSlot*           slot;
+    
+    
+    if ((!bind.id) || (bind.id > mAxisSlots.size()))
+        return;
+    
+    slot = &mAxisSlots[bind.id - 1];
+    if (mAxisMerge == AxisMerge::SUM)
+        slot->value += value;
+    else
+    {
+        // First non-zero value wins
+        if ((!value) || (slot->value != 0))
+            return;
+        slot->value = value;
+    }
+    
+    if (!slot->set)
+    {
+        slot->set = true;
+        mSetSlots.push_back( slot );
+    }
+}
+
+
+
+void Drivers::Gamepad::Driver::CommitAxes()
+{
+    // One store per output axis that was written this frame.  The device
+    // works out which axes went back to zero from what it wrote last time.
+    for (auto slot : mSetSlots)
+    {
+        slot->pDevice->SetAbs( slot->pInfo, slot->value );
+        slot->value = 0;
+        slot->set   = false;
+    }
+    mSetSlots.clear();
+}
+
+
+
+int Drivers::Gamepad::Driver::TakeAdopted( unsigned int dev, const Uinput::DeviceConfig& rCfg )
+{
+    int                 fd = mAdoptFd[dev];
+    
+    if (fd < 0)
+        return -1;
+    mAdoptFd[dev] = -1;
+    
+    // The profile may have changed since the device was created
+    if (mAdoptHash[dev] != Uinput::Device::HashConfig( rCfg ))
+    {
+        gLog.Write( Log::INFO, "The " + std::string(gHandoffNames[dev]) + " device of gamepad " + std::to_string(mIndex) + 
+                    " changed since the restart.  Creating a new one." );
+        close( fd );
+        return -1;
+    }
+    
+    return fd;
+}
+
+
+
+void Drivers::Gamepad::Driver::DropAdopted()
+{
+    for (unsigned int i = 0; i < HANDOFF_DEVICES; ++i)
+    {
+        if (mAdoptFd[i] >= 0)
+            close( mAdoptFd[i] );
+        mAdoptFd[i] = -1;
+    }
+}
+
+
+
 void Drivers::Gamepad::Driver::UpdateState( v100::PackedInputDataReport* pIr )
 {
     using namespace     v100;
     DeviceState         old = mState;
+    uint32_t            frames;
+    
+    // Timing
+    // Prefer the hardware frame counter so batched or delayed reads don't
+    // distort the time step.  Fall back to the monotonic clock if the
+    // counter jumps or doesn't advance.
+    mState.frame                = pIr->frame;
+    mState.timestamp            = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    frames                      = mState.frame - old.frame;
+    if (!old.timestamp)
+        mState.dt = REPORT_INTERVAL_SEC;
+    else
+        if ((frames > 0) && (frames * REPORT_INTERVAL_SEC <= MAX_INTERVAL_SEC))
+            mState.dt = frames * REPORT_INTERVAL_SEC;
+        else
+            mState.dt = (mState.timestamp - old.timestamp) * 0.000001;
+    if (mState.dt > MAX_INTERVAL_SEC)
+        mState.dt = MAX_INTERVAL_SEC;
     
     // Buttons
     mState.dpad.up              = pIr->up;
@@ -303,32 +880,41 @@ void Drivers::Gamepad::Driver::UpdateState( v100::PackedInputDataReport* pIr )
     mState.pad.r.press          = pIr->r_pad_press;
     mState.pad.r.force          = (double)pIr->r_pad_force * PAD_FORCE_MULT;
     // Left trackpad deltas
-    if ((mState.pad.l.touch) && (old.pad.l.touch))
+    if ((mState.pad.l.touch) && (old.pad.l.touch) && (mState.dt > 0))
     {
-        mState.pad.l.dx = ((mState.pad.l.sx - old.pad.l.sx) + old.pad.l.dx) / 2.0;
-        mState.pad.l.dy = ((mState.pad.l.sy - old.pad.l.sy) + old.pad.l.dy) / 2.0;
+        mState.pad.l.vx = ((mState.pad.l.sx - old.pad.l.sx) / mState.dt + old.pad.l.vx) / 2.0;
+        mState.pad.l.vy = ((mState.pad.l.sy - old.pad.l.sy) / mState.dt + old.pad.l.vy) / 2.0;
     }
     else
     {
-        // Delta decay / inertia
-        // Rate of decay here is fixed to hardware polling interval, which
-        // seems to be 250Hz.  If the polling rate changes, the decay will need
-        // to reflect that.  For now, 5% feels pretty good.
-        mState.pad.l.dx *= 0.95;
-        mState.pad.l.dy *= 0.95;
+        // Velocity decay / inertia
+        // Decay is applied over elapsed time rather than per report so the
+        // glide is the same regardless of report rate or dropped reports.
+        double decay = exp( -PAD_INERTIA_DECAY * mState.dt );
+        mState.pad.l.vx *= decay;
+        mState.pad.l.vy *= decay;
+        if (hypot( mState.pad.l.vx, mState.pad.l.vy ) < PAD_INERTIA_STOP)
+            mState.pad.l.vx = mState.pad.l.vy = 0;
     }
+    mState.pad.l.dx = mState.pad.l.vx * mState.dt;
+    mState.pad.l.dy = mState.pad.l.vy * mState.dt;
     // Right trackpad deltas
-    if ((mState.pad.r.touch) && (old.pad.r.touch))
+    if ((mState.pad.r.touch) && (old.pad.r.touch) && (mState.dt > 0))
     {
-        mState.pad.r.dx = ((mState.pad.r.sx - old.pad.r.sx) + old.pad.r.dx) / 2.0;
-        mState.pad.r.dy = ((mState.pad.r.sy - old.pad.r.sy) + old.pad.r.dy) / 2.0;
+        mState.pad.r.vx = ((mState.pad.r.sx - old.pad.r.sx) / mState.dt + old.pad.r.vx) / 2.0;
+        mState.pad.r.vy = ((mState.pad.r.sy - old.pad.r.sy) / mState.dt + old.pad.r.vy) / 2.0;
     }
     else
     {
-        // Delta decay / inertia
-        mState.pad.r.dx *= .95;
-        mState.pad.r.dy *= .95;
+        // Velocity decay / inertia
+        double decay = exp( -PAD_INERTIA_DECAY * mState.dt );
+        mState.pad.r.vx *= decay;
+        mState.pad.r.vy *= decay;
+        if (hypot( mState.pad.r.vx, mState.pad.r.vy ) < PAD_INERTIA_STOP)
+            mState.pad.r.vx = mState.pad.r.vy = 0;
     }
+    mState.pad.r.dx = mState.pad.r.vx * mState.dt;
+    mState.pad.r.dy = mState.pad.r.vy * mState.dt;
     // Trackpad deadzones
     if (mState.pad.filtered)
     {
@@ -406,17 +992,68 @@ void Drivers::Gamepad::Driver::UpdateState( v100::PackedInputDataReport* pIr )
     }
     else
     {
-        mState.pad.r.btn_quad_up = mState.pad.r.btn_quad_down = mState.pad.r.btn_quad_left = mState.pad.r.btn_quad_right = false;
-        mState.pad.r.btn_orth_up = mState.pad.r.btn_orth_down = mState.pad.r.btn_orth_left = mState.pad.r.btn_orth_right = false;
-        mState.pad.r.btn_2x2_1 = mState.pad.r.btn_2x2_2 = mState.pad.r.btn_2x2_3 = mState.pad.r.btn_2x2_4 = false;
-        mState.pad.r.btn_3x3_1 = mState.pad.r.btn_3x3_2 = mState.pad.r.btn_3x3_3 = mState.pad.r.btn_3x3_4 = mState.pad.r.btn_3x3_5 = mState.pad.r.btn_3x3_6 = mState.pad.r.btn_3x3_7 = mState.pad.r.btn_3x3_8 = mState.pad.r.btn_3x3_9 = false;
+        mState.pad.r.btn_quad_up = mState.pad.r.btn_quad_down = mState.pad.r.btn_quad_left = mState.pad.r.btn_quad_right = false;
+        mState.pad.r.btn_orth_up = mState.pad.r.btn_orth_down = mState.pad.r.btn_orth_left = mState.pad.r.btn_orth_right = false;
+        mState.pad.r.btn_2x2_1 = mState.pad.r.btn_2x2_2 = mState.pad.r.btn_2x2_3 = mState.pad.r.btn_2x2_4 = false;
+        mState.pad.r.btn_3x3_1 = mState.pad.r.btn_3x3_2 = mState.pad.r.btn_3x3_3 = mState.pad.r.btn_3x3_4 = mState.pad.r.btn_3x3_5 = mState.pad.r.btn_3x3_6 = mState.pad.r.btn_3x3_7 = mState.pad.r.btn_3x3_8 = mState.pad.r.btn_3x3_9 = false;
+    }
+    
+    // Accelerometers
+    mState.accel.x = pIr->accel_x * v100::ACCEL_AXIS_MULT;
+    mState.accel.y = pIr->accel_y * v100::ACCEL_AXIS_MULT;
+    mState.accel.z = pIr->accel_z * v100::ACCEL_AXIS_MULT;
+    
+    // Gyro
+    // Fuse gyro rates and gravity into an attitude estimate.  The filter
+    // works in a body frame where x is the roll axis (device z), y is the
+    // pitch axis (device x) and z is the yaw axis (device y).
+    mMotion.Update( pIr->roll    * v100::GYRO_RADS_MULT,
+                    pIr->pitch   * v100::GYRO_RADS_MULT,
+                    pIr->yaw     * v100::GYRO_RADS_MULT,
+                    pIr->accel_z * v100::ACCEL_G_MULT,
+                    pIr->accel_x * v100::ACCEL_G_MULT,
+                    pIr->accel_y * v100::ACCEL_G_MULT,
+                    mState.dt );
+    mMotion.GetAttitude( mState.att.roll, mState.att.pitch, mState.att.yaw );
+}
+
+
+
+void Drivers::Gamepad::Driver::TransRel( Uinput::Device* device, Binding& bind, double value )
+{
+    uint16_t            code  = bind.ev_code;
+    double              scale = 1.0;
+    int32_t             count;
+    
+    
+#ifdef REL_WHEEL_HI_RES
+    // Scroll wheels are accumulated in high-resolution units, the uinput
+    // device takes care of generating the matching low-res detents.
+    if (bind.ev_code == REL_WHEEL)
+    {
+        code  = REL_WHEEL_HI_RES;
+        scale = Uinput::REL_HI_RES_PER_DETENT;
     }
+    else
+        if (bind.ev_code == REL_HWHEEL)
+        {
+            code  = REL_HWHEEL_HI_RES;
+            scale = Uinput::REL_HI_RES_PER_DETENT;
+        }
+#endif // REL_WHEEL_HI_RES
     
-    // Accelerometers
-    // TODO
+    // Relative events are integers, so carry any fractional remainder over to
+    // the next frame instead of truncating it away.  This keeps slow movements
+    // from being lost regardless of report rate.
+    if (value != 0)
+        mRelActive = true;
     
-    // Gyro
-    // TODO
+    bind.rem += value * bind.gain * scale;
+    count     = (int32_t)bind.rem;
+    bind.rem -= count;
+    
+    if (count)
+        device->UpdateRel( code, count );
 }
 
 
@@ -426,6 +1063,8 @@ void Drivers::Gamepad::Driver::TransEvent( Binding& bind, double state, BindMode
     Uinput::Device*     device = nullptr;
     
     
+    TRACE_PROBE4( trans_event, (int)bind.type, bind.ev_type, bind.ev_code, (int32_t)(state * 1000) );
+    
     // Select which uinput device we need to write to
     switch (bind.type)
     {
@@ -461,7 +1100,7 @@ void Drivers::Gamepad::Driver::TransEvent( Binding& bind, double state, BindMode
                 if (bind.delay > 0)
                 {
                     // Handle repeat-delay (in ms) if set
-                    uint64_t time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+                    uint64_t time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
                     if (time < bind.timestamp)
                         return;
                     bind.timestamp = time + bind.delay;
@@ -476,17 +1115,41 @@ void Drivers::Gamepad::Driver::TransEvent( Binding& bind, double state, BindMode
             if (state)
             {
                 // Enforce a timeout for profile switching when called from binding
-                uint64_t time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+                uint64_t time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
                 if (time < mProfSwitchTimestamp)
                     return;
                 mProfSwitchTimestamp = time + mProfSwitchDelay;
 
                 // Let the daemon know the user wants to switch profiles
-                PushMessage( { .type = Drivers::MsgType::PROFILE, .msg = bind.str, .val = 0 } );
+                PushMessage( { .type = Drivers::MsgType::PROFILE, .id = bind.id, .val = 0 } );
+            }
+            return;
+        break;
+        
+        case BindType::LAYER:  // Switch binding layer
+            if (bind.id < mLayers.size())
+            {
+                bool    pressed = IsBindPressed( state, mode );
+                
+                if (bind.dir)
+                {
+                    // Toggle on press, back to the base layer if it was already on
+                    if (pressed && !mLayerPressed[bind.id])
+                        mLayerToggled = (mLayerToggled == bind.id) ? 0 : bind.id;
+                    mLayerPressed[bind.id] = pressed;
+                }
+                else
+                    if (pressed)
+                        mLayerHeld = bind.id;
             }
             return;
         break;
         
+        case BindType::ACTION:  // Turbo, toggle or macro
+            mActions.Trigger( bind.id, IsBindPressed( state, mode ) );
+            return;
+        break;
+        
         default:
             // Unhandled device type
             gLog.Write( Log::DEBUG, FUNC_NAME, "An unhandled device type occurred." );
@@ -512,14 +1175,14 @@ void Drivers::Gamepad::Driver::TransEvent( Binding& bind, double state, BindMode
                     // If triggered, emit an maximum absolute axis value in the direction specified by
                     // the binding
                     if (state)
-                        device->UpdateAbs( bind.ev_code, (bind.dir) ? 1.0 : -1.0 );
+                        UpdateAxis( bind, (bind.dir) ? 1.0 : -1.0 );
                 break;
                 
                 // Button press emits a relative axis value
                 case EV_REL:
                     // If triggered, emit a relative value in the direction specified in the binding
                     if (state) 
-                        device->UpdateRel( bind.ev_code, (bind.dir) ? 1 : -1 );  // TODO: Some kind of scaling / multiplier
+                        TransRel( device, bind, ((bind.dir) ? 1.0 : -1.0) * v100::REL_AXIS_RATE * mState.dt );
                 break;
                 
                 default:
@@ -545,7 +1208,7 @@ void Drivers::Gamepad::Driver::TransEvent( Binding& bind, double state, BindMode
                     // If triggered, emit the state as a positive or negive absolute axis
                     // value depending on the direction specified in the binding.
                     if (state < 0)
-                        device->UpdateAbs( bind.ev_code, (bind.dir) ? fabs(state) : state );
+                        UpdateAxis( bind, (bind.dir) ? fabs(state) : state );
                         
                 break;
 
@@ -554,7 +1217,7 @@ void Drivers::Gamepad::Driver::TransEvent( Binding& bind, double state, BindMode
                     // If triggered, emit the state as a positive or negative relative axis 
                     // value depending on the direction specified in the binding.
                     if (state < 0)
-                        device->UpdateRel( bind.ev_code, (bind.dir) ? fabs(state) : state );  // TODO Some kind of axis scaling / multiplier
+                        TransRel( device, bind, ((bind.dir) ? fabs(state) : state) * v100::REL_AXIS_RATE * mState.dt );
                 break;
                 
                 default:
@@ -581,7 +1244,7 @@ void Drivers::Gamepad::Driver::TransEvent( Binding& bind, double state, BindMode
                     // If triggered, emit the state as a positive or negive absolute axis
                     // value depending on the direction specified in the binding.
                     if (state > 0)
-                        device->UpdateAbs( bind.ev_code, (bind.dir) ? state : state * -1.0 );
+                        UpdateAxis( bind, (bind.dir) ? state : state * -1.0 );
                 break;
 
                 // Axis UP/LEFT emits an absolute axis event
@@ -589,7 +1252,7 @@ void Drivers::Gamepad::Driver::TransEvent( Binding& bind, double state, BindMode
                     // If triggered, emit the state as a positive or negative relative axis 
                     // value depending on the direction specified in the binding.
                     if (state > 0)
-                        device->UpdateRel( bind.ev_code, (bind.dir) ? state : state * -1.0 );  // TODO Some kind of axis scaling / multiplier
+                        TransRel( device, bind, ((bind.dir) ? state : state * -1.0) * v100::REL_AXIS_RATE * mState.dt );
                 break;
                 
                 // Unsupported input event type
@@ -607,7 +1270,8 @@ void Drivers::Gamepad::Driver::TransEvent( Binding& bind, double state, BindMode
                 // TODO: handle other bind types?  Is it practical?
                 
                 case EV_REL:
-                    device->UpdateRel( bind.ev_code, state );
+                    // Motion passes through as is unless a direction was given
+                    TransRel( device, bind, (bind.dir || !bind.dir_set) ? state : state * -1.0 );
                 break;
                 
                 default:
@@ -632,134 +1296,193 @@ void Drivers::Gamepad::Driver::Translate()
 {
     // Map normalized event values using the pregenerated map and write them to
     // our uinput event buffer
+    BindMap&        map = mLayers[mLayer];
+    uint32_t        next;
+    
+    mRelActive = false;
+    mLayerHeld = 0;
+    
+    // Run any action timers that are due before looking at new input
+    mActions.Advance( std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count() );
+    mActions.BeginFrame();
     
     // Dpad
-    TransEvent( mMap.dpad.up,               mState.dpad.up,                 BindMode::BUTTON );
-    TransEvent( mMap.dpad.down,             mState.dpad.down,               BindMode::BUTTON );
-    TransEvent( mMap.dpad.left,             mState.dpad.left,               BindMode::BUTTON );
-    TransEvent( mMap.dpad.right,            mState.dpad.right,              BindMode::BUTTON );
+    TransEvent( map.dpad.up,                 mState.dpad.up,                 BindMode::BUTTON );
+    TransEvent( map.dpad.down,               mState.dpad.down,               BindMode::BUTTON );
+    TransEvent( map.dpad.left,               mState.dpad.left,               BindMode::BUTTON );
+    TransEvent( map.dpad.right,              mState.dpad.right,              BindMode::BUTTON );
     // Buttons
-    TransEvent( mMap.btn.a,                 mState.btn.a,                   BindMode::BUTTON );
-    TransEvent( mMap.btn.b,                 mState.btn.b,                   BindMode::BUTTON );
-    TransEvent( mMap.btn.x,                 mState.btn.x,                   BindMode::BUTTON );
-    TransEvent( mMap.btn.y,                 mState.btn.y,                   BindMode::BUTTON );
-    TransEvent( mMap.btn.l1,                mState.btn.l1,                  BindMode::BUTTON );
-    TransEvent( mMap.btn.l2,                mState.btn.l2,                  BindMode::BUTTON );
-    TransEvent( mMap.btn.l3,                mState.btn.l3,                  BindMode::BUTTON );
-    TransEvent( mMap.btn.l4,                mState.btn.l4,                  BindMode::BUTTON );
-    TransEvent( mMap.btn.l5,                mState.btn.l5,                  BindMode::BUTTON );
-    TransEvent( mMap.btn.r1,                mState.btn.r1,                  BindMode::BUTTON );
-    TransEvent( mMap.btn.r2,                mState.btn.r2,                  BindMode::BUTTON );
-    TransEvent( mMap.btn.r3,                mState.btn.r3,                  BindMode::BUTTON );
-    TransEvent( mMap.btn.r4,                mState.btn.r4,                  BindMode::BUTTON );
-    TransEvent( mMap.btn.r5,                mState.btn.r5,                  BindMode::BUTTON );
-    TransEvent( mMap.btn.menu,              mState.btn.menu,                BindMode::BUTTON );
-    TransEvent( mMap.btn.options,           mState.btn.options,             BindMode::BUTTON );
-    TransEvent( mMap.btn.steam,             mState.btn.steam,               BindMode::BUTTON );
-    TransEvent( mMap.btn.quick_access,      mState.btn.quick_access,        BindMode::BUTTON );
+    TransEvent( map.btn.a,                   mState.btn.a,                   BindMode::BUTTON );
+    TransEvent( map.btn.b,                   mState.btn.b,                   BindMode::BUTTON );
+    TransEvent( map.btn.x,                   mState.btn.x,                   BindMode::BUTTON );
+    TransEvent( map.btn.y,                   mState.btn.y,                   BindMode::BUTTON );
+    TransEvent( map.btn.l1,                  mState.btn.l1,                  BindMode::BUTTON );
+    TransEvent( map.btn.l2,                  mState.btn.l2,                  BindMode::BUTTON );
+    TransEvent( map.btn.l3,                  mState.btn.l3,                  BindMode::BUTTON );
+    TransEvent( map.btn.l4,                  mState.btn.l4,                  BindMode::BUTTON );
+    TransEvent( map.btn.l5,                  mState.btn.l5,                  BindMode::BUTTON );
+    TransEvent( map.btn.r1,                  mState.btn.r1,                  BindMode::BUTTON );
+    TransEvent( map.btn.r2,                  mState.btn.r2,                  BindMode::BUTTON );
+    TransEvent( map.btn.r3,                  mState.btn.r3,                  BindMode::BUTTON );
+    TransEvent( map.btn.r4,                  mState.btn.r4,                  BindMode::BUTTON );
+    TransEvent( map.btn.r5,                  mState.btn.r5,                  BindMode::BUTTON );
+    TransEvent( map.btn.menu,                mState.btn.menu,                BindMode::BUTTON );
+    TransEvent( map.btn.options,             mState.btn.options,             BindMode::BUTTON );
+    TransEvent( map.btn.steam,               mState.btn.steam,               BindMode::BUTTON );
+    TransEvent( map.btn.quick_access,        mState.btn.quick_access,        BindMode::BUTTON );
     // Triggers
-    TransEvent( mMap.trigg.l,               mState.trigg.l.z,               BindMode::PRESSURE );
-    TransEvent( mMap.trigg.r,               mState.trigg.r.z,               BindMode::PRESSURE );
+    TransEvent( map.trigg.l,                 mState.trigg.l.z,               BindMode::PRESSURE );
+    TransEvent( map.trigg.r,                 mState.trigg.r.z,               BindMode::PRESSURE );
     // Sticks
-    TransEvent( mMap.stick.l.up,            mState.stick.l.y,               BindMode::AXIS_MINUS );
-    TransEvent( mMap.stick.l.down,          mState.stick.l.y,               BindMode::AXIS_PLUS );
-    TransEvent( mMap.stick.l.left,          mState.stick.l.x,               BindMode::AXIS_MINUS );
-    TransEvent( mMap.stick.l.right,         mState.stick.l.x,               BindMode::AXIS_PLUS );
-    TransEvent( mMap.stick.l.touch,         mState.stick.l.touch,           BindMode::BUTTON );
-    TransEvent( mMap.stick.l.force,         mState.stick.l.force,           BindMode::PRESSURE );
-    TransEvent( mMap.stick.r.up,            mState.stick.r.y,               BindMode::AXIS_MINUS );
-    TransEvent( mMap.stick.r.down,          mState.stick.r.y,               BindMode::AXIS_PLUS );
-    TransEvent( mMap.stick.r.left,          mState.stick.r.x,               BindMode::AXIS_MINUS );
-    TransEvent( mMap.stick.r.right,         mState.stick.r.x,               BindMode::AXIS_PLUS );
-    TransEvent( mMap.stick.r.touch,         mState.stick.r.touch,           BindMode::BUTTON );
-    TransEvent( mMap.stick.r.force,         mState.stick.r.force,           BindMode::PRESSURE );
+    TransEvent( map.stick.l.up,              mState.stick.l.y,               BindMode::AXIS_MINUS );
+    TransEvent( map.stick.l.down,            mState.stick.l.y,               BindMode::AXIS_PLUS );
+    TransEvent( map.stick.l.left,            mState.stick.l.x,               BindMode::AXIS_MINUS );
+    TransEvent( map.stick.l.right,           mState.stick.l.x,               BindMode::AXIS_PLUS );
+    TransEvent( map.stick.l.touch,           mState.stick.l.touch,           BindMode::BUTTON );
+    TransEvent( map.stick.l.force,           mState.stick.l.force,           BindMode::PRESSURE );
+    TransEvent( map.stick.r.up,              mState.stick.r.y,               BindMode::AXIS_MINUS );
+    TransEvent( map.stick.r.down,            mState.stick.r.y,               BindMode::AXIS_PLUS );
+    TransEvent( map.stick.r.left,            mState.stick.r.x,               BindMode::AXIS_MINUS );
+    TransEvent( map.stick.r.right,           mState.stick.r.x,               BindMode::AXIS_PLUS );
+    TransEvent( map.stick.r.touch,           mState.stick.r.touch,           BindMode::BUTTON );
+    TransEvent( map.stick.r.force,           mState.stick.r.force,           BindMode::PRESSURE );
     // Pads
-    TransEvent( mMap.pad.l.up,              mState.pad.l.y,                 BindMode::AXIS_MINUS );
-    TransEvent( mMap.pad.l.down,            mState.pad.l.y,                 BindMode::AXIS_PLUS );
-    TransEvent( mMap.pad.l.left,            mState.pad.l.x,                 BindMode::AXIS_MINUS );
-    TransEvent( mMap.pad.l.right,           mState.pad.l.x,                 BindMode::AXIS_PLUS );
-    TransEvent( mMap.pad.l.rel_x,           mState.pad.l.dx,                BindMode::RELATIVE );
-    TransEvent( mMap.pad.l.rel_y,           mState.pad.l.dy,                BindMode::RELATIVE );
-    TransEvent( mMap.pad.l.touch,           mState.pad.l.touch,             BindMode::BUTTON );
-    TransEvent( mMap.pad.l.press,           mState.pad.l.press,             BindMode::BUTTON );
-    TransEvent( mMap.pad.l.force,           mState.pad.l.force,             BindMode::PRESSURE );
-    TransEvent( mMap.pad.l.btn_quad_up,     mState.pad.l.btn_quad_up,       BindMode::BUTTON );
-    TransEvent( mMap.pad.l.btn_quad_down,   mState.pad.l.btn_quad_down,     BindMode::BUTTON );
-    TransEvent( mMap.pad.l.btn_quad_left,   mState.pad.l.btn_quad_left,     BindMode::BUTTON );
-    TransEvent( mMap.pad.l.btn_quad_right,  mState.pad.l.btn_quad_right,    BindMode::BUTTON );
-    TransEvent( mMap.pad.l.btn_orth_up,     mState.pad.l.btn_orth_up,       BindMode::BUTTON );
-    TransEvent( mMap.pad.l.btn_orth_down,   mState.pad.l.btn_orth_down,     BindMode::BUTTON );
-    TransEvent( mMap.pad.l.btn_orth_left,   mState.pad.l.btn_orth_left,     BindMode::BUTTON );
-    TransEvent( mMap.pad.l.btn_orth_right,  mState.pad.l.btn_orth_right,    BindMode::BUTTON );
-    TransEvent( mMap.pad.l.btn_2x2_1,       mState.pad.l.btn_2x2_1,         BindMode::BUTTON );
-    TransEvent( mMap.pad.l.btn_2x2_2,       mState.pad.l.btn_2x2_2,         BindMode::BUTTON );
-    TransEvent( mMap.pad.l.btn_2x2_3,       mState.pad.l.btn_2x2_3,         BindMode::BUTTON );
-    TransEvent( mMap.pad.l.btn_2x2_4,       mState.pad.l.btn_2x2_4,         BindMode::BUTTON );
-    TransEvent( mMap.pad.l.btn_3x3_1,       mState.pad.l.btn_3x3_1,         BindMode::BUTTON );
-    TransEvent( mMap.pad.l.btn_3x3_2,       mState.pad.l.btn_3x3_2,         BindMode::BUTTON );
-    TransEvent( mMap.pad.l.btn_3x3_3,       mState.pad.l.btn_3x3_3,         BindMode::BUTTON );
-    TransEvent( mMap.pad.l.btn_3x3_4,       mState.pad.l.btn_3x3_4,         BindMode::BUTTON );
-    TransEvent( mMap.pad.l.btn_3x3_5,       mState.pad.l.btn_3x3_5,         BindMode::BUTTON );
-    TransEvent( mMap.pad.l.btn_3x3_6,       mState.pad.l.btn_3x3_6,         BindMode::BUTTON );
-    TransEvent( mMap.pad.l.btn_3x3_7,       mState.pad.l.btn_3x3_7,         BindMode::BUTTON );
-    TransEvent( mMap.pad.l.btn_3x3_8,       mState.pad.l.btn_3x3_8,         BindMode::BUTTON );
-    TransEvent( mMap.pad.l.btn_3x3_9,       mState.pad.l.btn_3x3_9,         BindMode::BUTTON );
-    TransEvent( mMap.pad.r.up,              mState.pad.r.y,                 BindMode::AXIS_MINUS );
-    TransEvent( mMap.pad.r.down,            mState.pad.r.y,                 BindMode::AXIS_PLUS );
-    TransEvent( mMap.pad.r.left,            mState.pad.r.x,                 BindMode::AXIS_MINUS );
-    TransEvent( mMap.pad.r.right,           mState.pad.r.x,                 BindMode::AXIS_PLUS );
-    TransEvent( mMap.pad.r.rel_x,           mState.pad.r.dx,                BindMode::RELATIVE );
-    TransEvent( mMap.pad.r.rel_y,           mState.pad.r.dy,                BindMode::RELATIVE );
-    TransEvent( mMap.pad.r.touch,           mState.pad.r.touch,             BindMode::BUTTON );
-    TransEvent( mMap.pad.r.press,           mState.pad.r.press,             BindMode::BUTTON );
-    TransEvent( mMap.pad.r.force,           mState.pad.r.force,             BindMode::PRESSURE );
-    TransEvent( mMap.pad.r.btn_quad_up,     mState.pad.r.btn_quad_up,       BindMode::BUTTON );
-    TransEvent( mMap.pad.r.btn_quad_down,   mState.pad.r.btn_quad_down,     BindMode::BUTTON );
-    TransEvent( mMap.pad.r.btn_quad_left,   mState.pad.r.btn_quad_left,     BindMode::BUTTON );
-    TransEvent( mMap.pad.r.btn_quad_right,  mState.pad.r.btn_quad_right,    BindMode::BUTTON );
-    TransEvent( mMap.pad.r.btn_orth_up,     mState.pad.r.btn_orth_up,       BindMode::BUTTON );
-    TransEvent( mMap.pad.r.btn_orth_down,   mState.pad.r.btn_orth_down,     BindMode::BUTTON );
-    TransEvent( mMap.pad.r.btn_orth_left,   mState.pad.r.btn_orth_left,     BindMode::BUTTON );
-    TransEvent( mMap.pad.r.btn_orth_right,  mState.pad.r.btn_orth_right,    BindMode::BUTTON );
-    TransEvent( mMap.pad.r.btn_2x2_1,       mState.pad.r.btn_2x2_1,         BindMode::BUTTON );
-    TransEvent( mMap.pad.r.btn_2x2_2,       mState.pad.r.btn_2x2_2,         BindMode::BUTTON );
-    TransEvent( mMap.pad.r.btn_2x2_3,       mState.pad.r.btn_2x2_3,         BindMode::BUTTON );
-    TransEvent( mMap.pad.r.btn_2x2_4,       mState.pad.r.btn_2x2_4,         BindMode::BUTTON );
-    TransEvent( mMap.pad.r.btn_3x3_1,       mState.pad.r.btn_3x3_1,         BindMode::BUTTON );
-    TransEvent( mMap.pad.r.btn_3x3_2,       mState.pad.r.btn_3x3_2,         BindMode::BUTTON );
-    TransEvent( mMap.pad.r.btn_3x3_3,       mState.pad.r.btn_3x3_3,         BindMode::BUTTON );
-    TransEvent( mMap.pad.r.btn_3x3_4,       mState.pad.r.btn_3x3_4,         BindMode::BUTTON );
-    TransEvent( mMap.pad.r.btn_3x3_5,       mState.pad.r.btn_3x3_5,         BindMode::BUTTON );
-    TransEvent( mMap.pad.r.btn_3x3_6,       mState.pad.r.btn_3x3_6,         BindMode::BUTTON );
-    TransEvent( mMap.pad.r.btn_3x3_7,       mState.pad.r.btn_3x3_7,         BindMode::BUTTON );
-    TransEvent( mMap.pad.r.btn_3x3_8,       mState.pad.r.btn_3x3_8,         BindMode::BUTTON );
-    TransEvent( mMap.pad.r.btn_3x3_9,       mState.pad.r.btn_3x3_9,         BindMode::BUTTON );
+    TransEvent( map.pad.l.up,                mState.pad.l.y,                 BindMode::AXIS_MINUS );
+    TransEvent( map.pad.l.down,              mState.pad.l.y,                 BindMode::AXIS_PLUS );
+    TransEvent( map.pad.l.left,              mState.pad.l.x,                 BindMode::AXIS_MINUS );
+    TransEvent( map.pad.l.right,             mState.pad.l.x,                 BindMode::AXIS_PLUS );
+    TransEvent( map.pad.l.rel_x,             mState.pad.l.dx,                BindMode::RELATIVE );
+    TransEvent( map.pad.l.rel_y,             mState.pad.l.dy,                BindMode::RELATIVE );
+    TransEvent( map.pad.l.touch,             mState.pad.l.touch,             BindMode::BUTTON );
+    TransEvent( map.pad.l.press,             mState.pad.l.press,             BindMode::BUTTON );
+    TransEvent( map.pad.l.force,             mState.pad.l.force,             BindMode::PRESSURE );
+    TransEvent( map.pad.l.btn_quad_up,       mState.pad.l.btn_quad_up,       BindMode::BUTTON );
+    TransEvent( map.pad.l.btn_quad_down,     mState.pad.l.btn_quad_down,     BindMode::BUTTON );
+    TransEvent( map.pad.l.btn_quad_left,     mState.pad.l.btn_quad_left,     BindMode::BUTTON );
+    TransEvent( map.pad.l.btn_quad_right,    mState.pad.l.btn_quad_right,    BindMode::BUTTON );
+    TransEvent( map.pad.l.btn_orth_up,       mState.pad.l.btn_orth_up,       BindMode::BUTTON );
+    TransEvent( map.pad.l.btn_orth_down,     mState.pad.l.btn_orth_down,     BindMode::BUTTON );
+    TransEvent( map.pad.l.btn_orth_left,     mState.pad.l.btn_orth_left,     BindMode::BUTTON );
+    TransEvent( map.pad.l.btn_orth_right,    mState.pad.l.btn_orth_right,    BindMode::BUTTON );
+    TransEvent( map.pad.l.btn_2x2_1,         mState.pad.l.btn_2x2_1,         BindMode::BUTTON );
+    TransEvent( map.pad.l.btn_2x2_2,         mState.pad.l.btn_2x2_2,         BindMode::BUTTON );
+    TransEvent( map.pad.l.btn_2x2_3,         mState.pad.l.btn_2x2_3,         BindMode::BUTTON );
+    TransEvent( map.pad.l.btn_2x2_4,         mState.pad.l.btn_2x2_4,         BindMode::BUTTON );
+    TransEvent( map.pad.l.btn_3x3_1,         mState.pad.l.btn_3x3_1,         BindMode::BUTTON );
+    TransEvent( map.pad.l.btn_3x3_2,         mState.pad.l.btn_3x3_2,         BindMode::BUTTON );
+    TransEvent( map.pad.l.btn_3x3_3,         mState.pad.l.btn_3x3_3,         BindMode::BUTTON );
+    TransEvent( map.pad.l.btn_3x3_4,         mState.pad.l.btn_3x3_4,         BindMode::BUTTON );
+    TransEvent( map.pad.l.btn_3x3_5,         mState.pad.l.btn_3x3_5,         BindMode::BUTTON );
+    TransEvent( map.pad.l.btn_3x3_6,         mState.pad.l.btn_3x3_6,         BindMode::BUTTON );
+    TransEvent( map.pad.l.btn_3x3_7,         mState.pad.l.btn_3x3_7,         BindMode::BUTTON );
+    TransEvent( map.pad.l.btn_3x3_8,         mState.pad.l.btn_3x3_8,         BindMode::BUTTON );
+    TransEvent( map.pad.l.btn_3x3_9,         mState.pad.l.btn_3x3_9,         BindMode::BUTTON );
+    TransEvent( map.pad.r.up,                mState.pad.r.y,                 BindMode::AXIS_MINUS );
+    TransEvent( map.pad.r.down,              mState.pad.r.y,                 BindMode::AXIS_PLUS );
+    TransEvent( map.pad.r.left,              mState.pad.r.x,                 BindMode::AXIS_MINUS );
+    TransEvent( map.pad.r.right,             mState.pad.r.x,                 BindMode::AXIS_PLUS );
+    TransEvent( map.pad.r.rel_x,             mState.pad.r.dx,                BindMode::RELATIVE );
+    TransEvent( map.pad.r.rel_y,             mState.pad.r.dy,                BindMode::RELATIVE );
+    TransEvent( map.pad.r.touch,             mState.pad.r.touch,             BindMode::BUTTON );
+    TransEvent( map.pad.r.press,             mState.pad.r.press,             BindMode::BUTTON );
+    TransEvent( map.pad.r.force,             mState.pad.r.force,             BindMode::PRESSURE );
+    TransEvent( map.pad.r.btn_quad_up,       mState.pad.r.btn_quad_up,       BindMode::BUTTON );
+    TransEvent( map.pad.r.btn_quad_down,     mState.pad.r.btn_quad_down,     BindMode::BUTTON );
+    TransEvent( map.pad.r.btn_quad_left,     mState.pad.r.btn_quad_left,     BindMode::BUTTON );
+    TransEvent( map.pad.r.btn_quad_right,    mState.pad.r.btn_quad_right,    BindMode::BUTTON );
+    TransEvent( map.pad.r.btn_orth_up,       mState.pad.r.btn_orth_up,       BindMode::BUTTON );
+    TransEvent( map.pad.r.btn_orth_down,     mState.pad.r.btn_orth_down,     BindMode::BUTTON );
+    TransEvent( map.pad.r.btn_orth_left,     mState.pad.r.btn_orth_left,     BindMode::BUTTON );
+    TransEvent( map.pad.r.btn_orth_right,    mState.pad.r.btn_orth_right,    BindMode::BUTTON );
+    TransEvent( map.pad.r.btn_2x2_1,         mState.pad.r.btn_2x2_1,         BindMode::BUTTON );
+    TransEvent( map.pad.r.btn_2x2_2,         mState.pad.r.btn_2x2_2,         BindMode::BUTTON );
+    TransEvent( map.pad.r.btn_2x2_3,         mState.pad.r.btn_2x2_3,         BindMode::BUTTON );
+    TransEvent( map.pad.r.btn_2x2_4,         mState.pad.r.btn_2x2_4,         BindMode::BUTTON );
+    TransEvent( map.pad.r.btn_3x3_1,         mState.pad.r.btn_3x3_1,         BindMode::BUTTON );
+    TransEvent( map.pad.r.btn_3x3_2,         mState.pad.r.btn_3x3_2,         BindMode::BUTTON );
+    TransEvent( map.pad.r.btn_3x3_3,         mState.pad.r.btn_3x3_3,         BindMode::BUTTON );
+    TransEvent( map.pad.r.btn_3x3_4,         mState.pad.r.btn_3x3_4,         BindMode::BUTTON );
+    TransEvent( map.pad.r.btn_3x3_5,         mState.pad.r.btn_3x3_5,         BindMode::BUTTON );
+    TransEvent( map.pad.r.btn_3x3_6,         mState.pad.r.btn_3x3_6,         BindMode::BUTTON );
+    TransEvent( map.pad.r.btn_3x3_7,         mState.pad.r.btn_3x3_7,         BindMode::BUTTON );
+    TransEvent( map.pad.r.btn_3x3_8,         mState.pad.r.btn_3x3_8,         BindMode::BUTTON );
+    TransEvent( map.pad.r.btn_3x3_9,         mState.pad.r.btn_3x3_9,         BindMode::BUTTON );
     // Accelerometers
-    TransEvent( mMap.accel.x_plus,          mState.accel.x,                 BindMode::AXIS_PLUS );
-    TransEvent( mMap.accel.x_minus,         mState.accel.x,                 BindMode::AXIS_MINUS );
-    TransEvent( mMap.accel.y_plus,          mState.accel.y,                 BindMode::AXIS_PLUS );
-    TransEvent( mMap.accel.y_minus,         mState.accel.y,                 BindMode::AXIS_MINUS );
-    TransEvent( mMap.accel.z_plus,          mState.accel.z,                 BindMode::AXIS_PLUS );
-    TransEvent( mMap.accel.z_minus,         mState.accel.z,                 BindMode::AXIS_MINUS );
+    TransEvent( map.accel.x_plus,            mState.accel.x,                 BindMode::AXIS_PLUS );
+    TransEvent( map.accel.x_minus,           mState.accel.x,                 BindMode::AXIS_MINUS );
+    TransEvent( map.accel.y_plus,            mState.accel.y,                 BindMode::AXIS_PLUS );
+    TransEvent( map.accel.y_minus,           mState.accel.y,                 BindMode::AXIS_MINUS );
+    TransEvent( map.accel.z_plus,            mState.accel.z,                 BindMode::AXIS_PLUS );
+    TransEvent( map.accel.z_minus,           mState.accel.z,                 BindMode::AXIS_MINUS );
     // Gyros
-    TransEvent( mMap.att.roll_plus,         mState.att.roll,                BindMode::AXIS_PLUS );
-    TransEvent( mMap.att.roll_minus,        mState.att.roll,                BindMode::AXIS_MINUS );
-    TransEvent( mMap.att.pitch_plus,        mState.att.pitch,               BindMode::AXIS_PLUS );
-    TransEvent( mMap.att.pitch_minus,       mState.att.pitch,               BindMode::AXIS_MINUS );
-    TransEvent( mMap.att.yaw_plus,          mState.att.yaw,                 BindMode::AXIS_PLUS );
-    TransEvent( mMap.att.yaw_minus,         mState.att.yaw,                 BindMode::AXIS_MINUS );
+    TransEvent( map.att.roll_plus,           mState.att.roll,                BindMode::AXIS_PLUS );
+    TransEvent( map.att.roll_minus,          mState.att.roll,                BindMode::AXIS_MINUS );
+    TransEvent( map.att.pitch_plus,          mState.att.pitch,               BindMode::AXIS_PLUS );
+    TransEvent( map.att.pitch_minus,         mState.att.pitch,               BindMode::AXIS_MINUS );
+    TransEvent( map.att.yaw_plus,            mState.att.yaw,                 BindMode::AXIS_PLUS );
+    TransEvent( map.att.yaw_minus,           mState.att.yaw,                 BindMode::AXIS_MINUS );
+    
+    // Release actions the current layer no longer binds, then emit the 
+    // outputs held by turbo, toggle and macro bindings
+    mActions.EndFrame();
+    for (auto& i : mActions.GetOutputs())
+        TransEvent( *i, 1.0, BindMode::BUTTON );
+    
+    // Layer changes take effect on the next frame
+    next = mLayerHeld ? mLayerHeld : mLayerToggled;
+    if (next != mLayer)
+    {
+        mLayer = next;
+        // Apply the new layer even if the input doesn't change
+        mLastReportValid = false;
+    }
 }
 
 
 
-void Drivers::Gamepad::Driver::Flush()
+void Drivers::Gamepad::Driver::TickActions()
 {
-    if (mpGamepad != nullptr)
-        mpGamepad->Flush();
-    if (mpMotion != nullptr)
-        mpMotion->Flush();
-    if (mpMouse != nullptr)
-        mpMouse->Flush();
+    DeviceState     saved = mState;
+    
+    // Rebuild the outputs from the last report, without repeating its
+    // relative motion
+    mState.dt = 0;
+    mState.pad.l.dx = mState.pad.l.dy = 0;
+    mState.pad.r.dx = mState.pad.r.dy = 0;
+    Translate();
+    Flush();
+    mState = saved;
+}
+
+
+
+void Drivers::Gamepad::Driver::Flush( bool force )
+{
+    CommitAxes();
+    
+    if (mFrameIo.IsActive())
+        mFrameIo.Flush( { mpGamepad, mpMotion, mpMouse }, force );
+    else
+    {
+        if (mpGamepad != nullptr)
+            mpGamepad->Flush( force );
+        if (mpMotion != nullptr)
+            mpMotion->Flush( force );
+        if (mpMouse != nullptr)
+            mpMouse->Flush( force );
+    }
+    
+    // Motion output changes every frame and would crowd everything else out
+    // of the recorder
+    if (mRecorder.IsEnabled())
+    {
+        uint64_t        now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        
+        if (mpGamepad != nullptr)
+            mRecorder.RecordEvents( 0, mFrameIo.IsActive() ? mFrameIo.GetFrame( 0 ) : mpGamepad->GetFrame(), mState.frame, now );
+        if (mpMouse != nullptr)
+            mRecorder.RecordEvents( 2, mFrameIo.IsActive() ? mFrameIo.GetFrame( 2 ) : mpMouse->GetFrame(), mState.frame, now );
+    }
 }
 
 
@@ -773,6 +1496,7 @@ int Drivers::Gamepad::Driver::SetProfile( const Drivers::Gamepad::Profile& rProf
 
     // Lock driver so we can make changes
     std::lock_guard<std::mutex>     lock( mPollMutex );
+    std::lock_guard<std::mutex>     ff_lock( mFFMutex );
     
     // Wait 50ms for threads to hit the mutex just to be safe
     usleep( 50000 );
@@ -780,6 +1504,22 @@ int Drivers::Gamepad::Driver::SetProfile( const Drivers::Gamepad::Profile& rProf
     // Destroy any uinput objects since we need to create new ones
     DestroyUinputDevs();
     
+    // Let the FF thread know it needs to pick up the new gamepad device once
+    // we're done here
+    mFFDevChanged = true;
+    if (mFFWakeFd >= 0)
+    {
+        uint64_t    val = 1;
+        if (write( mFFWakeFd, &val, sizeof(val) ) < 0)
+            gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to wake FF thread." );
+    }
+    
+    // Start attitude estimate from scratch
+    mMotion.Reset();
+    
+    // New mappings have to be applied even if the input doesn't change
+    mLastReportValid = false;
+    
     // Create Gamepad device
     cfg.deviceinfo.name         = rProf.dev.gamepad.name;
     cfg.deviceinfo.vid          = rProf.dev.gamepad.vid;
@@ -792,7 +1532,8 @@ int Drivers::Gamepad::Driver::SetProfile( const Drivers::Gamepad::Profile& rProf
     cfg.key_list                = rProf.dev.gamepad.key_list;
     cfg.abs_list                = rProf.dev.gamepad.abs_list;
     cfg.rel_list.clear();
-    try { mpGamepad = new Uinput::Device( cfg ); } catch (...)
+    cfg.output                  = rProf.dev.gamepad.output;
+    try { mpGamepad = new Uinput::Device( cfg, TakeAdopted( 0, cfg ) ); } catch (...)
     {
         gLog.Write( Log::ERROR, "Failed to create gamepad uinput device." );
         DestroyUinputDevs();
@@ -813,7 +1554,8 @@ int Drivers::Gamepad::Driver::SetProfile( const Drivers::Gamepad::Profile& rProf
         cfg.key_list.clear();
         cfg.abs_list                = rProf.dev.motion.abs_list;
         cfg.rel_list.clear();
-        try { mpMotion = new Uinput::Device( cfg ); } catch (...)
+        cfg.output                  = rProf.dev.motion.output;
+        try { mpMotion = new Uinput::Device( cfg, TakeAdopted( 1, cfg ) ); } catch (...)
         {
             gLog.Write( Log::ERROR, "Failed to create motion control uinput device." );
             DestroyUinputDevs();
@@ -835,7 +1577,8 @@ int Drivers::Gamepad::Driver::SetProfile( const Drivers::Gamepad::Profile& rProf
         cfg.key_list                = rProf.dev.mouse.key_list;
         cfg.abs_list.clear();
         cfg.rel_list                = rProf.dev.mouse.rel_list;
-        try { mpMouse = new Uinput::Device( cfg ); } catch (...)
+        cfg.output                  = rProf.dev.mouse.output;
+        try { mpMouse = new Uinput::Device( cfg, TakeAdopted( 2, cfg ) ); } catch (...)
         {
             gLog.Write( Log::ERROR, "Failed to create trackpad/mouse uinput device." );
             DestroyUinputDevs();
@@ -843,8 +1586,24 @@ int Drivers::Gamepad::Driver::SetProfile( const Drivers::Gamepad::Profile& rProf
         }
     }
       
+    // Devices the profile doesn't use any more
+    DropAdopted();
+    
     // Set bindings
-    mMap = rProf.map;
+    mLayers.clear();
+    mLayers.push_back( rProf.map );
+    mLayers.insert( mLayers.end(), rProf.layers.begin(), rProf.layers.end() );
+    mLayer          = 0;
+    mLayerHeld      = 0;
+    mLayerToggled   = 0;
+    mLayerPressed.assign( mLayers.size(), 0 );
+    mAxisMerge      = rProf.features.axis_merge;
+    {
+        std::vector<Action>     actions = rProf.actions;
+        
+        CompileAxes( actions );
+        mActions.Load( actions, std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count() );
+    }
     
     // Set Deadzones
     SetStickFiltering( rProf.features.filter_sticks );
@@ -856,26 +1615,62 @@ int Drivers::Gamepad::Driver::SetProfile( const Drivers::Gamepad::Profile& rProf
     SetDeadzone( AxisEnum::L_TRIGG, rProf.dz.trigg.l );
     SetDeadzone( AxisEnum::R_TRIGG, rProf.dz.trigg.r );
     
+    TRACE_PROBE1( profile_set, mIndex );
+    mRecorder.RecordMark( RecMark::PROFILE, 0, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count() );
+    // The driver was held up while switching, which is expected
+    mLastReportNs = 0;
+    
     // Done
     return Err::OK;
 }
 
 
 
+void Drivers::Gamepad::Driver::ApplyCommands()
+{
+    Drivers::Message    msg;
+    
+    while (mCmdRing.Pop( msg ))
+    {
+        switch (msg.type)
+        {
+            case Drivers::MsgType::DEADZONE:
+                SetDeadzone( (AxisEnum)msg.id, msg.val );
+                // Output changes even if the input doesn't
+                mLastReportValid = false;
+            break;
+            
+            default:
+                gLog.Write( Log::DEBUG, FUNC_NAME, "Ignoring unknown gamepad driver command." );
+            break;
+        }
+    }
+}
+
+
+
 int Drivers::Gamepad::Driver::Poll()
 {
-    // Use static to avoid construction costs since reports should usually
-    // be the same size.  The underlying memory will stay allocated between
-    // calls.
-    static std::vector<uint8_t>     buff;
+    // The member buffer avoids construction costs since reports should 
+    // usually be the same size.  The underlying memory will stay allocated
+    // between calls.
+    std::vector<uint8_t>&           buff = mReadBuff;
     int                             result;
+    int                             timeout;
     
     using namespace v100;
     
     // Prevent other public functions from being called while handling device input
     std::lock_guard<std::mutex>     lock( mPollMutex );
+    
+    ApplyCommands();
 
-    result = mHid.Read( buff );
+    // Wake up in time for the next action timer
+    timeout = mActions.GetTimeout( std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count() );
+    if (mFrameIo.IsActive())
+        result = mFrameIo.Read( buff, timeout );
+    else
+        result = mHid.Read( buff, timeout );
     if (result != Err::OK)
     {
         switch (result)
@@ -891,8 +1686,7 @@ int Drivers::Gamepad::Driver::Poll()
             break;
             
             case Err::DEVICE_LOST:
-                gLog.Write( Log::ERROR, "Gamepad device has been lost.  Terminating gamepad driver." );
-                mRunning = false;
+                gLog.Write( Log::ERROR, "Gamepad device has been lost." );
                 return Err::DEVICE_LOST;
             break;
 
@@ -906,124 +1700,394 @@ int Drivers::Gamepad::Driver::Poll()
     if (buff.size())
         HandleInputReport( buff );
     else
-        gLog.Write( Log::VERB, FUNC_NAME, "Received zero-length report from gamepad device." );
+        if (mActions.IsBusy())
+            TickActions();  // Woke up for an action timer
+        else
+            gLog.Write( Log::VERB, FUNC_NAME, "Received zero-length report from gamepad device." );
     
-    // Handle incoming force-feedback events
-    if (mpGamepad->IsFFEnabled())
-    {
-        int             result;
-        input_event     ev;
+    return Err::OK;
+}
 
-        // Read event from uinput
-        result = mpGamepad->Read( ev );
-        if (result == Err::OK)
-        {
-            // Handle different event types accordingly
-            switch (ev.type)
+
+
+void Drivers::Gamepad::Driver::HandleFFEvent( const input_event& rEvent, double now )
+{
+    int                 result;
+    
+    
+    switch (rEvent.type)
+    {
+        // Force-feedback playback
+        case EV_FF:
+            if (rEvent.code == FF_GAIN)
+                mFF.SetGain( rEvent.value );
+            else
             {
-                // Force-feedback event
-                case EV_FF:
-                    switch (ev.code)
-                    {
-                        // Set gain
-                        case FF_GAIN:
-                            // TODO: Set gain
-                            //gLog.Write( Log::VERB, "FF GAIN: " + std::to_string(ev.value) );
-                        break;
-                        
-                        default:
-                            gLog.Write( Log::VERB, "Unknown FF effect:  code=" + std::to_string(ev.code) + "   val=" + std::to_string(ev.value) );
-                        break;
-                    }
-                break;
-                
-                // Uinput upload events
-                case EV_UINPUT:
-                    switch (ev.code)
-                    {
-                        // Upload force-feedback program
-                        case UI_FF_UPLOAD:
-                        {
-                            // TODO: FF uploads
-                            //uinput_ff_upload    data;
-                            
-                            //gLog.Write( Log::VERB, "UI_FF_UPLOAD" );
-                            
-                            //mpGamepad->GetFFEffect( ev.value, data );
-                        }
-                        break;
-                        
-                        // Erase force-feedback program
-                        case UI_FF_ERASE:
-                        {
-                            // TODO: FF Erase
-                            //uinput_ff_erase     data;
-                            
-                            //gLog.Write( Log::VERB, ">>> UI_FF_ERASE" );
-                            
-                            //mpGamepad->EraseFFEffect( ev.value, data );
-                        }   
-                        break;
-                        
-                        default:
-                            //gLog.Write( Log::VERB, "Unhandled EV_UINPUT code." );
-                        break;
-                    }
+                // Code is the effect id, value is the play count
+                result = mFF.Play( rEvent.code, rEvent.value, now );
+                if (result != Err::OK)
+                    gLog.Write( Log::VERB, FUNC_NAME, "Failed to play FF effect " + std::to_string(rEvent.code) + "." );
+            }
+        break;
+        
+        // Uinput upload events
+        case EV_UINPUT:
+            switch (rEvent.code)
+            {
+                // Upload force-feedback program
+                case UI_FF_UPLOAD:
+                {
+                    uinput_ff_upload    data;
+                    
+                    result = mpGamepad->GetFFEffect( rEvent.value, data );
+                    if (result == Err::OK)
+                        mFF.Upload( data.effect );
+                    else
+                        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to get uploaded FF effect." );
+                }
                 break;
                 
-                // Unimplemented
-                case EV_LED:
+                // Erase force-feedback program
+                case UI_FF_ERASE:
+                {
+                    uinput_ff_erase     data;
+                    
+                    result = mpGamepad->EraseFFEffect( rEvent.value, data );
+                    if (result == Err::OK)
+                        mFF.Erase( data.effect_id );
+                    else
+                        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to erase FF effect." );
+                }   
                 break;
                 
                 default:
-                    gLog.Write( Log::VERB, "Unhandled uinput type." );
                 break;
             }
-        }
+        break;
+        
+        // Unimplemented
+        case EV_LED:
+        break;
+        
+        default:
+            gLog.Write( Log::VERB, "Unhandled uinput type." );
+        break;
     }
+}
+
+
+
+int Drivers::Gamepad::Driver::WriteHaptic( uint8_t side, double level )
+{
+    uint8_t                         buff[OUTPUT_REPORT_SIZE] = {};
+    v100::PackedFeedbackReport*     rep;
     
-    return Err::OK;
+    using namespace v100;
+    
+    
+    rep = (PackedFeedbackReport*)buff;
+    
+    rep->report_id      = ReportType::HAPTIC_PULSE;
+    rep->report_size    = sizeof(PackedFeedbackReport) - 2;
+    rep->side           = side;
+    rep->amplitude      = level * FF_AMPLITUDE_MAX;
+    rep->period         = FF_PULSE_PERIOD_US;
+    // A zero count stops any pulse train already running
+    rep->count          = (level > 0) ? ceil( FF_HOLD_SEC * 1000000.0 / FF_PULSE_PERIOD_US ) : 0;
+    
+    // A newer level for the same side replaces one that hasn't been sent yet
+    return QueueOutput( OutPriority::HAPTIC, OutputKey( ReportType::HAPTIC_PULSE, side ), buff );
 }
 
 
 
-void Drivers::Gamepad::Driver::ThreadedLizardHandler()
+int Drivers::Gamepad::Driver::QueueOutput( OutPriority prio, uint32_t key, const uint8_t* pData )
 {
-    std::vector<uint8_t>    buff;
     int                     result;
+    
+    result = mOutQueue.Push( prio, key, pData );
+    if (result != Err::OK)
+        return result;
+    
+    // Without the output thread (i.e. during construction or shutdown) the
+    // queue is drained right away
+    if (!mOutRunning)
+        DrainOutput();
+    
+    return Err::OK;
+}
+
+
+
+void Drivers::Gamepad::Driver::DrainOutput()
+{
+    double                  now;
+    double                  wait;
+    
+    while (true)
+    {
+        now = std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        if (mOutQueue.Send( mHid, now, wait ) == Err::EMPTY)
+            break;
+        if (wait > 0)
+            usleep( wait * 1000000 );
+    }
+}
+
 
+
+void Drivers::Gamepad::Driver::ThreadedOutputHandler()
+{
+    epoll_event             ev = {};
+    epoll_event             events[3];
+    itimerspec              timer = {};
+    itimerspec              keepalive = {};
+    int                     epoll_fd;
+    int                     timer_fd;
+    int                     keepalive_fd;
+    int                     queue_fd = mOutQueue.GetEventFd();
+    uint8_t                 clear_mappings[OUTPUT_REPORT_SIZE] = {};
+    
+    // All HID output goes through here so writes never hold up the input
+    // loop.  The thread sleeps until something is queued, until the rate
+    // limit allows the next report to go out, or until the lizard mode
+    // keepalive is due.
+    
+    using namespace v100;
+    
+    epoll_fd        = epoll_create1( EPOLL_CLOEXEC );
+    timer_fd        = timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC );
+    keepalive_fd    = timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC );
+    if ((epoll_fd < 0) || (timer_fd < 0) || (keepalive_fd < 0))
+    {
+        int e = errno;
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to create output event descriptors: " + Err::GetErrnoString(e) );
+        gLog.Write( Log::ERROR, "Gamepad output thread failed to start." );
+        if (epoll_fd >= 0)
+            close( epoll_fd );
+        if (timer_fd >= 0)
+            close( timer_fd );
+        if (keepalive_fd >= 0)
+            close( keepalive_fd );
+        return;
+    }
+    
+    ev.events = EPOLLIN;
+    ev.data.fd = queue_fd;
+    epoll_ctl( epoll_fd, EPOLL_CTL_ADD, queue_fd, &ev );
+    ev.data.fd = timer_fd;
+    epoll_ctl( epoll_fd, EPOLL_CTL_ADD, timer_fd, &ev );
+    ev.data.fd = keepalive_fd;
+    epoll_ctl( epoll_fd, EPOLL_CTL_ADD, keepalive_fd, &ev );
+    
     // Strangely, the only known method to disable keyboard emulation only does
     // so for a few seconds, whereas disabling the mouse is permanent until
-    // re-enabled.  This means we have to run a separate thread which wakes up
-    // every couple seconds and disabled the keyboard again using the 
-    // CLEAR_MAPPINGS report.  If there's a better way to do this, I'd love to
-    // know about it.  Looking at you, Valve.
+    // re-enabled.  This means we have to keep sending the CLEAR_MAPPINGS
+    // report every couple seconds.  If there's a better way to do this, I'd
+    // love to know about it.  Looking at you, Valve.
+    clear_mappings[0]               = ReportType::CLEAR_MAPPINGS;
+    keepalive.it_value.tv_sec       = LIZARD_SLEEP_SEC;
+    keepalive.it_value.tv_nsec      = fmod( LIZARD_SLEEP_SEC, 1.0 ) * 1000000000.0;
+    keepalive.it_interval           = keepalive.it_value;
+    timerfd_settime( keepalive_fd, 0, &keepalive, nullptr );
+    
+    while (mRunning)
+    {
+        int         count;
+        double      now;
+        double      wait;
         
-    using namespace v100;
+        count = epoll_wait( epoll_fd, events, 3, -1 );
+        if (count < 0)
+        {
+            int e = errno;
+            if (e == EINTR)
+                continue;
+            gLog.Write( Log::DEBUG, FUNC_NAME, "epoll_wait failed: " + Err::GetErrnoString(e) );
+            gLog.Write( Log::ERROR, "Gamepad output thread has stopped." );
+            break;
+        }
+        
+        for (int i = 0; i < count; ++i)
+        {
+            uint64_t        val;
+            if (read( events[i].data.fd, &val, sizeof(val) ) < 0)
+                gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to read output event descriptor." );
+            
+            // If lizard mode is still disabled, send another CLEAR_MAPPINGS report
+            if ((events[i].data.fd == keepalive_fd) && (!mLizardMode))
+                mOutQueue.Push( OutPriority::KEEPALIVE, OutputKey( ReportType::CLEAR_MAPPINGS, 0 ), clear_mappings );
+        }
+        
+        // Send as much as the rate limit allows
+        while (true)
+        {
+            now = std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now().time_since_epoch()).count();
+            if (mOutQueue.Send( mHid, now, wait ) == Err::EMPTY)
+                break;
+            if (wait > 0)
+            {
+                // Come back when the next report is allowed
+                timer.it_value.tv_sec   = 0;
+                timer.it_value.tv_nsec  = wait * 1000000000.0 + 1;
+                timerfd_settime( timer_fd, 0, &timer, nullptr );
+                break;
+            }
+        }
+    }
     
-    // Initialize report
-    buff.resize( 64, 0 );
-    buff.at(0) = ReportType::CLEAR_MAPPINGS;
+    close( keepalive_fd );
+    close( timer_fd );
+    close( epoll_fd );
+}
+
+
 
-    // Loop thread while driver is running
+void Drivers::Gamepad::Driver::ThreadedFFHandler()
+{
+    epoll_event             ev = {};
+    epoll_event             events[3];
+    itimerspec              timer = {};
+    int                     epoll_fd;
+    int                     timer_fd;
+    int                     dev_fd = -1;
+    bool                    timer_armed = false;
+    double                  level[2];
+    double                  sent[2]         = { 0, 0 };
+    double                  last_write[2]   = { 0, 0 };
+    double                  expires[2]      = { 0, 0 };
+    
+    // Force-feedback runs on its own thread so uploads and playback never
+    // have to wait on the input loop.  The thread sleeps in epoll until the
+    // gamepad uinput device has events, the effect timer fires or the driver
+    // wakes it up.
+    
+    using namespace v100;
+    
+    epoll_fd = epoll_create1( EPOLL_CLOEXEC );
+    timer_fd = timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC );
+    if ((epoll_fd < 0) || (timer_fd < 0))
+    {
+        int e = errno;
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to create FF event descriptors: " + Err::GetErrnoString(e) );
+        gLog.Write( Log::ERROR, "Force feedback is unavailable." );
+        if (epoll_fd >= 0)
+            close( epoll_fd );
+        if (timer_fd >= 0)
+            close( timer_fd );
+        return;
+    }
+    
+    ev.events = EPOLLIN;
+    ev.data.fd = mFFWakeFd;
+    epoll_ctl( epoll_fd, EPOLL_CTL_ADD, mFFWakeFd, &ev );
+    ev.data.fd = timer_fd;
+    epoll_ctl( epoll_fd, EPOLL_CTL_ADD, timer_fd, &ev );
+    
     while (mRunning)
     {
-        // Sleep for a bit
-        usleep( LIZARD_SLEEP_SEC * 1000000 );   // in microseconds
+        int         count;
+        double      now;
+        bool        active;
+        
+        // Pick up a new gamepad device after a profile change
+        {
+            std::lock_guard<std::mutex>     lock( mFFMutex );
+            
+            if (mFFDevChanged)
+            {
+                // Closed descriptors are removed from epoll automatically, but
+                // the old one may still be registered if it wasn't closed yet
+                if (dev_fd >= 0)
+                    epoll_ctl( epoll_fd, EPOLL_CTL_DEL, dev_fd, nullptr );
+                
+                dev_fd = -1;
+                if ((mpGamepad != nullptr) && (mpGamepad->IsFFEnabled()))
+                {
+                    dev_fd = mpGamepad->GetFd();
+                    ev.data.fd = dev_fd;
+                    if (epoll_ctl( epoll_fd, EPOLL_CTL_ADD, dev_fd, &ev ) < 0)
+                    {
+                        int e = errno;
+                        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to watch gamepad uinput device: " + Err::GetErrnoString(e) );
+                        dev_fd = -1;
+                    }
+                }
+                
+                // Effects belong to the old device
+                mFF.Reset();
+                mFFDevChanged = false;
+            }
+        }
+        
+        count = epoll_wait( epoll_fd, events, 3, -1 );
+        if (count < 0)
+        {
+            int e = errno;
+            if (e == EINTR)
+                continue;
+            gLog.Write( Log::DEBUG, FUNC_NAME, "epoll_wait failed: " + Err::GetErrnoString(e) );
+            gLog.Write( Log::ERROR, "Force feedback thread has stopped." );
+            break;
+        }
+        
+        now = std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now().time_since_epoch()).count();
         
-        // If lizard mode is still false, send another CLEAR_MAPPINGS report
-        if (!mLizardMode)
+        for (int i = 0; i < count; ++i)
         {
-            if (!mHid.IsOpen())
-                gLog.Write( Log::DEBUG, FUNC_NAME, "Device is not open." );
+            uint64_t        val;
+            
+            if ((events[i].data.fd == mFFWakeFd) || (events[i].data.fd == timer_fd))
+            {
+                if (read( events[i].data.fd, &val, sizeof(val) ) < 0)
+                    gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to read FF event descriptor." );
+            }
             else
             {
-                result = mHid.Write( buff );
-                if (result != Err::OK)
-                    gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to write gamepad device." );
+                std::lock_guard<std::mutex>     lock( mFFMutex );
+                input_event                     uev;
+                
+                // Drain every pending uinput event
+                if ((mpGamepad != nullptr) && (!mFFDevChanged))
+                    while (mpGamepad->Read( uev ) == Err::OK)
+                        HandleFFEvent( uev, now );
+            }
+        }
+        
+        // Work out new actuator levels and send them to the controller
+        active = mFF.Update( now, level[FeedbackSide::LEFT], level[FeedbackSide::RIGHT] );
+        for (int side = 0; side < 2; ++side)
+        {
+            bool    changed  = (fabs( level[side] - sent[side] ) > FF_LEVEL_EPSILON) || ((level[side] == 0) && (sent[side] != 0));
+            bool    expiring = (level[side] > 0) && (now >= expires[side] - FF_MIN_REPORT_SEC);
+            
+            if ((changed || expiring) && (now - last_write[side] >= FF_MIN_REPORT_SEC))
+            {
+                if (WriteHaptic( side, level[side] ) != Err::OK)
+                    gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to write haptic report." );
+                sent[side]          = level[side];
+                last_write[side]    = now;
+                expires[side]       = now + FF_HOLD_SEC;
             }
         }
+        
+        // Only keep the timer running while there is something to update
+        if ((active || sent[0] || sent[1]) != timer_armed)
+        {
+            timer_armed = !timer_armed;
+            timer.it_value.tv_nsec      = (timer_armed) ? FF_UPDATE_SEC * 1000000000.0 : 0;
+            timer.it_interval.tv_nsec   = timer.it_value.tv_nsec;
+            timerfd_settime( timer_fd, 0, &timer, nullptr );
+        }
     }
+    
+    // Silence actuators on the way out
+    for (uint8_t side = 0; side < 2; ++side)
+        if (sent[side])
+            WriteHaptic( side, 0 );
+    
+    close( timer_fd );
+    close( epoll_fd );
 }
 
 
@@ -1032,23 +2096,61 @@ void Drivers::Gamepad::Driver::Run()
 {
     // Init
     mRunning    = true;
+    mOutRunning = true;
     mLizardMode = false;
     
-    // Run this function as a separate thread
-    mLizHandlerThread = std::thread( &Drivers::Gamepad::Driver::ThreadedLizardHandler, this );
+    // Run output and force-feedback handlers as separate threads.  Neither
+    // needs much stack, so they don't get the 8 MiB default.
+    if (mOutHandlerThread.Start( [this]{ ThreadedOutputHandler(); }, HELPER_THREAD_STACK_SIZE ) != Err::OK)
+        gLog.Write( Log::ERROR, "Failed to start gamepad output thread." );
+    if (mFFHandlerThread.Start( [this]{ ThreadedFFHandler(); }, HELPER_THREAD_STACK_SIZE ) != Err::OK)
+        gLog.Write( Log::ERROR, "Failed to start force feedback thread." );
+    
+    // Watch for the device being plugged back in
+    if (mHotplug.Open() != Err::OK)
+        gLog.Write( Log::WARN, "Failed to open uevent monitor.  Gamepad reconnects will be slower." );
     
     // Loop while driver is running
     gLog.Write( Log::DEBUG, FUNC_NAME, "Gamepad driver is now running..." );
     while (mRunning)
     {
-        Poll();
+        int         result;
+        
+        if (!mHid.IsOpen())
+        {
+            WaitForDevice();
+            continue;
+        }
+        
+        result = Poll();
+        if ((result == Err::DEVICE_LOST) || (result == Err::NO_DEVICE))
+        {
+            Detach();
+            continue;
+        }
         
-        // Polling interval is about 4ms so we can sleep a little
-        usleep( 250 );
+        // Poll() blocks until a report or timer is due, so there is no need
+        // to sleep.  Only back off on errors so a failing read can't spin.
+        if (result != Err::OK)
+            usleep( 1000 );
     }
     
+    mHotplug.Close();
+    
     // Rejoin threads after driver exits
-    mLizHandlerThread.join();
+    if (mFFWakeFd >= 0)
+    {
+        uint64_t    val = 1;
+        if (write( mFFWakeFd, &val, sizeof(val) ) < 0)
+            gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to wake FF thread." );
+    }
+    mFFHandlerThread.Join();
+    mOutQueue.Wake();
+    mOutHandlerThread.Join();
+    
+    // Send anything left over
+    mOutRunning = false;
+    DrainOutput();
 }
 
 
@@ -1056,7 +2158,7 @@ void Drivers::Gamepad::Driver::Run()
 int Drivers::Gamepad::Driver::SetLizardMode( bool enabled )
 {
     int                     result;
-    std::vector<uint8_t>    buff;
+    uint8_t                 buff[OUTPUT_REPORT_SIZE] = {};
 
     
     using namespace v100;
@@ -1072,13 +2174,10 @@ int Drivers::Gamepad::Driver::SetLizardMode( bool enabled )
     // Wait 10ms for drivers to hit the mutex just to be safe
     usleep( 10000 );
     
-    // Initialize report
-    buff.resize( 64, 0 );
-    
     if (!enabled)
     {
-        buff.at(0) = ReportType::CLEAR_MAPPINGS;                      // Disable keyboard emulation (for a few seconds)
-        result = mHid.Write( buff );
+        buff[0] = ReportType::CLEAR_MAPPINGS;                      // Disable keyboard emulation (for a few seconds)
+        result = QueueOutput( OutPriority::CONTROL, 0, buff );
         if (result != Err::OK)
             gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to disable keyboard emulation." );
 
@@ -1095,13 +2194,13 @@ int Drivers::Gamepad::Driver::SetLizardMode( bool enabled )
     }
     else
     {
-        buff.at(0) = ReportType::DEFAULT_MAPPINGS;                    // Enable keyboard emulation
-        result = mHid.Write( buff );
+        buff[0] = ReportType::DEFAULT_MAPPINGS;                    // Enable keyboard emulation
+        result = QueueOutput( OutPriority::CONTROL, 0, buff );
         if (result != Err::OK)
             gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to enable keyboard emulation." );
         
-        buff.at(0) = ReportType::DEFAULT_MOUSE;                       // Enable mouse emulation
-        result = mHid.Write( buff );
+        buff[0] = ReportType::DEFAULT_MOUSE;                       // Enable mouse emulation
+        result = QueueOutput( OutPriority::CONTROL, 0, buff );
         if (result != Err::OK)
             gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to enable mouse emulation." );
 
@@ -1159,6 +2258,22 @@ void Drivers::Gamepad::Driver::SetDeadzone( AxisEnum ax, double dz )
 
 
 
+int Drivers::Gamepad::Driver::QueueDeadzone( AxisEnum axis, double dz )
+{
+    if ((axis < AxisEnum::L_STICK) || (axis > AxisEnum::R_TRIGG))
+        return Err::INVALID_PARAMETER;
+    
+    if (!mCmdRing.Push( { .type = Drivers::MsgType::DEADZONE, .id = (uint32_t)axis, .val = dz } ))
+    {
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Gamepad driver command queue is full." );
+        return Err::WRITE_FAILED;
+    }
+    
+    return Err::OK;
+}
+
+
+
 void Drivers::Gamepad::Driver::SetStickFiltering( bool enabled )
 {
     mState.stick.filtered = enabled;
@@ -1173,7 +2288,7 @@ void Drivers::Gamepad::Driver::SetPadFiltering( bool enabled )
 
 
 
-Drivers::Gamepad::Driver::Driver()
+Drivers::Gamepad::Driver::Driver( unsigned int index, Handoff* pHandoff )
 {
     int             result;
     DeviceState     initstate = {};
@@ -1184,21 +2299,76 @@ Drivers::Gamepad::Driver::Driver()
     mState                  = initstate;
     mProfSwitchDelay        = 2000;         //  Default: 2 seconds
     mProfSwitchTimestamp    = 0;
+    mFFDevChanged           = true;
+    mOutRunning             = false;
+    mFFWakeFd               = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+    if (mFFWakeFd < 0)
+    {
+        int e = errno;
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to create eventfd: " + Err::GetErrnoString(e) );
+        throw std::runtime_error( "eventfd() failed" );
+    }
     
-    result = OpenHid();
+    mIndex                  = index;
+    mAttached               = false;
+    mStatReports            = 0;
+    mStatSkipped            = 0;
+    mStatBusyNs             = 0;
+    mStatMaxNs              = 0;
+    mHotplug.Configure( "hidraw", v100::HOTPLUG_RETRY_SEC, v100::HOTPLUG_RETRY_WINDOW_SEC, v100::HOTPLUG_RESCAN_SEC );
+    mRecorderThreshold      = 0;
+    mLastReportNs           = 0;
+    mLastDumpNs             = 0;
+    mLastReportValid        = false;
+    mRelActive              = false;
+    mLayers.resize( 1 );
+    mLayer                  = 0;
+    mLayerHeld              = 0;
+    mLayerToggled           = 0;
+    mLayerPressed.assign( 1, 0 );
+    mAxisMerge              = AxisMerge::PRIORITY;
+    mHandedOff              = false;
+    for (unsigned int i = 0; i < HANDOFF_DEVICES; ++i)
+    {
+        mAdoptFd[i]         = -1;
+        mAdoptHash[i]       = 0;
+    }
+    
+    // Devices handed over by the previous daemon are used by SetProfile()
+    if (pHandoff != nullptr)
+    {
+        for (unsigned int i = 0; i < HANDOFF_DEVICES; ++i)
+        {
+            std::string     name = "gp" + std::to_string(mIndex) + "." + gHandoffNames[i];
+            
+            mAdoptFd[i] = pHandoff->Take( name );
+            try { mAdoptHash[i] = std::stoull( pHandoff->GetValue( name ) ); } catch (...) { mAdoptHash[i] = 0; }
+        }
+    }
+    
+    // The driver thread picks the device up whenever it shows up
+    if ((pHandoff != nullptr) && (AdoptHid( *pHandoff ) == Err::OK))
+        result = Err::OK;
+    else
+        result = OpenHid();
     if (result != Err::OK)
-        throw;
-        
-    SetLizardMode( false );
+        gLog.Write( Log::WARN, "No compatible gamepad device is available for gamepad " + std::to_string(mIndex) + " yet.  Waiting for one to be connected." );
+    else
+        SetLizardMode( false );
 }
 
 
 
 Drivers::Gamepad::Driver::~Driver()
 {
-    SetLizardMode( true );
+    if (!mHandedOff)
+        SetLizardMode( true );
     
     DestroyUinputDevs();
+    DropAdopted();
         
-    mHid.Close();
+    CloseHid();
+    
+    if (mFFWakeFd >= 0)
+        close( mFFWakeFd );
 }
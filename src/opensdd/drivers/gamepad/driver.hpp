@@ -23,8 +23,17 @@
 #include "../driver_base.hpp"
 #include "../../hidraw.hpp"
 #include "../../uinput.hpp"
+#include "../../uevent.hpp"
+#include "../../handoff.hpp"
 #include "hid_reports.hpp"
 #include "device_state.hpp"
+#include "filter_motion.hpp"
+#include "ff_engine.hpp"
+#include "output_queue.hpp"
+#include "shared_state.hpp"
+#include "action_engine.hpp"
+#include "frame_io.hpp"
+#include "flight_recorder.hpp"
 #include "profile.hpp"
 
 
@@ -51,40 +60,125 @@ namespace Drivers::Gamepad
         R_TRIGG
     };
 
+    // Per-instance input processing counters
+    struct DriverStats
+    {
+        uint64_t                    reports;                // Input reports received
+        uint64_t                    skipped;                // Reports skipped because nothing changed
+        uint64_t                    busy_ns;                // Total time spent processing reports
+        uint64_t                    max_ns;                 // Longest time spent processing one report
+    };
+
+    // Output absolute axis shared by every binding that drives it.  Bindings are
+    // resolved to a slot when the profile is set, so each frame stores one
+    // value per axis without looking anything up.
+    struct AxisSlot
+    {
+        Uinput::Device*             pDevice;
+        Uinput::EventInfo*          pInfo;                  // Owned by the uinput device
+        double                      value;                  // Combined value for this frame
+        bool                        set;                    // A binding wrote to the slot this frame
+    };
+
+    // Uinput devices, in the order they are handed off
+    const unsigned int              HANDOFF_DEVICES = 3;
+
     // Gamepad driver class
     class Driver : public Drivers::DrvBase
     {
     private:
+        unsigned int                mIndex;                 // Gamepad number, used for logging and per-gamepad config
         Hidraw                      mHid;
+        std::string                 mClaimedNode;           // hidraw node this instance owns
+        std::atomic<bool>           mAttached;              // Device is open
+        FrameIo                     mFrameIo;               // io_uring reads and writes, if available
+        std::vector<uint8_t>        mReadBuff;
         DeviceState                 mState;
+        MotionFilter                mMotion;
+        SharedState                 mShared;                // Live state for clients
+        uint8_t                     mLastReport[64];        // Last input report that was fully processed
+        bool                        mLastReportValid;
+        bool                        mRelActive;             // A relative axis was driven during the last Translate()
         Uinput::Device*             mpGamepad;
         Uinput::Device*             mpMotion;
         Uinput::Device*             mpMouse;
-        BindMap                     mMap;
+        std::vector<BindMap>        mLayers;                // Base bindings followed by the profile's layers
+        unsigned int                mLayer;                 // Layer used by Translate()
+        uint32_t                    mLayerHeld;             // Layer held down during the last Translate(), or 0
+        uint32_t                    mLayerToggled;          // Layer toggled on, or 0
+        std::vector<uint8_t>        mLayerPressed;          // Toggle binding state per layer, for edge detection
+        ActionEngine                mActions;               // Turbo, toggle and macro bindings
+        std::vector<AxisSlot>       mAxisSlots;             // Indexed by Binding::id - 1 for EV_ABS bindings
+        std::vector<AxisSlot*>      mSetSlots;              // Slots written this frame
+        AxisMerge                   mAxisMerge;
         std::atomic<bool>           mLizardMode;
-        std::thread                 mLizHandlerThread;
         std::mutex                  mPollMutex;
+        MsgRing<Message, MAX_DRIVER_MESSAGES> mCmdRing;     // Settings changed by the daemon, applied by the driver thread
+        FFEngine                    mFF;
+        Drivers::Thread             mFFHandlerThread;
+        std::mutex                  mFFMutex;               // Guards gamepad uinput device from the FF thread
+        bool                        mFFDevChanged;          // Gamepad uinput device was recreated
+        int                         mFFWakeFd;              // eventfd used to wake the FF thread
+        OutputQueue                 mOutQueue;
+        Drivers::Thread             mOutHandlerThread;
+        std::atomic<bool>           mOutRunning;
+        HotplugWatch                mHotplug;               // Paces reopening the device after it was lost
+        std::atomic<uint64_t>       mStatReports;
+        std::atomic<uint64_t>       mStatSkipped;
+        std::atomic<uint64_t>       mStatBusyNs;
+        std::atomic<uint64_t>       mStatMaxNs;
         uint64_t                    mProfSwitchDelay;       // In milliseconds
         uint64_t                    mProfSwitchTimestamp;   // In milliseconds
+        FlightRecorder              mRecorder;              // Only written with mPollMutex held
+        uint64_t                    mRecorderThreshold;     // In nanoseconds, 0 to never dump automatically
+        uint64_t                    mLastReportNs;          // When the last report arrived, or 0
+        uint64_t                    mLastDumpNs;            // When the last automatic dump was asked for
+        int                         mAdoptFd[HANDOFF_DEVICES];      // Uinput devices taken over from the previous daemon
+        uint64_t                    mAdoptHash[HANDOFF_DEVICES];    // Config each one was created with
+        bool                        mHandedOff;             // Leave lizard mode off on exit, the next daemon took over
         
         // HID functions
         int                         OpenHid();
+        int                         AdoptHid( Handoff& rHandoff );
+        void                        CloseHid();
+        // Hotplug
+        void                        ReleaseInputs();
+        void                        Detach();
+        int                         Attach();
+        void                        WaitForDevice();
         // SDC reports
         int                         ReadRegister( uint8_t reg, uint16_t& rValue );
         int                         WriteRegister( uint8_t reg, uint16_t value );
         int                         ClearRegister( uint8_t reg );
+        int                         QueueOutput( OutPriority prio, uint32_t key, const uint8_t* pData );
+        void                        DrainOutput();
+        void                        ApplyCommands();
         int                         HandleInputReport( const std::vector<uint8_t>& rReport );
+        bool                        IsIdleRepeat( const std::vector<uint8_t>& rReport );
+        void                        ReportSlowInput( RecMark mark, uint64_t delayNs, uint64_t now );
         // Uinput
         int                         CreateUinputDevs();
         void                        DestroyUinputDevs();
+        int                         TakeAdopted( unsigned int dev, const Uinput::DeviceConfig& rCfg );
+        void                        DropAdopted();
+        void                        CompileAxes( std::vector<Action>& rActions );
+        void                        CompileAxis( Binding& rBind );
         // Update loop functions
         void                        UpdateState( v100::PackedInputDataReport* pIr );
+        void                        TransRel( Uinput::Device* device, Binding& bind, double value );
+        void                        UpdateAxis( const Binding& bind, double value );
+        void                        CommitAxes();
         void                        TransEvent( Binding& bind, double state, BindMode mode );
         void                        Translate();
-        void                        Flush();
+        void                        TickActions();
+        void                        Flush( bool force = false );
         int                         Poll();
+        // Force feedback
+        void                        HandleFFEvent( const input_event& rEvent, double now );
+        int                         WriteHaptic( uint8_t side, double level );
         // Threaded handlers
-        void                        ThreadedLizardHandler();
+        void                        ThreadedFFHandler();
+        void                        ThreadedOutputHandler();
         
     public:
         // Configuration functions
@@ -93,10 +187,31 @@ namespace Drivers::Gamepad
         void                        SetDeadzone( AxisEnum axis, double dz );
         void                        SetStickFiltering( bool enabled );
         void                        SetPadFiltering( bool enabled );
+        // Applied by the driver thread before the next report, without waiting
+        // on it.  Only call from one thread.
+        int                         QueueDeadzone( AxisEnum axis, double dz );
+        // Status
+        DriverStats                 GetStats();
+        bool                        IsAttached();
+        // Must be called before Start()
+        int                         EnableSharedState();
+        int                         GetSharedStateFd();
+        // Must be called before Start().  thresholdMs of 0 never dumps automatically.
+        int                         EnableRecorder( unsigned int thresholdMs );
+        int                         DumpRecorder( const char* pReason );
+        unsigned int                GetIndex();
+        // Moves the hidraw and uinput fds into rOut for the next daemon.  The
+        // driver must be stopped, and the devices are left in place when it
+        // is deleted.  Lizard mode is only turned back on with restoreLizard,
+        // for when it isn't certain that another daemon takes over.
+        int                         Release( Handoff& rOut, bool restoreLizard );
+        // Number of compatible hidraw interfaces currently present
+        static unsigned int         CountDevices();
         // Virtual function to start driver thread
         void                        Run();
 
-        Driver();
+        // Takes over devices from pHandoff if the previous daemon passed any
+        Driver( unsigned int index = 0, Handoff* pHandoff = nullptr );
         ~Driver();
     };
 
@@ -0,0 +1,268 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//  OpenSD
+//  An open-source userspace driver for Valve's Steam Deck hardware
+//
+//  Copyright 2022 seek
+//  https://gitlab.com/open-sd/opensd
+//  Licensed under the GNU GPLv3+
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the 
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of 
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; 
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. 
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with this program. 
+//  If not, see <https://www.gnu.org/licenses/>.             
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#include "ff_engine.hpp"
+#include "../../../common/log.hpp"
+// C++
+#include <cmath>
+
+
+// Periodic effects faster than this can't be reproduced by modulating the
+// actuator strength, so they are played as a steady vibration instead.
+const double        FF_MIN_WAVE_PERIOD_SEC  = 0.05;
+
+const double        FF_LEVEL_MAX            = 32767.0;
+const double        FF_MAGNITUDE_MAX        = 65535.0;
+
+
+
+double Drivers::Gamepad::FFEngine::ApplyEnvelope( const ff_envelope& rEnv, double level, double elapsed, double length )
+{
+    double          env_level;
+    double          env_time;
+    double          env_len;
+    
+    
+    // Same behaviour as the kernel's ff-memless envelope handling
+    if ((rEnv.attack_length) && (elapsed < rEnv.attack_length * 0.001))
+    {
+        env_len     = rEnv.attack_length * 0.001;
+        env_time    = elapsed;
+        env_level   = ((rEnv.attack_level > FF_LEVEL_MAX) ? FF_LEVEL_MAX : rEnv.attack_level) / FF_LEVEL_MAX;
+    }
+    else
+        if ((rEnv.fade_length) && (length > 0) && (elapsed > length - rEnv.fade_length * 0.001))
+        {
+            env_len     = rEnv.fade_length * 0.001;
+            env_time    = length - elapsed;
+            env_level   = ((rEnv.fade_level > FF_LEVEL_MAX) ? FF_LEVEL_MAX : rEnv.fade_level) / FF_LEVEL_MAX;
+        }
+        else
+            return level;
+    
+    return env_level + (level - env_level) * (env_time / env_len);
+}
+
+
+
+bool Drivers::Gamepad::FFEngine::GetEffectLevel( EffectSlot& rSlot, double now, double& rLeft, double& rRight )
+{
+    const ff_effect&    e       = rSlot.effect;
+    double              delay   = e.replay.delay * 0.001;
+    double              length  = e.replay.length * 0.001;
+    double              elapsed;
+    double              level;
+    
+    
+    rLeft = rRight = 0;
+    
+    if ((!rSlot.loaded) || (!rSlot.playing))
+        return false;
+    
+    // Handle repetitions which have run out
+    while ((length > 0) && (now >= rSlot.start + length))
+    {
+        if (--rSlot.plays <= 0)
+        {
+            rSlot.playing = false;
+            return false;
+        }
+        rSlot.start += length + delay;
+    }
+    
+    // Waiting for replay delay
+    if (now < rSlot.start)
+        return true;
+        
+    elapsed = now - rSlot.start;
+    
+    switch (e.type)
+    {
+        case FF_RUMBLE:
+            // Strong motor on the left, weak on the right
+            rLeft   = e.u.rumble.strong_magnitude / FF_MAGNITUDE_MAX;
+            rRight  = e.u.rumble.weak_magnitude / FF_MAGNITUDE_MAX;
+        break;
+        
+        case FF_PERIODIC:
+        {
+            double      period  = e.u.periodic.period * 0.001;
+            double      wave    = 1.0;
+            
+            level = ApplyEnvelope( e.u.periodic.envelope, abs( e.u.periodic.magnitude ) / FF_LEVEL_MAX, elapsed, length );
+            
+            // Slow waveforms modulate the actuator strength
+            if (period >= FF_MIN_WAVE_PERIOD_SEC)
+            {
+                double  phase = fmod( elapsed / period + e.u.periodic.phase / 65536.0, 1.0 );
+                
+                switch (e.u.periodic.waveform)
+                {
+                    case FF_SQUARE:     wave = (phase < 0.5) ? 1.0 : -1.0;          break;
+                    case FF_TRIANGLE:   wave = 1.0 - 4.0 * fabs( phase - 0.5 );     break;
+                    case FF_SINE:       wave = sin( 2.0 * M_PI * phase );           break;
+                    case FF_SAW_UP:     wave = 2.0 * phase - 1.0;                   break;
+                    case FF_SAW_DOWN:   wave = 1.0 - 2.0 * phase;                   break;
+                    default:            wave = 1.0;                                 break;
+                }
+            }
+            
+            level = fabs( e.u.periodic.offset / FF_LEVEL_MAX + level * wave );
+            rLeft = rRight = level;
+        }
+        break;
+        
+        case FF_CONSTANT:
+            level = ApplyEnvelope( e.u.constant.envelope, abs( e.u.constant.level ) / FF_LEVEL_MAX, elapsed, length );
+            rLeft = rRight = level;
+        break;
+        
+        default:
+            // Unsupported effect, just let it time out
+        break;
+    }
+    
+    return true;
+}
+
+
+
+int Drivers::Gamepad::FFEngine::Upload( const ff_effect& rEffect )
+{
+    if ((rEffect.id < 0) || (rEffect.id >= Uinput::FF_EFFECTS_MAX))
+    {
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Effect id " + std::to_string(rEffect.id) + " is out of range." );
+        return Err::OUT_OF_RANGE;
+    }
+    
+    switch (rEffect.type)
+    {
+        case FF_RUMBLE:
+        case FF_PERIODIC:
+        case FF_CONSTANT:
+        break;
+        
+        default:
+            gLog.Write( Log::DEBUG, FUNC_NAME, "Unsupported effect type " + std::to_string(rEffect.type) + "." );
+            return Err::UNSUPPORTED;
+        break;
+    }
+    
+    // Updating a playing effect keeps its current timing
+    mSlots[rEffect.id].effect = rEffect;
+    mSlots[rEffect.id].loaded = true;
+    
+    return Err::OK;
+}
+
+
+
+int Drivers::Gamepad::FFEngine::Erase( int16_t id )
+{
+    if ((id < 0) || (id >= Uinput::FF_EFFECTS_MAX))
+    {
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Effect id " + std::to_string(id) + " is out of range." );
+        return Err::OUT_OF_RANGE;
+    }
+    
+    mSlots[id].loaded   = false;
+    mSlots[id].playing  = false;
+    
+    return Err::OK;
+}
+
+
+
+int Drivers::Gamepad::FFEngine::Play( int16_t id, int32_t count, double now )
+{
+    if ((id < 0) || (id >= Uinput::FF_EFFECTS_MAX))
+    {
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Effect id " + std::to_string(id) + " is out of range." );
+        return Err::OUT_OF_RANGE;
+    }
+    
+    if (!mSlots[id].loaded)
+        return Err::NOT_FOUND;
+    
+    // A count of zero stops the effect
+    if (count <= 0)
+    {
+        mSlots[id].playing = false;
+        return Err::OK;
+    }
+    
+    mSlots[id].playing  = true;
+    mSlots[id].plays    = count;
+    mSlots[id].start    = now + mSlots[id].effect.replay.delay * 0.001;
+    
+    return Err::OK;
+}
+
+
+
+void Drivers::Gamepad::FFEngine::SetGain( uint16_t gain )
+{
+    mGain = gain / FF_MAGNITUDE_MAX;
+}
+
+
+
+void Drivers::Gamepad::FFEngine::Reset()
+{
+    for (auto&& i : mSlots)
+        i = {};
+    mGain = 1.0;
+}
+
+
+
+bool Drivers::Gamepad::FFEngine::Update( double now, double& rLeft, double& rRight )
+{
+    bool        active = false;
+    double      l;
+    double      r;
+    
+    rLeft = rRight = 0;
+    
+    for (auto&& i : mSlots)
+    {
+        if (GetEffectLevel( i, now, l, r ))
+        {
+            active  = true;
+            rLeft  += l;
+            rRight += r;
+        }
+    }
+    
+    rLeft   *= mGain;
+    rRight  *= mGain;
+    if (rLeft > 1.0)
+        rLeft = 1.0;
+    if (rRight > 1.0)
+        rRight = 1.0;
+    
+    return active;
+}
+
+
+
+Drivers::Gamepad::FFEngine::FFEngine()
+{
+    Reset();
+}
@@ -0,0 +1,71 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//  OpenSD
+//  An open-source userspace driver for Valve's Steam Deck hardware
+//
+//  Copyright 2022 seek
+//  https://gitlab.com/open-sd/opensd
+//  Licensed under the GNU GPLv3+
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the 
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of 
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; 
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. 
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with this program. 
+//  If not, see <https://www.gnu.org/licenses/>.             
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#ifndef __GAMEPAD__FF_ENGINE_HPP__
+#define __GAMEPAD__FF_ENGINE_HPP__
+
+#include "../../uinput.hpp"
+// Linux
+#include <linux/input.h>
+// C++
+#include <cstdint>
+
+
+namespace Drivers::Gamepad
+{
+    // Software force-feedback engine.
+    // Stores effects uploaded through uinput and works out how strong each
+    // actuator should be at a given point in time.  Timing follows the
+    // kernel's ff_effect semantics (replay delay / length, envelopes and
+    // repeat counts).  All times are in seconds from a monotonic clock.
+    class FFEngine
+    {
+    private:
+        struct EffectSlot
+        {
+            ff_effect           effect;
+            bool                loaded;
+            bool                playing;
+            int32_t             plays;          // Remaining number of repetitions
+            double              start;          // Start time of the current repetition, after delay
+        };
+
+        EffectSlot              mSlots[Uinput::FF_EFFECTS_MAX];
+        double                  mGain;
+
+        double                  ApplyEnvelope( const ff_envelope& rEnv, double level, double elapsed, double length );
+        bool                    GetEffectLevel( EffectSlot& rSlot, double now, double& rLeft, double& rRight );
+
+    public:
+        int                     Upload( const ff_effect& rEffect );
+        int                     Erase( int16_t id );
+        int                     Play( int16_t id, int32_t count, double now );
+        void                    SetGain( uint16_t gain );
+        void                    Reset();
+        // Sums all playing effects into normalized (0.0 - 1.0) actuator levels.
+        // Returns true while any effect is still playing or waiting to start.
+        bool                    Update( double now, double& rLeft, double& rRight );
+
+        FFEngine();
+    };
+
+} // namespace Drivers::Gamepad
+
+
+#endif // __GAMEPAD__FF_ENGINE_HPP__
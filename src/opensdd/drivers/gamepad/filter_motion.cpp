@@ -0,0 +1,210 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//  OpenSD
+//  An open-source userspace driver for Valve's Steam Deck hardware
+//
+//  Copyright 2022 seek
+//  https://gitlab.com/open-sd/opensd
+//  Licensed under the GNU GPLv3+
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the 
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of 
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; 
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. 
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with this program. 
+//  If not, see <https://www.gnu.org/licenses/>.             
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#include "filter_motion.hpp"
+#include <cmath>
+#include <cstring>
+
+
+// Accelerometer correction gain.  Higher values converge faster but let more
+// accelerometer noise into the attitude estimate.
+const double        MADGWICK_BETA       = 0.1;
+
+// Gyro bias is only re-estimated while the device has been sitting still for
+// a number of consecutive frames.
+const double        STILL_GYRO_RADS     = 0.05;     // ~3 deg/s
+const double        STILL_ACCEL_G       = 0.05;
+const unsigned int  STILL_FRAME_COUNT   = 50;
+const double        BIAS_RATE           = 0.01;
+
+// A quaternion held in one SIMD vector (AVX, or two SSE2 halves on baseline
+// x86-64), so the update is done four lanes at a time
+typedef double      Vec4 __attribute__((vector_size(4 * sizeof(double))));
+
+
+
+// Vectors are passed by reference.  Passing 32 byte vectors by value has a
+// different ABI depending on whether AVX is enabled.
+static inline double Dot( const Vec4& rA, const Vec4& rB )
+{
+    Vec4        p = rA * rB;
+    
+    return p[0] + p[1] + p[2] + p[3];
+}
+
+
+
+// Hamilton product p (x) r, one column of p at a time
+static inline void QuatMul( const Vec4& rP, const Vec4& rR, Vec4& rOut )
+{
+    rOut = rP[0] * rR
+         + rP[1] * (Vec4){ -rR[1],  rR[0], -rR[3],  rR[2] }
+         + rP[2] * (Vec4){ -rR[2],  rR[3],  rR[0], -rR[1] }
+         + rP[3] * (Vec4){ -rR[3], -rR[2],  rR[1],  rR[0] };
+}
+
+
+
+void Drivers::Gamepad::MotionFilter::InitFromAccel( double ax, double ay, double az )
+{
+    // Seed the orientation from the gravity vector so the filter doesn't have
+    // to slowly converge from identity.  Yaw is unobservable without a
+    // magnetometer, so it starts at zero.
+    double      roll    = atan2( ay, az );
+    double      pitch   = atan2( -ax, sqrt( ay * ay + az * az ) );
+    double      cr      = cos( roll * 0.5 );
+    double      sr      = sin( roll * 0.5 );
+    double      cp      = cos( pitch * 0.5 );
+    double      sp      = sin( pitch * 0.5 );
+
+    mQ[0] = cr * cp;
+    mQ[1] = sr * cp;
+    mQ[2] = cr * sp;
+    mQ[3] = -sr * sp;
+    mInit = true;
+}
+
+
+
+void Drivers::Gamepad::MotionFilter::UpdateBias( const double (&rGyro)[3], const double (&rAccel)[3] )
+{
+    double      g[3];
+    double      gmag = 0;
+    double      amag = 0;
+    
+    for (int i = 0; i < 3; ++i)
+    {
+        g[i]  = rGyro[i] - mBias[i];
+        gmag += g[i] * g[i];
+        amag += rAccel[i] * rAccel[i];
+    }
+    
+    // Device is at rest if it's barely rotating and only feeling gravity
+    if ((sqrt( gmag ) < STILL_GYRO_RADS) && (fabs( sqrt( amag ) - 1.0 ) < STILL_ACCEL_G))
+    {
+        if (mStillCount < STILL_FRAME_COUNT)
+            ++mStillCount;
+        else
+            for (int i = 0; i < 3; ++i)
+                mBias[i] += (rGyro[i] - mBias[i]) * BIAS_RATE;
+    }
+    else
+        mStillCount = 0;
+}
+
+
+
+void Drivers::Gamepad::MotionFilter::Update( double gx, double gy, double gz, double ax, double ay, double az, double dt )
+{
+    const double    gyro[3]     = { gx, gy, gz };
+    const double    accel[3]    = { ax, ay, az };
+    Vec4            q;
+    Vec4            w;
+    Vec4            qdot;
+    double          norm;
+    
+    
+    if (!mInit)
+    {
+        if ((ax == 0) && (ay == 0) && (az == 0))
+            return;
+        InitFromAccel( ax, ay, az );
+    }
+
+    UpdateBias( gyro, accel );
+    
+    // Angular rate as a pure quaternion, bias removed
+    memcpy( &q, mQ, sizeof(q) );
+    w = (Vec4){ 0, gx - mBias[0], gy - mBias[1], gz - mBias[2] };
+    
+    // Rate of change of orientation from gyro:  qdot = 0.5 * q (x) w
+    QuatMul( q, w, qdot );
+    qdot *= 0.5;
+
+    // Accelerometer correction, skipped in freefall
+    norm = sqrt( ax * ax + ay * ay + az * az );
+    if (norm > 0)
+    {
+        double      a[3] = { ax / norm, ay / norm, az / norm };
+        double      f[3];
+        Vec4        s;
+        
+        // Objective function:  difference between the measured gravity
+        // direction and gravity rotated into the body frame by q
+        f[0] = 2.0 * (q[1] * q[3] - q[0] * q[2]) - a[0];
+        f[1] = 2.0 * (q[0] * q[1] + q[2] * q[3]) - a[1];
+        f[2] = 2.0 * (0.5 - q[1] * q[1] - q[2] * q[2]) - a[2];
+        
+        // Gradient step (J^T * f), one column of J^T per residual
+        s = (2.0 * f[0]) * (Vec4){ -q[2], q[3], -q[0], q[1] }
+          + (2.0 * f[1]) * (Vec4){  q[1], q[0],  q[3], q[2] }
+          - (4.0 * f[2]) * (Vec4){  0,    q[1],  q[2], 0    };
+        
+        norm = sqrt( Dot( s, s ) );
+        if (norm > 0)
+            qdot -= (mBeta / norm) * s;
+    }
+    
+    // Integrate and renormalize
+    q += qdot * dt;
+    q *= 1.0 / sqrt( Dot( q, q ) );
+    memcpy( mQ, &q, sizeof(mQ) );
+}
+
+
+
+void Drivers::Gamepad::MotionFilter::GetAttitude( double& rRoll, double& rPitch, double& rYaw )
+{
+    const double*   q = mQ;
+    double          sinp;
+    
+    rRoll   = atan2( 2.0 * (q[0] * q[1] + q[2] * q[3]), 1.0 - 2.0 * (q[1] * q[1] + q[2] * q[2]) );
+    sinp    = 2.0 * (q[0] * q[2] - q[3] * q[1]);
+    sinp    = (sinp > 1.0) ? 1.0 : (sinp < -1.0) ? -1.0 : sinp;
+    rPitch  = asin( sinp );
+    rYaw    = atan2( 2.0 * (q[0] * q[3] + q[1] * q[2]), 1.0 - 2.0 * (q[2] * q[2] + q[3] * q[3]) );
+    
+    // Normalize to axis range
+    rRoll   /= M_PI;
+    rPitch  /= M_PI_2;
+    rYaw    /= M_PI;
+}
+
+
+
+void Drivers::Gamepad::MotionFilter::Reset()
+{
+    mQ[0]       = 1.0;
+    mQ[1]       = 0;
+    mQ[2]       = 0;
+    mQ[3]       = 0;
+    mStillCount = 0;
+    mInit       = false;
+}
+
+
+
+Drivers::Gamepad::MotionFilter::MotionFilter()
+{
+    mBias[0]    = 0;
+    mBias[1]    = 0;
+    mBias[2]    = 0;
+    mBeta       = MADGWICK_BETA;
+    Reset();
+}
@@ -0,0 +1,55 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//  OpenSD
+//  An open-source userspace driver for Valve's Steam Deck hardware
+//
+//  Copyright 2022 seek
+//  https://gitlab.com/open-sd/opensd
+//  Licensed under the GNU GPLv3+
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the 
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of 
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; 
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. 
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with this program. 
+//  If not, see <https://www.gnu.org/licenses/>.             
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#ifndef __GAMEPAD__FILTER_MOTION_HPP__
+#define __GAMEPAD__FILTER_MOTION_HPP__
+
+
+namespace Drivers::Gamepad
+{
+    // Quaternion based orientation filter (Madgwick IMU variant).
+    // Fuses calibrated gyro rates and accelerometer readings once per input
+    // report and produces an attitude estimate.  All inputs are expected in
+    // the filter's body frame:  x = roll axis, y = pitch axis, z = yaw axis.
+    class MotionFilter
+    {
+    private:
+        double              mQ[4];          // Orientation quaternion (w, x, y, z)
+        double              mBias[3];       // Estimated gyro bias in rad/s
+        double              mBeta;          // Accelerometer correction gain
+        unsigned int        mStillCount;    // Consecutive frames the device has been at rest
+        bool                mInit;
+        
+        void                InitFromAccel( double ax, double ay, double az );
+        void                UpdateBias( const double (&rGyro)[3], const double (&rAccel)[3] );
+
+    public:
+        // gx, gy, gz in rad/s, ax, ay, az in g, dt in seconds
+        void                Update( double gx, double gy, double gz, double ax, double ay, double az, double dt );
+        // Returns attitude as normalized euler angles (-1.0 to 1.0)
+        void                GetAttitude( double& rRoll, double& rPitch, double& rYaw );
+        void                Reset();
+
+        MotionFilter();
+    };
+
+} // namespace Drivers::Gamepad
+
+
+#endif // __GAMEPAD__FILTER_MOTION_HPP__
@@ -0,0 +1,461 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//  OpenSD
+//  An open-source userspace driver for Valve's Steam Deck hardware
+//
+//  Copyright 2022 seek
+//  https://gitlab.com/open-sd/opensd
+//  Licensed under the GNU GPLv3+
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the 
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of 
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; 
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. 
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with this program. 
+//  If not, see <https://www.gnu.org/licenses/>.             
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#include "flight_recorder.hpp"
+#include "../../../common/errors.hpp"
+// Linux
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+
+// Every recorder that can be dumped, for the crash handler
+static std::atomic<Drivers::Gamepad::FlightRecorder*>   gRecorders[Drivers::Gamepad::RECORDER_MAX];
+
+// Signals that leave a crash dump behind
+const int           RECORDER_CRASH_SIGNALS[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT };
+
+const char*         RECORDER_DEVICE_NAMES[Drivers::Gamepad::RECORDER_DEVICES] = { "gamepad", "motion", "mouse" };
+const char*         RECORDER_MARK_NAMES[] = { "attached", "detached", "profile", "slow_report", "late_report" };
+const char*         RECORDER_STAGE_NAMES[Drivers::Gamepad::STAGE_COUNT] = { "update", "translate", "flush", "publish" };
+
+
+
+// Buffered text output made only of async-signal-safe calls
+class DumpWriter
+{
+private:
+    int                 mFd;
+    char                mBuff[4096];
+    size_t              mLen;
+    
+public:
+    void                Flush()
+    {
+        size_t      done = 0;
+        
+        while (done < mLen)
+        {
+            ssize_t     result = write( mFd, mBuff + done, mLen - done );
+            if (result <= 0)
+                break;
+            done += result;
+        }
+        mLen = 0;
+    }
+    
+    void                Char( char c )
+    {
+        if (mLen >= sizeof(mBuff))
+            Flush();
+        mBuff[mLen++] = c;
+    }
+    
+    void                Str( const char* pStr )
+    {
+        while (*pStr)
+            Char( *pStr++ );
+    }
+    
+    void                UDec( uint64_t value )
+    {
+        char        digits[20];
+        int         count = 0;
+        
+        do
+        {
+            digits[count++] = '0' + (value % 10);
+            value /= 10;
+        } while (value);
+        
+        while (count)
+            Char( digits[--count] );
+    }
+    
+    void                Dec( int64_t value )
+    {
+        if (value < 0)
+        {
+            Char( '-' );
+            UDec( -(uint64_t)value );
+        }
+        else
+            UDec( value );
+    }
+    
+    void                Hex( uint8_t value )
+    {
+        const char  hex[] = "0123456789abcdef";
+        
+        Char( hex[value >> 4] );
+        Char( hex[value & 0x0f] );
+    }
+    
+    DumpWriter( int fd ) : mFd(fd), mLen(0) {}
+    ~DumpWriter() { Flush(); }
+};
+
+
+
+static void HandleCrash( int sig )
+{
+    Drivers::Gamepad::FlightRecorder::DumpAll( "crash" );
+    
+    // The handler was reset, so this takes the default action once we return
+    raise( sig );
+}
+
+
+
+int Drivers::Gamepad::FlightRecorder::Enable( unsigned int index, std::filesystem::path dumpDir )
+{
+    std::error_code     ec;
+    
+    
+    if (IsEnabled())
+        return Err::ALREADY_OPEN;
+    
+    std::filesystem::create_directories( dumpDir, ec );
+    if (ec || (dumpDir.string().size() >= sizeof(mDumpDir) - 64))
+        return Err::DIR_NOT_FOUND;
+    strcpy( mDumpDir, dumpDir.c_str() );
+    
+    try { mRing.resize( RECORDER_ENTRIES ); } catch (...)
+    {
+        return Err::OUT_OF_MEMORY;
+    }
+    mIndex = index;
+    mHead = 0;
+    
+    for (auto&& i : gRecorders)
+    {
+        FlightRecorder*     expected = nullptr;
+        if (i.compare_exchange_strong( expected, this ))
+            break;
+    }
+    
+    return Err::OK;
+}
+
+
+
+bool Drivers::Gamepad::FlightRecorder::IsEnabled()
+{
+    return !mRing.empty();
+}
+
+
+
+Drivers::Gamepad::RecEntry& Drivers::Gamepad::FlightRecorder::Next( RecType type, uint32_t frame, uint64_t timeNs )
+{
+    RecEntry&           entry = mRing[mHead.load( std::memory_order_relaxed ) & (RECORDER_ENTRIES - 1)];
+    
+    entry.time_ns   = timeNs;
+    entry.frame     = frame;
+    entry.type      = type;
+    entry.dev       = 0;
+    entry.ev_type   = 0;
+    entry.ev_code   = 0;
+    entry.value     = 0;
+    
+    return entry;
+}
+
+
+
+void Drivers::Gamepad::FlightRecorder::Commit()
+{
+    // Readers only trust entries below the head
+    mHead.store( mHead.load( std::memory_order_relaxed ) + 1, std::memory_order_release );
+}
+
+
+
+void Drivers::Gamepad::FlightRecorder::RecordReport( const uint8_t* pReport, uint32_t frame, uint64_t timeNs )
+{
+    if (!IsEnabled())
+        return;
+    
+    RecEntry&           entry = Next( RecType::REPORT, frame, timeNs );
+    memcpy( entry.report, pReport, sizeof(entry.report) );
+    Commit();
+}
+
+
+
+void Drivers::Gamepad::FlightRecorder::RecordStages( uint32_t frame, uint64_t startNs, const uint64_t (&rStageNs)[STAGE_COUNT] )
+{
+    uint64_t            prev = startNs;
+    
+    if (!IsEnabled())
+        return;
+    
+    // Stage end times are stored as durations
+    RecEntry&           entry = Next( RecType::STAGES, frame, startNs );
+    for (int i = 0; i < STAGE_COUNT; ++i)
+    {
+        entry.stage_ns[i] = (rStageNs[i] > prev) ? (uint32_t)(rStageNs[i] - prev) : 0;
+        prev = rStageNs[i];
+    }
+    Commit();
+}
+
+
+
+void Drivers::Gamepad::FlightRecorder::RecordEvents( unsigned int dev, const std::vector<input_event>& rEvents, uint32_t frame, uint64_t timeNs )
+{
+    int32_t*            last;
+    
+    if (!IsEnabled() || (dev >= RECORDER_DEVICES))
+        return;
+    
+    // Every frame carries the full state, so keep only what changed.  
+    // Relative events are deltas and always count.
+    for (auto&& ev : rEvents)
+    {
+        last = nullptr;
+        switch (ev.type)
+        {
+            case EV_KEY:
+                if (ev.code >= KEY_CNT)
+                    continue;
+                last = &mLastKey[dev][ev.code];
+            break;
+            
+            case EV_ABS:
+                if (ev.code >= ABS_CNT)
+                    continue;
+                last = &mLastAbs[dev][ev.code];
+            break;
+            
+            case EV_REL:
+                if (!ev.value)
+                    continue;
+            break;
+            
+            default:
+                continue;
+            break;
+        }
+        
+        if (last != nullptr)
+        {
+            if (*last == ev.value)
+                continue;
+            *last = ev.value;
+        }
+        
+        RecEntry&       entry = Next( RecType::EVENT, frame, timeNs );
+        entry.dev       = dev;
+        entry.ev_type   = ev.type;
+        entry.ev_code   = ev.code;
+        entry.value     = ev.value;
+        Commit();
+    }
+}
+
+
+
+void Drivers::Gamepad::FlightRecorder::RecordMark( RecMark mark, int32_t value, uint64_t timeNs )
+{
+    if (!IsEnabled())
+        return;
+    
+    RecEntry&           entry = Next( RecType::MARK, 0, timeNs );
+    entry.dev       = (uint8_t)mark;
+    entry.value     = value;
+    Commit();
+}
+
+
+
+int Drivers::Gamepad::FlightRecorder::WriteDump( int fd, const char* pReason )
+{
+    DumpWriter          out( fd );
+    RecEntry            entry;
+    timespec            ts;
+    uint64_t            now;
+    uint64_t            head;
+    uint64_t            first;
+    
+    
+    head = mHead.load( std::memory_order_acquire );
+    first = (head > RECORDER_ENTRIES) ? head - RECORDER_ENTRIES : 0;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    now = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    
+    out.Str( "# OpenSD flight recorder\n# gamepad " );
+    out.UDec( mIndex );
+    out.Str( ", reason " );
+    out.Str( pReason );
+    out.Str( ", " );
+    out.UDec( head - first );
+    out.Str( " entries\n# Times are in microseconds before the dump\n" );
+    
+    for (uint64_t i = first; i < head; ++i)
+    {
+        // The driver keeps recording, so throw away anything it overwrote
+        // while we were copying
+        memcpy( (void*)&entry, &mRing[i & (RECORDER_ENTRIES - 1)], sizeof(entry) );
+        std::atomic_thread_fence( std::memory_order_acquire );
+        if (mHead.load( std::memory_order_relaxed ) >= i + RECORDER_ENTRIES)
+            continue;
+        
+        out.Dec( (entry.time_ns < now) ? -(int64_t)((now - entry.time_ns) / 1000) : 0 );
+        switch (entry.type)
+        {
+            case RecType::REPORT:
+                out.Str( " report " );
+                out.UDec( entry.frame );
+                out.Char( ' ' );
+                for (auto&& b : entry.report)
+                    out.Hex( b );
+            break;
+            
+            case RecType::STAGES:
+                out.Str( " stages " );
+                out.UDec( entry.frame );
+                for (int s = 0; s < STAGE_COUNT; ++s)
+                {
+                    out.Char( ' ' );
+                    out.Str( RECORDER_STAGE_NAMES[s] );
+                    out.Char( ' ' );
+                    out.UDec( entry.stage_ns[s] / 1000 );
+                }
+            break;
+            
+            case RecType::EVENT:
+                out.Str( " event " );
+                out.UDec( entry.frame );
+                out.Char( ' ' );
+                out.Str( (entry.dev < RECORDER_DEVICES) ? RECORDER_DEVICE_NAMES[entry.dev] : "?" );
+                out.Str( (entry.ev_type == EV_KEY) ? " key " : ((entry.ev_type == EV_ABS) ? " abs " : " rel ") );
+                out.UDec( entry.ev_code );
+                out.Char( ' ' );
+                out.Dec( entry.value );
+            break;
+            
+            case RecType::MARK:
+                out.Str( " mark " );
+                out.Str( (entry.dev < sizeof(RECORDER_MARK_NAMES) / sizeof(RECORDER_MARK_NAMES[0])) ? RECORDER_MARK_NAMES[entry.dev] : "?" );
+                out.Char( ' ' );
+                out.Dec( entry.value );
+            break;
+        }
+        out.Char( '\n' );
+    }
+    
+    return Err::OK;
+}
+
+
+
+int Drivers::Gamepad::FlightRecorder::Dump( const char* pReason )
+{
+    char                path[PATH_MAX];
+    char                index[12];
+    char                digits[12];
+    int                 len = 0;
+    int                 count = 0;
+    unsigned int        value;
+    int                 fd;
+    
+    
+    if (!IsEnabled())
+        return Err::NOT_INITIALIZED;
+    
+    // No std::string here since this runs in the crash handler
+    value = mIndex;
+    do
+    {
+        digits[count++] = '0' + (value % 10);
+        value /= 10;
+    } while (value);
+    while (count)
+        index[len++] = digits[--count];
+    index[len] = '\0';
+    
+    // <dir>/flight-<gamepad>-<reason>.log
+    len = 0;
+    for (const char* part : { (const char*)mDumpDir, "/flight-", (const char*)index, "-", pReason, ".log" })
+        while (*part && (len < (int)sizeof(path) - 1))
+            path[len++] = *part++;
+    path[len] = '\0';
+    
+    fd = open( path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600 );
+    if (fd < 0)
+        return Err::CANNOT_CREATE;
+    
+    WriteDump( fd, pReason );
+    close( fd );
+    
+    return Err::OK;
+}
+
+
+
+void Drivers::Gamepad::FlightRecorder::InstallCrashHandler()
+{
+    struct sigaction    sa = {};
+    
+    sa.sa_handler = HandleCrash;
+    sa.sa_flags = SA_RESETHAND;
+    sigemptyset( &sa.sa_mask );
+    
+    for (auto&& sig : RECORDER_CRASH_SIGNALS)
+        sigaction( sig, &sa, nullptr );
+}
+
+
+
+void Drivers::Gamepad::FlightRecorder::DumpAll( const char* pReason )
+{
+    FlightRecorder*     rec;
+    
+    for (auto&& i : gRecorders)
+    {
+        rec = i.load();
+        if (rec != nullptr)
+            rec->Dump( pReason );
+    }
+}
+
+
+
+Drivers::Gamepad::FlightRecorder::FlightRecorder()
+{
+    mHead = 0;
+    mIndex = 0;
+    mDumpDir[0] = '\0';
+    memset( mLastKey, 0, sizeof(mLastKey) );
+    memset( mLastAbs, 0, sizeof(mLastAbs) );
+}
+
+
+
+Drivers::Gamepad::FlightRecorder::~FlightRecorder()
+{
+    for (auto&& i : gRecorders)
+    {
+        FlightRecorder*     expected = this;
+        i.compare_exchange_strong( expected, nullptr );
+    }
+}
@@ -0,0 +1,131 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//  OpenSD
+//  An open-source userspace driver for Valve's Steam Deck hardware
+//
+//  Copyright 2022 seek
+//  https://gitlab.com/open-sd/opensd
+//  Licensed under the GNU GPLv3+
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the 
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of 
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; 
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. 
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with this program. 
+//  If not, see <https://www.gnu.org/licenses/>.             
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#ifndef __GAMEPAD__FLIGHT_RECORDER_HPP__
+#define __GAMEPAD__FLIGHT_RECORDER_HPP__
+
+// Linux
+#include <linux/input.h>
+#include <limits.h>
+// C++
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+
+namespace Drivers::Gamepad
+{
+    // Must be a power of two.  About 700 KiB per gamepad, which covers 
+    // several seconds of active input.
+    const unsigned int              RECORDER_ENTRIES        = 8192;
+    // Recorders the crash handler knows about
+    const unsigned int              RECORDER_MAX            = 16;
+    // uinput devices whose output is recorded
+    const unsigned int              RECORDER_DEVICES        = 3;
+    // Least time between automatic dumps, in nanoseconds
+    const uint64_t                  RECORDER_DUMP_INTERVAL  = 30000000000;
+    
+    enum class RecType : uint8_t
+    {
+        REPORT,         // Raw input report
+        STAGES,         // Processing time of each stage for one report
+        EVENT,          // uinput event whose value changed
+        MARK            // Something worth noting, see RecMark
+    };
+    
+    enum class RecMark : uint8_t
+    {
+        ATTACHED,
+        DETACHED,
+        PROFILE,
+        SLOW_REPORT,    // Processing took longer than the threshold, value in us
+        LATE_REPORT     // Report arrived later than the threshold, value in us
+    };
+    
+    enum RecStage
+    {
+        STAGE_UPDATE,
+        STAGE_TRANSLATE,
+        STAGE_FLUSH,
+        STAGE_PUBLISH,
+        STAGE_COUNT
+    };
+    
+    struct RecEntry
+    {
+        uint64_t                    time_ns;        // Monotonic clock
+        uint32_t                    frame;          // Hardware frame counter
+        RecType                     type;
+        uint8_t                     dev;            // EVENT: uinput device.  MARK: RecMark
+        uint16_t                    ev_type;
+        uint16_t                    ev_code;
+        int32_t                     value;
+        union
+        {
+            uint8_t                 report[64];
+            uint32_t                stage_ns[STAGE_COUNT];
+        };
+    };
+    
+    // Fixed size ring of the last few seconds of input, output and timing.
+    // Only the driver thread records, without locks or allocations.  Dumps 
+    // can be taken from any thread while recording goes on, and from the 
+    // crash handler since they only use async-signal-safe calls.
+    class FlightRecorder
+    {
+    private:
+        std::vector<RecEntry>       mRing;
+        std::atomic<uint64_t>       mHead;          // Total entries recorded
+        unsigned int                mIndex;         // Gamepad number
+        char                        mDumpDir[PATH_MAX];
+        // Last value written for each code, so only changes are recorded
+        int32_t                     mLastKey[RECORDER_DEVICES][KEY_CNT];
+        int32_t                     mLastAbs[RECORDER_DEVICES][ABS_CNT];
+        
+        RecEntry&                   Next( RecType type, uint32_t frame, uint64_t timeNs );
+        void                        Commit();
+        int                         WriteDump( int fd, const char* pReason );
+        
+    public:
+        // Allocates the ring and creates the dump directory
+        int                         Enable( unsigned int index, std::filesystem::path dumpDir );
+        bool                        IsEnabled();
+        
+        // Driver thread only
+        void                        RecordReport( const uint8_t* pReport, uint32_t frame, uint64_t timeNs );
+        void                        RecordStages( uint32_t frame, uint64_t startNs, const uint64_t (&rStageNs)[STAGE_COUNT] );
+        void                        RecordEvents( unsigned int dev, const std::vector<input_event>& rEvents, uint32_t frame, uint64_t timeNs );
+        void                        RecordMark( RecMark mark, int32_t value, uint64_t timeNs );
+        
+        // Writes flight-<gamepad>-<reason>.log to the dump directory
+        int                         Dump( const char* pReason );
+        
+        // Dumps every enabled recorder when the daemon crashes
+        static void                 InstallCrashHandler();
+        static void                 DumpAll( const char* pReason );
+        
+        FlightRecorder();
+        ~FlightRecorder();
+    };
+    
+} // namespace Drivers::Gamepad
+
+
+#endif // __GAMEPAD__FLIGHT_RECORDER_HPP__
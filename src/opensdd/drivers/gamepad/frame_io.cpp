@@ -0,0 +1,315 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//  OpenSD
+//  An open-source userspace driver for Valve's Steam Deck hardware
+//
+//  Copyright 2022 seek
+//  https://gitlab.com/open-sd/opensd
+//  Licensed under the GNU GPLv3+
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the 
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of 
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; 
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. 
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with this program. 
+//  If not, see <https://www.gnu.org/licenses/>.             
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#include "frame_io.hpp"
+#include "../../../common/errors.hpp"
+#include "../../../common/log.hpp"
+#include "../../../common/trace.hpp"
+// Linux
+#include <unistd.h>
+// C++
+#include <chrono>
+#include <string>
+
+
+// Completion tags
+const uint64_t          FRAME_IO_TAG_READ   = 0;
+const uint64_t          FRAME_IO_TAG_WRITE  = 1;    // + device slot
+
+// Submission entries:  one read plus one write per device, with some spare
+const unsigned int      FRAME_IO_ENTRIES    = 8;
+
+// How long to wait on a device's previous write before giving up on a frame
+const int               FRAME_IO_WRITE_WAIT = 20;   // In milliseconds
+
+
+
+int Drivers::Gamepad::FrameIo::Start( Hidraw& rHid )
+{
+    int                 result;
+    
+    
+    if (IsActive())
+        return Err::ALREADY_OPEN;
+    
+    result = mRing.Open( FRAME_IO_ENTRIES );
+    if (result != Err::OK)
+    {
+        gLog.Write( Log::VERB, FUNC_NAME, "io_uring is not available, using poll and read for gamepad I/O." );
+        return result;
+    }
+    
+    // Hidraw may close its fd from other threads, so the ring reads its own 
+    // copy
+    mHidFd = rHid.Dup();
+    if (mHidFd < 0)
+    {
+        mRing.Close();
+        return Err::NOT_OPEN;
+    }
+    
+    mReadArmed = false;
+    mTimeoutCount = 0;
+    for (unsigned int i = 0; i < FRAME_IO_MAX_DEVICES; ++i)
+        mWriting[i] = false;
+    
+    gLog.Write( Log::VERB, FUNC_NAME, "Using io_uring for gamepad I/O." );
+    
+    return Err::OK;
+}
+
+
+
+void Drivers::Gamepad::FrameIo::Stop()
+{
+    if (!IsActive())
+        return;
+    
+    // Let the last frame's writes land before the ring cancels everything
+    for (unsigned int i = 0; i < FRAME_IO_MAX_DEVICES; ++i)
+        WaitForWrite( i );
+    
+    mRing.Close();
+    close( mHidFd );
+    mHidFd = -1;
+    mReadArmed = false;
+}
+
+
+
+bool Drivers::Gamepad::FrameIo::IsActive()
+{
+    return (mHidFd >= 0);
+}
+
+
+
+void Drivers::Gamepad::FrameIo::Reap()
+{
+    uint64_t            tag;
+    int                 result;
+    
+    
+    while (mRing.GetCompletion( tag, result ))
+    {
+        if (tag == FRAME_IO_TAG_READ)
+        {
+            mReadArmed = false;
+            mReadResult = result;
+        }
+        else
+        {
+            if ((tag >= FRAME_IO_TAG_WRITE) && (tag < FRAME_IO_TAG_WRITE + FRAME_IO_MAX_DEVICES))
+            {
+                mWriting[tag - FRAME_IO_TAG_WRITE] = false;
+                TRACE_PROBE2( uinput_flush_done, mWriteFds[tag - FRAME_IO_TAG_WRITE], result );
+                if (result < 0)
+                    gLog.Write( Log::DEBUG, FUNC_NAME, "uinput write error: " + Err::GetErrnoString(-result) );
+            }
+        }
+    }
+}
+
+
+
+void Drivers::Gamepad::FrameIo::WaitForWrite( unsigned int slot )
+{
+    auto                deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(FRAME_IO_WRITE_WAIT);
+    
+    
+    Reap();
+    while (mWriting[slot] && (std::chrono::steady_clock::now() < deadline))
+    {
+        if (mRing.Submit( 1, 1 ) != Err::OK)
+            break;
+        Reap();
+    }
+}
+
+
+
+int Drivers::Gamepad::FrameIo::Read( std::vector<uint8_t>& rData, int timeout )
+{
+    int                 result;
+    int                 remaining;
+    
+    
+    rData.clear();
+    
+    if (!IsActive())
+        return Err::NOT_OPEN;
+    
+    if ((timeout < 0) || (timeout > mReadTimeout))
+        timeout = mReadTimeout;
+    
+    auto                deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+    
+    if (!mReadArmed)
+    {
+        if (mRing.QueueRead( mHidFd, mReadBuff, sizeof(mReadBuff), FRAME_IO_TAG_READ ) != Err::OK)
+            return Err::READ_FAILED;
+        mReadArmed = true;
+    }
+    
+    // Completed writes can wake us up early, so keep waiting until the read
+    // is done or time runs out
+    for (;;)
+    {
+        Reap();
+        if (!mReadArmed)
+            break;
+        
+        remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+        if (remaining <= 0)
+        {
+            // Make sure the read is in flight before giving up
+            mRing.Submit();
+            break;
+        }
+        
+        result = mRing.Submit( 1, remaining );
+        if (result != Err::OK)
+            return Err::READ_FAILED;
+    }
+    
+    if (mReadArmed)
+    {
+        // The caller only wanted to wait a little
+        if (timeout < mReadTimeout)
+            return Err::OK;
+        
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Device timeout." );
+        ++mTimeoutCount;
+        if (mTimeoutCount > mMaxTimeouts)
+        {
+            gLog.Write( Log::ERROR, "Maximum timout count exceeded for hidraw device." );
+            return Err::DEVICE_LOST;
+        }
+        return Err::OK;
+    }
+    
+    mTimeoutCount = 0;
+    if (mReadResult < 0)
+    {
+        int e = -mReadResult;
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to read hidraw device: error " + std::to_string(e) + ": " + Err::GetErrnoString(e) );
+        if ((e == ENODEV) || (e == EIO))
+        {
+            gLog.Write( Log::ERROR, "Hidraw device was disconnected." );
+            return Err::DEVICE_LOST;
+        }
+        return Err::READ_FAILED;
+    }
+    
+    rData.assign( mReadBuff, mReadBuff + mReadResult );
+    
+    // Re-arm right away.  The read goes to the kernel with the next frame's 
+    // uinput writes.
+    if (mRing.QueueRead( mHidFd, mReadBuff, sizeof(mReadBuff), FRAME_IO_TAG_READ ) == Err::OK)
+        mReadArmed = true;
+    
+    return Err::OK;
+}
+
+
+
+int Drivers::Gamepad::FrameIo::Flush( std::initializer_list<Uinput::Device*> devices, bool force )
+{
+    int                 result = Err::OK;
+    unsigned int        slot = 0;
+    
+    
+    if (!IsActive())
+        return Err::NOT_OPEN;
+    
+    Reap();
+    for (auto&& dev : devices)
+    {
+        if (slot >= FRAME_IO_MAX_DEVICES)
+            break;
+        
+        if (dev != nullptr)
+        {
+            // Writes to one device must not overtake each other
+            if (mWriting[slot])
+                WaitForWrite( slot );
+            
+            if (mWriting[slot])
+            {
+                gLog.Write( Log::DEBUG, FUNC_NAME, "Previous uinput write is still pending." );
+                result = Err::WRITE_FAILED;
+            }
+            else
+            {
+                mFrames[slot].clear();
+                // The device's output policy may hold the frame back
+                if ((dev->Collect( mFrames[slot], force ) == Err::OK) && (!mFrames[slot].empty()))
+                {
+                    mWriteFds[slot] = dev->GetFd();
+                    TRACE_PROBE2( uinput_flush_start, mWriteFds[slot], mFrames[slot].size() );
+                    if (mRing.QueueWrite( mWriteFds[slot], mFrames[slot].data(), mFrames[slot].size() * sizeof(input_event), FRAME_IO_TAG_WRITE + slot ) == Err::OK)
+                        mWriting[slot] = true;
+                    else
+                        result = Err::WRITE_FAILED;
+                }
+            }
+        }
+        ++slot;
+    }
+    
+    // One syscall for the whole frame, including a re-armed read
+    if (mRing.Submit() != Err::OK)
+    {
+        gLog.Write( Log::ERROR, "Failed to write uinput: io_uring submission failed." );
+        return Err::WRITE_FAILED;
+    }
+    
+    return result;
+}
+
+
+
+const std::vector<input_event>& Drivers::Gamepad::FrameIo::GetFrame( unsigned int slot )
+{
+    return mFrames[slot % FRAME_IO_MAX_DEVICES];
+}
+
+
+
+Drivers::Gamepad::FrameIo::FrameIo()
+{
+    mHidFd = -1;
+    mReadArmed = false;
+    mReadResult = 0;
+    mReadTimeout = 1000; // in ms
+    mTimeoutCount = 0;
+    mMaxTimeouts = 5;
+    for (unsigned int i = 0; i < FRAME_IO_MAX_DEVICES; ++i)
+    {
+        mWriting[i] = false;
+        mWriteFds[i] = -1;
+    }
+}
+
+
+
+Drivers::Gamepad::FrameIo::~FrameIo()
+{
+    Stop();
+}
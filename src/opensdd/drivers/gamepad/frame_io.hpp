@@ -0,0 +1,78 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//  OpenSD
+//  An open-source userspace driver for Valve's Steam Deck hardware
+//
+//  Copyright 2022 seek
+//  https://gitlab.com/open-sd/opensd
+//  Licensed under the GNU GPLv3+
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the 
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of 
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; 
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. 
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with this program. 
+//  If not, see <https://www.gnu.org/licenses/>.             
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#ifndef __GAMEPAD__FRAME_IO_HPP__
+#define __GAMEPAD__FRAME_IO_HPP__
+
+#include "../../io_uring.hpp"
+#include "../../hidraw.hpp"
+#include "../../uinput.hpp"
+// C++
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+
+
+namespace Drivers::Gamepad
+{
+    // Most uinput devices written per frame
+    const unsigned int              FRAME_IO_MAX_DEVICES = 4;
+    
+    // io_uring backend for the driver thread's per-frame I/O.  A read is 
+    // kept armed on the hidraw device, and all of a frame's uinput writes go 
+    // out with one io_uring_enter.  If Start() fails the driver keeps using 
+    // Hidraw::Read() and Uinput::Device::Flush().
+    class FrameIo
+    {
+    private:
+        IoUring                     mRing;
+        int                         mHidFd;                 // Our own copy of the hidraw fd
+        uint8_t                     mReadBuff[64];
+        bool                        mReadArmed;             // A read is queued or in flight
+        int                         mReadResult;            // Result of the last completed read
+        int                         mReadTimeout;           // Same as Hidraw
+        int                         mTimeoutCount;
+        int                         mMaxTimeouts;
+        std::vector<input_event>    mFrames[FRAME_IO_MAX_DEVICES];  // Must outlive their writes
+        bool                        mWriting[FRAME_IO_MAX_DEVICES];
+        int                         mWriteFds[FRAME_IO_MAX_DEVICES];    // For tracing completions
+        
+        void                        Reap();
+        void                        WaitForWrite( unsigned int slot );
+        
+    public:
+        int                         Start( Hidraw& rHid );
+        void                        Stop();
+        bool                        IsActive();
+        // Same results as Hidraw::Read()
+        int                         Read( std::vector<uint8_t>& rData, int timeout = -1 );
+        // Null devices are skipped.  Each device keeps its position in the
+        // list between calls.  'force' is passed on to Uinput::Device::Collect().
+        int                         Flush( std::initializer_list<Uinput::Device*> devices, bool force = false );
+        // Events queued for a device by the last Flush()
+        const std::vector<input_event>& GetFrame( unsigned int slot );
+        
+        FrameIo();
+        ~FrameIo();
+    };
+    
+} // namespace Drivers::Gamepad
+
+
+#endif // __GAMEPAD__FRAME_IO_HPP__
@@ -21,6 +21,7 @@
 #define __GAMEPAD__HID_REPORTS_HPP__
 
 #include <cstdint>
+#include <cmath>
 
 
 namespace Drivers::Gamepad
@@ -45,7 +46,25 @@ namespace Drivers::Gamepad
         const double    PAD_FORCE_MAX       = 32767.0;
         const double    TRIGG_MIN           = 0;
         const double    TRIGG_MAX           = 32767.0;
-        
+        const double    ACCEL_MAX           = 32767.0;
+
+        // Motion sensor calibration.  These match the values used by the
+        // kernel hid-steam driver for the Deck IMU.
+        const double    ACCEL_RES_PER_G     = 16384.0;                  // +/- 2g full range
+        const double    GYRO_RES_PER_DPS    = 16.0;                     // +/- 2000 deg/s full range
+
+        // Nominal time between input reports (250Hz)
+        const double    REPORT_INTERVAL_SEC = 0.004;
+        // Longest time step allowed between two reports.  Anything longer
+        // (stalls, device resume) is treated as this to avoid large jumps.
+        const double    MAX_INTERVAL_SEC    = 0.1;
+
+        // Time based effects.  These are tuned so that behaviour at the nominal
+        // report rate matches the original per-report values.
+        const double    PAD_INERTIA_DECAY   = 12.823;                   // Per second, same as 5% per report at 250Hz
+        const double    PAD_INERTIA_STOP    = 1.0;                      // Glide ends below this speed, in pad units per second
+        const double    REL_AXIS_RATE       = 1.0 / REPORT_INTERVAL_SEC;  // Counts per second at full axis / button
+
         // Precalculated axis multipliers
         const double    STICK_X_AXIS_MULT   = 1.0 / STICK_X_MAX;
         const double    STICK_Y_AXIS_MULT   = 1.0 / STICK_Y_MAX;
@@ -56,11 +75,36 @@ namespace Drivers::Gamepad
         const double    PAD_Y_SENS_MULT     = 1.0 / 128.0;
         const double    PAD_FORCE_MULT      = 1.0 / PAD_FORCE_MAX;
         const double    TRIGG_AXIS_MULT     = 1.0 / TRIGG_MAX;
-        
-        // Lengh of time for the thread to sleep before keyboard emulation 
-        // has to be disabled again with a CLEAR_MAPPINGS report.
+        const double    ACCEL_AXIS_MULT     = 1.0 / ACCEL_MAX;
+        const double    ACCEL_G_MULT        = 1.0 / ACCEL_RES_PER_G;
+        const double    GYRO_RADS_MULT      = (M_PI / 180.0) / GYRO_RES_PER_DPS;
+
+        // Haptic output timing.  Each haptic report starts a pulse train long
+        // enough to bridge the gap until the next update, and reports for each
+        // side are rate limited so the controller is never flooded.
+        const double    FF_UPDATE_SEC       = 0.01;                     // Effect engine update interval
+        const double    FF_MIN_REPORT_SEC   = 0.02;                     // Minimum time between haptic reports per side
+        const double    FF_HOLD_SEC         = 0.06;                     // Length of each pulse train
+        const double    FF_LEVEL_EPSILON    = 0.02;                     // Level changes smaller than this are ignored
+        const uint16_t  FF_PULSE_PERIOD_US  = 5000;
+        const double    FF_AMPLITUDE_MAX    = 65535.0;
+
+        // Byte range of the frame counter, which is the only part of an input
+        // report that changes while the controller is idle
+        const unsigned int  REPORT_FRAME_OFFSET = 4;
+        const unsigned int  REPORT_FRAME_SIZE   = 4;
+
+        // Length of time before keyboard emulation has to be disabled again
+        // with a CLEAR_MAPPINGS report.
         const double    LIZARD_SLEEP_SEC    = 2.0;
         
+        // Reconnect timing.  Raw kernel uevents arrive before udev has set the
+        // node permissions, so opening is retried for a short while after a
+        // hidraw device is added.  A slow rescan covers lost events.
+        const double    HOTPLUG_RETRY_SEC   = 0.05;
+        const double    HOTPLUG_RETRY_WINDOW_SEC = 2.0;
+        const double    HOTPLUG_RESCAN_SEC  = 1.0;
+        
         namespace ReportType
         {
             enum
@@ -88,6 +132,15 @@ namespace Drivers::Gamepad
             };
         }
     
+        namespace FeedbackSide
+        {
+            enum
+            {
+                LEFT                        = 0x00,
+                RIGHT                       = 0x01
+            };
+        }
+    
         namespace Register
         {
             enum
@@ -181,11 +234,11 @@ namespace Drivers::Gamepad
             int16_t         r_pad_x         : 16;   // 20
             int16_t         r_pad_y         : 16;   // 22    
             // byte 24-29
-            int16_t         accel_x         : 16;   // 24       Accelerometers I think.  Needs more testing.
+            int16_t         accel_x         : 16;   // 24       Accelerometers, 16384 per g
             int16_t         accel_y         : 16;   // 26
             int16_t         accel_z         : 16;   // 28
             // byte 30-35
-            int16_t         pitch           : 16;   // 30       Attitude (?)  Needs more testing
+            int16_t         pitch           : 16;   // 30       Gyro angular rates, 16 per deg/s
             int16_t         yaw             : 16;   // 32
             int16_t         roll            : 16;   // 34
             // byte 36-43
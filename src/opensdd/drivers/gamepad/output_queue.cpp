@@ -0,0 +1,184 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//  OpenSD
+//  An open-source userspace driver for Valve's Steam Deck hardware
+//
+//  Copyright 2022 seek
+//  https://gitlab.com/open-sd/opensd
+//  Licensed under the GNU GPLv3+
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the 
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of 
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; 
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. 
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with this program. 
+//  If not, see <https://www.gnu.org/licenses/>.             
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#include "output_queue.hpp"
+#include "../../../common/log.hpp"
+// Linux
+#include <sys/eventfd.h>
+#include <unistd.h>
+// C++
+#include <cstring>
+#include <stdexcept>
+
+
+int Drivers::Gamepad::OutputQueue::Push( OutPriority prio, uint32_t key, const uint8_t* pData )
+{
+    Slot*               slot = nullptr;
+    
+    
+    {
+        std::lock_guard<std::mutex>     lock( mMutex );
+        
+        // Replace a superseded report
+        if (key)
+            for (auto&& i : mSlots)
+                if ((i.used) && (i.key == key) && (i.prio == prio))
+                {
+                    slot = &i;
+                    break;
+                }
+        
+        // Otherwise take a free slot
+        if (slot == nullptr)
+        {
+            for (auto&& i : mSlots)
+                if (!i.used)
+                {
+                    slot = &i;
+                    break;
+                }
+            
+            if (slot == nullptr)
+            {
+                gLog.Write( Log::DEBUG, FUNC_NAME, "Output queue is full, dropping report." );
+                return Err::OUT_OF_MEMORY;
+            }
+            
+            slot->used  = true;
+            slot->key   = key;
+            slot->prio  = prio;
+            slot->seq   = mSeq++;
+        }
+        
+        memcpy( slot->data, pData, OUTPUT_REPORT_SIZE );
+    }
+    
+    Wake();
+    
+    return Err::OK;
+}
+
+
+
+int Drivers::Gamepad::OutputQueue::Send( Hidraw& rHid, double now, double& rWait )
+{
+    uint8_t             data[OUTPUT_REPORT_SIZE];
+    Slot*               next = nullptr;
+    int                 result;
+    
+    
+    rWait = 0;
+    
+    {
+        std::lock_guard<std::mutex>     lock( mMutex );
+        
+        for (auto&& i : mSlots)
+            if ((i.used) && ((next == nullptr) || (i.prio < next->prio) || ((i.prio == next->prio) && (i.seq < next->seq))))
+                next = &i;
+        
+        if (next == nullptr)
+            return Err::EMPTY;
+        
+        if (now - mLastWrite < OUTPUT_MIN_INTERVAL_SEC)
+        {
+            rWait = OUTPUT_MIN_INTERVAL_SEC - (now - mLastWrite);
+            return Err::OK;
+        }
+        
+        // Copy out so the queue isn't locked during the write
+        memcpy( data, next->data, OUTPUT_REPORT_SIZE );
+        next->used = false;
+        mLastWrite = now;
+    }
+    
+    result = rHid.Write( data, OUTPUT_REPORT_SIZE );
+    if (result != Err::OK)
+    {
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to write output report type " + std::to_string(data[0]) + "." );
+        return Err::WRITE_FAILED;
+    }
+    
+    return Err::OK;
+}
+
+
+
+bool Drivers::Gamepad::OutputQueue::IsEmpty()
+{
+    std::lock_guard<std::mutex>     lock( mMutex );
+    
+    for (auto&& i : mSlots)
+        if (i.used)
+            return false;
+    
+    return true;
+}
+
+
+
+void Drivers::Gamepad::OutputQueue::Clear()
+{
+    std::lock_guard<std::mutex>     lock( mMutex );
+    
+    for (auto&& i : mSlots)
+        i.used = false;
+}
+
+
+
+void Drivers::Gamepad::OutputQueue::Wake()
+{
+    uint64_t            val = 1;
+    
+    if (write( mEventFd, &val, sizeof(val) ) < 0)
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to signal output queue event." );
+}
+
+
+
+int Drivers::Gamepad::OutputQueue::GetEventFd()
+{
+    return mEventFd;
+}
+
+
+
+Drivers::Gamepad::OutputQueue::OutputQueue()
+{
+    for (auto&& i : mSlots)
+        i = {};
+    mSeq        = 0;
+    mLastWrite  = 0;
+    
+    mEventFd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+    if (mEventFd < 0)
+    {
+        int e = errno;
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to create eventfd: " + Err::GetErrnoString(e) );
+        throw std::runtime_error( "eventfd() failed" );
+    }
+}
+
+
+
+Drivers::Gamepad::OutputQueue::~OutputQueue()
+{
+    if (mEventFd >= 0)
+        close( mEventFd );
+}
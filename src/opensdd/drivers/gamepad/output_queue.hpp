@@ -0,0 +1,89 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//  OpenSD
+//  An open-source userspace driver for Valve's Steam Deck hardware
+//
+//  Copyright 2022 seek
+//  https://gitlab.com/open-sd/opensd
+//  Licensed under the GNU GPLv3+
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the 
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of 
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; 
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. 
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with this program. 
+//  If not, see <https://www.gnu.org/licenses/>.             
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#ifndef __GAMEPAD__OUTPUT_QUEUE_HPP__
+#define __GAMEPAD__OUTPUT_QUEUE_HPP__
+
+#include "../../hidraw.hpp"
+// C++
+#include <cstdint>
+#include <mutex>
+
+
+namespace Drivers::Gamepad
+{
+    const unsigned int      OUTPUT_REPORT_SIZE      = 64;
+    const unsigned int      OUTPUT_QUEUE_SLOTS      = 32;
+    // Minimum time between two HID output reports
+    const double            OUTPUT_MIN_INTERVAL_SEC = 0.002;
+
+    // Output priorities, highest first
+    enum class OutPriority
+    {
+        CONTROL,
+        HAPTIC,
+        KEEPALIVE
+    };
+
+    // Builds a coalescing key from a report type and a sub-identifier
+    inline uint32_t OutputKey( uint8_t reportType, uint8_t id ) { return ((uint32_t)reportType << 8) | id; }
+
+    // Prioritized HID output queue.
+    // Reports are copied into preallocated slots and sent highest priority
+    // first, in FIFO order within the same priority.  A report pushed with a
+    // non-zero key replaces any queued report with the same key and priority
+    // so superseded writes (i.e. repeated writes to one register) are never
+    // sent.  The event fd becomes readable whenever a report is pushed.
+    class OutputQueue
+    {
+    private:
+        struct Slot
+        {
+            uint8_t                 data[OUTPUT_REPORT_SIZE];
+            uint32_t                key;
+            uint64_t                seq;
+            OutPriority             prio;
+            bool                    used;
+        };
+
+        Slot                        mSlots[OUTPUT_QUEUE_SLOTS];
+        uint64_t                    mSeq;
+        double                      mLastWrite;
+        int                         mEventFd;
+        std::mutex                  mMutex;
+
+    public:
+        int                         Push( OutPriority prio, uint32_t key, const uint8_t* pData );
+        // Writes the next queued report to the device if the rate limit allows.
+        // Returns Err::EMPTY if there is nothing to send.  If the rate limit is
+        // hit, Err::OK is returned with rWait set to the seconds remaining.
+        int                         Send( Hidraw& rHid, double now, double& rWait );
+        bool                        IsEmpty();
+        void                        Clear();
+        void                        Wake();
+        int                         GetEventFd();
+
+        OutputQueue();
+        ~OutputQueue();
+    };
+
+} // namespace Drivers::Gamepad
+
+
+#endif // __GAMEPAD__OUTPUT_QUEUE_HPP__
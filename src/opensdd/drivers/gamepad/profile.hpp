@@ -24,6 +24,7 @@
 #include "../../uinput_device_config.hpp"
 // C++
 #include <filesystem>
+#include <vector>
 
 
 namespace Drivers::Gamepad
@@ -42,6 +43,7 @@ namespace Drivers::Gamepad
             bool                                lizard;
             bool                                filter_sticks;
             bool                                filter_pads;
+            AxisMerge                           axis_merge;
         } features;
 
         // Stick deazone profiles
@@ -69,6 +71,7 @@ namespace Drivers::Gamepad
             std::vector<uint16_t>               key_list;
             std::vector<Uinput::AbsAxisInfo>    abs_list;
             std::vector<uint16_t>               rel_list;
+            Uinput::OutputPolicy                output;
         };
         
         // List of events each uinput device created by gamepad driver will
@@ -82,6 +85,13 @@ namespace Drivers::Gamepad
         
         // Map of each physical input to their respective uinput device events
         BindMap                                 map;
+        
+        // Alternate maps switched to by Layer bindings.  A Layer binding id of
+        // 1 selects the first one.
+        std::vector<BindMap>                    layers;
+        
+        // Turbo, toggle and macro actions, referred to by ACTION bindings
+        std::vector<Action>                     actions;
     };
     
 }   // namespace Driver::Gamepad
@@ -0,0 +1,201 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//  OpenSD
+//  An open-source userspace driver for Valve's Steam Deck hardware
+//
+//  Copyright 2022 seek
+//  https://gitlab.com/open-sd/opensd
+//  Licensed under the GNU GPLv3+
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the 
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of 
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; 
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. 
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with this program. 
+//  If not, see <https://www.gnu.org/licenses/>.             
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#include "shared_state.hpp"
+#include "../../../common/errors.hpp"
+#include "../../../common/log.hpp"
+// Linux
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+// C++
+#include <cstring>
+#include <new>
+#include <string>
+
+
+// Readers give up after this many torn reads
+const int           SHARED_STATE_READ_TRIES = 64;
+
+
+
+int Drivers::Gamepad::SharedState::Create( unsigned int index )
+{
+    std::string         name = "opensdd-gamepad-" + std::to_string(index);
+    void*               ptr;
+    
+    if (IsCreated())
+        return Err::ALREADY_OPEN;
+    
+    mFd = memfd_create( name.c_str(), MFD_CLOEXEC | MFD_ALLOW_SEALING );
+    if (mFd < 0)
+    {
+        int e = errno;
+        gLog.Write( Log::DEBUG, FUNC_NAME, "memfd_create failed: " + Err::GetErrnoString(e) );
+        return Err::CANNOT_CREATE;
+    }
+    
+    if (ftruncate( mFd, sizeof(SharedStateLayout) ) < 0)
+    {
+        int e = errno;
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to size shared state: " + Err::GetErrnoString(e) );
+        Destroy();
+        return Err::CANNOT_CREATE;
+    }
+    
+    ptr = mmap( nullptr, sizeof(SharedStateLayout), PROT_READ | PROT_WRITE, MAP_SHARED, mFd, 0 );
+    if (ptr == MAP_FAILED)
+    {
+        int e = errno;
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to map shared state: " + Err::GetErrnoString(e) );
+        Destroy();
+        return Err::CANNOT_CREATE;
+    }
+    
+    mpMap           = new (ptr) SharedStateLayout();
+    mpMap->magic    = SHARED_STATE_MAGIC;
+    mpMap->version  = SHARED_STATE_VERSION;
+    mpMap->size     = sizeof(SharedStateLayout);
+    mpMap->index    = index;
+    mpMap->seq      = 0;
+    mpMap->published = 0;
+    
+    // Clients only ever get a read-only fd, so they can't map the segment
+    // writable and corrupt the seqlock for other readers.  Reopening through
+    // /proc gives a new open file description with its own access mode.
+    mReadFd = open( ("/proc/self/fd/" + std::to_string(mFd)).c_str(), O_RDONLY | O_CLOEXEC );
+    if (mReadFd < 0)
+    {
+        int e = errno;
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to open read-only shared state fd: " + Err::GetErrnoString(e) );
+        Destroy();
+        return Err::CANNOT_CREATE;
+    }
+    
+    // Also keep anyone from reopening it writable through their own /proc
+    // entry.  Our mapping already exists and stays writable.  Not supported
+    // before Linux 5.1, where the read-only fd has to do.
+    if (fcntl( mFd, F_ADD_SEALS, F_SEAL_FUTURE_WRITE ) < 0)
+    {
+        int e = errno;
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to seal shared state against writes: " + Err::GetErrnoString(e) );
+    }
+    
+    // Clients can't resize the segment out from under us
+    if (fcntl( mFd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL ) < 0)
+    {
+        int e = errno;
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to seal shared state: " + Err::GetErrnoString(e) );
+    }
+    
+    return Err::OK;
+}
+
+
+
+void Drivers::Gamepad::SharedState::Destroy()
+{
+    if (mpMap != nullptr)
+        munmap( mpMap, sizeof(SharedStateLayout) );
+    if (mFd >= 0)
+        close( mFd );
+    if (mReadFd >= 0)
+        close( mReadFd );
+    
+    mpMap   = nullptr;
+    mFd     = -1;
+    mReadFd = -1;
+}
+
+
+
+bool Drivers::Gamepad::SharedState::IsCreated()
+{
+    return (mpMap != nullptr);
+}
+
+
+
+int Drivers::Gamepad::SharedState::GetFd()
+{
+    return mReadFd;
+}
+
+
+
+void Drivers::Gamepad::SharedState::Publish( const DeviceState& rState )
+{
+    uint32_t        seq;
+    
+    if (mpMap == nullptr)
+        return;
+    
+    seq = mpMap->seq.load( std::memory_order_relaxed );
+    mpMap->seq.store( seq + 1, std::memory_order_relaxed );
+    std::atomic_thread_fence( std::memory_order_release );
+    
+    memcpy( (void*)&mpMap->state, &rState, sizeof(DeviceState) );
+    ++mpMap->published;
+    
+    mpMap->seq.store( seq + 2, std::memory_order_release );
+}
+
+
+
+bool Drivers::Gamepad::SharedState::Read( const SharedStateLayout* pMap, DeviceState& rState, uint64_t& rPublished )
+{
+    uint32_t        seq1;
+    uint32_t        seq2;
+    
+    if ((pMap == nullptr) || (pMap->magic != SHARED_STATE_MAGIC) || (pMap->version != SHARED_STATE_VERSION))
+        return false;
+    
+    for (int i = 0; i < SHARED_STATE_READ_TRIES; ++i)
+    {
+        seq1 = pMap->seq.load( std::memory_order_acquire );
+        if (seq1 & 1)
+            continue;
+        
+        memcpy( &rState, (const void*)&pMap->state, sizeof(DeviceState) );
+        rPublished = pMap->published;
+        
+        std::atomic_thread_fence( std::memory_order_acquire );
+        seq2 = pMap->seq.load( std::memory_order_relaxed );
+        if (seq1 == seq2)
+            return true;
+    }
+    
+    return false;
+}
+
+
+
+Drivers::Gamepad::SharedState::SharedState()
+{
+    mpMap   = nullptr;
+    mFd     = -1;
+    mReadFd = -1;
+}
+
+
+
+Drivers::Gamepad::SharedState::~SharedState()
+{
+    Destroy();
+}
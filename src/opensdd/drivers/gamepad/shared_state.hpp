@@ -0,0 +1,90 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//  OpenSD
+//  An open-source userspace driver for Valve's Steam Deck hardware
+//
+//  Copyright 2022 seek
+//  https://gitlab.com/open-sd/opensd
+//  Licensed under the GNU GPLv3+
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the 
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of 
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; 
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. 
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with this program. 
+//  If not, see <https://www.gnu.org/licenses/>.             
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#ifndef __GAMEPAD__SHARED_STATE_HPP__
+#define __GAMEPAD__SHARED_STATE_HPP__
+
+#include "device_state.hpp"
+// C++
+#include <atomic>
+#include <cstdint>
+
+
+namespace Drivers::Gamepad
+{
+    const uint32_t          SHARED_STATE_MAGIC      = 0x5344534f;   // "OSDS"
+    const uint32_t          SHARED_STATE_VERSION    = 1;
+    
+    // Most segments that are handed to a client at once
+    const unsigned int      SHARED_STATE_MAX_FDS    = 16;
+    
+    static_assert( std::atomic<uint32_t>::is_always_lock_free, "Seqlock counter must be lock-free to be shared between processes" );
+    
+    // Layout of the shared memory segment.  Clients map the memfd read-only
+    // and use SharedState::Read() to take consistent snapshots.
+    struct SharedStateLayout
+    {
+        uint32_t                        magic;
+        uint32_t                        version;
+        uint32_t                        size;           // sizeof(SharedStateLayout)
+        uint32_t                        index;          // Gamepad number
+        alignas(64) std::atomic<uint32_t> seq;          // Odd while the state is being written
+        uint64_t                        published;      // Number of states published so far
+        DeviceState                     state;
+    };
+    
+    // Sent by the daemon to each client connecting to the state socket, along
+    // with one memfd per gamepad as SCM_RIGHTS ancillary data
+    struct SharedStateHandoff
+    {
+        uint32_t                        magic;
+        uint32_t                        version;
+        uint32_t                        count;          // Number of fds attached
+    };
+    
+    // Publishes the normalized device state in a sealed memfd guarded by a
+    // seqlock.  Only the driver thread may call Publish().  Readers never
+    // block the writer; they retry if they raced with an update.
+    class SharedState
+    {
+    private:
+        SharedStateLayout*              mpMap;
+        int                             mFd;
+        int                             mReadFd;        // Read-only fd on the same memfd, for clients
+        
+    public:
+        int                             Create( unsigned int index );
+        void                            Destroy();
+        bool                            IsCreated();
+        // Read-only, so clients can't map the segment writable
+        int                             GetFd();
+        void                            Publish( const DeviceState& rState );
+        
+        // Copies a consistent snapshot out of a mapped segment.  Returns false
+        // if the writer kept getting in the way.
+        static bool                     Read( const SharedStateLayout* pMap, DeviceState& rState, uint64_t& rPublished );
+        
+        SharedState();
+        ~SharedState();
+    };
+
+} // namespace Drivers::Gamepad
+
+
+#endif // __GAMEPAD__SHARED_STATE_HPP__
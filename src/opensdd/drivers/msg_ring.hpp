@@ -0,0 +1,81 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//  OpenSD
+//  An open-source userspace driver for Valve's Steam Deck hardware
+//
+//  Copyright 2022 seek
+//  https://gitlab.com/open-sd/opensd
+//  Licensed under the GNU GPLv3+
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the 
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of 
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; 
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. 
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with this program. 
+//  If not, see <https://www.gnu.org/licenses/>.             
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#ifndef __MSG_RING_HPP__
+#define __MSG_RING_HPP__
+
+// C++
+#include <atomic>
+#include <cstddef>
+#include <type_traits>
+
+
+namespace Drivers
+{
+    // Fixed capacity single producer, single consumer ring buffer.
+    // Push() may only be called from one thread and Pop() from one other 
+    // thread.  Neither call locks or allocates.  Size must be a power of two.
+    template <typename T, size_t Size>
+    class MsgRing
+    {
+        static_assert( (Size & (Size - 1)) == 0, "MsgRing size must be a power of two" );
+        static_assert( std::is_trivially_copyable<T>::value, "MsgRing elements must be trivially copyable" );
+        
+    private:
+        T                                   mBuff[Size];
+        alignas(64) std::atomic<size_t>     mHead;          // Next element to pop, written by consumer
+        alignas(64) std::atomic<size_t>     mTail;          // Next free element, written by producer
+        
+    public:
+        // Returns false if the ring is full
+        bool                                Push( const T& rItem )
+        {
+            size_t      tail = mTail.load( std::memory_order_relaxed );
+            
+            if (tail - mHead.load( std::memory_order_acquire ) >= Size)
+                return false;
+            mBuff[tail & (Size - 1)] = rItem;
+            mTail.store( tail + 1, std::memory_order_release );
+            return true;
+        }
+        
+        // Returns false if the ring is empty
+        bool                                Pop( T& rItem )
+        {
+            size_t      head = mHead.load( std::memory_order_relaxed );
+            
+            if (head == mTail.load( std::memory_order_acquire ))
+                return false;
+            rItem = mBuff[head & (Size - 1)];
+            mHead.store( head + 1, std::memory_order_release );
+            return true;
+        }
+        
+        bool                                IsEmpty()
+        {
+            return mHead.load( std::memory_order_acquire ) == mTail.load( std::memory_order_acquire );
+        }
+        
+        MsgRing(): mBuff(), mHead(0), mTail(0) {};
+    };
+
+} // namespace Drivers
+
+
+#endif // __MSG_RING_HPP__
@@ -0,0 +1,68 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//  OpenSD
+//  An open-source userspace driver for Valve's Steam Deck hardware
+//
+//  Copyright 2022 seek
+//  https://gitlab.com/open-sd/opensd
+//  Licensed under the GNU GPLv3+
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the 
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of 
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; 
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. 
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with this program. 
+//  If not, see <https://www.gnu.org/licenses/>.             
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#include "msg_strings.hpp"
+
+
+// Global instance
+Drivers::MsgStrings Drivers::gMsgStrings;
+
+
+
+uint32_t Drivers::MsgStrings::Intern( const std::string& rStr )
+{
+    if (rStr.empty())
+        return 0;
+    
+    std::lock_guard<std::mutex>     lock( mMutex );
+    
+    for (size_t i = 1; i < mStrings.size(); ++i)
+        if (mStrings[i] == rStr)
+            return i;
+    
+    mStrings.push_back( rStr );
+    return mStrings.size() - 1;
+}
+
+
+
+std::string Drivers::MsgStrings::Get( uint32_t id )
+{
+    std::lock_guard<std::mutex>     lock( mMutex );
+    
+    if (id >= mStrings.size())
+        return "";
+    
+    return mStrings[id];
+}
+
+
+
+Drivers::MsgStrings::MsgStrings()
+{
+    // Reserve id 0
+    mStrings.push_back( "" );
+}
+
+
+
+Drivers::MsgStrings::~MsgStrings()
+{
+    // Nothing to do
+}
@@ -0,0 +1,56 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//  OpenSD
+//  An open-source userspace driver for Valve's Steam Deck hardware
+//
+//  Copyright 2022 seek
+//  https://gitlab.com/open-sd/opensd
+//  Licensed under the GNU GPLv3+
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the 
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of 
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; 
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. 
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with this program. 
+//  If not, see <https://www.gnu.org/licenses/>.             
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#ifndef __MSG_STRINGS_HPP__
+#define __MSG_STRINGS_HPP__
+
+// C++
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+namespace Drivers
+{
+    // Strings that driver messages refer to (i.e. profile names) are interned
+    // here when a profile is parsed so messages only need to carry an id.  
+    // Entries are never removed, so an id stays valid for the life of the
+    // process.  Id 0 is reserved for the empty string.
+    class MsgStrings
+    {
+    private:
+        std::vector<std::string>            mStrings;
+        std::mutex                          mMutex;
+        
+    public:
+        uint32_t                            Intern( const std::string& rStr );
+        std::string                         Get( uint32_t id );
+        
+        MsgStrings();
+        ~MsgStrings();
+    };
+    
+    // Global instance
+    extern MsgStrings gMsgStrings;
+
+} // namespace Drivers
+
+
+#endif // __MSG_STRINGS_HPP__
@@ -0,0 +1,208 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//  OpenSD
+//  An open-source userspace driver for Valve's Steam Deck hardware
+//
+//  Copyright 2022 seek
+//  https://gitlab.com/open-sd/opensd
+//  Licensed under the GNU GPLv3+
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the 
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of 
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; 
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. 
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with this program. 
+//  If not, see <https://www.gnu.org/licenses/>.             
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#include "thread_config.hpp"
+#include "../../common/log.hpp"
+// Linux
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+// C++
+#include <cstring>
+#include <algorithm>
+#include <climits>
+
+
+
+int Drivers::ApplyThreadConfig( const ThreadConfig& rCfg, const std::string& rName )
+{
+    int             result = Err::OK;
+    bool            use_nice = true;
+    
+    if (rCfg.policy != SchedPolicy::OTHER)
+    {
+        sched_param     param = {};
+        int             policy = (rCfg.policy == SchedPolicy::FIFO) ? SCHED_FIFO : SCHED_RR;
+        int             err;
+        
+        param.sched_priority = rCfg.priority;
+        err = pthread_setschedparam( pthread_self(), policy, &param );
+        if (err)
+        {
+            gLog.Write( Log::DEBUG, FUNC_NAME, "pthread_setschedparam() failed: " + Err::GetErrnoString(err) );
+            if (err == EPERM)
+                gLog.Write( Log::WARN, "Cannot use real-time scheduling for " + rName + ": Requires CAP_SYS_NICE or a large enough RLIMIT_RTPRIO.  Falling back to Nice value." );
+            else
+                gLog.Write( Log::WARN, "Cannot use real-time scheduling for " + rName + ".  Falling back to Nice value." );
+            result = Err::UNKNOWN;
+        }
+        else
+        {
+            gLog.Write( Log::VERB, FUNC_NAME, "Using " + std::string((rCfg.policy == SchedPolicy::FIFO) ? "SCHED_FIFO" : "SCHED_RR") + 
+                        " priority " + std::to_string(rCfg.priority) + " for " + rName + "." );
+            use_nice = false;
+        }
+    }
+    
+    if (use_nice && rCfg.nice)
+    {
+        // On Linux the nice value is per thread
+        if (setpriority( PRIO_PROCESS, gettid(), rCfg.nice ) < 0)
+        {
+            int e = errno;
+            gLog.Write( Log::DEBUG, FUNC_NAME, "setpriority() failed: " + Err::GetErrnoString(e) );
+            if ((e == EPERM) || (e == EACCES))
+                gLog.Write( Log::WARN, "Cannot set nice value " + std::to_string(rCfg.nice) + " for " + rName + ": Requires CAP_SYS_NICE or a large enough RLIMIT_NICE." );
+            else
+                gLog.Write( Log::WARN, "Cannot set nice value for " + rName + "." );
+            result = Err::UNKNOWN;
+        }
+        else
+            gLog.Write( Log::VERB, FUNC_NAME, "Using nice value " + std::to_string(rCfg.nice) + " for " + rName + "." );
+    }
+    
+    if (!rCfg.cpus.empty())
+    {
+        cpu_set_t       set;
+        std::string     list;
+        int             err;
+        
+        CPU_ZERO( &set );
+        for (auto& i : rCfg.cpus)
+        {
+            CPU_SET( i, &set );
+            list += std::to_string(i) + " ";
+        }
+        
+        err = pthread_setaffinity_np( pthread_self(), sizeof(set), &set );
+        if (err)
+        {
+            gLog.Write( Log::DEBUG, FUNC_NAME, "pthread_setaffinity_np() failed: " + Err::GetErrnoString(err) );
+            gLog.Write( Log::WARN, "Cannot set CPU affinity for " + rName + ".  Check that CPUs " + list + "exist and are online." );
+            result = Err::UNKNOWN;
+        }
+        else
+            gLog.Write( Log::VERB, FUNC_NAME, "Pinned " + rName + " to CPUs " + list );
+    }
+    
+    return result;
+}
+
+
+
+void __attribute__((noinline)) Drivers::PrefaultStack()
+{
+    volatile uint8_t    buff[THREAD_STACK_PREFAULT];
+    
+    // One write per page is enough
+    for (unsigned int i = 0; i < THREAD_STACK_PREFAULT; i += 4096)
+        buff[i] = 0;
+    (void)buff;
+}
+
+
+
+int Drivers::LockMemory()
+{
+    int             flags = MCL_CURRENT | MCL_FUTURE;
+    
+#ifdef MCL_ONFAULT
+    // Only lock pages once they are used.  Otherwise every mapping, including
+    // the full reservation of each thread stack, is made resident up front.
+    flags |= MCL_ONFAULT;
+#endif // MCL_ONFAULT
+
+    if (mlockall( flags ) < 0)
+    {
+        int e = errno;
+        gLog.Write( Log::DEBUG, FUNC_NAME, "mlockall() failed: " + Err::GetErrnoString(e) );
+        if ((e == EPERM) || (e == ENOMEM))
+            gLog.Write( Log::WARN, "Cannot lock memory: Requires CAP_IPC_LOCK or a larger RLIMIT_MEMLOCK." );
+        else
+            gLog.Write( Log::WARN, "Cannot lock memory." );
+        return Err::UNKNOWN;
+    }
+    
+    gLog.Write( Log::VERB, FUNC_NAME, "Locked daemon memory." );
+    
+    return Err::OK;
+}
+
+
+
+void* Drivers::Thread::Entry( void* pArg )
+{
+    ((Thread*)pArg)->mFunc();
+    
+    return nullptr;
+}
+
+
+
+int Drivers::Thread::Start( std::function<void()> func, size_t stackSize )
+{
+    pthread_attr_t  attr;
+    int             err;
+    
+    if (mJoinable)
+        return Err::ALREADY_OPEN;
+    
+    mFunc = func;
+    pthread_attr_init( &attr );
+    pthread_attr_setstacksize( &attr, std::max<size_t>( stackSize, PTHREAD_STACK_MIN ) );
+    err = pthread_create( &mThread, &attr, &Thread::Entry, this );
+    pthread_attr_destroy( &attr );
+    if (err)
+    {
+        gLog.Write( Log::DEBUG, FUNC_NAME, "pthread_create() failed: " + Err::GetErrnoString(err) );
+        return Err::CANNOT_CREATE;
+    }
+    
+    mJoinable = true;
+    
+    return Err::OK;
+}
+
+
+
+void Drivers::Thread::Join()
+{
+    if (!mJoinable)
+        return;
+    
+    pthread_join( mThread, nullptr );
+    mJoinable = false;
+}
+
+
+
+Drivers::Thread::Thread()
+{
+    mThread     = {};
+    mJoinable   = false;
+}
+
+
+
+Drivers::Thread::~Thread()
+{
+    Join();
+}
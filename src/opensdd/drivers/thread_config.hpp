@@ -0,0 +1,93 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//  OpenSD
+//  An open-source userspace driver for Valve's Steam Deck hardware
+//
+//  Copyright 2022 seek
+//  https://gitlab.com/open-sd/opensd
+//  Licensed under the GNU GPLv3+
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the 
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of 
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; 
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. 
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with this program. 
+//  If not, see <https://www.gnu.org/licenses/>.             
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#ifndef __THREAD_CONFIG_HPP__
+#define __THREAD_CONFIG_HPP__
+
+#include "../../common/errors.hpp"
+// C++
+#include <functional>
+#include <string>
+#include <vector>
+// Linux
+#include <pthread.h>
+
+
+namespace Drivers
+{
+    // Bytes of stack touched by a driver thread before it starts running so
+    // later calls don't page fault
+    constexpr unsigned int                  THREAD_STACK_PREFAULT = 128 * 1024;
+    // Stack size for a driver's helper threads.  The 8 MiB default adds up 
+    // quickly when memory is locked.
+    constexpr size_t                        HELPER_THREAD_STACK_SIZE = 256 * 1024;
+    
+    enum class SchedPolicy
+    {
+        OTHER,      // Default time sharing scheduler
+        FIFO,
+        RR
+    };
+    
+    // Scheduling settings applied to a driver thread when it starts.  Threads
+    // created by the driver thread inherit its policy and affinity.
+    struct ThreadConfig
+    {
+        SchedPolicy                         policy;
+        int                                 priority;       // 1 - 99, only used with FIFO and RR
+        int                                 nice;           // -20 - 19, used with OTHER or if FIFO / RR are not permitted
+        std::vector<int>                    cpus;           // CPUs the thread may run on.  Empty for no restriction.
+        
+        ThreadConfig(): policy(SchedPolicy::OTHER), priority(0), nice(0), cpus() {};
+    };
+    
+    // Applies the settings to the calling thread.  Failures are logged and
+    // the remaining settings are still applied.
+    int                                     ApplyThreadConfig( const ThreadConfig& rCfg, const std::string& rName );
+    
+    // Touches the first THREAD_STACK_PREFAULT bytes of the calling thread's stack
+    void                                    PrefaultStack();
+    
+    // Locks the process' pages in RAM as they are touched.  Process wide, so
+    // call it once before starting any drivers.
+    int                                     LockMemory();
+    
+    // A joinable thread with an explicit stack size, which std::thread can't do
+    class Thread
+    {
+    private:
+        pthread_t                           mThread;
+        bool                                mJoinable;
+        std::function<void()>               mFunc;
+        
+        static void*                        Entry( void* pArg );
+        
+    public:
+        int                                 Start( std::function<void()> func, size_t stackSize );
+        // Does nothing if the thread was never started
+        void                                Join();
+        
+        Thread();
+        ~Thread();
+    };
+
+} // namespace Drivers
+
+
+#endif // __THREAD_CONFIG_HPP__
@@ -0,0 +1,494 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//  OpenSD
+//  An open-source userspace driver for Valve's Steam Deck hardware
+//
+//  Copyright 2022 seek
+//  https://gitlab.com/open-sd/opensd
+//  Licensed under the GNU GPLv3+
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the 
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of 
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; 
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. 
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with this program. 
+//  If not, see <https://www.gnu.org/licenses/>.             
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#include "handoff.hpp"
+#include "../common/log.hpp"
+#include "../common/errors.hpp"
+// Linux
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+// C++
+#include <cstddef>
+#include <cstring>
+#include <sstream>
+
+
+// First fd passed in by $LISTEN_FDS
+const int               HANDOFF_LISTEN_FDS_START = 3;
+
+// Sent along with the descriptors, which arrive in the same order as the names
+struct HandoffHeader
+{
+    uint32_t            magic;
+    uint16_t            version;
+    uint16_t            count;
+    char                names[HANDOFF_MAX_FDS][HANDOFF_NAME_SIZE];
+};
+
+
+
+int Handoff::PackState()
+{
+    std::string         text;
+    int                 fd;
+    size_t              done = 0;
+    ssize_t             result;
+    
+    
+    if (mValues.empty())
+        return Err::OK;
+    
+    for (auto& i : mValues)
+        text += i.first + "=" + i.second + "\n";
+    
+    fd = memfd_create( "opensdd-handoff", MFD_CLOEXEC );
+    if (fd < 0)
+    {
+        int e = errno;
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to create handoff state memfd: " + Err::GetErrnoString(e) );
+        return Err::CANNOT_CREATE;
+    }
+    
+    while (done < text.size())
+    {
+        result = write( fd, text.data() + done, text.size() - done );
+        if (result < 0)
+        {
+            int e = errno;
+            if (e == EINTR)
+                continue;
+            gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to write handoff state: " + Err::GetErrnoString(e) );
+            close( fd );
+            return Err::WRITE_FAILED;
+        }
+        done += result;
+    }
+    
+    Add( "state", fd );
+    mValues.clear();
+    
+    return Err::OK;
+}
+
+
+
+int Handoff::UnpackState()
+{
+    std::string         text;
+    std::string         line;
+    char                buff[4096];
+    off_t               offset = 0;
+    ssize_t             result;
+    int                 fd;
+    
+    
+    fd = Take( "state" );
+    if (fd < 0)
+        return Err::OK;
+    
+    // Someone else may share the file offset, so don't rely on it
+    while ((result = pread( fd, buff, sizeof(buff), offset )) != 0)
+    {
+        if (result < 0)
+        {
+            int e = errno;
+            if (e == EINTR)
+                continue;
+            gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to read handoff state: " + Err::GetErrnoString(e) );
+            close( fd );
+            return Err::READ_FAILED;
+        }
+        text.append( buff, result );
+        offset += result;
+    }
+    close( fd );
+    
+    std::istringstream  stream( text );
+    while (std::getline( stream, line ))
+    {
+        size_t      pos = line.find( '=' );
+        
+        if (pos != std::string::npos)
+            mValues[line.substr( 0, pos )] = line.substr( pos + 1 );
+    }
+    
+    return Err::OK;
+}
+
+
+
+int Handoff::Notify( const std::string& rMsg, int fd )
+{
+    const char*         path = getenv( "NOTIFY_SOCKET" );
+    sockaddr_un         addr = {};
+    size_t              len;
+    iovec               iov = { .iov_base = (void*)rMsg.data(), .iov_len = rMsg.size() };
+    msghdr              msg = {};
+    char                cbuff[CMSG_SPACE(sizeof(int))] = {};
+    cmsghdr*            pcmsg;
+    int                 sock;
+    int                 result = Err::OK;
+    
+    
+    // Only Unix sockets, either a path or an abstract name starting with '@'
+    if ((path == nullptr) || ((path[0] != '/') && (path[0] != '@')))
+        return Err::UNSUPPORTED;
+    
+    len = strlen( path );
+    if (len >= sizeof(addr.sun_path))
+        return Err::INVALID_PARAMETER;
+    
+    addr.sun_family = AF_UNIX;
+    memcpy( addr.sun_path, path, len );
+    if (addr.sun_path[0] == '@')
+        addr.sun_path[0] = 0;
+    
+    sock = socket( AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0 );
+    if (sock < 0)
+    {
+        int e = errno;
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to create notify socket: " + Err::GetErrnoString(e) );
+        return Err::CANNOT_CREATE;
+    }
+    
+    msg.msg_name = &addr;
+    msg.msg_namelen = offsetof(sockaddr_un, sun_path) + len;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (fd >= 0)
+    {
+        msg.msg_control = cbuff;
+        msg.msg_controllen = sizeof(cbuff);
+        pcmsg = CMSG_FIRSTHDR( &msg );
+        pcmsg->cmsg_level = SOL_SOCKET;
+        pcmsg->cmsg_type = SCM_RIGHTS;
+        pcmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy( CMSG_DATA(pcmsg), &fd, sizeof(int) );
+    }
+    
+    if (sendmsg( sock, &msg, MSG_NOSIGNAL ) < 0)
+    {
+        int e = errno;
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to notify '" + std::string(path) + "': " + Err::GetErrnoString(e) );
+        result = Err::WRITE_FAILED;
+    }
+    close( sock );
+    
+    return result;
+}
+
+
+
+void Handoff::Add( const std::string& rName, int fd )
+{
+    if (fd < 0)
+        return;
+    
+    if (rName.empty() || (rName.size() >= HANDOFF_NAME_SIZE))
+    {
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Invalid handoff name '" + rName + "'." );
+        close( fd );
+        return;
+    }
+    
+    mItems.push_back( { .name = rName, .fd = fd } );
+}
+
+
+
+int Handoff::Take( const std::string& rName )
+{
+    int                 fd;
+    
+    for (auto i = mItems.begin(); i != mItems.end(); ++i)
+    {
+        if (i->name == rName)
+        {
+            fd = i->fd;
+            mItems.erase( i );
+            return fd;
+        }
+    }
+    
+    return -1;
+}
+
+
+
+void Handoff::SetValue( const std::string& rKey, const std::string& rValue )
+{
+    mValues[rKey] = rValue;
+}
+
+
+
+std::string Handoff::GetValue( const std::string& rKey )
+{
+    auto                val = mValues.find( rKey );
+    
+    return (val == mValues.end()) ? "" : val->second;
+}
+
+
+
+bool Handoff::IsEmpty()
+{
+    return mItems.empty() && mValues.empty();
+}
+
+
+
+void Handoff::Clear()
+{
+    for (auto& i : mItems)
+        close( i.fd );
+    
+    mItems.clear();
+    mValues.clear();
+}
+
+
+
+int Handoff::Send( int sockFd )
+{
+    HandoffHeader       hdr = {};
+    int                 fds[HANDOFF_MAX_FDS];
+    char                cbuff[CMSG_SPACE(sizeof(fds))] = {};
+    iovec               iov = { .iov_base = &hdr, .iov_len = sizeof(hdr) };
+    msghdr              msg = {};
+    cmsghdr*            pcmsg;
+    int                 result = Err::OK;
+    
+    
+    if (PackState() != Err::OK)
+        gLog.Write( Log::WARN, "Failed to pack handoff state.  The new daemon will use its configured profiles." );
+    
+    if (mItems.size() > HANDOFF_MAX_FDS)
+    {
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Too many descriptors to hand off." );
+        Clear();
+        return Err::OUT_OF_RANGE;
+    }
+    
+    hdr.magic   = HANDOFF_MAGIC;
+    hdr.version = HANDOFF_VERSION;
+    for (auto& i : mItems)
+    {
+        memcpy( hdr.names[hdr.count], i.name.c_str(), i.name.size() );
+        fds[hdr.count++] = i.fd;
+    }
+    
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (hdr.count)
+    {
+        msg.msg_control = cbuff;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * hdr.count);
+        pcmsg = CMSG_FIRSTHDR( &msg );
+        pcmsg->cmsg_level = SOL_SOCKET;
+        pcmsg->cmsg_type = SCM_RIGHTS;
+        pcmsg->cmsg_len = CMSG_LEN(sizeof(int) * hdr.count);
+        memcpy( CMSG_DATA(pcmsg), fds, sizeof(int) * hdr.count );
+    }
+    
+    if (sendmsg( sockFd, &msg, MSG_NOSIGNAL ) < 0)
+    {
+        int e = errno;
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to send handoff: " + Err::GetErrnoString(e) );
+        result = Err::WRITE_FAILED;
+    }
+    else
+        gLog.Write( Log::VERB, FUNC_NAME, "Handed off " + std::to_string(hdr.count) + " descriptor(s)." );
+    
+    // The receiver has its own copies now
+    Clear();
+    
+    return result;
+}
+
+
+
+int Handoff::Receive( int sockFd )
+{
+    HandoffHeader       hdr = {};
+    int                 fds[HANDOFF_MAX_FDS];
+    unsigned int        count = 0;
+    char                cbuff[CMSG_SPACE(sizeof(fds))] = {};
+    iovec               iov = { .iov_base = &hdr, .iov_len = sizeof(hdr) };
+    msghdr              msg = {};
+    cmsghdr*            pcmsg;
+    ssize_t             result;
+    
+    
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuff;
+    msg.msg_controllen = sizeof(cbuff);
+    
+    do
+        result = recvmsg( sockFd, &msg, MSG_CMSG_CLOEXEC );
+    while ((result < 0) && (errno == EINTR));
+    if (result < 0)
+    {
+        int e = errno;
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to receive handoff: " + Err::GetErrnoString(e) );
+        return Err::READ_FAILED;
+    }
+    
+    for (pcmsg = CMSG_FIRSTHDR( &msg ); pcmsg != nullptr; pcmsg = CMSG_NXTHDR( &msg, pcmsg ))
+    {
+        if ((pcmsg->cmsg_level == SOL_SOCKET) && (pcmsg->cmsg_type == SCM_RIGHTS))
+        {
+            count = (pcmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            memcpy( fds, CMSG_DATA(pcmsg), sizeof(int) * count );
+        }
+    }
+    
+    if ((result != sizeof(hdr)) || (hdr.magic != HANDOFF_MAGIC) || (hdr.version != HANDOFF_VERSION) || 
+        (hdr.count != count) || (msg.msg_flags & MSG_CTRUNC))
+    {
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Received an invalid handoff." );
+        for (unsigned int i = 0; i < count; ++i)
+            close( fds[i] );
+        return Err::INVALID_FORMAT;
+    }
+    
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        hdr.names[i][HANDOFF_NAME_SIZE - 1] = 0;
+        Add( hdr.names[i], fds[i] );
+    }
+    gLog.Write( Log::VERB, FUNC_NAME, "Received " + std::to_string(count) + " descriptor(s)." );
+    
+    return UnpackState();
+}
+
+
+
+bool Handoff::HasFdStore()
+{
+    const char*         path = getenv( "NOTIFY_SOCKET" );
+    
+    return (path != nullptr) && (path[0] != 0);
+}
+
+
+
+int Handoff::Store()
+{
+    int                 result = Err::OK;
+    
+    
+    if (!HasFdStore())
+    {
+        Clear();
+        return Err::UNSUPPORTED;
+    }
+    
+    if (PackState() != Err::OK)
+        gLog.Write( Log::WARN, "Failed to pack handoff state.  The next daemon will use its configured profiles." );
+    
+    for (auto& i : mItems)
+        if (Notify( "FDSTORE=1\nFDNAME=" + i.name, i.fd ) != Err::OK)
+            result = Err::WRITE_FAILED;
+    
+    if (result == Err::OK)
+        gLog.Write( Log::VERB, FUNC_NAME, "Stored " + std::to_string(mItems.size()) + " descriptor(s)." );
+    
+    // The store keeps its own copies
+    Clear();
+    
+    return result;
+}
+
+
+
+int Handoff::Restore()
+{
+    const char*         pid = getenv( "LISTEN_PID" );
+    const char*         fds = getenv( "LISTEN_FDS" );
+    const char*         names = getenv( "LISTEN_FDNAMES" );
+    std::vector<std::string> name_list;
+    std::string         name;
+    int                 count;
+    
+    
+    // The variables are meant for this process only
+    if ((pid == nullptr) || (fds == nullptr) || (atol( pid ) != getpid()))
+        return Err::NOT_FOUND;
+    
+    count = atoi( fds );
+    if (names != nullptr)
+    {
+        std::istringstream  stream( names );
+        while (std::getline( stream, name, ':' ))
+            name_list.push_back( name );
+    }
+    
+    for (int i = 0; i < count; ++i)
+    {
+        int         fd = HANDOFF_LISTEN_FDS_START + i;
+        
+        // Everything we hand off is named, so anything else isn't ours
+        name = (i < (int)name_list.size()) ? name_list[i] : "";
+        if (name.empty() || (name == "unknown"))
+        {
+            close( fd );
+            continue;
+        }
+        
+        fcntl( fd, F_SETFD, FD_CLOEXEC );
+        Add( name, fd );
+        mStored.push_back( name );
+    }
+    
+    unsetenv( "LISTEN_PID" );
+    unsetenv( "LISTEN_FDS" );
+    unsetenv( "LISTEN_FDNAMES" );
+    
+    gLog.Write( Log::VERB, FUNC_NAME, "Restored " + std::to_string(mStored.size()) + " descriptor(s)." );
+    
+    return UnpackState();
+}
+
+
+
+void Handoff::Unstore()
+{
+    for (auto& i : mStored)
+        Notify( "FDSTOREREMOVE=1\nFDNAME=" + i, -1 );
+    
+    mStored.clear();
+}
+
+
+
+Handoff::Handoff()
+{
+}
+
+
+
+Handoff::~Handoff()
+{
+    Clear();
+}
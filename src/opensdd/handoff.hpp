@@ -0,0 +1,90 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//  OpenSD
+//  An open-source userspace driver for Valve's Steam Deck hardware
+//
+//  Copyright 2022 seek
+//  https://gitlab.com/open-sd/opensd
+//  Licensed under the GNU GPLv3+
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the 
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of 
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; 
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. 
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with this program. 
+//  If not, see <https://www.gnu.org/licenses/>.             
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#ifndef __HANDOFF_HPP__
+#define __HANDOFF_HPP__
+
+// C++
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+
+// Most descriptors handed over at once
+const unsigned int          HANDOFF_MAX_FDS     = 32;
+// Longest descriptor name, including the terminator
+const unsigned int          HANDOFF_NAME_SIZE   = 32;
+const uint32_t              HANDOFF_MAGIC       = 0x4F534448;     // "OSDH"
+const uint16_t              HANDOFF_VERSION     = 1;
+
+// Hands open device fds and the state needed to use them to the daemon that
+// replaces this one, so the virtual devices survive a restart.  Descriptors 
+// are named, e.g. "gp0.gamepad".  Values are carried in an extra memfd named
+// "state", which also lets them pass through the systemd fd store.
+class Handoff
+{
+private:
+    struct Item
+    {
+        std::string                 name;
+        int                         fd;
+    };
+    
+    std::vector<Item>               mItems;
+    std::map<std::string, std::string> mValues;
+    std::vector<std::string>        mStored;    // Names restored from the systemd fd store
+    
+    int                             PackState();
+    int                             UnpackState();
+    static int                      Notify( const std::string& rMsg, int fd );
+    
+public:
+    // Takes ownership of fd
+    void                            Add( const std::string& rName, int fd );
+    // Returns the fd, now owned by the caller, or -1
+    int                             Take( const std::string& rName );
+    void                            SetValue( const std::string& rKey, const std::string& rValue );
+    // Empty if not set
+    std::string                     GetValue( const std::string& rKey );
+    bool                            IsEmpty();
+    // Closes every fd that was not taken and forgets the values
+    void                            Clear();
+    
+    // Unix socket transport.  Send() hands over and closes every item.
+    int                             Send( int sockFd );
+    int                             Receive( int sockFd );
+    
+    // systemd fd store.  Anything speaking the sd_notify protocol on
+    // $NOTIFY_SOCKET and setting $LISTEN_FDS will do, e.g. for testing.
+    static bool                     HasFdStore();
+    // Hands over and closes every item
+    int                             Store();
+    // Picks up descriptors passed in by $LISTEN_FDS
+    int                             Restore();
+    // Removes restored descriptors from the store once they're in use
+    void                            Unstore();
+    
+    Handoff();
+    ~Handoff();
+};
+
+
+#endif // __HANDOFF_HPP__
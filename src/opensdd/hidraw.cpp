@@ -20,6 +20,7 @@
 #include "hidraw.hpp"
 #include "../common/log.hpp"
 #include "../common/string_funcs.hpp"
+#include "../common/trace.hpp"
 // Linux
 #include <fcntl.h>
 #include <unistd.h>
@@ -27,6 +28,10 @@
 #include <linux/hidraw.h>
 #include <linux/input.h>
 #include <poll.h>
+// C++
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
 
 
 bool MatchHidrawInfo( std::filesystem::path path, uint16_t vid, uint16_t pid, uint16_t iFaceNum )
@@ -96,32 +101,153 @@ bool MatchHidrawInfo( std::filesystem::path path, uint16_t vid, uint16_t pid, ui
 
 
 
-std::filesystem::path Hidraw::FindDevNode( uint16_t vid, uint16_t pid, uint16_t iFaceNum )
+bool MatchHidrawSysfs( std::filesystem::path sysPath, uint16_t vid, uint16_t pid, uint16_t iFaceNum )
 {
     namespace           fs = std::filesystem;
     
-    fs::path            dev_path = "/dev/";
-    fs::path            hidraw_path;
-    std::string         search_name = Str::Uint16ToHex(vid) + ":" + Str::Uint16ToHex(pid) + ":" + std::to_string(iFaceNum);
-        
-    gLog.Write( Log::DEBUG, FUNC_NAME, "Scanning hidraw nodes..." );
-    for (auto const& i : fs::directory_iterator( dev_path ))
+    std::ifstream       file;
+    std::string         line;
+    std::string         phys;
+    unsigned int        bus = 0;
+    unsigned int        dev_vid = 0;
+    unsigned int        dev_pid = 0;
+    bool                found = false;
+    std::error_code     ec;
+    
+    // The HID device's uevent has the bus, vid and pid as HID_ID=bbbb:vvvvvvvv:pppppppp
+    file.open( sysPath / "device" / "uevent" );
+    if (!file.is_open())
+    {
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to read '" + (sysPath / "device" / "uevent").string() + "'." );
+        return false;
+    }
+    while (std::getline( file, line ))
+    {
+        if (line.starts_with( "HID_ID=" ))
+            found = (sscanf( line.c_str(), "HID_ID=%x:%x:%x", &bus, &dev_vid, &dev_pid ) == 3);
+        else if (line.starts_with( "HID_PHYS=" ))
+            phys = line.substr( 9 );
+    }
+    file.close();
+    
+    if ((!found) || (bus != BUS_USB) || (dev_vid != vid) || (dev_pid != pid))
+    {
+        gLog.Write( Log::VERB, FUNC_NAME, "Device at '" + sysPath.string() + "' did not match search params." );
+        return false;
+    }
+    
+    // VID / PID match, now check interface.  The HID device sits below the 
+    // USB interface, which has the interface number as a hex attribute.
+    fs::path    iface_path = fs::canonical( sysPath / "device", ec ).parent_path() / "bInterfaceNumber";
+    if (!ec)
+    {
+        file.open( iface_path );
+        if (file.is_open())
+        {
+            unsigned int    iface = 0;
+            
+            file >> std::hex >> iface;
+            if (!file.fail())
+            {
+                file.close();
+                if (iface == iFaceNum)
+                {
+                    gLog.Write( Log::VERB, FUNC_NAME, "Device at '" + sysPath.string() + "' matches search params." );
+                    return true;
+                }
+                gLog.Write( Log::VERB, FUNC_NAME, "Device at '" + sysPath.string() + "' did not match search params." );
+                return false;
+            }
+            file.close();
+        }
+    }
+    
+    // Fall back to the physical location, same as HIDIOCGRAWPHYS
+    if (phys.ends_with( "input" + std::to_string(iFaceNum) ))
     {
-        // Look for character files in /dev/ that begin with "hidraw"
-        if ((i.path().filename().string().starts_with( "hidraw" )) && (fs::is_character_file( i.path() )))
+        gLog.Write( Log::VERB, FUNC_NAME, "Device at '" + sysPath.string() + "' matches search params." );
+        return true;
+    }
+    
+    gLog.Write( Log::VERB, FUNC_NAME, "Device at '" + sysPath.string() + "' did not match search params." );
+    return false;
+}
+
+
+
+std::vector<std::filesystem::path> Hidraw::FindDevNodes( uint16_t vid, uint16_t pid, uint16_t iFaceNum )
+{
+    namespace                       fs = std::filesystem;
+    
+    fs::path                        dev_path = "/dev/";
+    fs::path                        sys_path = "/sys/class/hidraw/";
+    fs::path                        hidraw_path;
+    std::vector<fs::path>           list;
+    std::string                     search_name = Str::Uint16ToHex(vid) + ":" + Str::Uint16ToHex(pid) + ":" + std::to_string(iFaceNum);
+    std::error_code                 ec;
+    
+    // Prefer sysfs since nothing has to be opened to check a device.  Only 
+    // the matching node will be opened by the caller.
+    if (fs::is_directory( sys_path, ec ))
+    {
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Scanning sysfs hidraw entries..." );
+        for (auto const& i : fs::directory_iterator( sys_path, ec ))
         {
+            if (!i.path().filename().string().starts_with( "hidraw" ))
+                continue;
+            
             gLog.Write( Log::VERB, "Checking '" + i.path().string() + "' for matching device info..." );
-            if (MatchHidrawInfo( i.path(), vid, pid, iFaceNum ))
+            if (MatchHidrawSysfs( i.path(), vid, pid, iFaceNum ))
             {
-                gLog.Write( Log::DEBUG, FUNC_NAME, "Found device matching '" + search_name + "' at '" + i.path().string() + "'" );
-                return i.path();
+                hidraw_path = dev_path / i.path().filename();
+                if (fs::is_character_file( hidraw_path, ec ))
+                {
+                    gLog.Write( Log::DEBUG, FUNC_NAME, "Found device matching '" + search_name + "' at '" + hidraw_path.string() + "'" );
+                    list.push_back( hidraw_path );
+                }
             }
         }
     }
-        
-    // No luck.  Return empty string on failure.
-    gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to find any hidraw device matching '" + search_name + "'." );
-    return "";
+    else
+    {
+        gLog.Write( Log::DEBUG, FUNC_NAME, "sysfs is not available.  Scanning hidraw nodes..." );
+        for (auto const& i : fs::directory_iterator( dev_path ))
+        {
+            // Look for character files in /dev/ that begin with "hidraw"
+            if ((i.path().filename().string().starts_with( "hidraw" )) && (fs::is_character_file( i.path() )))
+            {
+                gLog.Write( Log::VERB, "Checking '" + i.path().string() + "' for matching device info..." );
+                if (MatchHidrawInfo( i.path(), vid, pid, iFaceNum ))
+                {
+                    gLog.Write( Log::DEBUG, FUNC_NAME, "Found device matching '" + search_name + "' at '" + i.path().string() + "'" );
+                    list.push_back( i.path() );
+                }
+            }
+        }
+    }
+    
+    if (list.empty())
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to find any hidraw device matching '" + search_name + "'." );
+    
+    // Directory order is arbitrary, so sort by node number (hidraw2 before hidraw10)
+    std::sort( list.begin(), list.end(), []( const fs::path& a, const fs::path& b )
+    {
+        std::string     sa = a.filename().string();
+        std::string     sb = b.filename().string();
+        return (sa.size() != sb.size()) ? (sa.size() < sb.size()) : (sa < sb);
+    });
+    
+    return list;
+}
+
+
+
+std::filesystem::path Hidraw::FindDevNode( uint16_t vid, uint16_t pid, uint16_t iFaceNum )
+{
+    std::vector<std::filesystem::path>  list = FindDevNodes( vid, pid, iFaceNum );
+    
+    // Return empty string on failure
+    return list.empty() ? "" : list.front();
 }
 
 
@@ -129,6 +255,7 @@ std::filesystem::path Hidraw::FindDevNode( uint16_t vid, uint16_t pid, uint16_t
 int Hidraw::Open( std::filesystem::path hidrawPath )
 {
     namespace fs = std::filesystem;
+    int                 fd;
     
     if (!fs::exists( hidrawPath ))
     {
@@ -142,6 +269,9 @@ int Hidraw::Open( std::filesystem::path hidrawPath )
         return Err::INVALID_PARAMETER;
     }
 
+    // Only opening and closing are exclusive
+    std::lock_guard<std::mutex>     lock( mMutex );
+    
     if (IsOpen())
     {
         gLog.Write( Log::DEBUG, FUNC_NAME, "Hidraw object already has an open fd." );
@@ -150,20 +280,18 @@ int Hidraw::Open( std::filesystem::path hidrawPath )
     
     gLog.Write( Log::VERB, FUNC_NAME, "Opening hidraw device on '" + hidrawPath.string() + "'." );
 
-    // Multithreaded access guard
-    std::lock_guard<std::mutex>     lock( mMutex );
-    
-    mFd = open( hidrawPath.c_str(), O_RDWR );
-    if (mFd < 0)
+    fd = open( hidrawPath.c_str(), O_RDWR | O_CLOEXEC );
+    if (fd < 0)
     {
         int e = errno;
         gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to open device on '" + hidrawPath.string() + "' with error " + std::to_string(e) + ": " + Err::GetErrnoString(e) );
-        Close();
         return Err::CANNOT_OPEN;
     }
 
     gLog.Write( Log::VERB, FUNC_NAME, "Successfully opened hidraw device on '" + hidrawPath.string() + "'." );
     mPath = hidrawPath;
+    mTimeoutCount = 0;
+    mFd = fd;
     
     return Err::OK;
 }
@@ -172,50 +300,164 @@ int Hidraw::Open( std::filesystem::path hidrawPath )
 
 bool Hidraw::IsOpen()
 {
-    if (mFd > 0)
-        if (fcntl( mFd, F_GETFD) >= 0)
-            return true;
-            
-    return false;
+    return (mFd >= 0);
 }
 
 
 
-void Hidraw::Close()
+int Hidraw::AcquireFd()
+{
+    int                 fd;
+    
+    ++mUsers;
+    fd = mFd;
+    if (fd < 0)
+    {
+        ReleaseFd();
+        return -1;
+    }
+    
+    return fd;
+}
+
+
+
+void Hidraw::ReleaseFd()
+{
+    // Last user out finishes any close that was deferred while an fd was
+    // still in use
+    if ((--mUsers == 0) && mClosingCount)
+    {
+        std::lock_guard<std::mutex>     lock( mMutex );
+        
+        CloseDeferred();
+    }
+}
+
+
+
+void Hidraw::CloseDeferred()
+{
+    // Listed fds were taken out of mFd before being listed, so new users 
+    // can't pick them up.  Anyone still holding one is counted in mUsers.
+    if (mUsers)
+        return;
+    
+    for (auto& i : mClosingFds)
+        close( i );
+    mClosingFds.clear();
+    mClosingCount = 0;
+}
+
+
+
+std::filesystem::path Hidraw::GetPath()
 {
-    // Multithreaded access guard
     std::lock_guard<std::mutex>     lock( mMutex );
+    
+    return mPath;
+}
+
 
+
+int Hidraw::Adopt( int fd, std::filesystem::path hidrawPath )
+{
+    hidraw_devinfo      info;
+    
+    
+    // Make sure it really is a hidraw device before using it
+    if (ioctl( fd, HIDIOCGRAWINFO, &info ) < 0)
+    {
+        int e = errno;
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Handed off fd for '" + hidrawPath.string() + "' is not a hidraw device: " + Err::GetErrnoString(e) );
+        close( fd );
+        return Err::INVALID_PARAMETER;
+    }
+    
+    std::lock_guard<std::mutex>     lock( mMutex );
+    
     if (IsOpen())
+    {
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Hidraw object already has an open fd." );
+        close( fd );
+        return Err::ALREADY_OPEN;
+    }
+    
+    gLog.Write( Log::VERB, FUNC_NAME, "Took over hidraw device on '" + hidrawPath.string() + "'." );
+    mPath = hidrawPath;
+    mTimeoutCount = 0;
+    mFd = fd;
+    
+    return Err::OK;
+}
+
+
+
+void Hidraw::Close()
+{
+    int                 fd;
+    
+    
+    std::lock_guard<std::mutex>     lock( mMutex );
+
+    // Take the fd away from new users first.  If anyone is still using it,
+    // the last of them closes it when they are done.
+    fd = mFd.exchange( -1 );
+    if (fd >= 0)
     {
         gLog.Write( Log::VERB, FUNC_NAME, "Closing device '" + mPath.string() + "'." );
-        close( mFd );
-        mFd = -1;
+        
+        mClosingFds.push_back( fd );
+        ++mClosingCount;
+        CloseDeferred();
     }
     mPath.clear();
 }
 
 
 
-int Hidraw::Read( std::vector<uint8_t>& rData )
+int Hidraw::Dup()
+{
+    FdRef           fd( *this );
+    int             result;
+    
+    if (fd.Get() < 0)
+        return -1;
+    
+    result = fcntl( fd.Get(), F_DUPFD_CLOEXEC, 0 );
+    if (result < 0)
+    {
+        int e = errno;
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to duplicate hidraw fd: " + Err::GetErrnoString(e) );
+    }
+    
+    return result;
+}
+
+
+
+int Hidraw::Read( std::vector<uint8_t>& rData, int timeout )
 {
     int             result;
     uint8_t         buff[64];
-    pollfd          pfd = { .fd = mFd, .events = POLLIN, .revents = 0 };
+    pollfd          pfd = { .fd = -1, .events = POLLIN, .revents = 0 };
 
     // Make sure our return vector is empty
     rData.clear();
 
-    if (!IsOpen())
+    FdRef           fd( *this );
+    
+    if (fd.Get() < 0)
     {
         gLog.Write( Log::DEBUG, FUNC_NAME, "Device is not open." );
         return Err::NOT_OPEN;
     }
 
-    // Multithreaded access guard
-    std::lock_guard<std::mutex>     lock( mMutex );
-
-    result = poll( &pfd, 1, mReadTimeout );
+    // No lock is held while waiting, so writes can go out at any time
+    pfd.fd = fd.Get();
+    if ((timeout < 0) || (timeout > mReadTimeout))
+        timeout = mReadTimeout;
+    result = poll( &pfd, 1, timeout );
     if (result < 0)
     {
         int e = errno;
@@ -226,6 +468,10 @@ int Hidraw::Read( std::vector<uint8_t>& rData )
     {
         if (result == 0)
         {
+            // The caller only wanted to wait a little
+            if (timeout < mReadTimeout)
+                return Err::OK;
+            
             gLog.Write( Log::DEBUG, FUNC_NAME, "Device timeout." );
             ++mTimeoutCount;
             
@@ -239,12 +485,26 @@ int Hidraw::Read( std::vector<uint8_t>& rData )
         else
         {
             mTimeoutCount = 0;
-            result = read( mFd, buff, sizeof(buff) );
+            
+            // The kernel flags the node as hung up once the device is unplugged
+            if ((pfd.revents & (POLLHUP | POLLERR | POLLNVAL)) && !(pfd.revents & POLLIN))
+            {
+                gLog.Write( Log::ERROR, "Hidraw device '" + GetPath().string() + "' was disconnected." );
+                Close();
+                return Err::DEVICE_LOST;
+            }
+            
+            result = read( fd.Get(), buff, sizeof(buff) );
             if (result < 0)
             {
                 int e = errno;
-                gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to read '" + mPath.string() + "': error " + 
+                gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to read '" + GetPath().string() + "': error " + 
                             std::to_string(e) + ": " + Err::GetErrnoString(e) );
+                if ((e == ENODEV) || (e == EIO))
+                {
+                    Close();
+                    return Err::DEVICE_LOST;
+                }
                 return Err::READ_FAILED;
             }
             
@@ -265,28 +525,36 @@ int Hidraw::Read( std::vector<uint8_t>& rData )
 
 
 int Hidraw::Write( const std::vector<uint8_t>& rData )
+{
+    return Write( rData.data(), rData.size() );
+}
+
+
+
+int Hidraw::Write( const uint8_t* pData, size_t length )
 {
     int                 result;
 
     
-    if (!IsOpen())
+    FdRef           fd( *this );
+    
+    if (fd.Get() < 0)
     {
         gLog.Write( Log::DEBUG, FUNC_NAME, "Device is not open." );
         return Err::NOT_OPEN;
     }
     
-    // Multithreaded access guard
-    std::lock_guard<std::mutex>     lock( mMutex );
 
-    result = write( mFd, rData.data(), rData.size() );
+    result = write( fd.Get(), pData, length );
+    TRACE_PROBE3( hid_write, fd.Get(), length, result );
     if (result < 0)
     {
         int e = errno;
-        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to write '" + mPath.string() + " with error " + std::to_string(e) + ": " + Err::GetErrnoString(e) );
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to write '" + GetPath().string() + " with error " + std::to_string(e) + ": " + Err::GetErrnoString(e) );
         return Err::WRITE_FAILED;
     }
 
-    //gLog.Write( Log::VERB, FUNC_NAME, "Successfully wrote " + std::to_string(result) + " bytes to '" + mPath.string() );
+    //gLog.Write( Log::VERB, FUNC_NAME, "Successfully wrote " + std::to_string(result) + " bytes to '" + GetPath().string() );
     
     return Err::OK;
 }
@@ -303,29 +571,29 @@ int Hidraw::GetReportDescriptor( hidraw_report_descriptor& rDesc )
     // Clear descriptor parameter
     rDesc = temp_desc;
     
-    if (!IsOpen())
+    FdRef           fd( *this );
+    
+    if (fd.Get() < 0)
     {
         gLog.Write( Log::DEBUG, FUNC_NAME, "Device is not open." );
         return Err::NOT_OPEN;
     }
     
-    // Multithreaded access guard
-    std::lock_guard<std::mutex>     lock( mMutex );
 
-    result = ioctl( mFd, HIDIOCGRDESCSIZE, &desc_size );
+    result = ioctl( fd.Get(), HIDIOCGRDESCSIZE, &desc_size );
     if (result < 0)
     {
         int e = errno;
-        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to get report descriptor size on '" + mPath.string() + "' with error " + std::to_string(e) + ": " + Err::GetErrnoString(e) );
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to get report descriptor size on '" + GetPath().string() + "' with error " + std::to_string(e) + ": " + Err::GetErrnoString(e) );
         return Err::READ_FAILED;
     }
     
     temp_desc.size = desc_size;
-    result = ioctl( mFd, HIDIOCGRDESC, &temp_desc);
+    result = ioctl( fd.Get(), HIDIOCGRDESC, &temp_desc);
     if (result < 0)
     {
         int e = errno;
-        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to get report descriptor on '" + mPath.string() + "' with error " + std::to_string(e) + ": " + Err::GetErrnoString(e) );
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to get report descriptor on '" + GetPath().string() + "' with error " + std::to_string(e) + ": " + Err::GetErrnoString(e) );
         return Err::READ_FAILED;
     }
     
@@ -343,20 +611,20 @@ std::string Hidraw::GetName()
     char            buff[256] = {0};
     
 
-    if (!IsOpen())
+    FdRef           fd( *this );
+    
+    if (fd.Get() < 0)
     {
         gLog.Write( Log::DEBUG, FUNC_NAME, "Device is not open." );
         return "";
     }
     
-    // Multithreaded access guard
-    std::lock_guard<std::mutex>     lock( mMutex );
 
-    result = ioctl( mFd, HIDIOCGRAWNAME(sizeof(buff)), buff );
+    result = ioctl( fd.Get(), HIDIOCGRAWNAME(sizeof(buff)), buff );
     if (result < 0)
     {
         int e = errno;
-        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to read '" + mPath.string() + "' with error " + std::to_string(e) + ": " + Err::GetErrnoString(e) );
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to read '" + GetPath().string() + "' with error " + std::to_string(e) + ": " + Err::GetErrnoString(e) );
         return "";
     }
     
@@ -371,20 +639,20 @@ std::string Hidraw::GetPhysLocation()
     char            buff[256] = {0};
     
 
-    if (!IsOpen())
+    FdRef           fd( *this );
+    
+    if (fd.Get() < 0)
     {
         gLog.Write( Log::DEBUG, FUNC_NAME, "Device is not open." );
         return "";
     }
     
-    // Multithreaded access guard
-    std::lock_guard<std::mutex>     lock( mMutex );
 
-    result = ioctl( mFd, HIDIOCGRAWPHYS(sizeof(buff)), buff );
+    result = ioctl( fd.Get(), HIDIOCGRAWPHYS(sizeof(buff)), buff );
     if (result < 0)
     {
         int e = errno;
-        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to read '" + mPath.string() + "' with error " + std::to_string(e) + ": " + Err::GetErrnoString(e) );
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to read '" + GetPath().string() + "' with error " + std::to_string(e) + ": " + Err::GetErrnoString(e) );
         return "";
     }
     
@@ -402,20 +670,20 @@ int Hidraw::GetInfo( hidraw_devinfo& rInfo )
     // Clear info parameter
     rInfo = temp_info;
     
-    if (!IsOpen())
+    FdRef           fd( *this );
+    
+    if (fd.Get() < 0)
     {
         gLog.Write( Log::DEBUG, FUNC_NAME, "Device is not open." );
         return Err::NOT_OPEN;
     }
     
-    // Multithreaded access guard
-    std::lock_guard<std::mutex>     lock( mMutex );
 
-    result = ioctl( mFd, HIDIOCGRAWINFO, &temp_info);
+    result = ioctl( fd.Get(), HIDIOCGRAWINFO, &temp_info);
     if (result < 0)
     {
         int e = errno;
-        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to get report descriptor on '" + mPath.string() + "' with error " + std::to_string(e) + ": " + Err::GetErrnoString(e) );
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to get report descriptor on '" + GetPath().string() + "' with error " + std::to_string(e) + ": " + Err::GetErrnoString(e) );
         return Err::READ_FAILED;
     }
     
@@ -432,7 +700,9 @@ int Hidraw::GetFeatureReport( std::vector<uint8_t>& rData )
     int             result;
     
 
-    if (!IsOpen())
+    FdRef           fd( *this );
+    
+    if (fd.Get() < 0)
     {
         gLog.Write( Log::DEBUG, FUNC_NAME, "Device is not open." );
         return Err::NOT_OPEN;
@@ -448,14 +718,12 @@ int Hidraw::GetFeatureReport( std::vector<uint8_t>& rData )
     rData.resize( 1 );
     rData.resize( 256, 0 );
 
-    // Multithreaded access guard
-    std::lock_guard<std::mutex>     lock( mMutex );
     
-    result = ioctl( mFd, HIDIOCGFEATURE(rData.size()), rData.data() );
+    result = ioctl( fd.Get(), HIDIOCGFEATURE(rData.size()), rData.data() );
     if (result < 0)
     {
         int e = errno;
-        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to read feature report on '" + mPath.string() + " with error " + std::to_string(e) + ": " + Err::GetErrnoString(e) );
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to read feature report on '" + GetPath().string() + " with error " + std::to_string(e) + ": " + Err::GetErrnoString(e) );
         return Err::READ_FAILED;
     }
     
@@ -480,7 +748,9 @@ int Hidraw::SetFeatureReport( const std::vector<uint8_t>& rData )
     int             result;
 
 
-    if (!IsOpen())
+    FdRef           fd( *this );
+    
+    if (fd.Get() < 0)
     {
         gLog.Write( Log::DEBUG, FUNC_NAME, "Device is not open." );
         return Err::NOT_OPEN;
@@ -492,14 +762,13 @@ int Hidraw::SetFeatureReport( const std::vector<uint8_t>& rData )
         return Err::INVALID_PARAMETER;
     }
     
-    // Multithreaded access guard
-    std::lock_guard<std::mutex>     lock( mMutex );
 
-    result = ioctl( mFd, HIDIOCSFEATURE(rData.size()), rData.data() ); 
+    result = ioctl( fd.Get(), HIDIOCSFEATURE(rData.size()), rData.data() ); 
+    TRACE_PROBE3( hid_set_feature, fd.Get(), rData.size(), result );
     if (result < 0)
     {
         int e = errno;
-        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to get report descriptor on '" + mPath.string() + "' with error " + std::to_string(e) + ": " + Err::GetErrnoString(e) );
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to get report descriptor on '" + GetPath().string() + "' with error " + std::to_string(e) + ": " + Err::GetErrnoString(e) );
         return Err::READ_FAILED;
     }
     
@@ -522,6 +791,8 @@ int Hidraw::SetFeatureReport( uint8_t reportId, const std::vector<uint8_t>& rDat
 Hidraw::Hidraw()
 {
     mFd = -1;
+    mClosingCount = 0;
+    mUsers = 0;
     mReadTimeout = 1000; // in ms
     mTimeoutCount = 0;
     mMaxTimeouts = 5;
@@ -26,31 +26,68 @@
 #include <linux/hidraw.h>
 #include <poll.h>
 // C++
+#include <atomic>
 #include <cstdint>
 #include <filesystem>
 #include <vector>
+#include <mutex>
 #include <thread>
 
 
 class Hidraw
 {
 private:
-    int                     mFd;
+    std::atomic<int>        mFd;
+    std::vector<int>        mClosingFds;        // fds waiting for their last user before closing
+    std::atomic<int>        mClosingCount;      // Size of mClosingFds, checked without the lock
+    std::atomic<int>        mUsers;             // Number of calls currently using an fd
     int                     mReadTimeout;
     int                     mTimeoutCount;
     int                     mMaxTimeouts;
     std::filesystem::path   mPath;
-    std::mutex              mMutex;
+    std::mutex              mMutex;             // Guards open / close, mClosingFds and mPath
+    
+    // Reads, writes and ioctls don't lock each other out.  Instead they hold
+    // a reference on the fd for the duration of the call so a concurrent
+    // Close() is deferred until they are done.
+    int                     AcquireFd();
+    void                    ReleaseFd();
+    // Closes deferred fds if nobody is using one.  Call with mMutex held.
+    void                    CloseDeferred();
+    // Copy of mPath for messages from calls that don't hold the lock
+    std::filesystem::path   GetPath();
+    
+    class FdRef
+    {
+    private:
+        Hidraw&             mHid;
+        int                 mFd;
+    public:
+        int                 Get() { return mFd; }
+        FdRef( Hidraw& rHid ): mHid(rHid) { mFd = mHid.AcquireFd(); }
+        ~FdRef() { if (mFd >= 0) mHid.ReleaseFd(); }
+    };
     
 
 public:
     std::filesystem::path   FindDevNode( uint16_t vid, uint16_t pid, uint16_t iFaceNum );
+    // All matching nodes, sorted by node number
+    static std::vector<std::filesystem::path> FindDevNodes( uint16_t vid, uint16_t pid, uint16_t iFaceNum );
     int                     Open( std::filesystem::path hidrawPath );
+    // Takes ownership of an fd already open on hidrawPath, e.g. one handed 
+    // over by the previous daemon.  fd is closed on failure.
+    int                     Adopt( int fd, std::filesystem::path hidrawPath );
     void                    Close();
     bool                    IsOpen();
 
-    int                     Read( std::vector<uint8_t>& rData );
+    // A timeout shorter than the device timeout returns no data without
+    // counting against the device.  -1 uses the device timeout.
+    int                     Read( std::vector<uint8_t>& rData, int timeout = -1 );
     int                     Write( const std::vector<uint8_t>& rData );
+    int                     Write( const uint8_t* pData, size_t length );
+    // Close-on-exec copy of the device fd for callers doing their own I/O, 
+    // or -1.  The caller must close it.
+    int                     Dup();
 
     int                     GetReportDescriptor( hidraw_report_descriptor& rDesc );
     std::string             GetName();
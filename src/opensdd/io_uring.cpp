@@ -0,0 +1,357 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//  OpenSD
+//  An open-source userspace driver for Valve's Steam Deck hardware
+//
+//  Copyright 2022 seek
+//  https://gitlab.com/open-sd/opensd
+//  Licensed under the GNU GPLv3+
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the 
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of 
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; 
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. 
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with this program. 
+//  If not, see <https://www.gnu.org/licenses/>.             
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#include "io_uring.hpp"
+#include "../common/errors.hpp"
+#include "../common/log.hpp"
+#ifdef OPT_IO_URING
+// Linux
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <signal.h>
+// C++
+#include <atomic>
+#include <cstring>
+#include <string>
+#endif // OPT_IO_URING
+
+
+
+#ifdef OPT_IO_URING
+
+int IoUring::Open( unsigned int entries )
+{
+    io_uring_params     params = {};
+    size_t              sq_size;
+    size_t              cq_size;
+    void*               ptr;
+    unsigned int*       sq_array;
+    
+    
+    if (IsOpen())
+        return Err::ALREADY_OPEN;
+    
+    mFd = syscall( __NR_io_uring_setup, entries, &params );
+    if (mFd < 0)
+    {
+        int e = errno;
+        mFd = -1;
+        gLog.Write( Log::DEBUG, FUNC_NAME, "io_uring_setup failed: " + Err::GetErrnoString(e) );
+        return Err::UNSUPPORTED;
+    }
+    
+    // Timed waits need IORING_ENTER_EXT_ARG (linux 5.11)
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_NODROP))
+    {
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Kernel io_uring is missing required features." );
+        Close();
+        return Err::UNSUPPORTED;
+    }
+    
+    // SQ and CQ rings share one mapping
+    sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    mRingSize = (sq_size > cq_size) ? sq_size : cq_size;
+    ptr = mmap( nullptr, mRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mFd, IORING_OFF_SQ_RING );
+    if (ptr == MAP_FAILED)
+    {
+        int e = errno;
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to map io_uring rings: " + Err::GetErrnoString(e) );
+        Close();
+        return Err::OUT_OF_MEMORY;
+    }
+    mpRing = (uint8_t*)ptr;
+    
+    mSqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    ptr = mmap( nullptr, mSqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mFd, IORING_OFF_SQES );
+    if (ptr == MAP_FAILED)
+    {
+        int e = errno;
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to map io_uring submission entries: " + Err::GetErrnoString(e) );
+        Close();
+        return Err::OUT_OF_MEMORY;
+    }
+    mpSqes = (io_uring_sqe*)ptr;
+    
+    mpSqHead    = (unsigned int*)(mpRing + params.sq_off.head);
+    mpSqTail    = (unsigned int*)(mpRing + params.sq_off.tail);
+    mSqMask     = *(unsigned int*)(mpRing + params.sq_off.ring_mask);
+    mSqEntries  = params.sq_entries;
+    mpCqHead    = (unsigned int*)(mpRing + params.cq_off.head);
+    mpCqTail    = (unsigned int*)(mpRing + params.cq_off.tail);
+    mCqMask     = *(unsigned int*)(mpRing + params.cq_off.ring_mask);
+    mpCqes      = (io_uring_cqe*)(mpRing + params.cq_off.cqes);
+    mQueued     = 0;
+    
+    // Submission slots are always used in ring order
+    sq_array = (unsigned int*)(mpRing + params.sq_off.array);
+    for (unsigned int i = 0; i < mSqEntries; ++i)
+        sq_array[i] = i;
+    
+    gLog.Write( Log::DEBUG, FUNC_NAME, "Opened io_uring with " + std::to_string(mSqEntries) + " entries." );
+    
+    return Err::OK;
+}
+
+
+
+void IoUring::Close()
+{
+    // Closing the ring cancels anything still in flight
+    if (mpSqes != nullptr)
+        munmap( mpSqes, mSqesSize );
+    if (mpRing != nullptr)
+        munmap( mpRing, mRingSize );
+    if (mFd >= 0)
+        close( mFd );
+    
+    mFd = -1;
+    mpRing = nullptr;
+    mpSqes = nullptr;
+    mQueued = 0;
+}
+
+
+
+io_uring_sqe* IoUring::GetSqe()
+{
+    unsigned int        head;
+    unsigned int        tail;
+    io_uring_sqe*       sqe;
+    
+    
+    if (!IsOpen())
+        return nullptr;
+    
+    head = std::atomic_ref<unsigned int>( *mpSqHead ).load( std::memory_order_acquire );
+    tail = *mpSqTail;
+    if (tail - head >= mSqEntries)
+        return nullptr;
+    
+    sqe = &mpSqes[tail & mSqMask];
+    memset( sqe, 0, sizeof(io_uring_sqe) );
+    
+    return sqe;
+}
+
+
+
+int IoUring::QueueRead( int fd, void* pBuff, unsigned int length, uint64_t tag )
+{
+    io_uring_sqe*       sqe = GetSqe();
+    
+    if (sqe == nullptr)
+        return IsOpen() ? Err::OUT_OF_RANGE : Err::NOT_OPEN;
+    
+    sqe->opcode     = IORING_OP_READ;
+    sqe->fd         = fd;
+    sqe->addr       = (uint64_t)pBuff;
+    sqe->len        = length;
+    sqe->off        = (uint64_t)-1;     // Current file position
+    sqe->user_data  = tag;
+    
+    // Publish the entry to the kernel
+    std::atomic_ref<unsigned int>( *mpSqTail ).store( *mpSqTail + 1, std::memory_order_release );
+    ++mQueued;
+    
+    return Err::OK;
+}
+
+
+
+int IoUring::QueueWrite( int fd, const void* pBuff, unsigned int length, uint64_t tag )
+{
+    io_uring_sqe*       sqe = GetSqe();
+    
+    if (sqe == nullptr)
+        return IsOpen() ? Err::OUT_OF_RANGE : Err::NOT_OPEN;
+    
+    sqe->opcode     = IORING_OP_WRITE;
+    sqe->fd         = fd;
+    sqe->addr       = (uint64_t)pBuff;
+    sqe->len        = length;
+    sqe->off        = (uint64_t)-1;
+    sqe->user_data  = tag;
+    
+    std::atomic_ref<unsigned int>( *mpSqTail ).store( *mpSqTail + 1, std::memory_order_release );
+    ++mQueued;
+    
+    return Err::OK;
+}
+
+
+
+int IoUring::Submit( unsigned int waitNr, int timeout )
+{
+    int                         result;
+    unsigned int                flags = 0;
+    io_uring_getevents_arg      arg = {};
+    __kernel_timespec           ts = {};
+    void*                       p_arg = nullptr;
+    size_t                      arg_size = 0;
+    
+    
+    if (!IsOpen())
+        return Err::NOT_OPEN;
+    
+    // Nothing to do
+    if (!mQueued && !waitNr)
+        return Err::OK;
+    
+    if (waitNr)
+    {
+        flags |= IORING_ENTER_GETEVENTS;
+        if (timeout >= 0)
+        {
+            ts.tv_sec       = timeout / 1000;
+            ts.tv_nsec      = (timeout % 1000) * 1000000;
+            arg.sigmask_sz  = _NSIG / 8;
+            arg.ts          = (uint64_t)&ts;
+            p_arg           = &arg;
+            arg_size        = sizeof(arg);
+            flags |= IORING_ENTER_EXT_ARG;
+        }
+    }
+    
+    result = syscall( __NR_io_uring_enter, mFd, mQueued, waitNr, flags, p_arg, arg_size );
+    if (result < 0)
+    {
+        int e = errno;
+        
+        // Timed out, interrupted or the kernel is short on resources.  
+        // Anything queued goes out with the next call.
+        if ((e == ETIME) || (e == EINTR) || (e == EAGAIN) || (e == EBUSY))
+            return Err::OK;
+        
+        gLog.Write( Log::DEBUG, FUNC_NAME, "io_uring_enter failed: " + Err::GetErrnoString(e) );
+        return Err::WRITE_FAILED;
+    }
+    
+    // Number of entries consumed
+    mQueued -= ((unsigned int)result > mQueued) ? mQueued : result;
+    
+    return Err::OK;
+}
+
+
+
+bool IoUring::GetCompletion( uint64_t& rTag, int& rResult )
+{
+    unsigned int        head;
+    unsigned int        tail;
+    io_uring_cqe*       cqe;
+    
+    
+    if (!IsOpen())
+        return false;
+    
+    head = *mpCqHead;
+    tail = std::atomic_ref<unsigned int>( *mpCqTail ).load( std::memory_order_acquire );
+    if (head == tail)
+        return false;
+    
+    cqe = &mpCqes[head & mCqMask];
+    rTag = cqe->user_data;
+    rResult = cqe->res;
+    
+    // Hand the slot back to the kernel
+    std::atomic_ref<unsigned int>( *mpCqHead ).store( head + 1, std::memory_order_release );
+    
+    return true;
+}
+
+#else // OPT_IO_URING
+
+int IoUring::Open( unsigned int )
+{
+    gLog.Write( Log::DEBUG, FUNC_NAME, "Built without io_uring support." );
+    return Err::UNSUPPORTED;
+}
+
+
+
+void IoUring::Close()
+{
+}
+
+
+
+int IoUring::QueueRead( int, void*, unsigned int, uint64_t )
+{
+    return Err::NOT_OPEN;
+}
+
+
+
+int IoUring::QueueWrite( int, const void*, unsigned int, uint64_t )
+{
+    return Err::NOT_OPEN;
+}
+
+
+
+int IoUring::Submit( unsigned int, int )
+{
+    return Err::NOT_OPEN;
+}
+
+
+
+bool IoUring::GetCompletion( uint64_t&, int& )
+{
+    return false;
+}
+
+#endif // OPT_IO_URING
+
+
+
+bool IoUring::IsOpen()
+{
+    return (mFd >= 0);
+}
+
+
+
+IoUring::IoUring()
+{
+    mFd = -1;
+    mpRing = nullptr;
+    mRingSize = 0;
+    mpSqes = nullptr;
+    mSqesSize = 0;
+    mpSqHead = nullptr;
+    mpSqTail = nullptr;
+    mSqMask = 0;
+    mSqEntries = 0;
+    mpCqHead = nullptr;
+    mpCqTail = nullptr;
+    mCqMask = 0;
+    mpCqes = nullptr;
+    mQueued = 0;
+}
+
+
+
+IoUring::~IoUring()
+{
+    Close();
+}
@@ -0,0 +1,77 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//  OpenSD
+//  An open-source userspace driver for Valve's Steam Deck hardware
+//
+//  Copyright 2022 seek
+//  https://gitlab.com/open-sd/opensd
+//  Licensed under the GNU GPLv3+
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the 
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of 
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; 
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. 
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with this program. 
+//  If not, see <https://www.gnu.org/licenses/>.             
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#ifndef __IO_URING_HPP__
+#define __IO_URING_HPP__
+
+#include <cstddef>
+#include <cstdint>
+
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+
+// Minimal io_uring wrapper using the raw syscalls, so no liburing is needed.
+// Only built with the OPT_IO_URING cmake option; otherwise Open() returns 
+// Err::UNSUPPORTED and callers keep using plain syscalls.  Not thread safe, 
+// the ring belongs to the thread that opened it.
+class IoUring
+{
+private:
+    int                     mFd;
+    uint8_t*                mpRing;             // Shared SQ / CQ ring mapping
+    size_t                  mRingSize;
+    io_uring_sqe*           mpSqes;
+    size_t                  mSqesSize;
+    unsigned int*           mpSqHead;
+    unsigned int*           mpSqTail;
+    unsigned int            mSqMask;
+    unsigned int            mSqEntries;
+    unsigned int*           mpCqHead;
+    unsigned int*           mpCqTail;
+    unsigned int            mCqMask;
+    io_uring_cqe*           mpCqes;
+    unsigned int            mQueued;            // Queued entries the kernel hasn't consumed yet
+    
+    io_uring_sqe*           GetSqe();
+
+public:
+    int                     Open( unsigned int entries );
+    void                    Close();
+    bool                    IsOpen();
+    
+    // Queue requests without entering the kernel.  Buffers must stay valid 
+    // until the matching completion has been taken.
+    int                     QueueRead( int fd, void* pBuff, unsigned int length, uint64_t tag );
+    int                     QueueWrite( int fd, const void* pBuff, unsigned int length, uint64_t tag );
+    
+    // Submits everything queued in a single io_uring_enter and optionally 
+    // waits for completions.  Running out of time is not an error.
+    int                     Submit( unsigned int waitNr = 0, int timeout = -1 );
+    
+    // Takes the next completion.  Returns false if there are none.
+    bool                    GetCompletion( uint64_t& rTag, int& rResult );
+    
+    IoUring();
+    ~IoUring();
+};
+
+
+#endif // __IO_URING_HPP__
@@ -58,6 +58,8 @@ const std::string   HELP_BLOCK =
     "    -l    --log-level        Set minumum logging level.  Default: 'warn'\n"
     "                             Valid options are:\n"
     "                                 verbose, debug, info, warn, error\n"
+    "    -t    --takeover         Replace a running daemon, keeping its virtual\n"
+    "                             input devices.\n"
 };
 
 
@@ -159,6 +161,10 @@ int main( int argc, char **argv )
         }
     }
    
+    // Replace a running daemon
+    if (args.HasOpt( "t", "takeover" ))
+        opensdd.SetTakeover( true );
+   
     // Exit if there were argument parsing errors
     if (args.GetErrorCount())
     {
@@ -19,10 +19,12 @@
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 #include "profile_ini.hpp"
 #include "profile_template.hpp"
+#include "drivers/msg_strings.hpp"
 #include "../common/log.hpp"
 #include "../common/input_event_names.hpp"
 #include "../common/string_funcs.hpp"
 // C++
+#include <algorithm>
 #include <fstream>
 
 // Less messy
@@ -238,6 +240,54 @@ void ProfileIni::GetDeviceInfo( std::string key, uint16_t& rVid, uint16_t& rPid,
 
 
 
+void ProfileIni::GetOutputRate( std::string key, Uinput::OutputPolicy& rPolicy )
+{
+    Ini::ValVec         val;
+    std::string         str;
+    unsigned long       hz;
+    
+    
+    // Policy is unaltered if not found
+    
+    val = mIni.GetVal( "OutputRate", key );
+    if (!val.Count())
+        return;
+    
+    str = Str::Lowercase( val.String() );
+    if (str == "native")
+    {
+        rPolicy = { .mode = Uinput::OutputMode::NATIVE, .hz = 0 };
+        return;
+    }
+    
+    if (str == "onchange")
+    {
+        rPolicy = { .mode = Uinput::OutputMode::ON_CHANGE, .hz = 0 };
+        return;
+    }
+    
+    try
+    {
+        hz = std::stoul( str );
+    }
+    catch (...)
+    {
+        gLog.Write( Log::WARN, "Invalid output rate '" + val.String() + "' for '" + key + "'.  Using default." );
+        return;
+    }
+    
+    if ((hz < Uinput::OUTPUT_RATE_MIN) || (hz > Uinput::OUTPUT_RATE_MAX))
+    {
+        gLog.Write( Log::WARN, "Output rate for '" + key + "' must be between " + std::to_string(Uinput::OUTPUT_RATE_MIN) + 
+                               " and " + std::to_string(Uinput::OUTPUT_RATE_MAX) + " Hz.  Using default." );
+        return;
+    }
+    
+    rPolicy = { .mode = Uinput::OutputMode::FIXED, .hz = (uint32_t)hz };
+}
+
+
+
 void ProfileIni::GetDeadzone( std::string key, double& rValue )
 {
     Ini::ValVec         val;
@@ -310,17 +360,24 @@ void ProfileIni::GetAxisRange( std::string section, std::string key, int32_t& rM
 
 
 
-void ProfileIni::GetEventBinding( std::string key, Binding& rBind )
+void ProfileIni::GetEventBinding( std::string section, std::string key, Binding& rBind )
+{
+    Ini::ValVec             val;
+    
+    val = mIni.GetVal( section, key );
+    ParseEventBinding( key, val, rBind );
+}
+
+
+
+void ProfileIni::ParseEventBinding( std::string key, Ini::ValVec val, Binding& rBind )
 {
     Binding                 bind;
     std::string             dev_str;
     std::string             ev_str;
-    Ini::ValVec             val;
     int                     ev_type = 0;
     int                     result;
     
-    val = mIni.GetVal( "Bindings", key );
-
     // Need at least 2 params for event bindings
     if (val.Count() < 2)
     {
@@ -428,10 +485,33 @@ void ProfileIni::GetEventBinding( std::string key, Binding& rBind )
             bind.ev_code  = (uint16_t)result;
             bind.dir   = false;
             
+            // Optional direction and gain parameters:  <code> [ + | - ] [gain]
+            if (val.Count() > 2)
+            {
+                unsigned int    gain_idx = 2;
+                
+                if ((val.String(2) == "+") || (val.String(2) == "-"))
+                {
+                    bind.dir = (val.String(2) == "+");
+                    bind.dir_set = true;
+                    ++gain_idx;
+                }
+                
+                if (val.Count() > gain_idx)
+                {
+                    bind.gain = val.Double( gain_idx );
+                    if (bind.gain <= 0)
+                    {
+                        gLog.Write( Log::WARN, "Invalid gain in binding " + key + ": Must be a number greater than zero.  Using 1.0" );
+                        bind.gain = 1.0;
+                    }
+                }
+            }
+            
             // Enable relative axis event
             AddRelEvent( bind.type, bind.ev_code );
             
-            gLog.Write( Log::VERB, "Added binding: " + key + " = " + dev_str + " " + ev_str );
+            gLog.Write( Log::VERB, "Added binding: " + key + " = " + dev_str + " " + ev_str + (bind.dir_set ? (bind.dir ? " +" : " -") : "") + " x" + std::to_string(bind.gain) );
         break;
         
         default:
@@ -446,7 +526,7 @@ void ProfileIni::GetEventBinding( std::string key, Binding& rBind )
 
 
 
-void ProfileIni::GetCommandBinding( std::string key, Binding& rBind )
+void ProfileIni::GetCommandBinding( std::string section, std::string key, Binding& rBind )
 {
     Binding             bind;
     Ini::ValVec         val;
@@ -454,7 +534,7 @@ void ProfileIni::GetCommandBinding( std::string key, Binding& rBind )
     int                 result;
     static uint32_t     uid = 1;  // Unique ID for each command binding
 
-    val = mIni.GetVal( "Bindings", key );
+    val = mIni.GetVal( section, key );
 
     // Need at least 4 params for Command bindings
     if (val.Count() < 4)
@@ -507,12 +587,12 @@ void ProfileIni::GetCommandBinding( std::string key, Binding& rBind )
 
 
 
-void ProfileIni::GetProfileBinding( std::string key, Binding& rBind )
+void ProfileIni::GetProfileBinding( std::string section, std::string key, Binding& rBind )
 {
     Binding                 bind;
     Ini::ValVec             val;
 
-    val = mIni.GetVal( "Bindings", key );
+    val = mIni.GetVal( section, key );
 
     // Need 2 params for Profile bindings
     if (val.Count() < 2)
@@ -527,6 +607,9 @@ void ProfileIni::GetProfileBinding( std::string key, Binding& rBind )
     if (bind.str.empty())
         return;
     
+    // Profile switch messages refer to the filename by id
+    bind.id = Drivers::gMsgStrings.Intern( bind.str );
+    
     gLog.Write( Log::VERB, "Added binding: " + key + " = Profile " + bind.str );
     
     // Assign new binding to referenced parameter
@@ -535,14 +618,232 @@ void ProfileIni::GetProfileBinding( std::string key, Binding& rBind )
 
 
 
-void ProfileIni::GetBinding( std::string key, Binding& rBind )
+void ProfileIni::GetLayerBinding( std::string section, std::string key, Binding& rBind )
+{
+    Binding                 bind;
+    Ini::ValVec             val;
+    std::string             mode_str;
+
+    val = mIni.GetVal( section, key );
+
+    // Need 3 params for Layer bindings
+    if (val.Count() < 3)
+    {
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Error in binding " + key + ": Layer bindings must have at least three parameters." );
+        return;
+    }
+    
+    bind.type = BindType::LAYER;
+    
+    mode_str = Str::Uppercase( val.String(1) );
+    if (mode_str == "HOLD")
+        bind.dir = false;
+    else
+        if (mode_str == "TOGGLE")
+            bind.dir = true;
+        else
+        {
+            gLog.Write( Log::WARN, "Error in binding " + key + ": Layer mode must be 'Hold' or 'Toggle'.  Ignoring." );
+            return;
+        }
+    
+    bind.str = val.String(2);
+    for (unsigned int i = 0; i < mLayerNames.size(); ++i)
+        if (mLayerNames[i] == bind.str)
+            bind.id = i + 1;
+    if (!bind.id)
+    {
+        gLog.Write( Log::WARN, "Error in binding " + key + ": There is no [Layer_" + bind.str + "] section.  Ignoring." );
+        return;
+    }
+    
+    gLog.Write( Log::VERB, "Added binding: " + key + " = Layer " + (bind.dir ? "Toggle " : "Hold ") + bind.str );
+    
+    // Assign new binding to referenced parameter
+    rBind = bind;
+}
+
+
+
+int ProfileIni::GetOutput( std::string key, Ini::ValVec& rVal, unsigned int first, Binding& rBind )
+{
+    Ini::ValVec             sub;
+    
+    // Reuse the event binding parser on the <device> <event> [+|-] part
+    rBind = Binding();
+    sub = std::vector<std::string>( rVal.mData.begin() + std::min<size_t>( first, rVal.mData.size() ), rVal.mData.end() );
+    ParseEventBinding( key, sub, rBind );
+    
+    if ((rBind.type != BindType::GAME) && (rBind.type != BindType::MOTION) && (rBind.type != BindType::MOUSE))
+        return Err::INVALID_PARAMETER;
+    if (rBind.ev_type == EV_REL)
+    {
+        gLog.Write( Log::WARN, "Error in binding " + key + ": Actions can't use relative axes.  Ignoring." );
+        return Err::INVALID_PARAMETER;
+    }
+    
+    return Err::OK;
+}
+
+
+
+int ProfileIni::GetMacro( std::string name, Action& rAction )
+{
+    Ini::ValVec             keys;
+    std::string             section = "Macro_" + name;
+    
+    rAction = { .type = ActionType::MACRO, .name = name, .out = {}, .ms = 0, .steps = {} };
+    
+    if (!mIni.DoesSectionExist( section ))
+    {
+        gLog.Write( Log::WARN, "Macro '" + name + "' has no [" + section + "] section." );
+        return Err::NOT_FOUND;
+    }
+    
+    // Steps run in the order they are listed
+    keys = mIni.GetKeyList( section );
+    for (auto& key : keys.mData)
+    {
+        ActionStep          step = { .type = StepType::WAIT, .out = {}, .ms = 0 };
+        Ini::ValVec         val;
+        std::string         type_str;
+        unsigned int        first = 1;
+        
+        val = mIni.GetVal( section, key );
+        if (!val.Count())
+            continue;
+        
+        type_str = Str::Uppercase( val.String(0) );
+        if (type_str == "WAIT")
+            step.type = StepType::WAIT;
+        else
+            if (type_str == "TAP")
+            {
+                step.type = StepType::TAP;
+                first = 2;
+            }
+            else
+                if (type_str == "PRESS")
+                    step.type = StepType::PRESS;
+                else
+                    if (type_str == "RELEASE")
+                        step.type = StepType::RELEASE;
+                    else
+                    {
+                        gLog.Write( Log::WARN, "Error in macro step " + key + ": Unknown step type '" + val.String(0) + "'.  Ignoring." );
+                        continue;
+                    }
+        
+        // Wait and Tap take a time in ms
+        if ((step.type == StepType::WAIT) || (step.type == StepType::TAP))
+        {
+            if ((val.Count() < 2) || (val.Int(1) < 0))
+            {
+                gLog.Write( Log::WARN, "Error in macro step " + key + ": Missing or invalid time.  Ignoring." );
+                continue;
+            }
+            step.ms = val.Int(1);
+        }
+        
+        if (step.type != StepType::WAIT)
+            if (GetOutput( key, val, first, step.out ) != Err::OK)
+                continue;
+        
+        if (rAction.steps.size() >= MAX_MACRO_STEPS)
+        {
+            gLog.Write( Log::WARN, "Macro '" + name + "' has more than " + std::to_string(MAX_MACRO_STEPS) + " steps.  Ignoring the rest." );
+            break;
+        }
+        rAction.steps.push_back( step );
+    }
+    
+    if (rAction.steps.empty())
+    {
+        gLog.Write( Log::WARN, "Macro '" + name + "' has no valid steps." );
+        return Err::EMPTY;
+    }
+    
+    return Err::OK;
+}
+
+
+
+void ProfileIni::GetActionBinding( std::string section, std::string key, Binding& rBind )
+{
+    Binding                 bind;
+    Action                  action = { .type = ActionType::TOGGLE, .name = "", .out = {}, .ms = 0, .steps = {} };
+    Ini::ValVec             val;
+    std::string             type_str;
+    
+    val = mIni.GetVal( section, key );
+    type_str = Str::Uppercase( val.String(0) );
+    
+    if (type_str == "MACRO")
+    {
+        // Format: Input = Macro <macro_name>
+        if (val.Count() < 2)
+        {
+            gLog.Write( Log::WARN, "Error in binding " + key + ": Macro bindings need a macro name.  Ignoring." );
+            return;
+        }
+        
+        // Every binding gets its own copy of the macro, so each input is 
+        // edge-detected and plays the macro on its own
+        if (GetMacro( val.String(1), action ) != Err::OK)
+            return;
+    }
+    else
+    {
+        if (type_str == "TURBO")
+        {
+            // Format: Input = Turbo <rate_hz> <device> <event> [+|-]
+            if ((val.Count() < 4) || (val.Double(1) <= 0))
+            {
+                gLog.Write( Log::WARN, "Error in binding " + key + ": Turbo bindings need a rate greater than zero and an event.  Ignoring." );
+                return;
+            }
+            action.type = ActionType::TURBO;
+            // On for half of each period, off for the other half
+            action.ms = std::max<uint32_t>( 500.0 / val.Double(1), 1 );
+            if (GetOutput( key, val, 2, action.out ) != Err::OK)
+                return;
+        }
+        else
+        {
+            // Format: Input = Toggle <device> <event> [+|-]
+            action.type = ActionType::TOGGLE;
+            if (GetOutput( key, val, 1, action.out ) != Err::OK)
+                return;
+        }
+    }
+    
+    if (mProf.actions.size() >= MAX_ACTIONS)
+    {
+        gLog.Write( Log::WARN, "Error in binding " + key + ": Profile has more than " + std::to_string(MAX_ACTIONS) + " actions.  Ignoring." );
+        return;
+    }
+    
+    bind.type = BindType::ACTION;
+    bind.id = mProf.actions.size();
+    bind.str = action.name;
+    mProf.actions.push_back( action );
+    
+    gLog.Write( Log::VERB, "Added binding: " + key + " = " + val.FullString() );
+    
+    // Assign new binding to referenced parameter
+    rBind = bind;
+}
+
+
+
+void ProfileIni::GetBinding( std::string section, std::string key, Binding& rBind )
 {
     Ini::ValVec             val;
     std::string             temp_str;
     std::string             sub_str;
     
     // Find the key in the Bindings section
-    val = mIni.GetVal( "Bindings", key );
+    val = mIni.GetVal( section, key );
     if (!val.Count())
     {
         gLog.Write( Log::DEBUG, FUNC_NAME, "Error in binding " + key + ": No parameters.  Ignoring." );
@@ -552,27 +853,160 @@ void ProfileIni::GetBinding( std::string key, Binding& rBind )
     // Get the the binding type
     temp_str = Str::Uppercase(val.String(0));
     if (temp_str == "NONE")
+    {
+        // Also unbinds inputs a layer inherited from the base bindings
+        rBind = Binding();
         return;
+    }
     else
     {
         if ((temp_str == "GAMEPAD") || (temp_str == "MOTION") || (temp_str == "MOUSE"))
-            GetEventBinding( key, rBind );
+            GetEventBinding( section, key, rBind );
         else
             if (temp_str == "COMMAND")
-                GetCommandBinding( key, rBind );
+                GetCommandBinding( section, key, rBind );
             else
                 if (temp_str == "PROFILE")
-                    GetProfileBinding( key, rBind );
+                    GetProfileBinding( section, key, rBind );
                 else
-                {                        
-                    gLog.Write( Log::DEBUG, FUNC_NAME, "Error in binding " + key + ": Unknown bind type '" + temp_str + "'" );
-                    return;
-                }
+                    if (temp_str == "LAYER")
+                        GetLayerBinding( section, key, rBind );
+                    else
+                        if ((temp_str == "TURBO") || (temp_str == "TOGGLE") || (temp_str == "MACRO"))
+                            GetActionBinding( section, key, rBind );
+                        else
+                        {                        
+                            gLog.Write( Log::DEBUG, FUNC_NAME, "Error in binding " + key + ": Unknown bind type '" + temp_str + "'" );
+                            return;
+                        }
     }
 }
 
 
 
+void ProfileIni::GetBindMap( std::string section, BindMap& rMap )
+{
+    // Dpad
+    GetBinding( section, "DpadUp",               rMap.dpad.up );
+    GetBinding( section, "DpadDown",             rMap.dpad.down );
+    GetBinding( section, "DpadLeft",             rMap.dpad.left );
+    GetBinding( section, "DpadRight",            rMap.dpad.right );
+    // Buttons
+    GetBinding( section, "A",                    rMap.btn.a );
+    GetBinding( section, "B",                    rMap.btn.b );
+    GetBinding( section, "X",                    rMap.btn.x );
+    GetBinding( section, "Y",                    rMap.btn.y );
+    GetBinding( section, "L1",                   rMap.btn.l1 );
+    GetBinding( section, "L2",                   rMap.btn.l2 );
+    GetBinding( section, "L3",                   rMap.btn.l3 );
+    GetBinding( section, "L4",                   rMap.btn.l4 );
+    GetBinding( section, "L5",                   rMap.btn.l5 );
+    GetBinding( section, "R1",                   rMap.btn.r1 );
+    GetBinding( section, "R2",                   rMap.btn.r2 );
+    GetBinding( section, "R3",                   rMap.btn.r3 );
+    GetBinding( section, "R4",                   rMap.btn.r4 );
+    GetBinding( section, "R5",                   rMap.btn.r5 );
+    GetBinding( section, "Menu",                 rMap.btn.menu );
+    GetBinding( section, "Options",              rMap.btn.options );
+    GetBinding( section, "Steam",                rMap.btn.steam );
+    GetBinding( section, "QuickAccess",          rMap.btn.quick_access );
+    // Triggers
+    GetBinding( section, "LTrigg",               rMap.trigg.l );
+    GetBinding( section, "RTrigg",               rMap.trigg.r );
+    // Left Stick
+    GetBinding( section, "LStickUp",             rMap.stick.l.up );
+    GetBinding( section, "LStickDown",           rMap.stick.l.down );
+    GetBinding( section, "LStickLeft",           rMap.stick.l.left );
+    GetBinding( section, "LStickRight",          rMap.stick.l.right );
+    GetBinding( section, "LStickTouch",          rMap.stick.l.touch );
+    GetBinding( section, "LStickForce",          rMap.stick.l.force );
+    // Right Stick
+    GetBinding( section, "RStickUp",             rMap.stick.r.up );
+    GetBinding( section, "RStickDown",           rMap.stick.r.down );
+    GetBinding( section, "RStickLeft",           rMap.stick.r.left );
+    GetBinding( section, "RStickRight",          rMap.stick.r.right );
+    GetBinding( section, "RStickTouch",          rMap.stick.r.touch );
+    GetBinding( section, "RStickForce",          rMap.stick.r.force );
+    // Left Touchpad
+    GetBinding( section, "LPadUp",               rMap.pad.l.up );
+    GetBinding( section, "LPadDown",             rMap.pad.l.down );
+    GetBinding( section, "LPadLeft",             rMap.pad.l.left );
+    GetBinding( section, "LPadRight",            rMap.pad.l.right );
+    GetBinding( section, "LPadRelX",             rMap.pad.l.rel_x );
+    GetBinding( section, "LPadRelY",             rMap.pad.l.rel_y );
+    GetBinding( section, "LPadTouch",            rMap.pad.l.touch );
+    GetBinding( section, "LPadPress",            rMap.pad.l.press );
+    GetBinding( section, "LPadForce",            rMap.pad.l.force );
+    GetBinding( section, "LPadPressQuadUp",      rMap.pad.l.btn_quad_up );
+    GetBinding( section, "LPadPressQuadDown",    rMap.pad.l.btn_quad_down );
+    GetBinding( section, "LPadPressQuadLeft",    rMap.pad.l.btn_quad_left );
+    GetBinding( section, "LPadPressQuadRight",   rMap.pad.l.btn_quad_right );
+    GetBinding( section, "LPadPressOrthUp",      rMap.pad.l.btn_orth_up );
+    GetBinding( section, "LPadPressOrthDown",    rMap.pad.l.btn_orth_down );
+    GetBinding( section, "LPadPressOrthLeft",    rMap.pad.l.btn_orth_left );
+    GetBinding( section, "LPadPressOrthRight",   rMap.pad.l.btn_orth_right );
+    GetBinding( section, "LPadPressGrid2x2_1",   rMap.pad.l.btn_2x2_1 );
+    GetBinding( section, "LPadPressGrid2x2_2",   rMap.pad.l.btn_2x2_2 );
+    GetBinding( section, "LPadPressGrid2x2_3",   rMap.pad.l.btn_2x2_3 );
+    GetBinding( section, "LPadPressGrid2x2_4",   rMap.pad.l.btn_2x2_4 );
+    GetBinding( section, "LPadPressGrid3x3_1",   rMap.pad.l.btn_3x3_1 );
+    GetBinding( section, "LPadPressGrid3x3_2",   rMap.pad.l.btn_3x3_2 );
+    GetBinding( section, "LPadPressGrid3x3_3",   rMap.pad.l.btn_3x3_3 );
+    GetBinding( section, "LPadPressGrid3x3_4",   rMap.pad.l.btn_3x3_4 );
+    GetBinding( section, "LPadPressGrid3x3_5",   rMap.pad.l.btn_3x3_5 );
+    GetBinding( section, "LPadPressGrid3x3_6",   rMap.pad.l.btn_3x3_6 );
+    GetBinding( section, "LPadPressGrid3x3_7",   rMap.pad.l.btn_3x3_7 );
+    GetBinding( section, "LPadPressGrid3x3_8",   rMap.pad.l.btn_3x3_8 );
+    GetBinding( section, "LPadPressGrid3x3_9",   rMap.pad.l.btn_3x3_9 );
+    // Right Touchpad
+    GetBinding( section, "RPadUp",               rMap.pad.r.up );
+    GetBinding( section, "RPadDown",             rMap.pad.r.down );
+    GetBinding( section, "RPadLeft",             rMap.pad.r.left );
+    GetBinding( section, "RPadRight",            rMap.pad.r.right );
+    GetBinding( section, "RPadRelX",             rMap.pad.r.rel_x );
+    GetBinding( section, "RPadRelY",             rMap.pad.r.rel_y );
+    GetBinding( section, "RPadTouch",            rMap.pad.r.touch );
+    GetBinding( section, "RPadPress",            rMap.pad.r.press );
+    GetBinding( section, "RPadForce",            rMap.pad.r.force );
+    GetBinding( section, "RPadPressQuadUp",      rMap.pad.l.btn_quad_up );
+    GetBinding( section, "RPadPressQuadDown",    rMap.pad.l.btn_quad_down );
+    GetBinding( section, "RPadPressQuadLeft",    rMap.pad.l.btn_quad_left );
+    GetBinding( section, "RPadPressQuadRight",   rMap.pad.l.btn_quad_right );
+    GetBinding( section, "RPadPressOrthUp",      rMap.pad.l.btn_orth_up );
+    GetBinding( section, "RPadPressOrthDown",    rMap.pad.l.btn_orth_down );
+    GetBinding( section, "RPadPressOrthLeft",    rMap.pad.l.btn_orth_left );
+    GetBinding( section, "RPadPressOrthRight",   rMap.pad.l.btn_orth_right );
+    GetBinding( section, "RPadPressGrid2x2_1",   rMap.pad.l.btn_2x2_1 );
+    GetBinding( section, "RPadPressGrid2x2_2",   rMap.pad.l.btn_2x2_2 );
+    GetBinding( section, "RPadPressGrid2x2_3",   rMap.pad.l.btn_2x2_3 );
+    GetBinding( section, "RPadPressGrid2x2_4",   rMap.pad.l.btn_2x2_4 );
+    GetBinding( section, "RPadPressGrid3x3_1",   rMap.pad.l.btn_3x3_1 );
+    GetBinding( section, "RPadPressGrid3x3_2",   rMap.pad.l.btn_3x3_2 );
+    GetBinding( section, "RPadPressGrid3x3_3",   rMap.pad.l.btn_3x3_3 );
+    GetBinding( section, "RPadPressGrid3x3_4",   rMap.pad.l.btn_3x3_4 );
+    GetBinding( section, "RPadPressGrid3x3_5",   rMap.pad.l.btn_3x3_5 );
+    GetBinding( section, "RPadPressGrid3x3_6",   rMap.pad.l.btn_3x3_6 );
+    GetBinding( section, "RPadPressGrid3x3_7",   rMap.pad.l.btn_3x3_7 );
+    GetBinding( section, "RPadPressGrid3x3_8",   rMap.pad.l.btn_3x3_8 );
+    GetBinding( section, "RPadPressGrid3x3_9",   rMap.pad.l.btn_3x3_9 );
+    // Acclerometers
+    GetBinding( section, "AccelXPlus",           rMap.accel.x_plus );
+    GetBinding( section, "AccelXMinus",          rMap.accel.x_minus );
+    GetBinding( section, "AccelYPlus",           rMap.accel.y_plus );
+    GetBinding( section, "AccelYMinus",          rMap.accel.y_minus );
+    GetBinding( section, "AccelZPlus",           rMap.accel.z_plus );
+    GetBinding( section, "AccelZMinus",          rMap.accel.z_minus );
+    // Gyro / Attitude
+    GetBinding( section, "RollPlus",             rMap.att.roll_plus );
+    GetBinding( section, "RollMinus",            rMap.att.roll_minus );
+    GetBinding( section, "PitchPlus",            rMap.att.pitch_plus );
+    GetBinding( section, "PitchMinus",           rMap.att.pitch_minus );
+    GetBinding( section, "YawPlus",              rMap.att.yaw_plus );
+    GetBinding( section, "YawMinus",             rMap.att.yaw_minus );
+}
+
+
+
 int ProfileIni::Load( std::filesystem::path filePath, Profile& rProf )
 {
     Ini::ValVec             val;
@@ -620,6 +1054,19 @@ int ProfileIni::Load( std::filesystem::path filePath, Profile& rProf )
     GetFeatEnable( "LizardMode",        mProf.features.lizard );
     GetFeatEnable( "StickFiltering",    mProf.features.filter_sticks );
     GetFeatEnable( "TrackpadFiltering", mProf.features.filter_pads );
+    val = mIni.GetVal( "Features", "AxisMerge" );
+    if (val.Count())
+    {
+        if (Str::Lowercase(val.String()) == "sum")
+            mProf.features.axis_merge = AxisMerge::SUM;
+        else
+        {
+            if (Str::Lowercase(val.String()) == "priority")
+                mProf.features.axis_merge = AxisMerge::PRIORITY;
+            else
+                gLog.Write( Log::WARN, "Invalid 'AxisMerge' value '" + val.String() + "'.  Using 'Priority'." );
+        }
+    }
 
     // ----------------------------- [DeviceInfo] section -----------------------------
     gLog.Write( Log::VERB, "Reading [DeviceInfo] section..." );
@@ -627,6 +1074,12 @@ int ProfileIni::Load( std::filesystem::path filePath, Profile& rProf )
     GetDeviceInfo( "Motion",    mProf.dev.motion.vid, mProf.dev.motion.pid, mProf.dev.motion.ver, mProf.dev.motion.name );
     GetDeviceInfo( "Mouse",     mProf.dev.mouse.vid, mProf.dev.mouse.pid, mProf.dev.mouse.ver, mProf.dev.mouse.name );
 
+    // ----------------------------- [OutputRate] section -----------------------------
+    gLog.Write( Log::VERB, "Reading [OutputRate] section..." );
+    GetOutputRate( "Gamepad",   mProf.dev.gamepad.output );
+    GetOutputRate( "Motion",    mProf.dev.motion.output );
+    GetOutputRate( "Mouse",     mProf.dev.mouse.output );
+
     // ----------------------------- [Deadzone] section -----------------------------
     gLog.Write( Log::VERB, "Reading [Deadzone] section..." );
     GetDeadzone( "LStick",  mProf.dz.stick.l );
@@ -685,125 +1138,34 @@ int ProfileIni::Load( std::filesystem::path filePath, Profile& rProf )
         AddAbsEvent( BindType::MOTION, code, min, max, fuzz, res );
     }
     
+    // ----------------------------- [Layer_*] sections -----------------------------
+    // Layers are numbered in the order they appear so bindings can refer to them
+    mLayerNames.clear();
+    for (auto& sec : mIni.GetSectionList())
+    {
+        if (!Str::Uppercase( sec ).starts_with( "LAYER_" ) || (sec.size() <= 6))
+            continue;
+        if (mLayerNames.size() >= MAX_BIND_LAYERS)
+        {
+            gLog.Write( Log::WARN, "Profile has more than " + std::to_string(MAX_BIND_LAYERS) + " layers.  Ignoring [" + sec + "]." );
+            continue;
+        }
+        mLayerNames.push_back( sec.substr( 6 ) );
+    }
+    
     // ----------------------------- [Bindings] section -----------------------------
     gLog.Write( Log::VERB, "Reading [Bindings] section..." );
-    // Dpad
-    GetBinding( "DpadUp",               mProf.map.dpad.up );
-    GetBinding( "DpadDown",             mProf.map.dpad.down );
-    GetBinding( "DpadLeft",             mProf.map.dpad.left );
-    GetBinding( "DpadRight",            mProf.map.dpad.right );
-    // Buttons
-    GetBinding( "A",                    mProf.map.btn.a );
-    GetBinding( "B",                    mProf.map.btn.b );
-    GetBinding( "X",                    mProf.map.btn.x );
-    GetBinding( "Y",                    mProf.map.btn.y );
-    GetBinding( "L1",                   mProf.map.btn.l1 );
-    GetBinding( "L2",                   mProf.map.btn.l2 );
-    GetBinding( "L3",                   mProf.map.btn.l3 );
-    GetBinding( "L4",                   mProf.map.btn.l4 );
-    GetBinding( "L5",                   mProf.map.btn.l5 );
-    GetBinding( "R1",                   mProf.map.btn.r1 );
-    GetBinding( "R2",                   mProf.map.btn.r2 );
-    GetBinding( "R3",                   mProf.map.btn.r3 );
-    GetBinding( "R4",                   mProf.map.btn.r4 );
-    GetBinding( "R5",                   mProf.map.btn.r5 );
-    GetBinding( "Menu",                 mProf.map.btn.menu );
-    GetBinding( "Options",              mProf.map.btn.options );
-    GetBinding( "Steam",                mProf.map.btn.steam );
-    GetBinding( "QuickAccess",          mProf.map.btn.quick_access );
-    // Triggers
-    GetBinding( "LTrigg",               mProf.map.trigg.l );
-    GetBinding( "RTrigg",               mProf.map.trigg.r );
-    // Left Stick
-    GetBinding( "LStickUp",             mProf.map.stick.l.up );
-    GetBinding( "LStickDown",           mProf.map.stick.l.down );
-    GetBinding( "LStickLeft",           mProf.map.stick.l.left );
-    GetBinding( "LStickRight",          mProf.map.stick.l.right );
-    GetBinding( "LStickTouch",          mProf.map.stick.l.touch );
-    GetBinding( "LStickForce",          mProf.map.stick.l.force );
-    // Right Stick
-    GetBinding( "RStickUp",             mProf.map.stick.r.up );
-    GetBinding( "RStickDown",           mProf.map.stick.r.down );
-    GetBinding( "RStickLeft",           mProf.map.stick.r.left );
-    GetBinding( "RStickRight",          mProf.map.stick.r.right );
-    GetBinding( "RStickTouch",          mProf.map.stick.r.touch );
-    GetBinding( "RStickForce",          mProf.map.stick.r.force );
-    // Left Touchpad
-    GetBinding( "LPadUp",               mProf.map.pad.l.up );
-    GetBinding( "LPadDown",             mProf.map.pad.l.down );
-    GetBinding( "LPadLeft",             mProf.map.pad.l.left );
-    GetBinding( "LPadRight",            mProf.map.pad.l.right );
-    GetBinding( "LPadRelX",             mProf.map.pad.l.rel_x );
-    GetBinding( "LPadRelY",             mProf.map.pad.l.rel_y );
-    GetBinding( "LPadTouch",            mProf.map.pad.l.touch );
-    GetBinding( "LPadPress",            mProf.map.pad.l.press );
-    GetBinding( "LPadForce",            mProf.map.pad.l.force );
-    GetBinding( "LPadPressQuadUp",      mProf.map.pad.l.btn_quad_up );
-    GetBinding( "LPadPressQuadDown",    mProf.map.pad.l.btn_quad_down );
-    GetBinding( "LPadPressQuadLeft",    mProf.map.pad.l.btn_quad_left );
-    GetBinding( "LPadPressQuadRight",   mProf.map.pad.l.btn_quad_right );
-    GetBinding( "LPadPressOrthUp",      mProf.map.pad.l.btn_orth_up );
-    GetBinding( "LPadPressOrthDown",    mProf.map.pad.l.btn_orth_down );
-    GetBinding( "LPadPressOrthLeft",    mProf.map.pad.l.btn_orth_left );
-    GetBinding( "LPadPressOrthRight",   mProf.map.pad.l.btn_orth_right );
-    GetBinding( "LPadPressGrid2x2_1",   mProf.map.pad.l.btn_2x2_1 );
-    GetBinding( "LPadPressGrid2x2_2",   mProf.map.pad.l.btn_2x2_2 );
-    GetBinding( "LPadPressGrid2x2_3",   mProf.map.pad.l.btn_2x2_3 );
-    GetBinding( "LPadPressGrid2x2_4",   mProf.map.pad.l.btn_2x2_4 );
-    GetBinding( "LPadPressGrid3x3_1",   mProf.map.pad.l.btn_3x3_1 );
-    GetBinding( "LPadPressGrid3x3_2",   mProf.map.pad.l.btn_3x3_2 );
-    GetBinding( "LPadPressGrid3x3_3",   mProf.map.pad.l.btn_3x3_3 );
-    GetBinding( "LPadPressGrid3x3_4",   mProf.map.pad.l.btn_3x3_4 );
-    GetBinding( "LPadPressGrid3x3_5",   mProf.map.pad.l.btn_3x3_5 );
-    GetBinding( "LPadPressGrid3x3_6",   mProf.map.pad.l.btn_3x3_6 );
-    GetBinding( "LPadPressGrid3x3_7",   mProf.map.pad.l.btn_3x3_7 );
-    GetBinding( "LPadPressGrid3x3_8",   mProf.map.pad.l.btn_3x3_8 );
-    GetBinding( "LPadPressGrid3x3_9",   mProf.map.pad.l.btn_3x3_9 );
-    // Right Touchpad
-    GetBinding( "RPadUp",               mProf.map.pad.r.up );
-    GetBinding( "RPadDown",             mProf.map.pad.r.down );
-    GetBinding( "RPadLeft",             mProf.map.pad.r.left );
-    GetBinding( "RPadRight",            mProf.map.pad.r.right );
-    GetBinding( "RPadRelX",             mProf.map.pad.r.rel_x );
-    GetBinding( "RPadRelY",             mProf.map.pad.r.rel_y );
-    GetBinding( "RPadTouch",            mProf.map.pad.r.touch );
-    GetBinding( "RPadPress",            mProf.map.pad.r.press );
-    GetBinding( "RPadForce",            mProf.map.pad.r.force );
-    GetBinding( "RPadPressQuadUp",      mProf.map.pad.l.btn_quad_up );
-    GetBinding( "RPadPressQuadDown",    mProf.map.pad.l.btn_quad_down );
-    GetBinding( "RPadPressQuadLeft",    mProf.map.pad.l.btn_quad_left );
-    GetBinding( "RPadPressQuadRight",   mProf.map.pad.l.btn_quad_right );
-    GetBinding( "RPadPressOrthUp",      mProf.map.pad.l.btn_orth_up );
-    GetBinding( "RPadPressOrthDown",    mProf.map.pad.l.btn_orth_down );
-    GetBinding( "RPadPressOrthLeft",    mProf.map.pad.l.btn_orth_left );
-    GetBinding( "RPadPressOrthRight",   mProf.map.pad.l.btn_orth_right );
-    GetBinding( "RPadPressGrid2x2_1",   mProf.map.pad.l.btn_2x2_1 );
-    GetBinding( "RPadPressGrid2x2_2",   mProf.map.pad.l.btn_2x2_2 );
-    GetBinding( "RPadPressGrid2x2_3",   mProf.map.pad.l.btn_2x2_3 );
-    GetBinding( "RPadPressGrid2x2_4",   mProf.map.pad.l.btn_2x2_4 );
-    GetBinding( "RPadPressGrid3x3_1",   mProf.map.pad.l.btn_3x3_1 );
-    GetBinding( "RPadPressGrid3x3_2",   mProf.map.pad.l.btn_3x3_2 );
-    GetBinding( "RPadPressGrid3x3_3",   mProf.map.pad.l.btn_3x3_3 );
-    GetBinding( "RPadPressGrid3x3_4",   mProf.map.pad.l.btn_3x3_4 );
-    GetBinding( "RPadPressGrid3x3_5",   mProf.map.pad.l.btn_3x3_5 );
-    GetBinding( "RPadPressGrid3x3_6",   mProf.map.pad.l.btn_3x3_6 );
-    GetBinding( "RPadPressGrid3x3_7",   mProf.map.pad.l.btn_3x3_7 );
-    GetBinding( "RPadPressGrid3x3_8",   mProf.map.pad.l.btn_3x3_8 );
-    GetBinding( "RPadPressGrid3x3_9",   mProf.map.pad.l.btn_3x3_9 );
-    // Acclerometers
-    GetBinding( "AccelXPlus",           mProf.map.accel.x_plus );
-    GetBinding( "AccelXMinus",          mProf.map.accel.x_minus );
-    GetBinding( "AccelYPlus",           mProf.map.accel.y_plus );
-    GetBinding( "AccelYMinus",          mProf.map.accel.y_minus );
-    GetBinding( "AccelZPlus",           mProf.map.accel.z_plus );
-    GetBinding( "AccelZMinus",          mProf.map.accel.z_minus );
-    // Gyro / Attitude
-    GetBinding( "RollPlus",             mProf.map.att.roll_plus );
-    GetBinding( "RollMinus",            mProf.map.att.roll_minus );
-    GetBinding( "PitchPlus",            mProf.map.att.pitch_plus );
-    GetBinding( "PitchMinus",           mProf.map.att.pitch_minus );
-    GetBinding( "YawPlus",              mProf.map.att.yaw_plus );
-    GetBinding( "YawMinus",             mProf.map.att.yaw_minus );
+    GetBindMap( "Bindings", mProf.map );
+    
+    // Each layer starts out with the base bindings and replaces what it lists
+    for (auto& name : mLayerNames)
+    {
+        BindMap         map = mProf.map;
+        
+        gLog.Write( Log::VERB, "Reading [Layer_" + name + "] section..." );
+        GetBindMap( "Layer_" + name, map );
+        mProf.layers.push_back( map );
+    }
 
     // Assign loaded profile to reference parameter
     rProf = mProf;
@@ -21,10 +21,13 @@
 #define __PROFILE_INI_HPP__
 
 #include "drivers/gamepad/profile.hpp"
+#include "drivers/gamepad/action_engine.hpp"
 #include "../common/ini.hpp"
 #include "../common/errors.hpp"
 // C++
 #include <filesystem>
+#include <string>
+#include <vector>
 
 
 // Class for loading gamepad profiles
@@ -33,6 +36,7 @@ class ProfileIni
 private:
     Drivers::Gamepad::Profile   mProf;
     Ini::IniFile                mIni;
+    std::vector<std::string>    mLayerNames;    // Layer number - 1 to name
 
     // Loading helper methods
     void                        AddKeyEvent( Drivers::Gamepad::BindType bindType, uint16_t code );
@@ -40,12 +44,19 @@ private:
     void                        AddRelEvent( Drivers::Gamepad::BindType bindType, uint16_t code );
     void                        GetFeatEnable( std::string key, bool& rValue );
     void                        GetDeviceInfo( std::string key, uint16_t& rVid, uint16_t& rPid, uint16_t& rVer, std::string& rName );
+    void                        GetOutputRate( std::string key, Uinput::OutputPolicy& rPolicy );
     void                        GetDeadzone( std::string key, double& rValue );
     void                        GetAxisRange( std::string section, std::string key, int32_t& rMin, int32_t& rMax, int32_t& rFuzz, int32_t& rRes );
-    void                        GetEventBinding( std::string key, Drivers::Gamepad::Binding& rBind );
-    void                        GetCommandBinding( std::string key, Drivers::Gamepad::Binding& rBind );
-    void                        GetProfileBinding( std::string key, Drivers::Gamepad::Binding& rBind );
-    void                        GetBinding( std::string key, Drivers::Gamepad::Binding& rBind );
+    void                        GetEventBinding( std::string section, std::string key, Drivers::Gamepad::Binding& rBind );
+    void                        ParseEventBinding( std::string key, Ini::ValVec val, Drivers::Gamepad::Binding& rBind );
+    void                        GetCommandBinding( std::string section, std::string key, Drivers::Gamepad::Binding& rBind );
+    void                        GetProfileBinding( std::string section, std::string key, Drivers::Gamepad::Binding& rBind );
+    void                        GetLayerBinding( std::string section, std::string key, Drivers::Gamepad::Binding& rBind );
+    int                         GetOutput( std::string key, Ini::ValVec& rVal, unsigned int first, Drivers::Gamepad::Binding& rBind );
+    int                         GetMacro( std::string name, Drivers::Gamepad::Action& rAction );
+    void                        GetActionBinding( std::string section, std::string key, Drivers::Gamepad::Binding& rBind );
+    void                        GetBinding( std::string section, std::string key, Drivers::Gamepad::Binding& rBind );
+    void                        GetBindMap( std::string section, Drivers::Gamepad::BindMap& rMap );
     
 public:
     int                         Load( std::filesystem::path filePath, Drivers::Gamepad::Profile& rProf );
@@ -41,7 +41,8 @@ const Drivers::Gamepad::Profile PROFILE_TEMPLATE =
         .mouse                      = true,
         .lizard                     = false,
         .filter_sticks              = true,
-        .filter_pads                = true
+        .filter_pads                = true,
+        .axis_merge                 = Drivers::Gamepad::AxisMerge::PRIORITY
     },
     .dz
     {
@@ -84,7 +85,8 @@ const Drivers::Gamepad::Profile PROFILE_TEMPLATE =
             {
                 // No relative axes are defined by default here.
                 // This section will be filled in by ProfileIni::Load()
-            }
+            },
+            .output                 = { .mode = Uinput::OutputMode::NATIVE, .hz = 0 }
         },
         .motion
         {
@@ -103,7 +105,8 @@ const Drivers::Gamepad::Profile PROFILE_TEMPLATE =
             .rel_list
             {
                 // No relative axes defined
-            }
+            },
+            .output                 = { .mode = Uinput::OutputMode::NATIVE, .hz = 0 }
         },
         .mouse
         {
@@ -135,7 +138,8 @@ const Drivers::Gamepad::Profile PROFILE_TEMPLATE =
                 REL_Y,
                 REL_WHEEL,
                 REL_HWHEEL
-            }
+            },
+            .output                 = { .mode = Uinput::OutputMode::NATIVE, .hz = 0 }
         }
     },
     .map
@@ -283,7 +287,10 @@ const Drivers::Gamepad::Profile PROFILE_TEMPLATE =
             .yaw_plus               = {},
             .yaw_minus              = {}
         }
-    }
+    },
+    // No alternate binding layers or actions
+    .layers                         = {},
+    .actions                        = {}
 }; // end profile
 
 
@@ -20,54 +20,217 @@
 #include "runner.hpp"
 #include "../common/log.hpp"
 // Linux
-#include "sys/wait.h"
+#include <signal.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+
+extern char**       environ;
+
+// How often children without a pidfd are checked on, in milliseconds
+const int           RUNNER_REAP_FALLBACK_MS = 100;
+const int           RUNNER_MAX_EVENTS = 8;
 
 // Global instance
 Runner gRunner;
 
 
-void Runner::Daemon()
+
+static int OpenPidFd( int pid )
+{
+#ifdef SYS_pidfd_open
+    return syscall( SYS_pidfd_open, pid, 0 );
+#else
+    (void)pid;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+
+
+void Runner::Spawn( const PendingCmd& rCmd )
+{
+    posix_spawnattr_t   attr;
+    sigset_t            sigs;
+    pid_t               pid;
+    int                 result;
+    const char*         argv[] = { "sh", "-c", rCmd.command.c_str(), nullptr };
+    
+    gLog.Write( Log::VERB, "Running command: '" + rCmd.command + "'..." );
+    
+    // Children should not inherit the daemon's blocked signals or ignored 
+    // dispositions
+    posix_spawnattr_init( &attr );
+    sigemptyset( &sigs );
+    posix_spawnattr_setsigmask( &attr, &sigs );
+    sigaddset( &sigs, SIGINT );
+    sigaddset( &sigs, SIGTERM );
+    sigaddset( &sigs, SIGHUP );
+    sigaddset( &sigs, SIGUSR2 );
+    sigaddset( &sigs, SIGPIPE );
+    posix_spawnattr_setsigdefault( &attr, &sigs );
+    posix_spawnattr_setflags( &attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF );
+    
+    // glibc implements posix_spawn with CLONE_VM | CLONE_VFORK, so the daemon's
+    // address space is never copied
+    result = posix_spawn( &pid, "/bin/sh", nullptr, &attr, (char* const*)argv, environ );
+    posix_spawnattr_destroy( &attr );
+    if (result != 0)
+    {
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to create child process: " + Err::GetErrnoString(result) );
+        gLog.Write( Log::WARN, "Failed to execute command binding because posix_spawn() did not succeed." );
+        return;
+    }
+    
+    ProcInfo        pi = { .pid = pid, .fd = OpenPidFd( pid ), .bid = rCmd.bid };
+    
+    if (pi.fd >= 0)
+    {
+        epoll_event     ev = {};
+        
+        ev.events = EPOLLIN;
+        ev.data.fd = pi.fd;
+        if (epoll_ctl( mEpollFd, EPOLL_CTL_ADD, pi.fd, &ev ) < 0)
+        {
+            close( pi.fd );
+            pi.fd = -1;
+        }
+    }
+    if (pi.fd < 0)
+        gLog.Write( Log::VERB, FUNC_NAME, "No pidfd for child process, falling back to timed reaping." );
+    
+    std::lock_guard<std::mutex>     lock( mCmdMutex );
+    mProcList.push_back( pi );
+    gLog.Write( Log::VERB, FUNC_NAME, "Child process created (" + std::to_string(pid) + ")." );
+}
+
+
+
+void Runner::Reap( bool untrackedOnly )
 {
     int             result;
     int             status;
     
+    std::lock_guard<std::mutex>     lock( mCmdMutex );
+    for (auto i = mProcList.begin(); i != mProcList.end();)
+    {
+        if (untrackedOnly && (i->fd >= 0))
+        {
+            ++i;
+            continue;
+        }
+        
+        result = waitpid( i->pid, &status, WNOHANG );
+        if (result < 0)
+        {
+            int e = errno;
+            gLog.Write( Log::DEBUG, FUNC_NAME, "Call to waitpid() failed: " + Err::GetErrnoString(e) );
+            gLog.Write( Log::WARN, "Failed to get status of child PID " + std::to_string(i->pid) );
+            ++i;
+        }
+        else
+        {
+            if (result > 0)
+            {
+                // Process has terminated so we can erase the element
+                gLog.Write( Log::VERB, FUNC_NAME, "Child process terminated (" + std::to_string(i->pid) + ")." );
+                if (i->fd >= 0)
+                {
+                    epoll_ctl( mEpollFd, EPOLL_CTL_DEL, i->fd, nullptr );
+                    close( i->fd );
+                }
+                i = mProcList.erase(i);
+            }
+            else
+            {
+                // If we don't delete the element, increment our iterator
+                ++i;
+            }
+        }
+    }
+}
+
+
+
+void Runner::Daemon()
+{
+    epoll_event     events[RUNNER_MAX_EVENTS];
+    int             count;
+    int             timeout;
+    uint64_t        val;
+    
     gLog.Write( Log::VERB, FUNC_NAME, "Starting runner thread." );
     
+    // This thread starts before main(), so it has to block the signals the
+    // daemon handles itself
+    sigset_t        sigs;
+    sigemptyset( &sigs );
+    sigaddset( &sigs, SIGINT );
+    sigaddset( &sigs, SIGTERM );
+    sigaddset( &sigs, SIGHUP );
+    sigaddset( &sigs, SIGUSR2 );
+    pthread_sigmask( SIG_BLOCK, &sigs, nullptr );
+    
     // Loop this thread
     while (mIsRunning)
     {
-        // Don't need to check too frequently
-        usleep( 100000 );
+        bool        untracked = false;
         
-        // Lock access to ProcList since Exec will be called by other threads
-        std::lock_guard<std::mutex>     lock( mCmdMutex );
-        if (mProcList.size())
+        // Only wake on a timer if a child couldn't be given a pidfd
         {
-            // Loop through list of PIDs and delete entries which have 
-            for (auto i = mProcList.begin(); i != mProcList.end();)
+            std::lock_guard<std::mutex>     lock( mCmdMutex );
+            for (auto& i : mProcList)
+                if (i.fd < 0)
+                    untracked = true;
+        }
+        timeout = untracked ? RUNNER_REAP_FALLBACK_MS : -1;
+        
+        count = epoll_wait( mEpollFd, events, RUNNER_MAX_EVENTS, timeout );
+        if (count < 0)
+        {
+            int e = errno;
+            if (e == EINTR)
+                continue;
+            gLog.Write( Log::DEBUG, FUNC_NAME, "epoll_wait failed: " + Err::GetErrnoString(e) );
+            break;
+        }
+        
+        if (untracked)
+            Reap( true );
+        
+        for (int i = 0; i < count; ++i)
+        {
+            if (events[i].data.fd == mWakeFd)
             {
-                result = waitpid( i->pid, &status, WNOHANG );
-                if (result < 0)
+                std::vector<PendingCmd>     cmds;
+                
+                if (read( mWakeFd, &val, sizeof(val) ) < 0)
+                    gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to read wake event." );
+                
+                // Spawn without holding the lock so Exec() never waits on it.
+                // Commands stay in the pending list until their PID is tracked
+                // so a repeated binding can't slip in between.
                 {
-                    int e = errno;
-                    gLog.Write( Log::DEBUG, FUNC_NAME, "Call to waitpid() failed: " + Err::GetErrnoString(e) );
-                    gLog.Write( Log::WARN, "Failed to get status of child PID " + std::to_string(i->pid) );
+                    std::lock_guard<std::mutex>     lock( mCmdMutex );
+                    cmds = mPending;
                 }
-                else
+                for (auto& c : cmds)
+                    Spawn( c );
                 {
-                    if (result > 0)
-                    {
-                        // Process has terminated so we can erase the element
-                        gLog.Write( Log::VERB, FUNC_NAME, "Child process terminated (" + std::to_string(i->pid) + ")." );
-                        i = mProcList.erase(i);
-                    }
-                    else
-                    {
-                        // If we don't delete the element, increment our iterator
-                        ++i;
-                    }
+                    std::lock_guard<std::mutex>     lock( mCmdMutex );
+                    mPending.erase( mPending.begin(), mPending.begin() + cmds.size() );
                 }
-            }  
+            }
+            else
+            {
+                // A pidfd became readable
+                Reap( false );
+            }
         }
     }
     
@@ -79,7 +242,7 @@ void Runner::Daemon()
 
 int Runner::Exec( std::string command, uint32_t bindingId )
 {
-    int             result;
+    uint64_t        val = 1;
     
     if (!mIsRunning)
     {
@@ -98,37 +261,23 @@ int Runner::Exec( std::string command, uint32_t bindingId )
     
     // If binding ID is non-zero, prevent command from running if there's already and active pid
     if (bindingId)
-        for (auto i : mProcList)
+    {
+        for (auto& i : mProcList)
+            if (i.bid == bindingId)
+                return Err::ALREADY_OPEN;
+        for (auto& i : mPending)
             if (i.bid == bindingId)
                 return Err::ALREADY_OPEN;
-
-    gLog.Write( Log::VERB, "Running command: '" + command + "'..." );
-    
-    result = fork();
-    if (result == 0)
-    {
-        // Child process
-        
-        // Execute command and terminate child process
-        execl("/bin/sh", "sh", "-c", command.c_str(), (char*)0);
-        exit(0);
-    }
-    else if (result > 0)
-    {
-        // Parent process
-        
-        // Add bid/pid to list
-        ProcInfo        pi = { .pid = result, .bid = bindingId };
-        mProcList.push_back(pi);
-        gLog.Write( Log::VERB, FUNC_NAME, "Child process created (" + std::to_string(result) + ")." );
     }
-    else if (result < 0)
+    
+    // Hand the command to the runner thread
+    mPending.push_back( { .command = command, .bid = bindingId } );
+    if (write( mWakeFd, &val, sizeof(val) ) < 0)
     {
-        // fork() error
         int e = errno;
-        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to create child process: " + Err::GetErrnoString(e) );
-        gLog.Write( Log::WARN, "Failed to execute command binding because fork() did not succeed." );
-        return Err::CANNOT_CREATE;
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to wake runner thread: " + Err::GetErrnoString(e) );
+        mPending.pop_back();
+        return Err::WRITE_FAILED;
     }
     
     return Err::OK;
@@ -138,6 +287,21 @@ int Runner::Exec( std::string command, uint32_t bindingId )
 
 Runner::Runner()
 {
+    epoll_event     ev = {};
+    
+    mEpollFd = epoll_create1( EPOLL_CLOEXEC );
+    mWakeFd  = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+    if ((mEpollFd < 0) || (mWakeFd < 0))
+    {
+        // Exec() refuses to run commands when the thread isn't running
+        mIsRunning = false;
+        return;
+    }
+    
+    ev.events = EPOLLIN;
+    ev.data.fd = mWakeFd;
+    epoll_ctl( mEpollFd, EPOLL_CTL_ADD, mWakeFd, &ev );
+    
     mIsRunning = true;
     mThread = std::thread( &Runner::Daemon, this );
 }
@@ -146,8 +310,15 @@ Runner::Runner()
 
 Runner::~Runner()
 {
+    uint64_t        val = 1;
+    
     mIsRunning = false;
-    mThread.join();
+    if (mThread.joinable())
+    {
+        if (write( mWakeFd, &val, sizeof(val) ) < 0)
+            gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to wake runner thread." );
+        mThread.join();
+    }
     
     if (!mProcList.empty())
     {
@@ -162,6 +333,15 @@ Runner::~Runner()
         
         // Wait for all child processes to exit
         for (auto& i : mProcList)
+        {
             waitpid( i.pid, &status, 0 );
+            if (i.fd >= 0)
+                close( i.fd );
+        }
     }
-}
\ No newline at end of file
+    
+    if (mEpollFd >= 0)
+        close( mEpollFd );
+    if (mWakeFd >= 0)
+        close( mWakeFd );
+}
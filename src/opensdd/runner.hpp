@@ -22,7 +22,9 @@
 
 #include "../common/errors.hpp"
 // C++
+#include <atomic>
 #include <thread>
+#include <mutex>
 #include <string>
 #include <cstdint>
 #include <vector>
@@ -34,6 +36,13 @@ private:
     struct ProcInfo
     {
         int                 pid;    // Process ID
+        int                 fd;     // pidfd, or -1 if the kernel doesn't support them
+        uint32_t            bid;    // binding ID
+    };
+    
+    struct PendingCmd
+    {
+        std::string         command;
         uint32_t            bid;    // binding ID
     };
     
@@ -41,7 +50,12 @@ private:
     std::thread             mThread;
     std::mutex              mCmdMutex;
     std::vector<ProcInfo>   mProcList;
+    std::vector<PendingCmd> mPending;       // Queued by Exec(), spawned by the runner thread
+    int                     mEpollFd;
+    int                     mWakeFd;
     
+    void                    Spawn( const PendingCmd& rCmd );
+    void                    Reap( bool untrackedOnly );
     void                    Daemon();
     
 public:
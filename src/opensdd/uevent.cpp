@@ -0,0 +1,316 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//  OpenSD
+//  An open-source userspace driver for Valve's Steam Deck hardware
+//
+//  Copyright 2022 seek
+//  https://gitlab.com/open-sd/opensd
+//  Licensed under the GNU GPLv3+
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the 
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of 
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; 
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. 
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with this program. 
+//  If not, see <https://www.gnu.org/licenses/>.             
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#include "uevent.hpp"
+#include "../common/log.hpp"
+// Linux
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+// C++
+#include <cstring>
+#include <chrono>
+
+
+// Kernel uevents are limited to a few kilobytes
+const size_t        UEVENT_BUFFER_SIZE = 8192;
+// Receive buffer for bursts of events, i.e. resuming with many devices attached
+const int           UEVENT_RCVBUF_SIZE = 256 * 1024;
+
+
+
+int UeventMonitor::Open()
+{
+    sockaddr_nl         addr = {};
+    int                 fd;
+    int                 size = UEVENT_RCVBUF_SIZE;
+    
+    if (IsOpen())
+    {
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Uevent monitor is already open." );
+        return Err::ALREADY_OPEN;
+    }
+    
+    fd = socket( AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT );
+    if (fd < 0)
+    {
+        int e = errno;
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to create netlink socket: " + Err::GetErrnoString(e) );
+        return Err::CANNOT_OPEN;
+    }
+    
+    setsockopt( fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size) );
+    
+    // Group 1 is raw kernel events.  These arrive before udev has processed
+    // the device, so the node may not have its final permissions yet.
+    addr.nl_family  = AF_NETLINK;
+    addr.nl_pid     = 0;
+    addr.nl_groups  = 1;
+    if (bind( fd, (sockaddr*)&addr, sizeof(addr) ) < 0)
+    {
+        int e = errno;
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to bind netlink socket: " + Err::GetErrnoString(e) );
+        close( fd );
+        return Err::CANNOT_OPEN;
+    }
+    
+    mFd     = fd;
+    mOwnFd  = true;
+    
+    return Err::OK;
+}
+
+
+
+int UeventMonitor::Open( int fd )
+{
+    if (IsOpen())
+    {
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Uevent monitor is already open." );
+        return Err::ALREADY_OPEN;
+    }
+    
+    if (fd < 0)
+        return Err::INVALID_PARAMETER;
+    
+    mFd     = fd;
+    mOwnFd  = false;
+    
+    return Err::OK;
+}
+
+
+
+void UeventMonitor::Close()
+{
+    if (mOwnFd && (mFd >= 0))
+        close( mFd );
+    
+    mFd     = -1;
+    mOwnFd  = false;
+}
+
+
+
+bool UeventMonitor::IsOpen()
+{
+    return (mFd >= 0);
+}
+
+
+
+int UeventMonitor::GetFd()
+{
+    return mFd;
+}
+
+
+
+int UeventMonitor::Read( Uevent& rEvent )
+{
+    char                buff[UEVENT_BUFFER_SIZE];
+    ssize_t             result;
+    
+    if (!IsOpen())
+        return Err::NOT_OPEN;
+    
+    result = recv( mFd, buff, sizeof(buff), MSG_DONTWAIT );
+    if (result < 0)
+    {
+        int e = errno;
+        if ((e == EAGAIN) || (e == EWOULDBLOCK))
+            return Err::EMPTY;
+        
+        // ENOBUFS means events were lost.  The caller should rescan.
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Failed to receive uevent: " + Err::GetErrnoString(e) );
+        return Err::READ_FAILED;
+    }
+    
+    return Parse( buff, result, rEvent );
+}
+
+
+
+int UeventMonitor::Parse( const char* pBuff, size_t length, Uevent& rEvent )
+{
+    size_t              pos;
+    const char*         at;
+    
+    rEvent = {};
+    
+    if ((pBuff == nullptr) || (!length))
+        return Err::EMPTY;
+    
+    // Header is "action@devpath".  Anything else (i.e. udev's own messages)
+    // is ignored.
+    at = (const char*)memchr( pBuff, '@', strnlen( pBuff, length ) );
+    if (at == nullptr)
+        return Err::INVALID_FORMAT;
+    rEvent.action.assign( pBuff, at - pBuff );
+    
+    pos = strnlen( pBuff, length ) + 1;
+    while (pos < length)
+    {
+        std::string     line( pBuff + pos, strnlen( pBuff + pos, length - pos ) );
+        
+        pos += line.size() + 1;
+        if (line.starts_with( "SUBSYSTEM=" ))
+            rEvent.subsystem = line.substr( 10 );
+        else if (line.starts_with( "DEVNAME=" ))
+            rEvent.devname = line.substr( 8 );
+        else if (line.starts_with( "DEVPATH=" ))
+            rEvent.devpath = line.substr( 8 );
+        else if (line.starts_with( "ACTION=" ))
+            rEvent.action = line.substr( 7 );
+    }
+    
+    return Err::OK;
+}
+
+
+
+UeventMonitor::UeventMonitor()
+{
+    mFd     = -1;
+    mOwnFd  = false;
+}
+
+
+
+UeventMonitor::~UeventMonitor()
+{
+    Close();
+}
+
+
+
+static double NowSec()
+{
+    return std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+
+void HotplugWatch::Configure( const std::string& rSubsystem, double retrySec, double windowSec, double rescanSec )
+{
+    mSubsystem  = rSubsystem;
+    mRetrySec   = retrySec;
+    mWindowSec  = windowSec;
+    mRescanSec  = rescanSec;
+    mRetryUntil = 0;
+}
+
+
+
+int HotplugWatch::Open()
+{
+    return mMonitor.Open();
+}
+
+
+
+int HotplugWatch::Open( int fd )
+{
+    return mMonitor.Open( fd );
+}
+
+
+
+void HotplugWatch::Close()
+{
+    mMonitor.Close();
+}
+
+
+
+bool HotplugWatch::IsOpen()
+{
+    return mMonitor.IsOpen();
+}
+
+
+
+bool HotplugWatch::Wait()
+{
+    pollfd          pfd = { .fd = mMonitor.GetFd(), .events = POLLIN, .revents = 0 };
+    Uevent          ev;
+    double          wait;
+    int             result;
+    bool            scan = false;
+    
+    wait = (NowSec() < mRetryUntil) ? mRetrySec : mRescanSec;
+    
+    if (mMonitor.IsOpen())
+    {
+        result = poll( &pfd, 1, wait * 1000 );
+        if (result < 0)
+        {
+            int e = errno;
+            if (e != EINTR)
+                gLog.Write( Log::DEBUG, FUNC_NAME, "Error while waiting for uevents: " + Err::GetErrnoString(e) );
+            return false;
+        }
+        scan = (result == 0);
+    }
+    else
+    {
+        usleep( wait * 1000000 );
+        scan = true;
+    }
+    
+    // Look for nodes being added
+    while (true)
+    {
+        result = mMonitor.Read( ev );
+        if ((result == Err::EMPTY) || (result == Err::NOT_OPEN))
+            break;
+        if (result == Err::READ_FAILED)
+        {
+            // Events were probably dropped
+            scan = true;
+            break;
+        }
+        if ((result == Err::OK) && (ev.subsystem == mSubsystem) && (ev.action == "add"))
+        {
+            gLog.Write( Log::DEBUG, FUNC_NAME, mSubsystem + " device added: '" + ev.devname + "'." );
+            mRetryUntil = NowSec() + mWindowSec;
+            scan = true;
+        }
+    }
+    
+    return scan;
+}
+
+
+
+void HotplugWatch::Attached()
+{
+    mRetryUntil = 0;
+}
+
+
+
+HotplugWatch::HotplugWatch()
+{
+    mRetrySec   = 0;
+    mWindowSec  = 0;
+    mRescanSec  = 0;
+    mRetryUntil = 0;
+}
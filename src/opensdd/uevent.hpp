@@ -0,0 +1,101 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//  OpenSD
+//  An open-source userspace driver for Valve's Steam Deck hardware
+//
+//  Copyright 2022 seek
+//  https://gitlab.com/open-sd/opensd
+//  Licensed under the GNU GPLv3+
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the 
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of 
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; 
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. 
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with this program. 
+//  If not, see <https://www.gnu.org/licenses/>.             
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#ifndef __UEVENT_HPP__
+#define __UEVENT_HPP__
+
+#include "../common/errors.hpp"
+// C++
+#include <string>
+
+
+// A single kernel uevent.  Only the fields we care about are kept.
+struct Uevent
+{
+    std::string             action;         // add, remove, change, bind, ...
+    std::string             subsystem;      // i.e. hidraw
+    std::string             devname;        // Device node name relative to /dev, i.e. hidraw3
+    std::string             devpath;        // sysfs path relative to /sys
+};
+
+
+// Listens for kernel uevents on a NETLINK_KOBJECT_UEVENT socket.  Any other
+// datagram socket carrying messages in the same format can be attached 
+// instead, which allows hotplug handling to be exercised without real
+// hardware.
+class UeventMonitor
+{
+private:
+    int                     mFd;
+    bool                    mOwnFd;
+
+public:
+    // Opens a netlink socket subscribed to kernel uevents
+    int                     Open();
+    // Uses an existing socket instead of netlink.  Ownership is not taken.
+    int                     Open( int fd );
+    void                    Close();
+    bool                    IsOpen();
+    int                     GetFd();
+    
+    // Non-blocking.  Returns Err::EMPTY if there is no pending event.
+    int                     Read( Uevent& rEvent );
+    
+    // Parses a raw "action@devpath\0KEY=VALUE\0..." message
+    static int              Parse( const char* pBuff, size_t length, Uevent& rEvent );
+    
+    UeventMonitor();
+    ~UeventMonitor();
+};
+
+
+// Paces the search for a device that went away.  An "add" uevent for the 
+// subsystem starts a short window of fast retries, since the new node may not
+// be usable until udev is done with it.  Otherwise, or without uevents, the
+// caller rescans at a slow rate.
+class HotplugWatch
+{
+private:
+    UeventMonitor           mMonitor;
+    std::string             mSubsystem;
+    double                  mRetrySec;          // Between attempts after an add event
+    double                  mWindowSec;         // How long to keep retrying after an add event
+    double                  mRescanSec;         // Between attempts otherwise
+    double                  mRetryUntil;        // Retry quickly until this time
+
+public:
+    int                     Open();
+    // Uses an existing socket instead of netlink.  Ownership is not taken.
+    int                     Open( int fd );
+    void                    Close();
+    bool                    IsOpen();
+    // Must be called before Wait()
+    void                    Configure( const std::string& rSubsystem, double retrySec, double windowSec, double rescanSec );
+    
+    // Blocks for up to one retry or rescan interval.  Returns true when the
+    // caller should look for the device.
+    bool                    Wait();
+    // The device was found, go back to rescanning slowly
+    void                    Attached();
+    
+    HotplugWatch();
+};
+
+
+#endif // __UEVENT_HPP__
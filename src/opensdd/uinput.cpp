@@ -19,13 +19,15 @@
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 #include "uinput.hpp"
 #include "../common/log.hpp"
+#include "../common/trace.hpp"
 #include <sys/stat.h>
-#include <sys/uio.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <unistd.h>
 #include <cstring>
 #include <cmath>
+#include <chrono>
+#include <algorithm>
 
 
 int Uinput::Device::Open( std::string deviceName )
@@ -56,7 +58,7 @@ int Uinput::Device::Open( std::string deviceName )
     }
 
     // Check if uinput can be opened
-    mFd = open( uinput_path.c_str(), O_RDWR | O_NONBLOCK );
+    mFd = open( uinput_path.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC );
     if (mFd < 0)
     {
         int e = errno;
@@ -89,11 +91,8 @@ void Uinput::Device::Close()
 
 bool Uinput::Device::IsOpen()
 {
-    if (mFd > 0)
-        if (fcntl( mFd, F_GETFD) >= 0)
-            return true;
-
-    return false;
+    // Close() resets the fd, so there is no need to ask the kernel
+    return (mFd > 0);
 }
 
 
@@ -276,11 +275,41 @@ int Uinput::Device::EnableRel( uint16_t code )
     evinfo.min          = 0;
     mEvBuff.rel[code]   = evinfo;
 
+#ifdef REL_WHEEL_HI_RES
+    // Scroll wheels get a matching high-resolution axis so applications that
+    // support it can scroll smoothly.  The low-res wheel is still emitted for
+    // everything else.
+    if ((code == REL_WHEEL) && (!mEvBuff.rel.count(REL_WHEEL_HI_RES)))
+        EnableRel( REL_WHEEL_HI_RES );
+    if ((code == REL_HWHEEL) && (!mEvBuff.rel.count(REL_HWHEEL_HI_RES)))
+        EnableRel( REL_HWHEEL_HI_RES );
+#endif // REL_WHEEL_HI_RES
+
     return Err::OK;
 }
 
 
 
+std::vector<uint16_t> Uinput::Device::GetRelList( const Uinput::DeviceConfig& rCfg )
+{
+    std::vector<uint16_t>   list = rCfg.rel_list;
+    
+#ifdef REL_WHEEL_HI_RES
+    // Must match what EnableRel() adds for the scroll wheels
+    for (auto&& i : rCfg.rel_list)
+    {
+        uint16_t    hi_res = (i == REL_WHEEL) ? REL_WHEEL_HI_RES : (i == REL_HWHEEL) ? REL_HWHEEL_HI_RES : 0;
+        
+        if (hi_res && (std::find( list.begin(), list.end(), hi_res ) == list.end()))
+            list.push_back( hi_res );
+    }
+#endif // REL_WHEEL_HI_RES
+
+    return list;
+}
+
+
+
 int Uinput::Device::EnableFF()
 {
     int             result;
@@ -305,107 +334,20 @@ int Uinput::Device::EnableFF()
         gLog.Write( Log::WARN, FUNC_NAME, "Failed to enable FF_RUMBLE effect for '" + mDeviceName + "'." );
     }
     
-    // TODO: Enable full FF support
-    /*
-    result = ioctl( mFd, UI_SET_FFBIT, FF_CONSTANT );
-    if (result < 0)
+    // Additional effects are handled in software by the driver.  Condition
+    // effects (spring, friction, etc.) have no meaning for vibration motors
+    // and are left disabled.
+    for (auto&& i : { FF_CONSTANT, FF_PERIODIC, FF_SQUARE, FF_TRIANGLE, FF_SINE, FF_SAW_UP, FF_SAW_DOWN, FF_GAIN })
     {
-        int e = errno;
-        gLog.Write( Log::DEBUG, FUNC_NAME, "ioctl error: " + Err::GetErrnoString(e) + " for '" + mDeviceName + "'." );
-        gLog.Write( Log::WARN, FUNC_NAME, "Failed to enable FF_CONSTANT effect for '" + mDeviceName + "'." );
-    }
-    
-    result = ioctl( mFd, UI_SET_FFBIT, FF_PERIODIC );
-    if (result < 0)
-    {
-        int e = errno;
-        gLog.Write( Log::DEBUG, FUNC_NAME, "ioctl error: " + Err::GetErrnoString(e) + " for '" + mDeviceName + "'." );
-        gLog.Write( Log::WARN, FUNC_NAME, "Failed to enable FF_PERIODIC effect for '" + mDeviceName + "'." );
-    }
-    else
-    {
-        result = ioctl( mFd, UI_SET_FFBIT, FF_SQUARE );
-        if (result < 0)
-        {
-            int e = errno;
-            gLog.Write( Log::DEBUG, FUNC_NAME, "ioctl error: " + Err::GetErrnoString(e) + " for '" + mDeviceName + "'." );
-            gLog.Write( Log::WARN, FUNC_NAME, "Failed to enable FF_SQUARE effect for '" + mDeviceName + "'." );
-        }
-
-        result = ioctl( mFd, UI_SET_FFBIT, FF_TRIANGLE );
-        if (result < 0)
-        {
-            int e = errno;
-            gLog.Write( Log::DEBUG, FUNC_NAME, "ioctl error: " + Err::GetErrnoString(e) + " for '" + mDeviceName + "'." );
-            gLog.Write( Log::WARN, FUNC_NAME, "Failed to enable FF_TRIANGLE effect for '" + mDeviceName + "'." );
-        }
-
-        result = ioctl( mFd, UI_SET_FFBIT, FF_SINE );
-        if (result < 0)
-        {
-            int e = errno;
-            gLog.Write( Log::DEBUG, FUNC_NAME, "ioctl error: " + Err::GetErrnoString(e) + " for '" + mDeviceName + "'." );
-            gLog.Write( Log::WARN, FUNC_NAME, "Failed to enable FF_SINE effect for '" + mDeviceName + "'." );
-        }
-        
-        result = ioctl( mFd, UI_SET_FFBIT, FF_SAW_UP );
-        if (result < 0)
-        {
-            int e = errno;
-            gLog.Write( Log::DEBUG, FUNC_NAME, "ioctl error: " + Err::GetErrnoString(e) + " for '" + mDeviceName + "'." );
-            gLog.Write( Log::WARN, FUNC_NAME, "Failed to enable FF_SAW_UP effect for '" + mDeviceName + "'." );
-        }
-        
-        result = ioctl( mFd, UI_SET_FFBIT, FF_SAW_DOWN );
+        result = ioctl( mFd, UI_SET_FFBIT, i );
         if (result < 0)
         {
             int e = errno;
             gLog.Write( Log::DEBUG, FUNC_NAME, "ioctl error: " + Err::GetErrnoString(e) + " for '" + mDeviceName + "'." );
-            gLog.Write( Log::WARN, FUNC_NAME, "Failed to enable FF_SAW_DOWN effect for '" + mDeviceName + "'." );
+            gLog.Write( Log::WARN, FUNC_NAME, "Failed to enable FF effect (" + std::to_string(i) + ") for '" + mDeviceName + "'." );
         }
-
-        result = ioctl( mFd, UI_SET_FFBIT, FF_CUSTOM );
-        if (result < 0)
-        {
-            int e = errno;
-            gLog.Write( Log::DEBUG, FUNC_NAME, "ioctl error: " + Err::GetErrnoString(e) + " for '" + mDeviceName + "'." );
-            gLog.Write( Log::WARN, FUNC_NAME, "Failed to enable FF_CUSTOM effect for '" + mDeviceName + "'." );
-        }
-    }
-    
-    result = ioctl( mFd, UI_SET_FFBIT, FF_RAMP );
-    if (result < 0)
-    {
-        int e = errno;
-        gLog.Write( Log::DEBUG, FUNC_NAME, "ioctl error: " + Err::GetErrnoString(e) + " for '" + mDeviceName + "'." );
-        gLog.Write( Log::WARN, FUNC_NAME, "Failed to enable FF_RAMP effect for '" + mDeviceName + "'." );
-    }
-
-    result = ioctl( mFd, UI_SET_FFBIT, FF_SPRING );
-    if (result < 0)
-    {
-        int e = errno;
-        gLog.Write( Log::DEBUG, FUNC_NAME, "ioctl error: " + Err::GetErrnoString(e) + " for '" + mDeviceName + "'." );
-        gLog.Write( Log::WARN, FUNC_NAME, "Failed to enable FF_SPRING effect for '" + mDeviceName + "'." );
-    }
-
-    result = ioctl( mFd, UI_SET_FFBIT, FF_FRICTION );
-    if (result < 0)
-    {
-        int e = errno;
-        gLog.Write( Log::DEBUG, FUNC_NAME, "ioctl error: " + Err::GetErrnoString(e) + " for '" + mDeviceName + "'." );
-        gLog.Write( Log::WARN, FUNC_NAME, "Failed to enable FF_SPRING effect for '" + mDeviceName + "'." );
     }
 
-    result = ioctl( mFd, UI_SET_FFBIT, FF_GAIN );
-    if (result < 0)
-    {
-        int e = errno;
-        gLog.Write( Log::DEBUG, FUNC_NAME, "ioctl error: " + Err::GetErrnoString(e) + " for '" + mDeviceName + "'." );
-        gLog.Write( Log::WARN, FUNC_NAME, "Failed to enable FF_GAIN effect for '" + mDeviceName + "'." );
-    }
-    */
-
     return Err::OK;
 }
 
@@ -427,7 +369,7 @@ int Uinput::Device::Create( std::string deviceName, uint16_t vid, uint16_t pid,
     dev_info.id.product     = pid;
     dev_info.id.version     = ver;
     if (mFFEnabled)
-        dev_info.ff_effects_max = 16;
+        dev_info.ff_effects_max = FF_EFFECTS_MAX;
     
     if (!IsOpen())
     {
@@ -469,7 +411,9 @@ int Uinput::Device::Create( std::string deviceName, uint16_t vid, uint16_t pid,
 
 int Uinput::Device::UpdateKey( uint16_t code, bool value )
 {
-    if (!mEvBuff.key.count(code))
+    auto                info = mEvBuff.key.find( code );
+    
+    if (info == mEvBuff.key.end())
     {
         gLog.Write( Log::DEBUG, FUNC_NAME, "Key code (" + std::to_string(code) + ") is not mapped to buffer. " );
         gLog.Write( Log::WARN, "Attemped to update unmapped key for '" + mDeviceName + "'." );
@@ -480,8 +424,9 @@ int Uinput::Device::UpdateKey( uint16_t code, bool value )
     // buttons being bound to the same key event, we use OR logic
     if (!value)
         return Err::OK;
-    else
-        mEvBuff.key[code].ev.value = 1;
+    
+    info->second.ev.value = 1;
+    Touch( &info->second );
     
     return Err::OK;
 }
@@ -490,7 +435,9 @@ int Uinput::Device::UpdateKey( uint16_t code, bool value )
 
 int Uinput::Device::UpdateAbs( uint16_t code, double value )
 {
-    if (!mEvBuff.abs.count(code))
+    auto                info = mEvBuff.abs.find( code );
+    
+    if (info == mEvBuff.abs.end())
     {
         gLog.Write( Log::DEBUG, FUNC_NAME, "Abs code (" + std::to_string(code) + ") is not mapped to buffer. " );
         gLog.Write( Log::WARN, "Attemped to update unmapped absolute axis for '" + mDeviceName + "'." );
@@ -499,10 +446,33 @@ int Uinput::Device::UpdateAbs( uint16_t code, double value )
     
     // Values are already zeroed after being written and in the event of multiple
     // axes being bound to the same abs event, we use the first non-zero value 
-    // written to the buffer.  This is implemented for split axis mapping.
-    if ((!value) || (mEvBuff.key[code].ev.value != 0))
+    // written to the buffer.  The gamepad driver combines its bindings itself 
+    // and uses SetAbs() instead.
+    if ((!value) || (info->second.ev.value != 0))
         return Err::OK;
     
+    SetAbs( &info->second, value );
+    
+    return Err::OK;
+}
+
+
+
+Uinput::EventInfo* Uinput::Device::GetAbsInfo( uint16_t code )
+{
+    auto                info = mEvBuff.abs.find( code );
+    
+    // Map nodes never move, so the pointer stays good
+    if (info == mEvBuff.abs.end())
+        return nullptr;
+    
+    return &info->second;
+}
+
+
+
+void Uinput::Device::SetAbs( EventInfo* pInfo, double value )
+{
     // Clamp float
     if (value < -1.0)
         value = -1.0;
@@ -512,36 +482,72 @@ int Uinput::Device::UpdateAbs( uint16_t code, double value )
         
     // Multiply normalized value to what was defined in uinput
     if (value > 0)
-        mEvBuff.abs[code].ev.value = fabs(value) * mEvBuff.abs[code].max;
+        pInfo->ev.value = fabs(value) * pInfo->max;
     else
-        mEvBuff.abs[code].ev.value = fabs(value) * mEvBuff.abs[code].min;
+        pInfo->ev.value = fabs(value) * pInfo->min;
     
-    return Err::OK;
+    Touch( pInfo );
 }
 
 
 
 int Uinput::Device::UpdateRel( uint16_t code, int32_t value )
 {
-    if (!mEvBuff.rel.count(code))
+    if (!value)
+        return Err::OK;
+    
+#ifdef REL_WHEEL_HI_RES
+    // High-resolution scroll values also generate legacy wheel detents once
+    // enough of them have accumulated
+    if ((code == REL_WHEEL_HI_RES) || (code == REL_HWHEEL_HI_RES))
+    {
+        uint16_t        lo_code = (code == REL_WHEEL_HI_RES) ? REL_WHEEL : REL_HWHEEL;
+        int32_t&        rem     = (code == REL_WHEEL_HI_RES) ? mWheelRem : mHWheelRem;
+        int32_t         detents;
+        
+        if (!mEvBuff.rel.count(lo_code))
+        {
+            gLog.Write( Log::DEBUG, FUNC_NAME, "Rel code (" + std::to_string(lo_code) + ") is not mapped to buffer. " );
+            gLog.Write( Log::WARN, "Attemped to update unmapped relative axis for '" + mDeviceName + "'." );
+            return Err::NOT_FOUND;
+        }
+        
+        rem     += value;
+        detents  = rem / REL_HI_RES_PER_DETENT;
+        rem     -= detents * REL_HI_RES_PER_DETENT;
+        
+        // Hi-res axis may have failed to enable
+        auto    hi_res = mEvBuff.rel.find( code );
+        if (hi_res != mEvBuff.rel.end())
+        {
+            hi_res->second.ev.value += value;
+            Touch( &hi_res->second );
+        }
+        if (detents)
+        {
+            EventInfo&      lo_res = mEvBuff.rel[lo_code];
+            
+            lo_res.ev.value += detents;
+            Touch( &lo_res );
+        }
+        
+        return Err::OK;
+    }
+#endif // REL_WHEEL_HI_RES
+    
+    auto                info = mEvBuff.rel.find( code );
+    
+    if (info == mEvBuff.rel.end())
     {
         gLog.Write( Log::DEBUG, FUNC_NAME, "Rel code (" + std::to_string(code) + ") is not mapped to buffer. " );
         gLog.Write( Log::WARN, "Attemped to update unmapped relative axis for '" + mDeviceName + "'." );
         return Err::NOT_FOUND;
     }
     
-    // Values are already zeroed after being written and in the event of multiple
-    // axes being bound to the same rel event, use use the first non-zero value
-    // that gets sent to the buffer
-    if (!value)
-        return Err::OK;
-    
-    if (mEvBuff.rel[code].ev.value)
-        return Err::OK;
-        
-    mEvBuff.rel[code].ev.value = value;
-    
-    // TODO:  There's no way this will work well
+    // Values are zeroed after being written.  Relative motion is additive, so
+    // multiple inputs bound to the same rel event are summed.
+    info->second.ev.value += value;
+    Touch( &info->second );
     
     return Err::OK;
 }
@@ -638,75 +644,217 @@ int Uinput::Device::Configure( const Uinput::DeviceConfig& rCfg )
 
 
 
-int Uinput::Device::Flush()
+int Uinput::Device::Collect( std::vector<input_event>& rEvents, bool force )
 {
-    int                         result;
-    std::vector<iovec>          iov;
-    iovec                       iov_data;
+    bool                keys = false;       // A key changed since the last write
+    bool                axes = false;       // An axis changed or relative motion is waiting
+    uint64_t            now = 0;
+    input_event         ev = {};
+    
     
-
     if (!IsOpen())
     {
         gLog.Write( Log::DEBUG, FUNC_NAME, "Device is not open for '" + mDeviceName + "'." );
-        gLog.Write( Log::ERROR, "Failed to write uinput: Device not open." );
         return Err::NOT_OPEN;
     }
+    
+    // Anything that changed was either updated this frame, or was set last
+    // time and has dropped back to zero
+    for (auto p : mDirty)
+    {
+        if (p->ev.type == EV_REL)
+            axes |= (p->ev.value != 0);
+        else
+            if (p->ev.value != p->last)
+            {
+                keys |= (p->ev.type == EV_KEY);
+                axes |= (p->ev.type == EV_ABS);
+            }
+    }
+    for (auto p : mActive)
+    {
+        if (!p->dirty)
+        {
+            keys |= (p->ev.type == EV_KEY);
+            axes |= (p->ev.type == EV_ABS);
+        }
+    }
 
-    iov_data.iov_len = sizeof(input_event);
-
-    // loop through lists of events and add them to an iovector to write out
-    for (auto&& i : mEvBuff.key )
+    if (mOutput.mode != OutputMode::NATIVE)
+    {
+        if ((!keys) && (!axes))
+        {
+            ClearBuffer( true );
+            mPending = false;
+            return Err::OK;
+        }
+        
+        // Key edges are never held back, so short presses survive decimation
+        if ((mOutput.mode == OutputMode::FIXED) && (!keys) && (!force))
+        {
+            now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+            if (now < mNextWriteNs)
+            {
+                // Relative motion adds up until the next write.  Keys and 
+                // axes are rebuilt every frame, so the latest value is kept.
+                ClearBuffer( false );
+                mPending = true;
+                return Err::OK;
+            }
+        }
+    }
+    
+    // Only append what changed.  The kernel drops repeated key and axis 
+    // values anyway, so a native rate device still writes a frame, just 
+    // without them.
+    for (auto p : mActive)
     {
-        iov_data.iov_base = &i.second.ev;
-        iov.push_back(iov_data);
+        if (!p->dirty)
+        {
+            rEvents.push_back( p->ev );
+            p->last = 0;
+        }
     }
-    for (auto&& i : mEvBuff.abs )
+    mActive.clear();
+    for (auto p : mDirty)
     {
-        iov_data.iov_base = &i.second.ev;
-        iov.push_back(iov_data);
+        if (p->ev.type == EV_REL)
+        {
+            if (p->ev.value)
+                rEvents.push_back( p->ev );
+            continue;
+        }
+        
+        if (p->ev.value != p->last)
+        {
+            rEvents.push_back( p->ev );
+            p->last = p->ev.value;
+        }
+        if (p->last)
+            mActive.push_back( p );
     }
-    for (auto&& i : mEvBuff.rel )
+    
+    if (mOutput.mode == OutputMode::FIXED)
     {
-        iov_data.iov_base = &i.second.ev;
-        iov.push_back(iov_data);
+        if (!now)
+            now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        mNextWriteNs = now + (1000000000 / mOutput.hz);
     }
+    mPending = false;
 
-    // Sync events
-    input_event     ev = {};
     ev.type = EV_SYN;
     ev.code = SYN_REPORT;
-    iov_data.iov_base = &ev;
-    iov.push_back(iov_data);
+    rEvents.push_back( ev );
 
-    // Write out event vector
-    result = writev( mFd, iov.data(), iov.size() );
-    if (result < 0)
+    // Clear collected values to flag them for updates
+    ClearBuffer( true );
+    
+    return Err::OK;
+}
+
+
+
+void Uinput::Device::ClearBuffer( bool clearRel )
+{
+    size_t              kept = 0;
+    
+    // Relative motion that is being held back stays listed
+    for (auto p : mDirty)
     {
-        int e = errno;
-        gLog.Write( Log::DEBUG, FUNC_NAME, "write error: " + Err::GetErrnoString(e) );
-        gLog.Write( Log::ERROR, "Failed to write uinput: I/O error for '" +mDeviceName + "'." );
-        return Err::WRITE_FAILED;
+        if ((!clearRel) && (p->ev.type == EV_REL))
+        {
+            mDirty[kept++] = p;
+            continue;
+        }
+        p->ev.value = 0;
+        p->dirty = false;
     }
+    mDirty.resize( kept );
+}
+
+
+
+void Uinput::Device::Touch( EventInfo* pInfo )
+{
+    if (pInfo->dirty)
+        return;
+    
+    pInfo->dirty = true;
+    mDirty.push_back( pInfo );
+}
+
+
 
-    // Clear written values to flag them for updates
-    for (auto&& i : mEvBuff.key )
+void Uinput::Device::InitTracking( bool adopted )
+{
+    size_t              count = mEvBuff.key.size() + mEvBuff.abs.size() + mEvBuff.rel.size();
+    
+    mDirty.clear();
+    mActive.clear();
+    mDirty.reserve( count );
+    mActive.reserve( count );
+    
+    // Whatever the old process left set is cleared by the first frame
+    if (adopted)
     {
-        i.second.ev.value = 0;
+        for (auto&& i : mEvBuff.key)
+            mActive.push_back( &i.second );
+        for (auto&& i : mEvBuff.abs)
+            mActive.push_back( &i.second );
     }
-    for (auto&& i : mEvBuff.abs )
+}
+
+
+
+bool Uinput::Device::IsPending()
+{
+    return mPending;
+}
+
+
+
+int Uinput::Device::Flush( bool force )
+{
+    int                         result;
+    
+
+    if (!IsOpen())
     {
-        i.second.ev.value = 0;
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Device is not open for '" + mDeviceName + "'." );
+        gLog.Write( Log::ERROR, "Failed to write uinput: Device not open." );
+        return Err::NOT_OPEN;
     }
-    for (auto&& i : mEvBuff.rel )
+
+    // The frame buffer keeps its memory between calls
+    mFrame.clear();
+    Collect( mFrame, force );
+    if (mFrame.empty())
+        return Err::OK;
+
+    // Uinput takes any number of whole events in one write
+    TRACE_PROBE2( uinput_flush_start, mFd, mFrame.size() );
+    result = write( mFd, mFrame.data(), mFrame.size() * sizeof(input_event) );
+    TRACE_PROBE2( uinput_flush_done, mFd, result );
+    if (result < 0)
     {
-        i.second.ev.value = 0;
+        int e = errno;
+        gLog.Write( Log::DEBUG, FUNC_NAME, "write error: " + Err::GetErrnoString(e) );
+        gLog.Write( Log::ERROR, "Failed to write uinput: I/O error for '" +mDeviceName + "'." );
+        return Err::WRITE_FAILED;
     }
-    
+
     return Err::OK;
 }
 
 
 
+const std::vector<input_event>& Uinput::Device::GetFrame()
+{
+    return mFrame;
+}
+
+
+
 int Uinput::Device::Read( input_event& rEvent )
 {
     int             result;
@@ -730,6 +878,13 @@ int Uinput::Device::Read( input_event& rEvent )
 
 
 
+int Uinput::Device::GetFd()
+{
+    return mFd;
+}
+
+
+
 bool Uinput::Device::IsFFEnabled()
 {
     return mFFEnabled;
@@ -805,13 +960,150 @@ int Uinput::Device::EraseFFEffect( int32_t id, uinput_ff_erase& rData )
 
 
 
-Uinput::Device::Device( const Uinput::DeviceConfig& rCfg )
+int Uinput::Device::Adopt( int fd, const Uinput::DeviceConfig& rCfg )
+{
+    char                sysname[64] = {};
+    EventInfo           evinfo = {};
+    
+    
+    // Only succeeds on a uinput fd whose device has been created
+    if (ioctl( fd, UI_GET_SYSNAME(sizeof(sysname)), sysname ) < 0)
+    {
+        int e = errno;
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Handed off fd is not a uinput device: " + Err::GetErrnoString(e) );
+        return Err::INVALID_PARAMETER;
+    }
+    
+    mFd = fd;
+    mFFEnabled = rCfg.features.enable_ff;
+    
+    // The kernel already has the capabilities, so only the buffers are set up.
+    // The old process may have left anything set, so the first frame always
+    // writes every key and axis.
+    evinfo.last = INT32_MIN;
+    if (rCfg.features.enable_keys)
+    {
+        for (auto&& i : rCfg.key_list)
+        {
+            evinfo.ev.type = EV_KEY;
+            evinfo.ev.code = i;
+            evinfo.min = 0;
+            evinfo.max = 1;
+            mEvBuff.key[i] = evinfo;
+        }
+    }
+    if (rCfg.features.enable_abs)
+    {
+        for (auto&& i : rCfg.abs_list)
+        {
+            evinfo.ev.type = EV_ABS;
+            evinfo.ev.code = i.code;
+            evinfo.min = i.min;
+            evinfo.max = i.max;
+            mEvBuff.abs[i.code] = evinfo;
+        }
+    }
+    if (rCfg.features.enable_rel)
+    {
+        for (auto&& i : GetRelList( rCfg ))
+        {
+            evinfo.ev.type = EV_REL;
+            evinfo.ev.code = i;
+            evinfo.min = 0;
+            evinfo.max = 0;
+            mEvBuff.rel[i] = evinfo;
+        }
+    }
+    
+    gLog.Write( Log::INFO, "Took over uinput device '" + mDeviceName + "' (" + std::string(sysname) + ")." );
+    
+    return Err::OK;
+}
+
+
+
+void Uinput::Device::Release()
+{
+    if (IsOpen())
+    {
+        close( mFd );
+        gLog.Write( Log::DEBUG, FUNC_NAME, "Released uinput device '" + mDeviceName + "'." );
+    }
+    
+    mFd = 0;
+}
+
+
+
+uint64_t Uinput::Device::GetConfigHash()
+{
+    return mConfigHash;
+}
+
+
+
+uint64_t Uinput::Device::HashConfig( const Uinput::DeviceConfig& rCfg )
+{
+    uint64_t            hash = 0xCBF29CE484222325;     // FNV-1a
+    auto                add = [&hash]( const void* pData, size_t size )
+    {
+        for (size_t i = 0; i < size; ++i)
+            hash = (hash ^ ((const uint8_t*)pData)[i]) * 0x100000001B3;
+    };
+    
+    add( rCfg.deviceinfo.name.data(), rCfg.deviceinfo.name.size() );
+    add( &rCfg.deviceinfo.vid, sizeof(rCfg.deviceinfo.vid) );
+    add( &rCfg.deviceinfo.pid, sizeof(rCfg.deviceinfo.pid) );
+    add( &rCfg.deviceinfo.ver, sizeof(rCfg.deviceinfo.ver) );
+    add( &rCfg.features.enable_keys, sizeof(rCfg.features.enable_keys) );
+    add( &rCfg.features.enable_abs, sizeof(rCfg.features.enable_abs) );
+    add( &rCfg.features.enable_rel, sizeof(rCfg.features.enable_rel) );
+    add( &rCfg.features.enable_ff, sizeof(rCfg.features.enable_ff) );
+    add( rCfg.key_list.data(), rCfg.key_list.size() * sizeof(uint16_t) );
+    for (auto&& i : rCfg.abs_list)
+    {
+        add( &i.code, sizeof(i.code) );
+        add( &i.min, sizeof(i.min) );
+        add( &i.max, sizeof(i.max) );
+        add( &i.fuzz, sizeof(i.fuzz) );
+        add( &i.res, sizeof(i.res) );
+    }
+    std::vector<uint16_t>   rel_list = GetRelList( rCfg );
+    add( rel_list.data(), rel_list.size() * sizeof(uint16_t) );
+    
+    return hash;
+}
+
+
+
+Uinput::Device::Device( const Uinput::DeviceConfig& rCfg, int adoptFd )
 {
     int     result;
     
     mFd = 0;
     mDeviceName = rCfg.deviceinfo.name;
     mFFEnabled = false;
+    mWheelRem = 0;
+    mHWheelRem = 0;
+    mOutput = rCfg.output;
+    mNextWriteNs = 0;
+    mPending = false;
+    
+    // A fixed rate of zero would never write
+    if ((mOutput.mode == OutputMode::FIXED) && (!mOutput.hz))
+        mOutput.mode = OutputMode::NATIVE;
+    mConfigHash = HashConfig( rCfg );
+    
+    if (adoptFd >= 0)
+    {
+        if (Adopt( adoptFd, rCfg ) == Err::OK)
+        {
+            InitTracking( true );
+            return;
+        }
+        close( adoptFd );
+        gLog.Write( Log::WARN, "Failed to take over uinput device for '" + mDeviceName + "'.  Creating a new one." );
+    }
     
     result = Open( mDeviceName );
     if (result != Err::OK)
@@ -828,6 +1120,7 @@ Uinput::Device::Device( const Uinput::DeviceConfig& rCfg )
         gLog.Write( Log::ERROR, "Failed to create uinput object for '" + mDeviceName + "'." );
         throw;
     }
+    InitTracking( false );
 }
 
 
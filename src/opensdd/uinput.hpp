@@ -34,6 +34,11 @@ namespace Uinput
 {
     // Define list of known uinput device nodes
     const std::vector<std::string>  UINPUT_PATH_LIST = { "/dev/uinput", "/dev/uinput/uninput", "/dev/misc/uinput" };
+    // Number of force-feedback effects a device can store
+    const int                       FF_EFFECTS_MAX = 16;
+    
+    // High-resolution scroll units per wheel detent, as defined by the kernel
+    const int32_t                   REL_HI_RES_PER_DETENT = 120;
     //const input_event               SYN_EVENT = { .type   = EV_SYN, .code   = SYN_REPORT, .value  = 0, .time = 0 };
 
     struct EventInfo
@@ -41,6 +46,8 @@ namespace Uinput
         input_event             ev;
         double                  min;
         double                  max;
+        int32_t                 last;               // Value last written
+        bool                    dirty;              // Updated since the last write, listed in mDirty
     };
     
     struct EventBuffer
@@ -57,6 +64,17 @@ namespace Uinput
         int                     mFd;
         EventBuffer             mEvBuff;
         bool                    mFFEnabled;
+        int32_t                 mWheelRem;          // Hi-res scroll units not yet emitted as a detent
+        int32_t                 mHWheelRem;
+        std::vector<input_event> mFrame;            // Events written by the last Flush()
+        OutputPolicy            mOutput;
+        uint64_t                mNextWriteNs;       // Earliest time a FIXED device writes again
+        bool                    mPending;           // Changes are being held back until mNextWriteNs
+        uint64_t                mConfigHash;
+        // Only events in these lists are looked at when a frame is written, so
+        // the cost of a frame doesn't depend on how many events are enabled
+        std::vector<EventInfo*> mDirty;             // Updated since the last write
+        std::vector<EventInfo*> mActive;            // Keys and axes last written with a non-zero value
 
         int                     Open( std::string deviceName );
         void                    Close();
@@ -64,23 +82,55 @@ namespace Uinput
         int                     EnableKey( uint16_t code );
         int                     EnableAbs( uint16_t code, int32_t min, int32_t max, int32_t fuzz = 0, int32_t res = 0 );
         int                     EnableRel( uint16_t code );
+        // rel_list plus the axes EnableRel() turns on implicitly
+        static std::vector<uint16_t> GetRelList( const Uinput::DeviceConfig& rCfg );
         int                     EnableFF();
         int                     Create( std::string deviceName, uint16_t vid, uint16_t pid, uint16_t ver );
         int                     Configure( const Uinput::DeviceConfig& rCfg );
+        int                     Adopt( int fd, const Uinput::DeviceConfig& rCfg );
+        void                    ClearBuffer( bool clearRel );
+        void                    Touch( EventInfo* pInfo );
+        // Sizes the lists so frames never allocate.  'adopted' marks every key
+        // and axis as possibly set, since another process owned the device.
+        void                    InitTracking( bool adopted );
         
     public:
         int                     UpdateKey( uint16_t code, bool value );
         int                     UpdateAbs( uint16_t code, double value );
+        // For callers that resolve an axis once and then write it every frame
+        // without a lookup.  Valid until the device is destroyed.
+        EventInfo*              GetAbsInfo( uint16_t code );
+        void                    SetAbs( EventInfo* pInfo, double value );
         int                     UpdateRel( uint16_t code, int32_t value );
-        int                     Flush();
+        // Writes the buffered events as allowed by the device's output 
+        // policy.  'force' writes held back changes regardless of the rate.
+        int                     Flush( bool force = false );
+        // Appends the buffered events and a sync event to rEvents and clears
+        // them like Flush() does, without writing them.  Nothing is appended
+        // if the output policy holds the frame back.  The caller writes the 
+        // events to GetFd() itself.
+        int                     Collect( std::vector<input_event>& rEvents, bool force = false );
+        // Changes were held back and need another Flush()
+        bool                    IsPending();
+        // Events written by the last Flush()
+        const std::vector<input_event>& GetFrame();
         int                     Read( input_event& rEvent );
         // Force-feedback methods
+        int                     GetFd();
         bool                    IsFFEnabled();
         int                     GetFFEffect( int32_t id, uinput_ff_upload& rData );
         int                     EraseFFEffect( int32_t id, uinput_ff_erase& rData );
+        // Device handoff.  Release() closes our fd without destroying the
+        // device, which lives on while another process holds a copy of the fd.
+        void                    Release();
+        uint64_t                GetConfigHash();
+        // Identifies everything the kernel device was created with
+        static uint64_t         HashConfig( const Uinput::DeviceConfig& rCfg );
 
 
-        Device( const Uinput::DeviceConfig& rCfg );
+        // adoptFd is an fd to a device created by another process with the 
+        // same config, e.g. before a restart.  It is closed if it can't be used.
+        Device( const Uinput::DeviceConfig& rCfg, int adoptFd = -1 );
         ~Device();
     };
 
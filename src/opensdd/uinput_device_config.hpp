@@ -38,6 +38,24 @@ namespace Uinput
         int32_t             res;        // Axis resolution in units/mm or units/radian
     };
     
+    // When a device writes its buffered events
+    enum class OutputMode
+    {
+        NATIVE,                 // Every frame
+        ON_CHANGE,              // Only frames that change something
+        FIXED                   // At most 'hz' times per second.  Key changes are written immediately.
+    };
+    
+    // Range accepted for FIXED output rates, in Hz
+    const uint32_t          OUTPUT_RATE_MIN = 10;
+    const uint32_t          OUTPUT_RATE_MAX = 1000;
+    
+    struct OutputPolicy
+    {
+        OutputMode          mode;
+        uint32_t            hz;         // Write rate for FIXED
+    };
+    
     struct DeviceConfig
     {
         // USB Device information
@@ -66,6 +84,9 @@ namespace Uinput
         
         // List of relative axes to be enabled
         std::vector<uint16_t>       rel_list;
+        
+        // How often events are written
+        OutputPolicy                output;
     };
     
 }   // namespace Uinput
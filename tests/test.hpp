@@ -0,0 +1,52 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//  OpenSD
+//  An open-source userspace driver for Valve's Steam Deck hardware
+//
+//  Copyright 2022 seek
+//  https://gitlab.com/open-sd/opensd
+//  Licensed under the GNU GPLv3+
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the 
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of 
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; 
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. 
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with this program. 
+//  If not, see <https://www.gnu.org/licenses/>.             
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#ifndef __TEST_HPP__
+#define __TEST_HPP__
+
+// C++
+#include <iostream>
+
+
+// Tests are plain programs run by ctest.  Failed checks are reported and
+// counted, and the program exits non-zero if there were any.
+inline int          gTestFailures = 0;
+
+
+#define CHECK( expr )                                                                           \
+    do                                                                                          \
+    {                                                                                           \
+        if (!(expr))                                                                            \
+        {                                                                                       \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #expr << std::endl;  \
+            ++gTestFailures;                                                                    \
+        }                                                                                       \
+    } while (0)
+
+
+inline int TestResult()
+{
+    if (gTestFailures)
+        std::cerr << gTestFailures << " check(s) failed." << std::endl;
+
+    return gTestFailures ? 1 : 0;
+}
+
+
+#endif // __TEST_HPP__
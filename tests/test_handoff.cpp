@@ -0,0 +1,309 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//  OpenSD
+//  An open-source userspace driver for Valve's Steam Deck hardware
+//
+//  Copyright 2022 seek
+//  https://gitlab.com/open-sd/opensd
+//  Licensed under the GNU GPLv3+
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the 
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of 
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; 
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. 
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with this program. 
+//  If not, see <https://www.gnu.org/licenses/>.             
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#include "test.hpp"
+#include "../src/opensdd/handoff.hpp"
+#include "../src/common/errors.hpp"
+// Linux
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+// C++
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+
+// Fds are moved out of the way of $LISTEN_FDS, which starts at 3
+const int           TEST_HIGH_FD    = 100;
+
+struct StoredFd
+{
+    std::string         name;
+    int                 fd;
+};
+
+
+
+// Stands in for a device fd.  The contents tell the copies apart.
+static int MakeFd( const std::string& rText )
+{
+    int             fd = memfd_create( "opensd-test", MFD_CLOEXEC );
+
+    CHECK( fd >= 0 );
+    CHECK( write( fd, rText.data(), rText.size() ) == (ssize_t)rText.size() );
+
+    return fd;
+}
+
+
+
+static std::string ReadFd( int fd )
+{
+    char            buff[256];
+    ssize_t         result;
+
+    if (fd < 0)
+        return "";
+
+    result = pread( fd, buff, sizeof(buff), 0 );
+
+    return (result > 0) ? std::string( buff, result ) : "";
+}
+
+
+
+static bool IsCloexec( int fd )
+{
+    int             flags = fcntl( fd, F_GETFD );
+
+    return (flags >= 0) && (flags & FD_CLOEXEC);
+}
+
+
+
+// Fills a handoff the way Driver::Release() does
+static void FillHandoff( Handoff& rOut )
+{
+    rOut.Add( "gp0.hidraw", MakeFd( "hidraw" ) );
+    rOut.SetValue( "gp0.hidraw", "/dev/hidraw3" );
+    rOut.Add( "gp0.gamepad", MakeFd( "gamepad" ) );
+    rOut.SetValue( "gp0.gamepad", "1234567890" );
+    rOut.Add( "gp0.mouse", MakeFd( "mouse" ) );
+    rOut.SetValue( "gp0.mouse", "42" );
+    rOut.SetValue( "profile", "default.profile" );
+}
+
+
+
+// Checks that rIn holds what FillHandoff() put in
+static void CheckHandoff( Handoff& rIn )
+{
+    int             fd;
+
+    CHECK( rIn.GetValue( "gp0.hidraw" ) == "/dev/hidraw3" );
+    CHECK( rIn.GetValue( "gp0.gamepad" ) == "1234567890" );
+    CHECK( rIn.GetValue( "gp0.mouse" ) == "42" );
+    CHECK( rIn.GetValue( "profile" ) == "default.profile" );
+    CHECK( rIn.GetValue( "gp0.motion" ) == "" );
+
+    fd = rIn.Take( "gp0.hidraw" );
+    CHECK( ReadFd( fd ) == "hidraw" );
+    CHECK( IsCloexec( fd ) );
+    close( fd );
+    fd = rIn.Take( "gp0.gamepad" );
+    CHECK( ReadFd( fd ) == "gamepad" );
+    CHECK( IsCloexec( fd ) );
+    close( fd );
+    fd = rIn.Take( "gp0.mouse" );
+    CHECK( ReadFd( fd ) == "mouse" );
+    CHECK( IsCloexec( fd ) );
+    close( fd );
+
+    // The values memfd is unpacked and closed on arrival
+    CHECK( rIn.Take( "state" ) < 0 );
+    CHECK( rIn.Take( "gp0.motion" ) < 0 );
+}
+
+
+
+static void TestSendReceive()
+{
+    Handoff         out;
+    Handoff         in;
+    Handoff         empty;
+    int             fds[2];
+    const char      junk[] = "not a handoff";
+
+    CHECK( socketpair( AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds ) == 0 );
+
+    FillHandoff( out );
+    CHECK( !out.IsEmpty() );
+    CHECK( out.Send( fds[0] ) == Err::OK );
+    CHECK( out.IsEmpty() );
+    CHECK( in.Receive( fds[1] ) == Err::OK );
+    CheckHandoff( in );
+
+    // Nothing to hand off still makes a valid message
+    CHECK( out.Send( fds[0] ) == Err::OK );
+    CHECK( empty.Receive( fds[1] ) == Err::OK );
+    CHECK( empty.IsEmpty() );
+
+    // Values alone travel in the state memfd
+    out.SetValue( "profile", "dualsense.profile" );
+    CHECK( out.Send( fds[0] ) == Err::OK );
+    CHECK( empty.Receive( fds[1] ) == Err::OK );
+    CHECK( empty.GetValue( "profile" ) == "dualsense.profile" );
+    empty.Clear();
+    CHECK( empty.IsEmpty() );
+
+    CHECK( send( fds[0], junk, sizeof(junk), 0 ) == sizeof(junk) );
+    CHECK( empty.Receive( fds[1] ) == Err::INVALID_FORMAT );
+    CHECK( empty.IsEmpty() );
+
+    close( fds[0] );
+    close( fds[1] );
+}
+
+
+
+// Reads the fds a Store() sent to the fake notify socket
+static std::vector<StoredFd> ReadNotify( int sockFd, const std::string& rPrefix )
+{
+    std::vector<StoredFd>   list;
+    char                    buff[256];
+    char                    cbuff[CMSG_SPACE(sizeof(int))];
+    iovec                   iov = { .iov_base = buff, .iov_len = sizeof(buff) };
+    msghdr                  msg = {};
+    cmsghdr*                pcmsg;
+    ssize_t                 result;
+
+    while (true)
+    {
+        StoredFd    item = { .name = "", .fd = -1 };
+
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = cbuff;
+        msg.msg_controllen = sizeof(cbuff);
+        result = recvmsg( sockFd, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC );
+        if (result < 0)
+            break;
+
+        std::string     text( buff, result );
+
+        CHECK( text.starts_with( rPrefix ) );
+        item.name = text.substr( rPrefix.size() );
+        for (pcmsg = CMSG_FIRSTHDR( &msg ); pcmsg != nullptr; pcmsg = CMSG_NXTHDR( &msg, pcmsg ))
+            if ((pcmsg->cmsg_level == SOL_SOCKET) && (pcmsg->cmsg_type == SCM_RIGHTS))
+                memcpy( &item.fd, CMSG_DATA(pcmsg), sizeof(int) );
+        list.push_back( item );
+    }
+
+    return list;
+}
+
+
+
+// Plays systemd's part across a restart:  the fds stored by the old daemon
+// are passed to the new one starting at fd 3, with $LISTEN_FDS set
+static void TestStoreRestore()
+{
+    std::string             path = "@opensd-test-" + std::to_string(getpid());
+    sockaddr_un             addr = {};
+    std::vector<StoredFd>   stored;
+    std::vector<StoredFd>   removed;
+    std::string             names;
+    Handoff                 out;
+    Handoff                 in;
+    int                     sock;
+    int                     unknown;
+    bool                    has_state = false;
+
+    unsetenv( "NOTIFY_SOCKET" );
+    CHECK( !Handoff::HasFdStore() );
+    FillHandoff( out );
+    CHECK( out.Store() == Err::UNSUPPORTED );
+    CHECK( out.IsEmpty() );
+
+    sock = socket( AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0 );
+    CHECK( sock >= 0 );
+    addr.sun_family = AF_UNIX;
+    memcpy( addr.sun_path + 1, path.c_str() + 1, path.size() - 1 );
+    CHECK( bind( sock, (sockaddr*)&addr, offsetof(sockaddr_un, sun_path) + path.size() ) == 0 );
+    setenv( "NOTIFY_SOCKET", path.c_str(), 1 );
+    CHECK( Handoff::HasFdStore() );
+
+    FillHandoff( out );
+    CHECK( out.Store() == Err::OK );
+    CHECK( out.IsEmpty() );
+    stored = ReadNotify( sock, "FDSTORE=1\nFDNAME=" );
+    CHECK( stored.size() == 4 );
+
+    // Everything we own goes above the $LISTEN_FDS range first
+    sock = fcntl( sock, F_DUPFD_CLOEXEC, TEST_HIGH_FD );
+    CHECK( sock >= TEST_HIGH_FD );
+    for (auto& i : stored)
+    {
+        CHECK( i.fd >= 0 );
+        i.fd = fcntl( i.fd, F_DUPFD_CLOEXEC, TEST_HIGH_FD );
+        CHECK( i.fd >= TEST_HIGH_FD );
+        has_state |= (i.name == "state");
+    }
+    CHECK( has_state );
+    for (int fd = STDERR_FILENO + 1; fd < TEST_HIGH_FD; ++fd)
+        close( fd );
+
+    // systemd doesn't set close-on-exec, and may pass fds it can't name
+    for (unsigned int i = 0; i < stored.size(); ++i)
+    {
+        CHECK( dup2( stored[i].fd, 3 + i ) == (int)(3 + i) );
+        close( stored[i].fd );
+        names += stored[i].name + ":";
+    }
+    unknown = 3 + stored.size();
+    CHECK( dup2( sock, unknown ) == unknown );
+    names += "unknown";
+    setenv( "LISTEN_PID", std::to_string(getpid()).c_str(), 1 );
+    setenv( "LISTEN_FDS", std::to_string(stored.size() + 1).c_str(), 1 );
+    setenv( "LISTEN_FDNAMES", names.c_str(), 1 );
+
+    CHECK( in.Restore() == Err::OK );
+    CHECK( getenv( "LISTEN_PID" ) == nullptr );
+    CHECK( getenv( "LISTEN_FDS" ) == nullptr );
+    CHECK( getenv( "LISTEN_FDNAMES" ) == nullptr );
+    CHECK( fcntl( unknown, F_GETFD ) < 0 );
+    CheckHandoff( in );
+
+    // Once in use, every restored fd is dropped from the store
+    in.Unstore();
+    removed = ReadNotify( sock, "FDSTOREREMOVE=1\nFDNAME=" );
+    CHECK( removed.size() == stored.size() );
+    for (auto& i : removed)
+        CHECK( i.fd < 0 );
+    in.Unstore();
+    CHECK( ReadNotify( sock, "" ).empty() );
+
+    in.Clear();
+
+    // $LISTEN_FDS meant for another process is left alone
+    setenv( "LISTEN_PID", std::to_string(getpid() + 1).c_str(), 1 );
+    setenv( "LISTEN_FDS", "1", 1 );
+    CHECK( in.Restore() == Err::NOT_FOUND );
+    CHECK( in.IsEmpty() );
+    unsetenv( "LISTEN_PID" );
+    unsetenv( "LISTEN_FDS" );
+
+    unsetenv( "NOTIFY_SOCKET" );
+    close( sock );
+}
+
+
+
+int main()
+{
+    TestSendReceive();
+    TestStoreRestore();
+
+    return TestResult();
+}
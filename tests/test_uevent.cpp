@@ -0,0 +1,163 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//  OpenSD
+//  An open-source userspace driver for Valve's Steam Deck hardware
+//
+//  Copyright 2022 seek
+//  https://gitlab.com/open-sd/opensd
+//  Licensed under the GNU GPLv3+
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the 
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of 
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; 
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. 
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with this program. 
+//  If not, see <https://www.gnu.org/licenses/>.             
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#include "test.hpp"
+#include "../src/opensdd/uevent.hpp"
+// Linux
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+// C++
+#include <chrono>
+#include <string>
+
+
+// Short timings so the test runs quickly.  Sends are checked against
+// half the rescan interval, which leaves plenty of slack for slow machines.
+const double        RETRY_SEC       = 0.01;
+const double        WINDOW_SEC      = 0.5;
+const double        RESCAN_SEC      = 0.4;
+
+
+
+// Sends a kernel formatted uevent, the same as the netlink socket delivers
+static void SendUevent( int fd, const std::string& rAction, const std::string& rSubsystem, const std::string& rDevname )
+{
+    std::string     msg;
+
+    msg = rAction + "@/devices/virtual/" + rSubsystem + "/" + rDevname;
+    msg.push_back( '\0' );
+    msg += "ACTION=" + rAction;
+    msg.push_back( '\0' );
+    msg += "SUBSYSTEM=" + rSubsystem;
+    msg.push_back( '\0' );
+    msg += "DEVNAME=" + rDevname;
+    msg.push_back( '\0' );
+
+    CHECK( send( fd, msg.data(), msg.size(), 0 ) == (ssize_t)msg.size() );
+}
+
+
+
+// Runs one Wait() and returns how long it took, in seconds
+static double TimedWait( HotplugWatch& rWatch, bool& rScan )
+{
+    auto            start = std::chrono::steady_clock::now();
+
+    rScan = rWatch.Wait();
+
+    return std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+
+static void TestParse()
+{
+    const char      msg[] = "add@/devices/virtual/hidraw/hidraw3\0ACTION=add\0DEVPATH=/devices/virtual/hidraw/hidraw3\0SUBSYSTEM=hidraw\0DEVNAME=hidraw3";
+    Uevent          ev;
+
+    CHECK( UeventMonitor::Parse( msg, sizeof(msg), ev ) == Err::OK );
+    CHECK( ev.action == "add" );
+    CHECK( ev.subsystem == "hidraw" );
+    CHECK( ev.devname == "hidraw3" );
+    CHECK( ev.devpath == "/devices/virtual/hidraw/hidraw3" );
+
+    // udev's own messages start with a different header
+    CHECK( UeventMonitor::Parse( "libudev\0\0\0", 10, ev ) == Err::INVALID_FORMAT );
+    CHECK( UeventMonitor::Parse( msg, 0, ev ) == Err::EMPTY );
+}
+
+
+
+// Goes through a device being lost and plugged back in, the way the gamepad
+// driver does between Detach() and Attach()
+static void TestReattach()
+{
+    HotplugWatch    watch;
+    int             fds[2];
+    double          elapsed;
+    bool            scan;
+
+    CHECK( socketpair( AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0, fds ) == 0 );
+    watch.Configure( "hidraw", RETRY_SEC, WINDOW_SEC, RESCAN_SEC );
+    CHECK( watch.Open( fds[0] ) == Err::OK );
+    CHECK( watch.IsOpen() );
+    CHECK( watch.Open( fds[0] ) == Err::ALREADY_OPEN );
+
+    // Detached with nothing happening, only the slow rescan is due
+    elapsed = TimedWait( watch, scan );
+    CHECK( scan );
+    CHECK( elapsed >= RESCAN_SEC * 0.9 );
+
+    // Other subsystems and other actions wake the wait without a rescan
+    SendUevent( fds[1], "add", "input", "event7" );
+    elapsed = TimedWait( watch, scan );
+    CHECK( !scan );
+    CHECK( elapsed < RESCAN_SEC / 2 );
+    SendUevent( fds[1], "remove", "hidraw", "hidraw3" );
+    elapsed = TimedWait( watch, scan );
+    CHECK( !scan );
+    CHECK( elapsed < RESCAN_SEC / 2 );
+
+    // The device comes back.  Its node is looked for right away...
+    SendUevent( fds[1], "add", "hidraw", "hidraw3" );
+    elapsed = TimedWait( watch, scan );
+    CHECK( scan );
+    CHECK( elapsed < RESCAN_SEC / 2 );
+
+    // ...and retried quickly while udev sets it up
+    elapsed = TimedWait( watch, scan );
+    CHECK( scan );
+    CHECK( elapsed < RESCAN_SEC / 2 );
+
+    // Attached again, so a later loss goes back to the slow rescan
+    watch.Attached();
+    elapsed = TimedWait( watch, scan );
+    CHECK( scan );
+    CHECK( elapsed >= RESCAN_SEC * 0.9 );
+
+    // Several events queued up at once are all read in one go
+    SendUevent( fds[1], "add", "input", "event7" );
+    SendUevent( fds[1], "add", "hidraw", "hidraw4" );
+    SendUevent( fds[1], "bind", "hidraw", "hidraw4" );
+    elapsed = TimedWait( watch, scan );
+    CHECK( scan );
+    CHECK( elapsed < RESCAN_SEC / 2 );
+    elapsed = TimedWait( watch, scan );
+    CHECK( scan );
+    CHECK( elapsed < RESCAN_SEC / 2 );
+
+    // The socket belongs to the caller
+    watch.Close();
+    CHECK( !watch.IsOpen() );
+    CHECK( fcntl( fds[0], F_GETFD ) >= 0 );
+
+    close( fds[0] );
+    close( fds[1] );
+}
+
+
+
+int main()
+{
+    TestParse();
+    TestReattach();
+
+    return TestResult();
+}